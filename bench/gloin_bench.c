@@ -0,0 +1,507 @@
+// End-to-end compiler throughput benchmark.
+//
+// Generates deterministic Gloin programs that grow along one axis at a time
+// (functions, statements per function, expression depth, structs with
+// methods, imported modules), compiles each one in process to an object
+// with a time report installed, and prints lines per second for every
+// phase as JSON. Given a baseline written by an earlier run, it compares
+// the totals and fails when a benchmark got slower than the threshold.
+
+#include "codegen.h"
+#include "parser.h"
+#include "timing.h"
+#include "types.h"
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Functions in each imported module
+#define IMPORT_FUNCTIONS 8
+// Differences below this are noise, whatever the percentage
+#define NOISE_FLOOR_SECONDS 0.002
+
+typedef struct {
+    const char *axis;
+    int functions;
+    int statements;  // Per function
+    int depth;       // Of every expression
+    int structs;
+    int methods;     // Per struct
+    int imports;
+} ProgramShape;
+
+// Each axis scales from the same small program. Struct type ids and the
+// code generator's 256-entry tables bound the largest sizes.
+static const ProgramShape base_shape = {"base", 20, 12, 3, 2, 2, 0};
+
+static const struct {
+    const char *axis;
+    int sizes[4];
+} axes[] = {
+    {"functions", {25, 50, 100, 200}},
+    {"statements", {10, 40, 160, 0}},
+    {"depth", {2, 8, 32, 0}},
+    {"structs", {5, 20, 40, 0}},
+    {"imports", {1, 4, 16, 0}},
+};
+
+typedef struct {
+    char name[64];
+    ProgramShape shape;
+    long lines;
+    double seconds;  // Fastest repetition
+    TimePoint phases[TIMING_PHASE_COUNT];
+} BenchResult;
+
+typedef struct {
+    int repetitions;
+    int optimization_level;
+    const char *axis;  // NULL runs every axis
+    const char *output;
+    const char *baseline;
+    double threshold;  // Percent
+    int keep;          // Leave the generated programs behind
+    int sizes;         // Of each axis, from the smallest
+} BenchOptions;
+
+// xorshift32, so every run generates the same programs
+static unsigned rng_state;
+
+static unsigned next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static ProgramShape shape_for(const char *axis, int size) {
+    ProgramShape shape = base_shape;
+    shape.axis = axis;
+    if (strcmp(axis, "functions") == 0) {
+        shape.functions = size;
+    } else if (strcmp(axis, "statements") == 0) {
+        shape.statements = size;
+    } else if (strcmp(axis, "depth") == 0) {
+        shape.depth = size;
+    } else if (strcmp(axis, "structs") == 0) {
+        shape.structs = size;
+    } else if (strcmp(axis, "imports") == 0) {
+        shape.imports = size;
+    }
+    return shape;
+}
+
+static void write_expression(FILE *out, int depth) {
+    static const char *operators[] = {"+", "-", "*"};
+    if (next_random() % 2) {
+        fprintf(out, "v%u", next_random() % 4);
+    } else {
+        fprintf(out, "%u", 1 + next_random() % 9);
+    }
+    if (depth > 0) {
+        // Nest on the right, so the depth grows linearly with the text
+        fprintf(out, " %s (", operators[next_random() % 3]);
+        write_expression(out, depth - 1);
+        fputc(')', out);
+    }
+}
+
+// Functions named <prefix>work<n>; each one calls the one before it
+static void write_function(FILE *out, const ProgramShape *shape,
+                           const char *prefix, int index) {
+    fprintf(out, "def %swork%d(x: i32) -> i32 {\n", prefix, index);
+    fprintf(out, "    def mut v0: i32 = x;\n");
+    fprintf(out, "    def mut v1: i32 = %d;\n", index);
+    fprintf(out, "    def mut v2: i32 = 0;\n");
+    fprintf(out, "    def mut v3: i32 = 1;\n");
+    for (int i = 0; i < shape->statements; i++) {
+        unsigned target = next_random() % 4;
+        switch (next_random() % 3) {
+        case 0:
+            fprintf(out, "    v%u = ", target);
+            write_expression(out, shape->depth);
+            fprintf(out, ";\n");
+            break;
+        case 1:
+            fprintf(out, "    if v%u > %u {\n", target, next_random() % 100);
+            fprintf(out, "        v%u = ", target);
+            write_expression(out, shape->depth);
+            fprintf(out, ";\n    }\n");
+            break;
+        default:
+            if (index > 0) {
+                fprintf(out, "    v%u = %swork%d(v%u);\n", target, prefix,
+                        index - 1, next_random() % 4);
+            } else {
+                fprintf(out, "    v%u = v%u + 1;\n", target,
+                        next_random() % 4);
+            }
+            break;
+        }
+    }
+    fprintf(out, "    return v0 + v1;\n}\n\n");
+}
+
+static void write_struct(FILE *out, int methods, int index) {
+    fprintf(out, "def struct S%d {\n    a: i32;\n    b: i32;\n", index);
+    for (int i = 0; i < methods; i++) {
+        // Methods cannot take or return numeric types yet
+        fprintf(out, "\n    pub m%d() -> bool {\n", i);
+        fprintf(out, "        return a * %d > b;\n    }\n", i + 1);
+    }
+    fprintf(out, "}\n\n");
+}
+
+static long count_lines(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return 0;
+    }
+    long lines = 0;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(in);
+    return lines;
+}
+
+// Writes main.gloin and its imports into dir; returns the line count of
+// them all, or -1 on failure
+static long generate_program(const char *dir, const ProgramShape *shape) {
+    char path[4096];
+    long lines = 0;
+    rng_state = 0x9e3779b9u;
+
+    for (int i = 0; i < shape->imports; i++) {
+        snprintf(path, sizeof(path), "%s/mod%d.gloin", dir, i);
+        FILE *out = fopen(path, "w");
+        if (!out) {
+            return -1;
+        }
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "m%d_", i);
+        for (int f = 0; f < IMPORT_FUNCTIONS; f++) {
+            write_function(out, shape, prefix, f);
+        }
+        fclose(out);
+        lines += count_lines(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/main.gloin", dir);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return -1;
+    }
+    fprintf(out, "import \"@std\"\n");
+    for (int i = 0; i < shape->imports; i++) {
+        fprintf(out, "import \"./mod%d\"\n", i);
+    }
+    fputc('\n', out);
+    for (int i = 0; i < shape->structs; i++) {
+        write_struct(out, shape->methods, i);
+    }
+    for (int i = 0; i < shape->functions; i++) {
+        write_function(out, shape, "", i);
+    }
+
+    // Calls cannot be operands yet, so their results go through variables
+    fprintf(out, "def main() -> i32 {\n    def mut total: i32 = 0;\n");
+    if (shape->functions > 0) {
+        fprintf(out, "    total = work%d(1);\n", shape->functions - 1);
+    }
+    for (int i = 0; i < shape->structs; i++) {
+        fprintf(out, "    def s%d: S%d = S%d { a: %d, b: 1 };\n", i, i, i, i);
+        for (int m = 0; m < shape->methods; m++) {
+            fprintf(out, "    def r%d_%d: bool = s%d.m%d();\n", i, m, i, m);
+        }
+    }
+    for (int i = 0; i < shape->imports; i++) {
+        fprintf(out, "    def imp%d: i32 = m%d_work%d(1);\n", i, i,
+                IMPORT_FUNCTIONS - 1);
+        fprintf(out, "    total = total + imp%d;\n", i);
+    }
+    fprintf(out, "    std.println(std.to_string(total));\n");
+    fprintf(out, "    return 0;\n}\n");
+    fclose(out);
+    return lines + count_lines(path);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void remove_tree(const char *path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// One in-process compilation to an object, as gloinc would do it, but
+// without linking. Imported modules are rebuilt every time.
+static int compile_once(const char *dir, int optimization_level,
+                        double *seconds, TimePoint *phases) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.gloin-cache", dir);
+    remove_tree(path);
+    snprintf(path, sizeof(path), "%s/main.gloin", dir);
+
+    TypeRegistry *types = create_type_registry();
+    TypeRegistry *previous_types = set_type_registry(types);
+    TimeReport *report = create_time_report();
+    set_time_report(report);
+
+    int failed = 1;
+    ASTNode *ast = parse_file(path);
+    if (ast) {
+        CodeGen *codegen = create_codegen("gloin_module");
+        codegen->source_path = strdup(path);
+        codegen->optimization_level = optimization_level;
+        codegen_program(codegen, ast);
+        LLVMMemoryBufferRef object = NULL;
+        if (!codegen->has_error && emit_object_buffer(codegen, &object) == 0) {
+            LLVMDisposeMemoryBuffer(object);
+            failed = 0;
+        }
+        free_codegen(codegen);
+        free_ast_node(ast);
+    }
+
+    set_time_report(NULL);
+    *seconds = time_since(report->started).wall;
+    for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        phases[phase] = report->phases[phase].time;
+    }
+    free_time_report(report);
+    set_type_registry(previous_types);
+    free_type_registry(types);
+    return failed;
+}
+
+static int run_benchmark(const char *work_dir, const ProgramShape *shape,
+                         int size, const BenchOptions *options,
+                         BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s/%d", shape->axis, size);
+    result->shape = *shape;
+
+    char dir[2048];
+    snprintf(dir, sizeof(dir), "%s/%s-%d", work_dir, shape->axis, size);
+    if (mkdir(dir, 0755) != 0) {
+        fprintf(stderr, "Error: Cannot create %s\n", dir);
+        return 1;
+    }
+    result->lines = generate_program(dir, shape);
+    if (result->lines < 0) {
+        fprintf(stderr, "Error: Cannot write the program in %s\n", dir);
+        return 1;
+    }
+
+    // A warm-up, then keep the fastest repetition
+    for (int rep = 0; rep <= options->repetitions; rep++) {
+        double seconds;
+        TimePoint phases[TIMING_PHASE_COUNT];
+        if (compile_once(dir, options->optimization_level, &seconds,
+                         phases) != 0) {
+            fprintf(stderr, "Error: %s failed to compile\n", result->name);
+            return 1;
+        }
+        if (rep > 0 && (rep == 1 || seconds < result->seconds)) {
+            result->seconds = seconds;
+            memcpy(result->phases, phases, sizeof(phases));
+        }
+    }
+    fprintf(stderr, "  %-20s %8ld lines %10.3f ms\n", result->name,
+            result->lines, result->seconds * 1000);
+    return 0;
+}
+
+static double lines_per_second(long lines, double seconds) {
+    return seconds > 0 ? (double)lines / seconds : 0;
+}
+
+// One result per line, which is what read_baseline expects
+static void write_results(FILE *out, const BenchOptions *options,
+                          const BenchResult *results, int count) {
+    fprintf(out, "{\"benchmark\":\"gloin_bench\",\"optimization_level\":%d,"
+            "\"repetitions\":%d,\"results\":[\n", options->optimization_level,
+            options->repetitions);
+    for (int i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(out, "{\"name\":\"%s\",\"axis\":\"%s\",\"functions\":%d,"
+                "\"statements\":%d,\"depth\":%d,\"structs\":%d,\"methods\":%d,"
+                "\"imports\":%d,\"lines\":%ld,\"seconds\":%.6f,"
+                "\"lines_per_second\":%.1f,\"phases\":{",
+                r->name, r->shape.axis, r->shape.functions,
+                r->shape.statements, r->shape.depth, r->shape.structs,
+                r->shape.methods, r->shape.imports, r->lines, r->seconds,
+                lines_per_second(r->lines, r->seconds));
+        for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+            fprintf(out, "%s\"%s\":{\"seconds\":%.6f,\"lines_per_second\":%.1f}",
+                    phase ? "," : "", timing_phase_name(phase),
+                    r->phases[phase].wall,
+                    lines_per_second(r->lines, r->phases[phase].wall));
+        }
+        fprintf(out, "}}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+// Compares against a file written by write_results; returns the number of
+// regressions
+static int compare_baseline(const char *path, double threshold,
+                            const BenchResult *results, int count) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Error: Cannot read baseline '%s'\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[4096];
+    fprintf(stderr, "\n  %-20s %12s %12s %9s\n", "Benchmark", "Baseline ms",
+            "Current ms", "Change");
+    while (fgets(line, sizeof(line), in)) {
+        char name[64];
+        const char *seconds_field = strstr(line, "\"seconds\":");
+        if (sscanf(line, "{\"name\":\"%63[^\"]\"", name) != 1 ||
+            !seconds_field) {
+            continue;
+        }
+        double before = strtod(seconds_field + 10, NULL);
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double after = results[i].seconds;
+            double change = before > 0 ? (after - before) / before * 100 : 0;
+            int slower = change > threshold &&
+                         after - before > NOISE_FLOOR_SECONDS;
+            fprintf(stderr, "  %-20s %12.3f %12.3f %+8.1f%%%s\n", name,
+                    before * 1000, after * 1000, change,
+                    slower ? "  REGRESSION" : "");
+            regressions += slower;
+        }
+    }
+    fclose(in);
+    return regressions;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --axis=<name>           # functions, statements, depth, structs or imports\n");
+    fprintf(stderr, "  --repetitions=<n>       # Timed compilations per program (default: 3)\n");
+    fprintf(stderr, "  -O0, -O1, -O2, -O3      # Optimization level (default: -O0)\n");
+    fprintf(stderr, "  --output=<file>         # Write the JSON there instead of stdout\n");
+    fprintf(stderr, "  --baseline=<file>       # Compare with an earlier --output\n");
+    fprintf(stderr, "  --threshold=<percent>   # Slowdown counted as a regression (default: 10)\n");
+    fprintf(stderr, "  --keep                  # Keep the generated programs\n");
+    fprintf(stderr, "  --quick                 # Compile the smallest program of each axis once\n");
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    memset(&options, 0, sizeof(options));
+    options.repetitions = 3;
+    options.threshold = 10;
+    options.sizes = 4;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--axis=", 7) == 0) {
+            options.axis = argv[i] + 7;
+        } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            options.repetitions = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+                   argv[i][2] <= '3' && argv[i][3] == '\0') {
+            options.optimization_level = argv[i][2] - '0';
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            options.output = argv[i] + 9;
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            options.baseline = argv[i] + 11;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            options.threshold = atof(argv[i] + 12);
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            options.keep = 1;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            options.repetitions = 1;
+            options.sizes = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.repetitions < 1) {
+        fprintf(stderr, "Error: --repetitions must be at least 1\n");
+        return 1;
+    }
+    int axis_count = sizeof(axes) / sizeof(axes[0]);
+    int known_axis = options.axis == NULL;
+    for (int a = 0; a < axis_count; a++) {
+        known_axis |= options.axis && strcmp(options.axis, axes[a].axis) == 0;
+    }
+    if (!known_axis) {
+        fprintf(stderr, "Error: Unknown axis '%s'\n", options.axis);
+        return 1;
+    }
+
+    // Parse every time rather than loading cached syntax trees
+    setenv("GLOIN_NO_CACHE", "1", 1);
+
+    char work_dir[] = "/tmp/gloin-bench-XXXXXX";
+    if (!mkdtemp(work_dir)) {
+        fprintf(stderr, "Error: Cannot create a work directory\n");
+        return 1;
+    }
+
+    BenchResult *results = malloc(axis_count * 4 * sizeof(BenchResult));
+    int count = 0;
+    int failed = 0;
+    fprintf(stderr, "Compiling at -O%d, fastest of %d:\n",
+            options.optimization_level, options.repetitions);
+    for (int a = 0; a < axis_count && !failed; a++) {
+        if (options.axis && strcmp(options.axis, axes[a].axis) != 0) {
+            continue;
+        }
+        for (int s = 0; s < options.sizes && axes[a].sizes[s] && !failed; s++) {
+            ProgramShape shape = shape_for(axes[a].axis, axes[a].sizes[s]);
+            failed = run_benchmark(work_dir, &shape, axes[a].sizes[s],
+                                   &options, &results[count]);
+            count += !failed;
+        }
+    }
+    if (!failed) {
+        FILE *out = options.output ? fopen(options.output, "w") : stdout;
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", options.output);
+            failed = 1;
+        } else {
+            write_results(out, &options, results, count);
+            if (out != stdout) {
+                fclose(out);
+            }
+        }
+    }
+    if (!failed && options.baseline) {
+        int regressions = compare_baseline(options.baseline,
+                                           options.threshold, results, count);
+        if (regressions != 0) {
+            if (regressions > 0) {
+                fprintf(stderr, "%d benchmark(s) slower than the baseline by "
+                        "more than %.1f%%\n", regressions, options.threshold);
+            }
+            failed = 1;
+        }
+    }
+
+    if (options.keep) {
+        fprintf(stderr, "Programs kept in %s\n", work_dir);
+    } else {
+        remove_tree(work_dir);
+    }
+    free(results);
+    return failed;
+}
@@ -0,0 +1,375 @@
+// Component microbenchmarks: the lexer, the parser, type name lookup and
+// the code generator's variable table, each timed in isolation.
+//
+// Every benchmark body does a fixed batch of work. After warm-up calls,
+// each repetition times one call, and the report gives percentiles of the
+// time per item (a byte of source, or a lookup).
+
+#include "codegen.h"
+#include "lexer.h"
+#include "parser.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CORPUS_BYTES (16 * 1024)
+// Lookups per call, spread evenly over the names in the table
+#define LOOKUPS 20000
+
+typedef struct {
+    const char *name;
+    void (*run)(void *state);
+    void *state;
+    long items;        // Per call
+    const char *unit;  // What an item is
+} Benchmark;
+
+typedef struct {
+    int warmup;
+    int repetitions;
+    const char *filter;  // Substring of the names to run
+    int json;
+} MicrobenchOptions;
+
+// Results land here so the work cannot be optimized away
+static volatile long sink;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, double p) {
+    int rank = (int)(p / 100 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > count) {
+        rank = count;
+    }
+    return sorted[rank - 1];
+}
+
+static void run_benchmark(const Benchmark *bench,
+                          const MicrobenchOptions *options, int first) {
+    for (int i = 0; i < options->warmup; i++) {
+        bench->run(bench->state);
+    }
+    double *samples = malloc(options->repetitions * sizeof(double));
+    for (int i = 0; i < options->repetitions; i++) {
+        double start = now_seconds();
+        bench->run(bench->state);
+        // Nanoseconds per item
+        samples[i] = (now_seconds() - start) * 1e9 / bench->items;
+    }
+    qsort(samples, options->repetitions, sizeof(double), compare_doubles);
+
+    int n = options->repetitions;
+    double p50 = percentile(samples, n, 50);
+    if (options->json) {
+        printf("%s{\"name\":\"%s\",\"unit\":\"%s\",\"items\":%ld,"
+               "\"min_ns\":%.3f,\"p50_ns\":%.3f,\"p90_ns\":%.3f,"
+               "\"p99_ns\":%.3f,\"max_ns\":%.3f,\"items_per_second\":%.1f}",
+               first ? "" : ",\n", bench->name, bench->unit, bench->items,
+               samples[0], p50, percentile(samples, n, 90),
+               percentile(samples, n, 99), samples[n - 1],
+               p50 > 0 ? 1e9 / p50 : 0);
+    } else {
+        printf("  %-34s %-7s %9.2f %9.2f %9.2f %9.2f %14.0f\n", bench->name,
+               bench->unit, samples[0], p50, percentile(samples, n, 90),
+               percentile(samples, n, 99), p50 > 0 ? 1e9 / p50 : 0);
+    }
+    free(samples);
+}
+
+// Lexer
+
+typedef enum {
+    CORPUS_IDENTIFIERS,
+    CORPUS_COMMENTS,
+    CORPUS_NUMBERS
+} CorpusKind;
+
+static char *make_corpus(CorpusKind kind) {
+    char *text = malloc(CORPUS_BYTES + 128);
+    int length = 0;
+    unsigned seed = 12345;
+    while (length < CORPUS_BYTES) {
+        seed = seed * 1103515245 + 12345;
+        switch (kind) {
+        case CORPUS_IDENTIFIERS:
+            length += sprintf(text + length, "def value_%u: counter_%u = "
+                              "total_%u;\n", seed % 997, seed % 89, seed % 31);
+            break;
+        case CORPUS_COMMENTS:
+            length += sprintf(text + length, "// note %u: keep this in sync "
+                              "with the caller\nx\n", seed % 997);
+            break;
+        case CORPUS_NUMBERS:
+            length += sprintf(text + length, "%u, %u.%u, %u\n", seed % 100000,
+                              seed % 1000, seed % 97, seed % 7);
+            break;
+        }
+    }
+    return text;
+}
+
+static void lex_corpus(void *state) {
+    Lexer *lexer = create_lexer(state);
+    long tokens = 0;
+    for (;;) {
+        Token token = next_token(lexer);
+        TokenType type = token.type;
+        free_token(&token);
+        tokens++;
+        if (type == TOKEN_EOF) {
+            break;
+        }
+    }
+    free_lexer(lexer);
+    sink = tokens;
+}
+
+// Parser
+
+static char *make_wide_program(void) {
+    char *text = malloc(CORPUS_BYTES + 256);
+    int length = sprintf(text, "def main() -> i32 {\n    def mut x: i32 = 0;\n");
+    while (length < CORPUS_BYTES) {
+        length += sprintf(text + length, "    x = x + %d;\n", length % 97);
+    }
+    sprintf(text + length, "    return x;\n}\n");
+    return text;
+}
+
+// Nested ifs, each around one statement with a nested expression
+static char *make_deep_program(int depth) {
+    char *text = malloc(depth * 96 + 256);
+    int length = sprintf(text, "def main() -> i32 {\n    def mut x: i32 = 0;\n");
+    for (int i = 0; i < depth; i++) {
+        length += sprintf(text + length, "if x > %d {\n", i);
+    }
+    for (int i = 0; i < depth; i++) {
+        length += sprintf(text + length, "x = (x + (%d * (x - 1)));\n}\n", i);
+    }
+    sprintf(text + length, "    return x;\n}\n");
+    return text;
+}
+
+static void parse_source(void *state) {
+    Lexer *lexer = create_lexer(state);
+    Parser *parser = create_parser(lexer);
+    ASTNode *program = parse_program(parser);
+    sink = program != NULL;
+    free_ast_node(program);
+    free_parser(parser);
+    free_lexer(lexer);
+}
+
+// Struct registry lookups
+
+typedef struct {
+    TypeRegistry *registry;
+    char **names;
+    int count;
+    int rounds;
+    long lookups;  // Per call
+} TypeLookup;
+
+static TypeLookup *make_type_lookup(int structs) {
+    TypeLookup *lookup = malloc(sizeof(TypeLookup));
+    lookup->registry = create_type_registry();
+    lookup->names = malloc(structs * sizeof(char *));
+    lookup->count = structs;
+    lookup->rounds = LOOKUPS / structs;
+    lookup->lookups = (long)structs * lookup->rounds;
+
+    // Registering past the struct type id range still exercises lookup
+    TypeRegistry *previous = set_type_registry(lookup->registry);
+    StructField fields[2] = {{"x", TYPE_I32, 0}, {"y", TYPE_I32, 0}};
+    for (int i = 0; i < structs; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Struct%d", i);
+        lookup->names[i] = strdup(name);
+        register_struct_type(name, fields, 2);
+    }
+    set_type_registry(previous);
+    return lookup;
+}
+
+static void lookup_string_to_type(void *state) {
+    TypeLookup *lookup = state;
+    TypeRegistry *previous = set_type_registry(lookup->registry);
+    long total = 0;
+    for (int round = 0; round < lookup->rounds; round++) {
+        for (int i = 0; i < lookup->count; i++) {
+            total += string_to_type(lookup->names[i]);
+        }
+    }
+    set_type_registry(previous);
+    sink = total;
+}
+
+static void lookup_find_struct(void *state) {
+    TypeLookup *lookup = state;
+    TypeRegistry *previous = set_type_registry(lookup->registry);
+    long total = 0;
+    for (int round = 0; round < lookup->rounds; round++) {
+        for (int i = 0; i < lookup->count; i++) {
+            total += find_struct_by_name(lookup->names[i]) != NULL;
+        }
+    }
+    set_type_registry(previous);
+    sink = total;
+}
+
+// Variable table lookups
+
+typedef struct {
+    CodeGen *codegen;
+    char **names;
+    int count;
+    int rounds;
+    long lookups;  // Per call
+} VariableLookup;
+
+static VariableLookup *make_variable_lookup(int variables) {
+    VariableLookup *lookup = malloc(sizeof(VariableLookup));
+    lookup->codegen = create_codegen("microbench");
+    lookup->names = malloc(variables * sizeof(char *));
+    lookup->count = variables;
+    lookup->rounds = LOOKUPS / variables;
+    lookup->lookups = (long)variables * lookup->rounds;
+    LLVMTypeRef type = LLVMInt32TypeInContext(lookup->codegen->context);
+    for (int i = 0; i < variables; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "local_%d", i);
+        lookup->names[i] = strdup(name);
+        set_variable(lookup->codegen, name, LLVMConstInt(type, i, 0), type, 1);
+    }
+    return lookup;
+}
+
+static void lookup_variable(void *state) {
+    VariableLookup *lookup = state;
+    long total = 0;
+    for (int round = 0; round < lookup->rounds; round++) {
+        for (int i = 0; i < lookup->count; i++) {
+            total += get_variable(lookup->codegen, lookup->names[i]) != NULL;
+        }
+    }
+    sink = total;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --filter=<text>         # Run benchmarks whose name contains text\n");
+    fprintf(stderr, "  --repetitions=<n>       # Timed calls per benchmark (default: 50)\n");
+    fprintf(stderr, "  --warmup=<n>            # Untimed calls first (default: 5)\n");
+    fprintf(stderr, "  --json                  # Print JSON instead of a table\n");
+}
+
+int main(int argc, char *argv[]) {
+    MicrobenchOptions options;
+    memset(&options, 0, sizeof(options));
+    options.warmup = 5;
+    options.repetitions = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            options.filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            options.repetitions = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+            options.warmup = atoi(argv[i] + 9);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.json = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.repetitions < 1 || options.warmup < 0) {
+        fprintf(stderr, "Error: Invalid repetition or warm-up count\n");
+        return 1;
+    }
+
+    char *identifiers = make_corpus(CORPUS_IDENTIFIERS);
+    char *comments = make_corpus(CORPUS_COMMENTS);
+    char *numbers = make_corpus(CORPUS_NUMBERS);
+    char *wide = make_wide_program();
+    char *deep = make_deep_program(150);
+    TypeLookup *types[3] = {make_type_lookup(10), make_type_lookup(100),
+                            make_type_lookup(1000)};
+    VariableLookup *variables[3] = {make_variable_lookup(8),
+                                    make_variable_lookup(64),
+                                    make_variable_lookup(256)};
+
+    Benchmark benchmarks[] = {
+        {"lexer/identifiers", lex_corpus, identifiers, (long)strlen(identifiers), "byte"},
+        {"lexer/comments", lex_corpus, comments, (long)strlen(comments), "byte"},
+        {"lexer/numbers", lex_corpus, numbers, (long)strlen(numbers), "byte"},
+        {"parser/wide", parse_source, wide, (long)strlen(wide), "byte"},
+        {"parser/deep", parse_source, deep, (long)strlen(deep), "byte"},
+        {"types/string_to_type/10", lookup_string_to_type, types[0], types[0]->lookups, "lookup"},
+        {"types/string_to_type/100", lookup_string_to_type, types[1], types[1]->lookups, "lookup"},
+        {"types/string_to_type/1000", lookup_string_to_type, types[2], types[2]->lookups, "lookup"},
+        {"types/find_struct_by_name/10", lookup_find_struct, types[0], types[0]->lookups, "lookup"},
+        {"types/find_struct_by_name/100", lookup_find_struct, types[1], types[1]->lookups, "lookup"},
+        {"types/find_struct_by_name/1000", lookup_find_struct, types[2], types[2]->lookups, "lookup"},
+        {"symbols/get_variable/8", lookup_variable, variables[0], variables[0]->lookups, "lookup"},
+        {"symbols/get_variable/64", lookup_variable, variables[1], variables[1]->lookups, "lookup"},
+        {"symbols/get_variable/256", lookup_variable, variables[2], variables[2]->lookups, "lookup"},
+    };
+
+    if (options.json) {
+        printf("{\"benchmark\":\"gloin_microbench\",\"warmup\":%d,"
+               "\"repetitions\":%d,\"results\":[\n", options.warmup,
+               options.repetitions);
+    } else {
+        printf("  %-34s %-7s %9s %9s %9s %9s %14s\n", "Benchmark", "Unit",
+               "min ns", "p50 ns", "p90 ns", "p99 ns", "Items/s");
+    }
+    int first = 1;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (options.filter && !strstr(benchmarks[i].name, options.filter)) {
+            continue;
+        }
+        run_benchmark(&benchmarks[i], &options, first);
+        first = 0;
+    }
+    if (options.json) {
+        printf("\n]}\n");
+    }
+
+    free(identifiers);
+    free(comments);
+    free(numbers);
+    free(wide);
+    free(deep);
+    for (int i = 0; i < 3; i++) {
+        free_type_registry(types[i]->registry);
+        for (int j = 0; j < types[i]->count; j++) {
+            free(types[i]->names[j]);
+        }
+        free(types[i]->names);
+        free(types[i]);
+        free_codegen(variables[i]->codegen);
+        for (int j = 0; j < variables[i]->count; j++) {
+            free(variables[i]->names[j]);
+        }
+        free(variables[i]->names);
+        free(variables[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,322 @@
+// Generated code runtime benchmark.
+//
+// Builds each program in bench/runtime twice, once from the Gloin source
+// with gloinc and once from the equivalent C source with a C compiler, at
+// the same optimization level. Both executables run with their output
+// compared, then the fastest of several timed runs is reported for each,
+// along with the Gloin/C time ratio. The C side is built with -fwrapv,
+// since Gloin integer arithmetic wraps on overflow.
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const struct {
+    const char *name;
+    const char *description;
+} programs[] = {
+    {"fib", "recursive Fibonacci"},
+    {"factorial", "iterative factorial in a loop"},
+    {"loops", "nested arithmetic loops"},
+    {"methods", "struct construction and method calls"},
+    {"pointers", "dependent loads through pointers"},
+    {"output", "string output"},
+};
+
+#define PROGRAM_COUNT ((int)(sizeof(programs) / sizeof(programs[0])))
+
+typedef struct {
+    const char *name;
+    double gloin_seconds;  // Fastest run
+    double c_seconds;
+} RuntimeResult;
+
+typedef struct {
+    int repetitions;
+    int optimization_level;
+    const char *filter;  // NULL runs every program
+    const char *gloinc;
+    const char *cc;
+    const char *source_dir;
+    const char *output;
+    int keep;  // Leave the executables behind
+} RuntimeOptions;
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void remove_tree(const char *path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs argv with stdout sent to output_path (or /dev/null) and returns the
+// exit status, or -1 when the child could not run
+static int run_command(char *const argv[], const char *output_path,
+                       double *seconds) {
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        int fd = open(output_path ? output_path : "/dev/null",
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    if (seconds) {
+        *seconds = now_seconds() - start;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int files_equal(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int equal = fa && fb;
+    while (equal) {
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        equal = ca == cb;
+        if (ca == EOF || cb == EOF) {
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return equal;
+}
+
+static int build_program(const char *work_dir, const char *name,
+                         const RuntimeOptions *options) {
+    char level[8];
+    char gloin_source[4096];
+    char c_source[4096];
+    char gloin_exe[4096];
+    char c_exe[4096];
+    snprintf(level, sizeof(level), "-O%d", options->optimization_level);
+    snprintf(gloin_source, sizeof(gloin_source), "%s/%s.gloin",
+             options->source_dir, name);
+    snprintf(c_source, sizeof(c_source), "%s/%s.c", options->source_dir, name);
+    snprintf(gloin_exe, sizeof(gloin_exe), "%s/%s-gloin", work_dir, name);
+    snprintf(c_exe, sizeof(c_exe), "%s/%s-c", work_dir, name);
+
+    char *gloin_argv[] = {(char *)options->gloinc, gloin_source, "-o",
+                          gloin_exe, level, NULL};
+    if (run_command(gloin_argv, NULL, NULL) != 0) {
+        fprintf(stderr, "Error: gloinc failed to build %s\n", gloin_source);
+        return 1;
+    }
+    char *c_argv[] = {(char *)options->cc, level, "-fwrapv", c_source, "-o",
+                      c_exe, NULL};
+    if (run_command(c_argv, NULL, NULL) != 0) {
+        fprintf(stderr, "Error: %s failed to build %s\n", options->cc,
+                c_source);
+        return 1;
+    }
+    return 0;
+}
+
+// A checked run, then keep the fastest timed one
+static int time_executable(const char *work_dir, const char *name,
+                           const char *suffix, int repetitions,
+                           double *fastest) {
+    char exe[2048];
+    char output[4096];
+    snprintf(exe, sizeof(exe), "%s/%s-%s", work_dir, name, suffix);
+    snprintf(output, sizeof(output), "%s.out", exe);
+
+    char *argv[] = {exe, NULL};
+    if (run_command(argv, output, NULL) != 0) {
+        fprintf(stderr, "Error: %s exited with an error\n", exe);
+        return 1;
+    }
+    for (int rep = 0; rep < repetitions; rep++) {
+        double seconds;
+        if (run_command(argv, NULL, &seconds) != 0) {
+            fprintf(stderr, "Error: %s exited with an error\n", exe);
+            return 1;
+        }
+        if (rep == 0 || seconds < *fastest) {
+            *fastest = seconds;
+        }
+    }
+    return 0;
+}
+
+static int run_benchmark(const char *work_dir, const char *name,
+                         const RuntimeOptions *options,
+                         RuntimeResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    if (build_program(work_dir, name, options) != 0 ||
+        time_executable(work_dir, name, "gloin", options->repetitions,
+                        &result->gloin_seconds) != 0 ||
+        time_executable(work_dir, name, "c", options->repetitions,
+                        &result->c_seconds) != 0) {
+        return 1;
+    }
+
+    char gloin_output[4096];
+    char c_output[4096];
+    snprintf(gloin_output, sizeof(gloin_output), "%s/%s-gloin.out", work_dir,
+             name);
+    snprintf(c_output, sizeof(c_output), "%s/%s-c.out", work_dir, name);
+    if (!files_equal(gloin_output, c_output)) {
+        fprintf(stderr, "Error: %s printed different output from C\n", name);
+        return 1;
+    }
+
+    fprintf(stderr, "  %-12s %10.3f %10.3f %8.2fx\n", name,
+            result->gloin_seconds * 1000, result->c_seconds * 1000,
+            result->gloin_seconds / result->c_seconds);
+    return 0;
+}
+
+static void write_results(FILE *out, const RuntimeOptions *options,
+                          const RuntimeResult *results, int count) {
+    double log_sum = 0;
+    fprintf(out, "{\"benchmark\":\"gloin_runtime_bench\",\"optimization_level\":%d,"
+            "\"repetitions\":%d,\"cc\":\"%s\",\"results\":[\n",
+            options->optimization_level, options->repetitions, options->cc);
+    for (int i = 0; i < count; i++) {
+        const RuntimeResult *r = &results[i];
+        double ratio = r->gloin_seconds / r->c_seconds;
+        log_sum += log(ratio);
+        fprintf(out, "{\"name\":\"%s\",\"gloin_seconds\":%.6f,"
+                "\"c_seconds\":%.6f,\"ratio\":%.3f}%s\n", r->name,
+                r->gloin_seconds, r->c_seconds, ratio,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "],\"geomean_ratio\":%.3f}\n",
+            count ? exp(log_sum / count) : 0);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --filter=<text>         # Only programs whose name contains text\n");
+    fprintf(stderr, "  --repetitions=<n>       # Timed runs per executable (default: 5)\n");
+    fprintf(stderr, "  -O0, -O1, -O2, -O3      # Optimization level for both (default: -O2)\n");
+    fprintf(stderr, "  --gloinc=<path>         # Gloin compiler (default: %s)\n", GLOIN_RUNTIME_GLOINC);
+    fprintf(stderr, "  --cc=<compiler>         # C compiler (default: %s)\n", GLOIN_RUNTIME_CC);
+    fprintf(stderr, "  --source-dir=<dir>      # Benchmark programs (default: %s)\n", GLOIN_RUNTIME_SOURCES);
+    fprintf(stderr, "  --output=<file>         # Write the JSON there instead of stdout\n");
+    fprintf(stderr, "  --keep                  # Keep the executables and their output\n");
+    fprintf(stderr, "\nPrograms:\n");
+    for (int p = 0; p < PROGRAM_COUNT; p++) {
+        fprintf(stderr, "  %-12s %s\n", programs[p].name,
+                programs[p].description);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    RuntimeOptions options;
+    memset(&options, 0, sizeof(options));
+    options.repetitions = 5;
+    options.optimization_level = 2;
+    options.gloinc = GLOIN_RUNTIME_GLOINC;
+    options.cc = GLOIN_RUNTIME_CC;
+    options.source_dir = GLOIN_RUNTIME_SOURCES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            options.filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            options.repetitions = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+                   argv[i][2] <= '3' && argv[i][3] == '\0') {
+            options.optimization_level = argv[i][2] - '0';
+        } else if (strncmp(argv[i], "--gloinc=", 9) == 0) {
+            options.gloinc = argv[i] + 9;
+        } else if (strncmp(argv[i], "--cc=", 5) == 0) {
+            options.cc = argv[i] + 5;
+        } else if (strncmp(argv[i], "--source-dir=", 13) == 0) {
+            options.source_dir = argv[i] + 13;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            options.output = argv[i] + 9;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            options.keep = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.repetitions < 1) {
+        fprintf(stderr, "Error: --repetitions must be at least 1\n");
+        return 1;
+    }
+
+    // Keep gloinc from writing a cache next to the benchmark sources
+    setenv("GLOIN_NO_CACHE", "1", 1);
+
+    char work_dir[] = "/tmp/gloin-runtime-XXXXXX";
+    if (!mkdtemp(work_dir)) {
+        fprintf(stderr, "Error: Cannot create a work directory\n");
+        return 1;
+    }
+
+    RuntimeResult results[PROGRAM_COUNT];
+    int count = 0;
+    int failed = 0;
+    fprintf(stderr, "Running at -O%d against %s, fastest of %d:\n",
+            options.optimization_level, options.cc, options.repetitions);
+    fprintf(stderr, "  %-12s %10s %10s %9s\n", "Program", "Gloin ms", "C ms",
+            "Ratio");
+    for (int p = 0; p < PROGRAM_COUNT && !failed; p++) {
+        if (options.filter && !strstr(programs[p].name, options.filter)) {
+            continue;
+        }
+        failed = run_benchmark(work_dir, programs[p].name, &options,
+                               &results[count]);
+        count += !failed;
+    }
+    if (!failed) {
+        FILE *out = options.output ? fopen(options.output, "w") : stdout;
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", options.output);
+            failed = 1;
+        } else {
+            write_results(out, &options, results, count);
+            if (out != stdout) {
+                fclose(out);
+            }
+        }
+    }
+
+    if (options.keep) {
+        fprintf(stderr, "Executables kept in %s\n", work_dir);
+    } else {
+        remove_tree(work_dir);
+    }
+    return failed;
+}
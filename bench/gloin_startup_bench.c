@@ -0,0 +1,350 @@
+// Compiler start-up benchmark.
+//
+// Times whole gloinc processes where start-up is most of the work: printing
+// the version, compiling a hello world program to an executable, and
+// running it in the bytecode interpreter (gloinc run --interp). The
+// interpreter's own front end, parsing hello world and compiling it to
+// bytecode, is also timed in this process, since a gloinc process spends
+// most of its start-up loading LLVM's shared library. Each case runs
+// --repetitions times after one untimed run, and the median and fastest
+// wall times are reported. A case whose median exceeds its budget fails
+// the benchmark, so the budgets can gate changes that make the compiler
+// slower to start, such as initializing or linking more of LLVM.
+//
+// Process start-up is noisy, so the default budgets are about twice the
+// medians measured on a development machine. Given the results of an
+// earlier run on the same machine (--baseline), each budget is instead
+// --margin times that run's median.
+
+#include "ast.h"
+#include "interp.h"
+#include "parser.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char hello_source[] =
+    "import \"@std\"\n"
+    "\n"
+    "def main() -> i32 {\n"
+    "    std.println(\"Hello, World!\");\n"
+    "    return 0;\n"
+    "}\n";
+
+typedef struct {
+    const char *name;
+    double median_seconds;
+    double fastest_seconds;
+    double budget_seconds;
+    int over_budget;  // The median
+} StartupResult;
+
+// Budgets when neither a flag nor a baseline sets them
+#define DEFAULT_VERSION_BUDGET_MS 50
+#define DEFAULT_COMPILE_BUDGET_MS 250
+#define DEFAULT_INTERP_BUDGET_MS 50
+#define DEFAULT_FRONTEND_BUDGET_MS 0.5
+
+typedef struct {
+    int repetitions;
+    double version_budget_ms;  // 0 until set
+    double compile_budget_ms;
+    double interp_budget_ms;
+    double frontend_budget_ms;
+    const char *baseline;
+    double margin;  // Budget over the baseline median
+    const char *gloinc;
+    const char *output;
+} StartupOptions;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs argv with stdout discarded and returns the exit status, or -1 when
+// the child could not run
+static int run_command(char *const argv[], double *seconds) {
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    *seconds = now_seconds() - start;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Parses source and compiles it to bytecode, as gloinc run --interp does
+// before running it. Returns nonzero when either step fails.
+static int run_frontend(const char *source, double *seconds) {
+    double start = now_seconds();
+    ASTNode *ast = parse_file(source);
+    InterpProgram *program = ast ? interp_compile(ast, source) : NULL;
+    *seconds = now_seconds() - start;
+    free_interp_program(program);
+    free_ast_node(ast);
+    return program == NULL;
+}
+
+// Sorts the samples, reports them and frees them
+static void record_result(const char *name, double *samples,
+                          double budget_ms, int repetitions,
+                          StartupResult *result) {
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+    result->name = name;
+    result->median_seconds = samples[repetitions / 2];
+    result->fastest_seconds = samples[0];
+    result->budget_seconds = budget_ms / 1000;
+    free(samples);
+
+    result->over_budget = result->median_seconds > result->budget_seconds;
+    fprintf(stderr, "  %-10s %10.2f %10.2f %10.2f%s\n", name,
+            result->median_seconds * 1000, result->fastest_seconds * 1000,
+            budget_ms, result->over_budget ? "  over budget" : "");
+}
+
+static int time_command(const char *name, char *const argv[],
+                        double budget_ms, int repetitions,
+                        StartupResult *result) {
+    double *samples = malloc(repetitions * sizeof(double));
+    double seconds;
+    int failed = run_command(argv, &seconds) != 0;
+    for (int rep = 0; rep < repetitions && !failed; rep++) {
+        failed = run_command(argv, &samples[rep]) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "Error: %s exited with an error\n", name);
+        free(samples);
+        return 1;
+    }
+    record_result(name, samples, budget_ms, repetitions, result);
+    return 0;
+}
+
+static int time_frontend(const char *name, const char *source,
+                         double budget_ms, int repetitions,
+                         StartupResult *result) {
+    double *samples = malloc(repetitions * sizeof(double));
+    double seconds;
+    int failed = run_frontend(source, &seconds) != 0;
+    for (int rep = 0; rep < repetitions && !failed; rep++) {
+        failed = run_frontend(source, &samples[rep]) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "Error: %s failed to compile\n", name);
+        free(samples);
+        return 1;
+    }
+    record_result(name, samples, budget_ms, repetitions, result);
+    return 0;
+}
+
+// The median a file written by write_results recorded for a case, or 0
+static double baseline_median(const char *path, const char *name) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return 0;
+    }
+    double median = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+        char line_name[64];
+        const char *field = strstr(line, "\"median_seconds\":");
+        if (sscanf(line, "{\"name\":\"%63[^\"]\"", line_name) == 1 && field &&
+            strcmp(line_name, name) == 0) {
+            median = strtod(field + 17, NULL);
+            break;
+        }
+    }
+    fclose(in);
+    return median;
+}
+
+// An explicit budget wins, then one from the baseline, then the default
+static int resolve_budget(const StartupOptions *options, const char *name,
+                          double *budget_ms, double default_ms) {
+    if (*budget_ms > 0) {
+        return 0;
+    }
+    if (!options->baseline) {
+        *budget_ms = default_ms;
+        return 0;
+    }
+    double median = baseline_median(options->baseline, name);
+    if (median <= 0) {
+        fprintf(stderr, "Error: Baseline '%s' has no median for %s\n",
+                options->baseline, name);
+        return 1;
+    }
+    *budget_ms = median * 1000 * options->margin;
+    return 0;
+}
+
+static void write_results(FILE *out, const StartupOptions *options,
+                          const StartupResult *results, int count) {
+    fprintf(out, "{\"benchmark\":\"gloin_startup_bench\",\"repetitions\":%d,"
+            "\"results\":[\n", options->repetitions);
+    for (int i = 0; i < count; i++) {
+        const StartupResult *r = &results[i];
+        fprintf(out, "{\"name\":\"%s\",\"median_seconds\":%.6f,"
+                "\"fastest_seconds\":%.6f,\"budget_seconds\":%.6f,"
+                "\"over_budget\":%s}%s\n",
+                r->name, r->median_seconds, r->fastest_seconds,
+                r->budget_seconds, r->over_budget ? "true" : "false",
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --repetitions=<n>        # Timed runs per case (default: 20)\n");
+    fprintf(stderr, "  --version-budget=<ms>    # Median budget for gloinc --version (default: %d)\n", DEFAULT_VERSION_BUDGET_MS);
+    fprintf(stderr, "  --compile-budget=<ms>    # Median budget for compiling hello world (default: %d)\n", DEFAULT_COMPILE_BUDGET_MS);
+    fprintf(stderr, "  --interp-budget=<ms>     # Median budget for interpreting hello world (default: %d)\n", DEFAULT_INTERP_BUDGET_MS);
+    fprintf(stderr, "  --frontend-budget=<ms>   # Median budget for parsing and compiling hello world to bytecode in-process (default: %g)\n", DEFAULT_FRONTEND_BUDGET_MS);
+    fprintf(stderr, "  --baseline=<file>        # Budget the medians of an earlier --output instead\n");
+    fprintf(stderr, "  --margin=<factor>        # Budget over a baseline median (default: 2)\n");
+    fprintf(stderr, "  --gloinc=<path>          # Gloin compiler (default: %s)\n", GLOIN_STARTUP_GLOINC);
+    fprintf(stderr, "  --output=<file>          # Write the JSON there instead of stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+    StartupOptions options;
+    memset(&options, 0, sizeof(options));
+    options.repetitions = 20;
+    options.margin = 2;
+    options.gloinc = GLOIN_STARTUP_GLOINC;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            options.repetitions = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "--version-budget=", 17) == 0) {
+            options.version_budget_ms = atof(argv[i] + 17);
+        } else if (strncmp(argv[i], "--compile-budget=", 17) == 0) {
+            options.compile_budget_ms = atof(argv[i] + 17);
+        } else if (strncmp(argv[i], "--interp-budget=", 16) == 0) {
+            options.interp_budget_ms = atof(argv[i] + 16);
+        } else if (strncmp(argv[i], "--frontend-budget=", 18) == 0) {
+            options.frontend_budget_ms = atof(argv[i] + 18);
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            options.baseline = argv[i] + 11;
+        } else if (strncmp(argv[i], "--margin=", 9) == 0) {
+            options.margin = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--gloinc=", 9) == 0) {
+            options.gloinc = argv[i] + 9;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            options.output = argv[i] + 9;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.repetitions < 1) {
+        fprintf(stderr, "Error: --repetitions must be at least 1\n");
+        return 1;
+    }
+    if (options.margin <= 0) {
+        fprintf(stderr, "Error: --margin must be positive\n");
+        return 1;
+    }
+    if (options.baseline && access(options.baseline, R_OK) != 0) {
+        fprintf(stderr, "Error: Cannot read baseline '%s'\n", options.baseline);
+        return 1;
+    }
+    if (resolve_budget(&options, "version", &options.version_budget_ms,
+                       DEFAULT_VERSION_BUDGET_MS) ||
+        resolve_budget(&options, "hello", &options.compile_budget_ms,
+                       DEFAULT_COMPILE_BUDGET_MS) ||
+        resolve_budget(&options, "interp", &options.interp_budget_ms,
+                       DEFAULT_INTERP_BUDGET_MS) ||
+        resolve_budget(&options, "frontend", &options.frontend_budget_ms,
+                       DEFAULT_FRONTEND_BUDGET_MS)) {
+        return 1;
+    }
+
+    // Every compile starts cold
+    setenv("GLOIN_NO_CACHE", "1", 1);
+
+    char work_dir[] = "/tmp/gloin-startup-XXXXXX";
+    if (!mkdtemp(work_dir)) {
+        fprintf(stderr, "Error: Cannot create a work directory\n");
+        return 1;
+    }
+    char source[64];
+    char executable[64];
+    snprintf(source, sizeof(source), "%s/hello.gloin", work_dir);
+    snprintf(executable, sizeof(executable), "%s/hello", work_dir);
+    FILE *file = fopen(source, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", source);
+        rmdir(work_dir);
+        return 1;
+    }
+    fputs(hello_source, file);
+    fclose(file);
+
+    char *version_argv[] = {(char *)options.gloinc, "--version", NULL};
+    char *compile_argv[] = {(char *)options.gloinc, source, "-o", executable,
+                            NULL};
+    char *interp_argv[] = {(char *)options.gloinc, "run", "--interp", source,
+                           NULL};
+    StartupResult results[4];
+    fprintf(stderr, "Median and fastest of %d runs:\n", options.repetitions);
+    fprintf(stderr, "  %-10s %10s %10s %10s\n", "Case", "Median ms",
+            "Fastest ms", "Budget ms");
+    int failed = time_command("version", version_argv,
+                              options.version_budget_ms, options.repetitions,
+                              &results[0]) ||
+                 time_command("hello", compile_argv, options.compile_budget_ms,
+                              options.repetitions, &results[1]) ||
+                 time_command("interp", interp_argv, options.interp_budget_ms,
+                              options.repetitions, &results[2]) ||
+                 time_frontend("frontend", source, options.frontend_budget_ms,
+                               options.repetitions, &results[3]);
+
+    if (!failed) {
+        FILE *out = options.output ? fopen(options.output, "w") : stdout;
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", options.output);
+            failed = 1;
+        } else {
+            write_results(out, &options, results, 4);
+            if (out != stdout) {
+                fclose(out);
+            }
+        }
+        failed |= results[0].over_budget || results[1].over_budget ||
+                  results[2].over_budget || results[3].over_budget;
+    }
+
+    unlink(executable);
+    unlink(source);
+    rmdir(work_dir);
+    return failed;
+}
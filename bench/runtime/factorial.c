@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+// Iterative factorial, recomputed for every n in a long loop
+
+static int factorial(int n) {
+    int result = 1;
+    int i = 1;
+    while (i <= n) {
+        result = result * i;
+        i = i + 1;
+    }
+    return result;
+}
+
+int main(void) {
+    int checksum = 0;
+    int f = 0;
+    int i = 0;
+    while (i < 20000000) {
+        f = factorial(i / 1000000 + 1);
+        checksum = checksum + f;
+        i = i + 1;
+    }
+    printf("%d\n", checksum);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+// Naive recursive Fibonacci: call overhead and branching
+
+static int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    int a = fib(n - 1);
+    int b = fib(n - 2);
+    return a + b;
+}
+
+int main(void) {
+    int result = fib(38);
+    printf("%d\n", result);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+// Nested counting loops over integer arithmetic
+
+int main(void) {
+    int acc = 0;
+    int i = 0;
+    int j = 0;
+    while (i < 20000) {
+        j = 0;
+        while (j < 10000) {
+            acc = acc * 31 + i - j / 3;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    printf("%d\n", acc);
+    return 0;
+}
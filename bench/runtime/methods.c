@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <stdio.h>
+
+// Struct construction and method calls, one probe per iteration
+
+typedef struct {
+    int low;
+    int high;
+} Range;
+
+static bool range_starts_below_zero(const Range *self) {
+    return self->low < 0;
+}
+
+static bool range_ends_above_zero(const Range *self) {
+    return self->high > 0;
+}
+
+static int probe(int i) {
+    Range r = { i / 7 - 1000, i / 5 - 2000 };
+    bool below = range_starts_below_zero(&r);
+    bool above = range_ends_above_zero(&r);
+    if (below) {
+        if (above) {
+            return 2;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    int hits = 0;
+    int h = 0;
+    int i = 0;
+    while (i < 50000000) {
+        h = probe(i - i / 16384 * 16384);
+        hits = hits + h;
+        i = i + 1;
+    }
+    printf("%d\n", hits);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+// Formatted and literal string output through printf
+
+static int emit(int n) {
+    char buffer[32];
+    printf("%s", "line ");
+    sprintf(buffer, "%d", n);
+    printf("%s\n", buffer);
+    return 0;
+}
+
+int main(void) {
+    int r = 0;
+    int i = 0;
+    while (i < 2000000) {
+        r = emit(i);
+        i = i + 1;
+    }
+    return r;
+}
@@ -0,0 +1,29 @@
+#include <stdbool.h>
+#include <stdio.h>
+
+// Pointer chasing: the value loaded through p picks the slot p points to
+// next, and is flipped on the way, so every load waits for the one before
+
+int main(void) {
+    bool a = true;
+    bool b = false;
+    bool *pa = &a;
+    bool *pb = &b;
+    bool *p = pa;
+    int count = 0;
+    int i = 0;
+    while (i < 300000000) {
+        bool v = *p;
+        *p = v == false;
+        if (v) {
+            count = count + 1;
+            p = pb;
+        }
+        if (v == false) {
+            p = pa;
+        }
+        i = i + 1;
+    }
+    printf("%d\n", count);
+    return 0;
+}
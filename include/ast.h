@@ -71,6 +71,8 @@ typedef enum {
 
 typedef struct ASTNode {
     NodeType type;
+    int line;    // Source position of the node's first token, 0 if unknown
+    int column;
     union {
         struct {
             struct ASTNode **imports;
@@ -310,6 +312,7 @@ void add_case_to_switch(ASTNode *switch_stmt, ASTNode *switch_case);
 void add_statement_to_switch_case(ASTNode *switch_case, ASTNode *statement);
 void add_case_to_match(ASTNode *match_stmt, ASTNode *match_case);
 void set_switch_default(ASTNode *switch_stmt, ASTNode *default_case);
+void set_node_location(ASTNode *node, int line, int column);
 void free_ast_node(ASTNode *node);
 
 // Type analysis functions  
@@ -0,0 +1,56 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Binary AST cache (.gloinast)
+//
+// A parsed program is stored as a flat, relocatable image: a header, a
+// table of fixed-size node records, an index array holding child lists
+// and a blob of NUL-terminated strings. Records refer to each other by
+// index and to strings by offset, never by pointer, so the file can be
+// mapped at any address and decoded in a single pass. Nodes are stored in
+// pre-order, which the loader relies on to reject cycles and sharing.
+//
+// The loader validates everything it reads. A truncated, corrupted or
+// out-of-date cache entry is reported as a miss and the caller parses the
+// source instead.
+
+#define GLOIN_AST_CACHE_MAGIC "GLOINAST"
+#define GLOIN_AST_CACHE_VERSION 3
+
+int write_ast_cache(ASTNode *program, const char *path,
+                    uint64_t source_hash, uint64_t source_size);
+ASTNode *load_ast_cache(const char *path, uint64_t source_hash,
+                        uint64_t source_size);
+
+// Decode an in-memory image; exposed for tools that map cache files
+// themselves
+ASTNode *decode_ast_cache(const void *data, size_t size,
+                          uint64_t source_hash, uint64_t source_size);
+
+// Lookup used by parse_file(): trees kept resident in memory come first,
+// then the cache file at cache_path (which may be NULL). A resident tree is
+// handed over to the caller and removed from the table.
+//
+// Whenever a source's cache file is known to be current (it was loaded or
+// freshly written), the observer set with set_ast_cache_observer() is
+// called with the canonical source path.
+ASTNode *find_cached_ast(const char *source_path, const char *cache_path,
+                         uint64_t source_hash, uint64_t source_size);
+
+// Record a freshly parsed tree by writing it to cache_path
+void store_parsed_ast(const char *source_path, const char *cache_path,
+                      ASTNode *program, uint64_t source_hash,
+                      uint64_t source_size);
+
+// Resident trees, used by single-threaded long-lived processes such as
+// the compile daemon; the table is process-wide and not locked.
+// make_ast_resident() loads the current cache file of a source into the
+// table, replacing any stale entry; returns 0 on success.
+int make_ast_resident(const char *source_path);
+void set_ast_cache_observer(void (*observer)(const char *source_path));
+
+#endif
@@ -7,8 +7,16 @@
 #include <llvm-c/Target.h>
 #include <llvm-c/TargetMachine.h>
 #include "ast.h"
+#include "imports.h"
+#include "lto.h"
+#include "passes.h"
+#include "reachability.h"
 #include "types.h"
 
+// printf, puts, strlen, scanf, getline, atoi, atol, sprintf, malloc, free
+// and realloc
+#define RUNTIME_FUNCTION_COUNT 11
+
 typedef struct {
     LLVMContextRef context;
     LLVMModuleRef module;
@@ -24,6 +32,7 @@ typedef struct {
         TypeKind type_kind;  // Semantic type information
     } variables[256];
     int variable_count;
+    int peak_variable_count;  // High-water mark, for --mem-report
     
     // Function table
     struct {
@@ -31,6 +40,10 @@ typedef struct {
         LLVMValueRef function;
     } functions[256];
     int function_count;
+
+    // C library functions the generated code calls, declared on first use
+    // (see get_runtime_function)
+    LLVMValueRef runtime_functions[RUNTIME_FUNCTION_COUNT];
     
     // Loop context stack for break/continue
     struct {
@@ -39,6 +52,30 @@ typedef struct {
     } loop_stack[32];
     int loop_depth;
     
+    // Modules pulled in by imports, each compiled once and linked in
+    ImportGraph *imports;
+    int owns_imports;   // Module compilers share the importer's graph
+    char *source_path;  // File being compiled (root of the import graph)
+    
+    // Output options
+    int optimization_level;  // -O level, 0 runs no IR passes
+    int codegen_threads;     // Partitioned parallel emission when > 0
+    int debug_info;          // -g: emit DWARF debug info
+    int profile;             // --profile: count calls and cycles per function
+    char *profile_generate;  // --profile-generate: raw PGO profile to write
+    char *profile_use;       // --profile-use: indexed PGO profile to read
+    int whole_program;       // --whole-program: imports are generated into
+                             // this module and only main stays external
+    Reachability *reachable; // Functions worth generating, NULL for all
+    LTOMode lto;             // -flto: imports are cached and linked as bitcode
+    int emit_bitcode;        // --emit=bc: imports are cached as bitcode too
+
+    // Debug info state (see debuginfo.h), live while generating
+    LLVMDIBuilderRef di_builder;
+    LLVMTargetDataRef di_layout;
+    LLVMMetadataRef di_file;
+    LLVMMetadataRef di_scope;  // Subprogram of the function being generated
+    
     // Error flag for stopping compilation
     int has_error;
 } CodeGen;
@@ -78,7 +115,7 @@ LLVMValueRef codegen_break(CodeGen *codegen, ASTNode *break_stmt);
 LLVMValueRef codegen_continue(CodeGen *codegen, ASTNode *continue_stmt);
 
 // Helper functions
-void add_builtin_functions(CodeGen *codegen);
+LLVMValueRef get_runtime_function(CodeGen *codegen, const char *name);
 LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call);
 LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call);
 LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call);
@@ -92,17 +129,36 @@ int get_variable_mutability(CodeGen *codegen, const char *name);
 void set_variable(CodeGen *codegen, const char *name, LLVMValueRef value, LLVMTypeRef type, int is_mutable);
 void set_variable_with_type(CodeGen *codegen, const char *name, LLVMValueRef value, LLVMTypeRef type, int is_mutable, TypeKind type_kind);
 TypeKind get_variable_type_kind(CodeGen *codegen, const char *name);
+
+// Function bodies add their parameters and locals to the symbol table, and
+// update entries of the same name in place, so variables that outlive a
+// function (globals, the REPL's session) are saved around it
+typedef struct {
+    void *entries;
+    int count;
+} VariableScope;
+
+void save_variables(CodeGen *codegen, VariableScope *scope);
+void restore_variables(CodeGen *codegen, VariableScope *scope);
 TypeKind get_expression_type(CodeGen *codegen, ASTNode *node);
 LLVMValueRef get_function(CodeGen *codegen, const char *name);
 void set_function(CodeGen *codegen, const char *name, LLVMValueRef function);
+void codegen_imports(CodeGen *codegen, ASTNode *program);
 void process_local_import(CodeGen *codegen, ASTNode *import);
 void process_external_import(CodeGen *codegen, ASTNode *import);
 void push_loop_context(CodeGen *codegen, LLVMBasicBlockRef break_target, LLVMBasicBlockRef continue_target);
 void pop_loop_context(CodeGen *codegen);
 
 // Output functions
+void initialize_native_target(void);  // Once per process, on first use
+LLVMTargetMachineRef create_target_machine(LLVMModuleRef module, int optimization_level, char **error_message);
+int optimize_module(LLVMModuleRef module, LLVMTargetMachineRef target_machine, int optimization_level, LTOMode lto, const PassProfile *profile, char **error_message);
 void print_llvm_ir(CodeGen *codegen);
 int write_object_file(CodeGen *codegen, const char *filename);
+int write_assembly_file(CodeGen *codegen, const char *filename);
+int write_bitcode_file(CodeGen *codegen, const char *filename);
+int write_ir_file(CodeGen *codegen, const char *filename);
+int emit_object_buffer(CodeGen *codegen, LLVMMemoryBufferRef *buffer);
 int write_executable(CodeGen *codegen, const char *filename);
 
 #endif
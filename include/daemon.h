@@ -0,0 +1,34 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+// Compile daemon
+//
+// `gloinc --daemon` initializes LLVM once and then serves compile requests
+// on a Unix domain socket. Every request runs in its own forked process,
+// chdir'd to the client's working directory, so requests are isolated from
+// each other and from the daemon, and several clients can be served at
+// once. Forked compilers inherit the daemon's initialized LLVM targets and
+// the syntax trees it keeps resident; the compilers report which sources
+// they used and the daemon refreshes its copies from the AST cache, so a
+// tree is dropped as soon as its source hash changes.
+//
+// `gloinc --connect <args>` is the thin client: it forwards its arguments,
+// working directory and environment, streams its stdin to the compiler,
+// relays the compiler's output and exits with the compiler's exit status.
+
+// Runs a gloinc command line (argv[0] is the program name)
+typedef int (*DaemonCommand)(int argc, char **argv);
+
+// Socket location: $GLOIN_DAEMON_SOCKET, else a per-user path under
+// $XDG_RUNTIME_DIR or /tmp. Returns a malloc'd path.
+char *daemon_socket_path(void);
+
+int run_daemon(const char *socket_path, DaemonCommand command);
+
+// isatty() for the command's streams. A compiler serving a --connect
+// client reads stdin from a pipe, so for it this reports whether the
+// client's stdin is a terminal.
+int input_is_terminal(int fd);
+int run_daemon_client(const char *socket_path, int argc, char **argv);
+
+#endif
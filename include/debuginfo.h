@@ -0,0 +1,35 @@
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include "ast.h"
+#include "codegen.h"
+
+// DWARF debug info for -g. Each module gets a compile unit for its source
+// file, each function a subprogram, and instructions take the line and
+// column of the statement or expression they were generated for. All of
+// these do nothing unless the code generator has debug_info set.
+
+// Start the compile unit once source_path is known
+void debug_info_begin(CodeGen *codegen);
+// Attribute the functions generated from here on to another source file,
+// for imports generated into this module by --whole-program
+void debug_info_file(CodeGen *codegen, const char *path);
+// Resolve the metadata; call before verifying the module
+void debug_info_finish(CodeGen *codegen);
+
+// Attach a subprogram to a function about to get its body, and point the
+// builder at its first line
+void debug_info_function(CodeGen *codegen, LLVMValueRef function,
+                         const char *name, const ASTNode *node);
+void debug_info_end_function(CodeGen *codegen);
+
+// Locate the instructions built from here on at a node; nodes without a
+// location keep the current one
+void debug_info_location(CodeGen *codegen, const ASTNode *node);
+
+// Describe a local variable (arg_number 0) or parameter held in storage
+void debug_info_variable(CodeGen *codegen, LLVMValueRef storage,
+                         const char *name, TypeKind type,
+                         const ASTNode *node, int arg_number);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stddef.h>
+
+// Compiler messages. Errors and warnings go to stderr and informational
+// messages to stdout, unless the calling thread has installed a buffer;
+// library sessions do this so that concurrent compilations keep their
+// messages apart and never write to the host's streams.
+typedef struct {
+    char *data;  // NUL-terminated, NULL while empty
+    size_t length;
+    size_t capacity;
+} DiagnosticBuffer;
+
+void report_error(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+void report_info(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+// Install a buffer on the calling thread (NULL restores the standard
+// streams); returns the previous one
+DiagnosticBuffer *set_diagnostic_buffer(DiagnosticBuffer *buffer);
+void clear_diagnostic_buffer(DiagnosticBuffer *buffer);
+
+#endif
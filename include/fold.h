@@ -0,0 +1,28 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+
+// Constant folding on a program after resolve_types, done before code
+// generation and before compiling to bytecode, so it applies at -O0 and in
+// the interpreter too. Nodes are rewritten in place:
+//
+// - Arithmetic and comparisons on literals of the same integer, float or
+//   bool type become literals. They are evaluated as the instructions the
+//   LLVM backend emits would be: integers wrap at the width of their type,
+//   and division and ordering compare signed. Division by zero and the
+//   overflowing signed division are left to run.
+// - Uses of a `def const`, local or top-level, whose value folded become
+//   literals of the declared type, unless the name is assigned or has its
+//   address taken anywhere in the program. A later declaration of the
+//   name, or a parameter of that name, ends it.
+// - `if` and `unless` on a constant condition become the block taken, and
+//   `while false` an empty block.
+// - `comptime f(args)` becomes the integer or bool f returns, evaluated by
+//   the bytecode interpreter (see interp_evaluate) within a step and
+//   memory limit.
+//
+// Returns nonzero after reporting a comptime call that failed.
+int fold_constants(ASTNode *program);
+
+#endif
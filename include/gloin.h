@@ -0,0 +1,51 @@
+#ifndef GLOIN_H
+#define GLOIN_H
+
+#include <stddef.h>
+#include <llvm-c/Types.h>
+
+// Embedding API
+//
+// A GloinSession owns everything a compilation needs: the struct type
+// registry, the diagnostics and the LLVM context and module of the last
+// compilation. Sessions share nothing, so a host can compile in parallel
+// by giving each thread its own session. A single session must not be
+// used by two threads at once.
+
+typedef struct GloinSession GloinSession;
+
+typedef enum {
+    GLOIN_OUTPUT_LLVM_IR,  // Textual LLVM IR
+    GLOIN_OUTPUT_BITCODE,  // LLVM bitcode
+    GLOIN_OUTPUT_OBJECT    // Object file for the host target
+} GloinOutputKind;
+
+typedef struct {
+    char *data;   // Followed by a NUL byte not counted in size
+    size_t size;
+} GloinBuffer;
+
+GloinSession *gloin_session_create(void);
+void gloin_session_destroy(GloinSession *session);
+
+// Compile Gloin source text. source_name is used to resolve local imports
+// (NULL resolves them against the working directory). Imported modules are
+// compiled separately into cached object files, which are listed by
+// gloin_session_import_objects() and must be linked with the output.
+// Returns 0 and fills output on success (release it with
+// gloin_buffer_free()); on failure the reasons are in
+// gloin_session_diagnostics().
+int gloin_compile_buffer(GloinSession *session, const char *source,
+                         size_t length, const char *source_name,
+                         GloinOutputKind kind, GloinBuffer *output);
+
+// Results of the last compilation; valid until the next compilation or
+// until the session is destroyed
+const char *gloin_session_diagnostics(GloinSession *session);
+LLVMModuleRef gloin_session_module(GloinSession *session);
+const char *const *gloin_session_import_objects(GloinSession *session,
+                                                int *count);
+
+void gloin_buffer_free(GloinBuffer *buffer);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef IMPORTS_H
+#define IMPORTS_H
+
+#include <sys/types.h>
+#include "ast.h"
+#include "interface.h"
+
+// Processing state of a module in the import graph
+typedef enum {
+    MODULE_VISITING,  // Imports are being processed (module is on the stack)
+    MODULE_DONE       // Parsed, analysed and generated
+} ModuleState;
+
+// A source file in the import graph. Modules are identified by the
+// (device, inode) pair of the file, so different spellings of the same
+// path, symlinks and hard links all resolve to a single module.
+typedef struct ImportModule {
+    char *path;        // Canonical path (realpath)
+    dev_t device;
+    ino_t inode;
+    ASTNode *program;  // Parsed AST, shared by every importer (NULL when
+                       // the module was loaded from its interface)
+    int owns_program;  // Whether the graph frees the AST
+    ModuleState state;
+
+    // Separate compilation artifacts
+    ModuleInterface *interface;  // Exports, from the cache or freshly built
+    char *object_path;           // Object file to link, NULL for the root
+
+    // Direct imports of this module
+    struct ImportModule **deps;
+    int dep_count;
+    int dep_capacity;
+} ImportModule;
+
+typedef struct {
+    ImportModule **modules;
+    int module_count;
+    int module_capacity;
+
+    // Modules currently being processed, outermost first
+    ImportModule **stack;
+    int stack_depth;
+    int stack_capacity;
+} ImportGraph;
+
+// Graph lifetime
+ImportGraph *create_import_graph(void);
+void free_import_graph(ImportGraph *graph);
+
+// Resolve the file an import refers to. Local imports are looked up next to
+// the importing file first and then relative to the working directory;
+// external packages live in includes/. Returns a malloc'd path.
+char *resolve_import_path(ImportType import_type, const char *path,
+                          const char *importer_path);
+
+// Module lookup and registration
+ImportModule *import_graph_find(ImportGraph *graph, const char *file_path);
+ImportModule *import_graph_add(ImportGraph *graph, const char *file_path,
+                               ASTNode *program, int owns_program);
+void import_graph_add_dependency(ImportModule *importer, ImportModule *module);
+
+// Every module of the graph, each after the modules it imports: the order
+// in which their top-level initializers run. order must hold module_count
+// entries. Returns module_count.
+int import_graph_order(ImportGraph *graph, ImportModule **order);
+
+// Processing stack, used for cycle detection
+void import_graph_push(ImportGraph *graph, ImportModule *module);
+void import_graph_pop(ImportGraph *graph);
+ImportModule *import_graph_current(ImportGraph *graph);
+void report_import_cycle(ImportGraph *graph, ImportModule *module);
+
+#endif
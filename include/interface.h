@@ -0,0 +1,86 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+
+#include <stdint.h>
+#include "ast.h"
+
+// Module interface files (.gloini)
+//
+// A compiled module leaves two artifacts in a .gloin-cache directory next
+// to its source: the object file and a compact binary interface holding
+// everything an importer needs (exported function signatures, struct
+// layouts and public method tables). Importers load the interface instead
+// of parsing the module again as long as it is up to date.
+
+#define GLOIN_INTERFACE_MAGIC "GLOINI\0\0"
+#define GLOIN_INTERFACE_VERSION 2
+
+// Identity of the source a cache entry was built from
+typedef struct {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;
+} SourceStamp;
+
+typedef struct {
+    char *name;
+    char *return_type;
+    char **param_types;
+    int param_count;
+} InterfaceFunction;
+
+typedef struct {
+    char *name;
+    char **field_names;
+    char **field_types;
+    int field_count;
+    InterfaceFunction *methods;  // Public methods only, unmangled names
+    int method_count;
+} InterfaceStruct;
+
+typedef struct {
+    ImportType import_type;
+    char *path;               // Import path as written in the source
+    uint64_t interface_hash;  // Hash of the dependency's exports at build time
+} InterfaceDependency;
+
+typedef struct {
+    uint64_t interface_hash;  // Hash of the exported declarations
+    InterfaceDependency *deps;
+    int dep_count;
+    InterfaceFunction *functions;
+    int function_count;
+    InterfaceStruct *structs;
+    int struct_count;
+} ModuleInterface;
+
+// Build the interface of a parsed module. Dependency hashes are left at
+// zero for the caller to fill in once the dependencies are resolved.
+ModuleInterface *build_module_interface(ASTNode *program);
+void free_module_interface(ModuleInterface *iface);
+
+// Serialization
+int write_module_interface(ModuleInterface *iface, const char *path,
+                           const SourceStamp *stamp);
+// Returns NULL if the file is missing, corrupt or was built from a
+// different version of source_path
+ModuleInterface *load_module_interface(const char *path, const char *source_path);
+
+// Source identity and cache layout
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+// Identity of the running compiler: its version and the build ID of its
+// executable. Cache entries another build wrote are misses.
+uint64_t compiler_build_id(void);
+int get_source_stamp(const char *source_path, SourceStamp *stamp);
+char *module_cache_path(const char *source_path, const char *extension);
+
+// Name for a temporary file next to path, to be renamed over it once
+// complete. Returns a malloc'd path.
+char *temporary_path(const char *path);
+// Whether output for path has to be written to it directly: "-" (stdout)
+// and existing files that are not regular, such as /dev/null, which a
+// rename would replace
+int writes_in_place(const char *path);
+
+#endif
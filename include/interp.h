@@ -0,0 +1,92 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Bytecode interpreter for `gloinc run --interp`. A program and the modules
+// it imports are compiled from their typed syntax trees to a compact
+// register bytecode, which is executed right away without involving LLVM,
+// so editing and re-running a program costs no more than parsing it.
+//
+// Programs behave as they do when compiled: integers wrap at the width of
+// their type, division and ordered comparisons are signed, and the std.*
+// builtins call the same C library functions with the same formats.
+// Programs that only the LLVM verifier would reject may still run.
+typedef struct InterpProgram InterpProgram;
+
+// Compile a parsed program. source_path locates its local imports.
+// Returns NULL after reporting errors.
+InterpProgram *interp_compile(ASTNode *program, const char *source_path);
+void free_interp_program(InterpProgram *program);
+
+// Run main. Returns nonzero after reporting a runtime error (division by
+// zero, stack overflow); otherwise *exit_code is main's return value, or 0
+// for a void main.
+int interp_run(InterpProgram *program, int *exit_code);
+
+// Compile-time evaluation of `comptime f(args)`: f, a function of program
+// (not its imports), runs in the interpreter on integer or bool literal
+// arguments, which fold_constants has already folded. Only the functions
+// it reaches are compiled, and any that print, read or allocate are
+// rejected. Returns nonzero after reporting an error, including a
+// runaway evaluation; otherwise *result holds the value in the registers'
+// representation and *result_type its type.
+typedef struct {
+    uint64_t steps;  // Loop iterations and calls
+    size_t memory;   // Bytes of stack, shared by registers and frames
+} InterpLimits;
+
+int interp_evaluate(ASTNode *program, ASTNode *call, const InterpLimits *limits,
+                    int64_t *result, TypeKind *result_type);
+
+// Tiered execution (see tier.h). Native code takes its arguments as
+// 64-bit values, in the registers' representation, and returns its result
+// the same way.
+typedef int64_t (*InterpNative)(const int64_t *args);
+typedef void (*InterpHotHook)(void *context, int function);
+
+// Call hook once for each function whose calls and loop iterations reach
+// threshold. It runs on the interpreter's thread and should only queue
+// the function.
+void interp_set_tiering(InterpProgram *program, uint32_t threshold,
+                        InterpHotHook hook, void *context);
+// Have calls to a function run native code from now on; safe to call
+// from any thread while the program runs
+void interp_set_native(InterpProgram *program, int function,
+                       InterpNative native);
+// On-stack replacement: an outermost loop of a function can hand the
+// rest of a running call to native code at its back edge, just before the
+// condition is tested. That code takes the loop's variables, in the order
+// given here, and returns what the function returns.
+int interp_loop_count(const InterpProgram *program, int function);
+ASTNode *interp_loop_node(const InterpProgram *program, int function, int loop);
+int interp_loop_variable_count(const InterpProgram *program, int function, int loop);
+const char *interp_loop_variable(const InterpProgram *program, int function, int loop,
+                                 int variable, TypeKind *type);
+// Have running calls of the function continue in native code the next
+// time they reach the loop's back edge; safe to call from any thread
+void interp_set_loop_native(InterpProgram *program, int function, int loop,
+                            InterpNative native);
+// Call a function from native code, in the interpreter unless it has
+// native code by now. Only valid while interp_run is running.
+int64_t interp_call(InterpProgram *program, int function, const int64_t *args);
+
+// Functions, struct methods included, and the modules they came from
+int interp_function_count(const InterpProgram *program);
+ASTNode *interp_function_node(const InterpProgram *program, int function);
+int interp_find_function(const InterpProgram *program, const char *name);
+int interp_function_module(const InterpProgram *program, int function);
+int interp_module_count(const InterpProgram *program);
+ASTNode *interp_module(const InterpProgram *program, int module);
+
+// Top-level variables of each module. They live in memory the program
+// owns, laid out as compiled code lays them out, so native code can use
+// them in place.
+int interp_global_count(const InterpProgram *program);
+ASTNode *interp_global_node(const InterpProgram *program, int global);
+int interp_global_module(const InterpProgram *program, int global);
+void *interp_global_address(const InterpProgram *program, int global);
+
+#endif
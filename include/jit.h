@@ -0,0 +1,20 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/LLJIT.h>
+
+// In-process JIT for tiered execution and the REPL: an ORC LLJIT whose
+// main library holds every module added to it and resolves the C library
+// functions generated code calls from this process. Errors are reported
+// with report_error.
+LLVMOrcLLJITRef create_jit(void);  // NULL on failure
+void free_jit(LLVMOrcLLJITRef jit);
+
+// Compile a copy of module into the JIT; the caller keeps module. Its
+// external definitions must not clash with those of earlier modules.
+int jit_add_module(LLVMOrcLLJITRef jit, LLVMModuleRef module);
+// Address of a function defined by an added module, NULL if missing
+void *jit_lookup(LLVMOrcLLJITRef jit, const char *name);
+
+#endif
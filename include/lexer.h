@@ -49,6 +49,7 @@ typedef enum {
     TOKEN_DEFERRED,   // NEW: deferred keyword
     TOKEN_SPAWNABLE,  // NEW: spawnable keyword
     TOKEN_RUN,        // NEW: run keyword
+    TOKEN_COMPTIME,   // comptime keyword
     TOKEN_IDENTIFIER,
     TOKEN_STRING,
     TOKEN_NUMBER,
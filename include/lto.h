@@ -0,0 +1,41 @@
+#ifndef LTO_H
+#define LTO_H
+
+#include <llvm-c/Core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Link-time optimization for -flto. Every module is written as bitcode,
+// and the LTO link optimizes the program as a whole before it becomes
+// machine code: full LTO merges all modules into one, while ThinLTO keeps
+// them apart and imports the functions each one calls from the others,
+// guided by the summary written into every module's bitcode.
+typedef enum {
+    LTO_NONE,
+    LTO_FULL,  // -flto, -flto=full
+    LTO_THIN   // -flto=thin
+} LTOMode;
+
+// Writes the module's bitcode, with a ThinLTO summary for LTO_THIN.
+// Returns nonzero and a malloc'd message on failure.
+int write_lto_bitcode(LLVMModuleRef module, const char *path, LTOMode mode,
+                      char **error_message);
+
+// Runs the LTO link over bitcode files and writes the resulting objects
+// next to output_prefix, returning their malloc'd paths. Only main stays
+// visible to the native link. threads limits ThinLTO backends and full LTO
+// code generation partitions (0 picks one per core, or one partition).
+// ThinLTO backends reuse the objects in cache_dir when their inputs are
+// unchanged; cache_dir may be NULL.
+int run_lto(const char *const *inputs, int input_count, LTOMode mode,
+            int optimization_level, int threads, const char *cache_dir,
+            const char *output_prefix, char ***objects, int *object_count,
+            char **error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "codegen.h"
+#include "lexer.h"
+
+// Compiler memory report (--mem-report). Like the time report, statistics
+// are collected into the report installed on the calling thread, and the
+// recording calls do nothing without one. Counts cover the whole
+// compilation, including every imported module compiled along the way.
+
+#define AST_NODE_TYPES (NODE_CONTINUE + 1)
+
+typedef struct {
+    long count;
+    long bytes;  // Nodes with their child arrays and strings
+} AstNodeStats;
+
+typedef struct {
+    // Syntax trees, parsed or loaded from the cache
+    long trees;
+    AstNodeStats nodes[AST_NODE_TYPES];
+    long ast_string_bytes;  // Names, types and literal text held by nodes
+
+    long tokens;
+    long token_bytes;  // Token text
+
+    // Code generators and their symbol tables
+    long code_generators;
+    long symbol_bytes;    // Fixed tables plus the names they own
+    int peak_variables;   // Largest variable table
+    long functions;       // Function table entries
+    int structs;          // Registered struct types
+
+    // LLVM modules as handed to the backend
+    long modules;
+    long llvm_functions;  // With a body
+    long llvm_declarations;
+    long llvm_globals;
+    long llvm_blocks;
+    long llvm_instructions;
+
+    long peak_rss;  // Kilobytes, for the whole process
+} MemReport;
+
+MemReport *create_mem_report(void);
+void free_mem_report(MemReport *report);
+
+// Install a report on the calling thread (NULL stops recording); returns
+// the previous one
+MemReport *set_mem_report(MemReport *report);
+int mem_report_enabled(void);
+
+void record_syntax_tree(const ASTNode *program);
+void record_token(const Token *token);
+void record_symbol_tables(const CodeGen *codegen);
+void record_llvm_module(LLVMModuleRef module);
+
+// Sample peak RSS and the struct registry at the end of a compilation
+void finish_mem_report(MemReport *report);
+void print_mem_report(const MemReport *report, FILE *out, int json);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "codegen.h"
+
+// Parallel code generation
+//
+// `--codegen-threads=N` splits the module into partitions of whole
+// functions, and worker threads optimize and emit one partition at a time,
+// each in its own LLVM context. How the module is split depends only on its
+// contents, never on N, and the partition objects are linked in partition
+// order, so every thread count produces the same executable.
+//
+// Partitions see each other's functions as available_externally bodies,
+// which the optimizer may inline before they become declarations. Internal
+// functions and mutable internal globals are promoted to hidden external
+// symbols, and non-local globals are defined in partition 0 only.
+
+// Emits codegen->module as <base>.<partition>.o using up to `threads`
+// workers. On success returns 0 and stores the malloc'd object paths, in
+// link order, in *paths and their number in *count.
+int write_partitioned_objects(CodeGen *codegen, const char *base, int threads,
+                              char ***paths, int *count);
+
+#endif
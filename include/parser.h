@@ -1,12 +1,25 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <setjmp.h>
 #include "lexer.h"
 #include "ast.h"
+#include "timing.h"
 
 typedef struct {
     Lexer *lexer;
     Token current_token;
+    
+    // Syntax errors are reported and unwind to parse_program(), which
+    // then returns NULL. Nodes under construction at that point are lost.
+    jmp_buf error_jump;
+    int has_error;
+
+    // With --time-report the whole input is lexed up front, in one timed
+    // interval, and the parser takes its tokens from here
+    Token *tokens;
+    int token_count;
+    int token_index;  // Of the token after the current one
 } Parser;
 
 // Parser functions
@@ -17,6 +30,10 @@ void parser_error(Parser *parser, const char *message);
 
 // Parsing functions
 ASTNode *parse_program(Parser *parser);
+// Like parse_program, but statements may appear between the declarations
+// and are added to the program's functions in input order (for the REPL)
+ASTNode *parse_partial_program(Parser *parser);
+char *read_file(const char *filename);
 ASTNode *parse_file(const char *filename);
 ASTNode *parse_import(Parser *parser);
 ASTNode *parse_function_declaration(Parser *parser);
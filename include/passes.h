@@ -0,0 +1,29 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <llvm-c/Error.h>
+#include <llvm-c/TargetMachine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Profile-guided optimization for the default<On> pipelines
+typedef struct {
+    const char *generate;  // Add IR counters that write a raw profile here
+    const char *use;       // Indexed profile to take branch weights from
+} PassProfile;
+
+// Runs a textual pass pipeline, as LLVMRunPasses does, and records every
+// pass in the calling thread's time report and in the trace. The C API has
+// no pass instrumentation or PGO options, so the pipeline is built with
+// LLVM's C++ interface. profile may be NULL.
+LLVMErrorRef run_pass_pipeline(LLVMModuleRef module, const char *passes,
+                               LLVMTargetMachineRef target_machine,
+                               const PassProfile *profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
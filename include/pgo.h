@@ -0,0 +1,19 @@
+#ifndef PGO_H
+#define PGO_H
+
+#include "codegen.h"
+
+// Runtime for --profile-generate. LLVM's PGO instrumentation puts its
+// per-function data, counters and names in the __llvm_prf_data,
+// __llvm_prf_cnts and __llvm_prf_names sections and expects compiler-rt's
+// profile runtime to write them out. Instead, the instrumented module gets
+// a small writer of its own: at exit it copies the three sections, behind
+// a raw profile header, to $LLVM_PROFILE_FILE or the --profile-generate
+// path. Raw profiles are merged into an indexed one with
+// merge_pgo_profiles (profdata.h).
+
+// Add the writer to a module the PGO pipeline instrumented; does nothing
+// unless the code generator has profile_generate set
+void pgo_add_runtime(CodeGen *codegen);
+
+#endif
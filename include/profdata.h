@@ -0,0 +1,18 @@
+#ifndef PROFDATA_H
+#define PROFDATA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Merges raw (.profraw) and indexed (.profdata) PGO profiles into one
+// indexed profile for --profile-use, as llvm-profdata merge does. Returns
+// nonzero and a malloc'd message on failure.
+int merge_pgo_profiles(const char *const *inputs, int input_count,
+                       const char *output, char **error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "codegen.h"
+
+// Function-level profiling for --profile. Every function generated by
+// codegen_function or codegen_struct_method counts its calls and the cycles
+// spent in it (llvm.readcyclecounter) into thread-local counter tables, and
+// call sites between profiled functions count caller-callee pairs. Small
+// leaf functions are left alone to keep the overhead down; their cycles
+// count towards their callers.
+//
+// Each instrumented object registers its tables from a constructor, and the
+// first one to register writes the flat and caller-callee profiles of the
+// thread that exits to $GLOIN_PROFILE (default gloin.prof) from atexit.
+
+// Instrument every function defined in the module; does nothing unless the
+// code generator has profile set. Runs on the optimized module right before
+// emission, so the counters never stop inlining, and functions inlined away
+// count towards their callers.
+void profile_module(CodeGen *codegen);
+
+#endif
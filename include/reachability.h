@@ -0,0 +1,27 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include "ast.h"
+
+// Functions and struct methods reachable from an entry function, across the
+// programs of a whole-program build. Calls are matched by name. Method calls
+// carry no receiver type in the AST, so a call reaches every method of that
+// name, whichever struct declares it.
+typedef struct Reachability {
+    const ASTNode **nodes;  // Reachable NODE_FUNCTION and NODE_STRUCT_METHOD
+    int count;
+    int capacity;
+} Reachability;
+
+// Walk the call graph from every function named entry. Initializers of
+// top-level variables run before main, so with main as the entry what they
+// call is reachable too.
+Reachability *compute_reachability(ASTNode **programs, int program_count,
+                                   const char *entry);
+void free_reachability(Reachability *reachability);
+
+// Whether a function or method node can be called. A NULL reachability
+// reaches everything.
+int is_reachable(const Reachability *reachability, const ASTNode *node);
+
+#endif
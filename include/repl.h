@@ -0,0 +1,30 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include <stdio.h>
+
+// Interactive sessions for `gloinc repl`. Each input, a mix of function,
+// struct and enum definitions, `def` variables and statements, is compiled
+// into a module of its own and added to an in-process JIT that keeps the
+// modules of earlier inputs. Later inputs call earlier functions and use
+// earlier variables, which live as globals for the rest of the session.
+//
+// Defining a name again shadows it from the next input on; code compiled
+// before keeps using the definition it was compiled against. Statements
+// run as soon as their input is compiled, and the value of an expression
+// statement is printed. Only "@std" can be imported.
+typedef struct ReplSession ReplSession;
+
+ReplSession *create_repl_session(void);  // NULL if the JIT cannot start
+void free_repl_session(ReplSession *session);
+
+// Compile and run one input. Returns nonzero after reporting errors, in
+// which case the session is left as it was.
+int repl_eval(ReplSession *session, const char *source);
+
+// Read inputs from a stream until it ends or `:quit` is entered, prompting
+// when it is a terminal. An input continues over lines while it has
+// unclosed braces.
+int run_repl(FILE *input);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include "interp.h"
+
+// Tiered execution for `gloinc run --tiered`. Programs start in the
+// bytecode interpreter; a function whose calls and loop iterations reach
+// the threshold is queued for a background thread, which compiles it with
+// codegen_function at -O2 into an LLVM JIT and swaps the native code into
+// the interpreter's function table. Native code calls functions that are
+// still interpreted through interp_call.
+//
+// Only top-level functions whose parameters and result are integers,
+// bools, strings or pointers are compiled; struct methods and functions
+// taking or returning structs by value keep running in the interpreter,
+// though compiled functions call them natively. A call already running
+// (such as main in its loop) continues natively from the back edge of an
+// outermost loop, through a second entry point that takes the function's
+// variables and runs the loop and the statements after it.
+typedef struct TierCompiler TierCompiler;
+
+#define TIER_DEFAULT_THRESHOLD 1000
+
+// Start tiering a compiled program. Must be called on the thread that
+// compiled it, before interp_run.
+TierCompiler *create_tier_compiler(InterpProgram *program, uint32_t threshold);
+// Stop the background thread and release the JIT; call after interp_run
+void free_tier_compiler(TierCompiler *tier);
+// Functions running as native code so far
+int tier_compiled_count(const TierCompiler *tier);
+
+#endif
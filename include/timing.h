@@ -0,0 +1,77 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compile time report (--time-report). Timings are collected into the report
+// installed on the calling thread; without one, the timing calls do nothing.
+// Phases record work done on each thread, so with --codegen-threads the
+// optimize and emit phases add up the time of every partition.
+
+typedef enum {
+    TIMING_READ,           // read_file
+    TIMING_LOAD_CACHE,     // Cached syntax trees
+    TIMING_LEX,            // The whole input, before parsing it
+    TIMING_PARSE,          // parse_program, without lexing
+    TIMING_RESOLVE_TYPES,
+    TIMING_FOLD_CONSTANTS,
+    TIMING_CODEGEN,        // Per top-level function
+    TIMING_VERIFY,
+    TIMING_OPTIMIZE,       // Per LLVM pass
+    TIMING_EMIT,
+    TIMING_LINK,
+    TIMING_PHASE_COUNT
+} TimingPhase;
+
+typedef struct {
+    double wall;  // Seconds
+    double cpu;   // Seconds of CPU time on the measuring thread
+} TimePoint;
+
+typedef struct {
+    char *name;
+    TimePoint time;
+    long count;
+} TimingEntry;
+
+typedef struct {
+    TimingEntry phases[TIMING_PHASE_COUNT];
+    struct {
+        TimingEntry *entries;  // Functions, passes or partitions
+        int count;
+        int capacity;
+    } details[TIMING_PHASE_COUNT];
+    TimePoint started;
+} TimeReport;
+
+TimeReport *create_time_report(void);
+void free_time_report(TimeReport *report);
+
+// Install a report on the calling thread (NULL stops timing); returns the
+// previous one
+TimeReport *set_time_report(TimeReport *report);
+TimeReport *current_time_report(void);
+int timing_enabled(void);
+
+// Current time, or zero when the thread is not timing
+TimePoint time_now(void);
+TimePoint time_since(TimePoint start);
+
+// Add the time since `start` to a phase and, if given, to one of its details
+void record_time(TimingPhase phase, const char *detail, TimePoint start);
+void add_time(TimingPhase phase, const char *detail, TimePoint elapsed);
+
+const char *timing_phase_name(TimingPhase phase);
+
+void merge_time_report(TimeReport *into, const TimeReport *from);
+void print_time_report(const TimeReport *report, FILE *out, int json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Chrome trace-event output (--trace-out=<file>), viewable in Perfetto or
+// chrome://tracing. Spans from every thread go into one process-wide trace;
+// each thread gets its own timeline, so parallel code generation workers
+// show up side by side. Without an active trace the calls do nothing.
+
+int start_trace(const char *path);
+// Writes the trace file and stops tracing; returns 0 on success
+int finish_trace(void);
+int tracing_enabled(void);
+
+// Name the calling thread's timeline
+void trace_thread_name(const char *name);
+
+// Opens a span: returns its start time, 0 when not tracing
+double trace_begin(void);
+// Closes a span opened by trace_begin. `file` and `function` tag the span
+// and may be NULL.
+void trace_end(double start, const char *category, const char *name,
+               const char *file, const char *function);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -77,10 +77,21 @@ typedef struct StructType {
     int total_size;        // Total size of struct in bytes
 } StructType;
 
-// Global struct registry
-extern StructType *registered_structs;
-extern int struct_count;
-extern int next_struct_type_id;
+// Struct registry. Each compilation session owns one; the struct type
+// functions below operate on the registry installed on the calling thread
+// (a per-thread default when none is installed).
+typedef struct TypeRegistry {
+    StructType *structs;
+    int struct_count;
+    int next_struct_type_id;
+} TypeRegistry;
+
+TypeRegistry *create_type_registry(void);
+void free_type_registry(TypeRegistry *registry);
+void clear_type_registry(TypeRegistry *registry);
+TypeRegistry *current_type_registry(void);
+// Install a registry on the calling thread; returns the previous one
+TypeRegistry *set_type_registry(TypeRegistry *registry);
 
 // Type system functions
 const Type* get_type_info(TypeKind kind);
@@ -3,9 +3,17 @@
 #include "types.h"
 #include <stdio.h>
 
-ASTNode *create_program_node(void) {
+// Nodes start without a source location; the parser sets it
+static ASTNode *new_node(NodeType type) {
   ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_PROGRAM;
+  node->type = type;
+  node->line = 0;
+  node->column = 0;
+  return node;
+}
+
+ASTNode *create_program_node(void) {
+  ASTNode *node = new_node(NODE_PROGRAM);
   node->data.program.imports = NULL;
   node->data.program.functions = NULL;
   node->data.program.import_count = 0;
@@ -14,16 +22,14 @@ ASTNode *create_program_node(void) {
 }
 
 ASTNode *create_import_node(ImportType type, const char *path) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_IMPORT;
+  ASTNode *node = new_node(NODE_IMPORT);
   node->data.import.import_type = type;
   node->data.import.path = strdup(path);
   return node;
 }
 
 ASTNode *create_function_node(const char *name, const char *return_type) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_FUNCTION;
+  ASTNode *node = new_node(NODE_FUNCTION);
   node->data.function.name = strdup(name);
   node->data.function.return_type = strdup(return_type);
   node->data.function.params = NULL;
@@ -33,8 +39,7 @@ ASTNode *create_function_node(const char *name, const char *return_type) {
 }
 
 ASTNode *create_parameter_node(const char *name, const char *type) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_PARAMETER;
+  ASTNode *node = new_node(NODE_PARAMETER);
   node->data.parameter.name = strdup(name);
   node->data.parameter.type = strdup(type);
   node->data.parameter.resolved_type = string_to_type(type);
@@ -43,8 +48,7 @@ ASTNode *create_parameter_node(const char *name, const char *type) {
 
 ASTNode *create_variable_decl_node(const char *name, const char *type,
                                    ASTNode *value, int is_mutable) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_VARIABLE_DECL;
+  ASTNode *node = new_node(NODE_VARIABLE_DECL);
   node->data.variable_decl.name = strdup(name);
   node->data.variable_decl.type = strdup(type);
   node->data.variable_decl.value = value;
@@ -54,31 +58,27 @@ ASTNode *create_variable_decl_node(const char *name, const char *type,
 }
 
 ASTNode *create_assignment_node(const char *variable_name, ASTNode *value) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_ASSIGNMENT;
+  ASTNode *node = new_node(NODE_ASSIGNMENT);
   node->data.assignment.variable_name = strdup(variable_name);
   node->data.assignment.value = value;
   return node;
 }
 
 ASTNode *create_pointer_assignment_node(ASTNode *target, ASTNode *value) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_POINTER_ASSIGNMENT;
+  ASTNode *node = new_node(NODE_POINTER_ASSIGNMENT);
   node->data.pointer_assignment.target = target;
   node->data.pointer_assignment.value = value;
   return node;
 }
 
 ASTNode *create_return_node(ASTNode *value) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_RETURN;
+  ASTNode *node = new_node(NODE_RETURN);
   node->data.return_stmt.value = value;
   return node;
 }
 
 ASTNode *create_call_node(const char *name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_CALL;
+  ASTNode *node = new_node(NODE_CALL);
   node->data.call.name = strdup(name);
   node->data.call.args = NULL;
   node->data.call.arg_count = 0;
@@ -86,16 +86,14 @@ ASTNode *create_call_node(const char *name) {
 }
 
 ASTNode *create_identifier_node(const char *name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_IDENTIFIER;
+  ASTNode *node = new_node(NODE_IDENTIFIER);
   node->data.identifier.name = strdup(name);
   node->data.identifier.resolved_type = TYPE_UNKNOWN; // Will be resolved later
   return node;
 }
 
 ASTNode *create_literal_node(const char *value, const char *type) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_LITERAL;
+  ASTNode *node = new_node(NODE_LITERAL);
   node->data.literal.value = strdup(value);
   node->data.literal.type = strdup(type);
   node->data.literal.resolved_type = string_to_type(type);
@@ -104,8 +102,7 @@ ASTNode *create_literal_node(const char *value, const char *type) {
 
 ASTNode *create_binary_op_node(BinaryOperator operator, ASTNode *left,
                                ASTNode *right) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_BINARY_OP;
+  ASTNode *node = new_node(NODE_BINARY_OP);
   node->data.binary_op.operator = operator;
   node->data.binary_op.left = left;
   node->data.binary_op.right = right;
@@ -114,8 +111,7 @@ ASTNode *create_binary_op_node(BinaryOperator operator, ASTNode *left,
 }
 
 ASTNode *create_unary_op_node(UnaryOperator operator, ASTNode *operand) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_UNARY_OP;
+  ASTNode *node = new_node(NODE_UNARY_OP);
   node->data.unary_op.operator = operator;
   node->data.unary_op.operand = operand;
   node->data.unary_op.resolved_type = TYPE_UNKNOWN; // Will be resolved later
@@ -123,16 +119,14 @@ ASTNode *create_unary_op_node(UnaryOperator operator, ASTNode *operand) {
 }
 
 ASTNode *create_block_node(void) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_BLOCK;
+  ASTNode *node = new_node(NODE_BLOCK);
   node->data.block.statements = NULL;
   node->data.block.statement_count = 0;
   return node;
 }
 
 ASTNode *create_struct_node(const char *name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_STRUCT;
+  ASTNode *node = new_node(NODE_STRUCT);
   node->data.struct_decl.name = strdup(name);
   node->data.struct_decl.fields = NULL;
   node->data.struct_decl.methods = NULL;
@@ -142,8 +136,7 @@ ASTNode *create_struct_node(const char *name) {
 }
 
 ASTNode *create_struct_field_node(const char *name, const char *type) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_STRUCT_FIELD;
+  ASTNode *node = new_node(NODE_STRUCT_FIELD);
   node->data.struct_field.name = strdup(name);
   node->data.struct_field.type = strdup(type);
   node->data.struct_field.resolved_type = TYPE_UNKNOWN;
@@ -152,8 +145,7 @@ ASTNode *create_struct_field_node(const char *name, const char *type) {
 
 ASTNode *create_struct_method_node(const char *name, const char *return_type,
                                    Visibility visibility) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_STRUCT_METHOD;
+  ASTNode *node = new_node(NODE_STRUCT_METHOD);
   node->data.struct_method.name = strdup(name);
   node->data.struct_method.return_type = strdup(return_type);
   node->data.struct_method.params = NULL;
@@ -164,8 +156,7 @@ ASTNode *create_struct_method_node(const char *name, const char *return_type,
 }
 
 ASTNode *create_field_access_node(ASTNode *object, const char *field_name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_FIELD_ACCESS;
+  ASTNode *node = new_node(NODE_FIELD_ACCESS);
   node->data.field_access.object = object;
   node->data.field_access.field_name = strdup(field_name);
   node->data.field_access.resolved_type = TYPE_UNKNOWN;
@@ -173,8 +164,7 @@ ASTNode *create_field_access_node(ASTNode *object, const char *field_name) {
 }
 
 ASTNode *create_method_call_node(ASTNode *object, const char *method_name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_METHOD_CALL;
+  ASTNode *node = new_node(NODE_METHOD_CALL);
   node->data.method_call.object = object;
   node->data.method_call.method_name = strdup(method_name);
   node->data.method_call.args = NULL;
@@ -184,8 +174,7 @@ ASTNode *create_method_call_node(ASTNode *object, const char *method_name) {
 }
 
 ASTNode *create_struct_literal_node(const char *struct_type_name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_STRUCT_LITERAL;
+  ASTNode *node = new_node(NODE_STRUCT_LITERAL);
   node->data.struct_literal.struct_type_name = strdup(struct_type_name);
   node->data.struct_literal.field_values = NULL;
   node->data.struct_literal.field_names = NULL;
@@ -195,8 +184,7 @@ ASTNode *create_struct_literal_node(const char *struct_type_name) {
 }
 
 ASTNode *create_enum_node(const char *name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_ENUM;
+  ASTNode *node = new_node(NODE_ENUM);
   node->data.enum_decl.name = strdup(name);
   node->data.enum_decl.variants = NULL;
   node->data.enum_decl.variant_count = 0;
@@ -204,16 +192,14 @@ ASTNode *create_enum_node(const char *name) {
 }
 
 ASTNode *create_enum_variant_node(const char *name) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_ENUM_VARIANT;
+  ASTNode *node = new_node(NODE_ENUM_VARIANT);
   node->data.enum_variant.name = strdup(name);
   return node;
 }
 
 ASTNode *create_if_node(ASTNode *condition, ASTNode *then_block,
                         ASTNode *else_block) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_IF;
+  ASTNode *node = new_node(NODE_IF);
   node->data.if_stmt.condition = condition;
   node->data.if_stmt.then_block = then_block;
   node->data.if_stmt.else_block = else_block;
@@ -222,8 +208,7 @@ ASTNode *create_if_node(ASTNode *condition, ASTNode *then_block,
 
 ASTNode *create_unless_node(ASTNode *condition, ASTNode *then_block,
                             ASTNode *else_block) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_UNLESS;
+  ASTNode *node = new_node(NODE_UNLESS);
   node->data.unless_stmt.condition = condition;
   node->data.unless_stmt.then_block = then_block;
   node->data.unless_stmt.else_block = else_block;
@@ -232,8 +217,7 @@ ASTNode *create_unless_node(ASTNode *condition, ASTNode *then_block,
 
 ASTNode *create_for_node(ASTNode *init, ASTNode *condition, ASTNode *update,
                          ASTNode *body) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_FOR;
+  ASTNode *node = new_node(NODE_FOR);
   node->data.for_stmt.init = init;
   node->data.for_stmt.condition = condition;
   node->data.for_stmt.update = update;
@@ -242,16 +226,14 @@ ASTNode *create_for_node(ASTNode *init, ASTNode *condition, ASTNode *update,
 }
 
 ASTNode *create_while_node(ASTNode *condition, ASTNode *body) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_WHILE;
+  ASTNode *node = new_node(NODE_WHILE);
   node->data.while_stmt.condition = condition;
   node->data.while_stmt.body = body;
   return node;
 }
 
 ASTNode *create_switch_node(ASTNode *expression) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_SWITCH;
+  ASTNode *node = new_node(NODE_SWITCH);
   node->data.switch_stmt.expression = expression;
   node->data.switch_stmt.cases = NULL;
   node->data.switch_stmt.case_count = 0;
@@ -260,8 +242,7 @@ ASTNode *create_switch_node(ASTNode *expression) {
 }
 
 ASTNode *create_switch_case_node(ASTNode *value) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_SWITCH_CASE;
+  ASTNode *node = new_node(NODE_SWITCH_CASE);
   node->data.switch_case.value = value;
   node->data.switch_case.statements = NULL;
   node->data.switch_case.statement_count = 0;
@@ -269,8 +250,7 @@ ASTNode *create_switch_case_node(ASTNode *value) {
 }
 
 ASTNode *create_match_node(ASTNode *expression) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_MATCH;
+  ASTNode *node = new_node(NODE_MATCH);
   node->data.match_stmt.expression = expression;
   node->data.match_stmt.cases = NULL;
   node->data.match_stmt.case_count = 0;
@@ -278,22 +258,19 @@ ASTNode *create_match_node(ASTNode *expression) {
 }
 
 ASTNode *create_match_case_node(ASTNode *pattern, ASTNode *body) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_MATCH_CASE;
+  ASTNode *node = new_node(NODE_MATCH_CASE);
   node->data.match_case.pattern = pattern;
   node->data.match_case.body = body;
   return node;
 }
 
 ASTNode *create_break_node(void) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_BREAK;
+  ASTNode *node = new_node(NODE_BREAK);
   return node;
 }
 
 ASTNode *create_continue_node(void) {
-  ASTNode *node = malloc(sizeof(ASTNode));
-  node->type = NODE_CONTINUE;
+  ASTNode *node = new_node(NODE_CONTINUE);
   return node;
 }
 
@@ -434,6 +411,15 @@ void set_switch_default(ASTNode *switch_stmt, ASTNode *default_case) {
   switch_stmt->data.switch_stmt.default_case = default_case;
 }
 
+// Keeps a location already set, so a node built from an inner construct
+// (an expression statement is its call) reports where that construct began
+void set_node_location(ASTNode *node, int line, int column) {
+  if (node && node->line == 0) {
+    node->line = line;
+    node->column = column;
+  }
+}
+
 void free_ast_node(ASTNode *node) {
   if (!node)
     return;
@@ -553,6 +539,16 @@ void free_ast_node(ASTNode *node) {
     free(node->data.struct_literal.field_values);
     free(node->data.struct_literal.field_names);
     break;
+  case NODE_ENUM:
+    free(node->data.enum_decl.name);
+    for (int i = 0; i < node->data.enum_decl.variant_count; i++) {
+      free_ast_node(node->data.enum_decl.variants[i]);
+    }
+    free(node->data.enum_decl.variants);
+    break;
+  case NODE_ENUM_VARIANT:
+    free(node->data.enum_variant.name);
+    break;
   case NODE_IF:
     free_ast_node(node->data.if_stmt.condition);
     free_ast_node(node->data.if_stmt.then_block);
@@ -0,0 +1,966 @@
+#include "astcache.h"
+#include "interface.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Deeper trees are not cached; the loader rejects them as well, which
+// bounds its recursion on hostile input
+#define AST_CACHE_MAX_DEPTH 4096
+
+#define AST_CACHE_ENDIAN_MARK 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t endian;
+    uint32_t version;
+    uint64_t source_size;
+    uint64_t source_hash;
+    uint64_t checksum;      // Hash of everything after the header
+    uint32_t node_count;
+    uint32_t node_offset;
+    uint32_t index_count;
+    uint32_t index_offset;
+    uint32_t string_size;
+    uint32_t string_offset;
+    uint32_t root;          // Index of the program node
+    uint32_t reserved;
+    uint64_t compiler_id;   // compiler_build_id() of the writer
+} CacheHeader;
+
+// One record per node. Which slots are used depends on the node type:
+// str[] are string offsets, kid[] are node references and list[]/count[]
+// describe ranges of the index array. A reference of 0 means NULL;
+// otherwise it is the node index plus one.
+typedef struct {
+    uint16_t type;
+    uint16_t small;  // Operator, import type or visibility
+    int32_t ival;    // Variable mutability
+    int32_t line;    // Source location
+    int32_t column;
+    uint32_t str[3];
+    uint32_t kid[4];
+    uint32_t list[2];
+    uint32_t count[2];
+} CachedNode;
+
+// Writer
+
+typedef struct {
+    CachedNode *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t *index;
+    uint32_t index_count;
+    uint32_t index_capacity;
+    char *strings;
+    uint32_t string_size;
+    uint32_t string_capacity;
+    int failed;
+} CacheWriter;
+
+static uint32_t put_string(CacheWriter *w, const char *str) {
+    if (!str) {
+        return 0;
+    }
+    uint32_t len = (uint32_t)strlen(str) + 1;
+    if (w->string_size + len > w->string_capacity) {
+        w->string_capacity = (w->string_size + len) * 2;
+        w->strings = realloc(w->strings, w->string_capacity);
+    }
+    uint32_t offset = w->string_size;
+    memcpy(w->strings + offset, str, len);
+    w->string_size += len;
+    return offset;
+}
+
+static uint32_t put_node(CacheWriter *w, ASTNode *node, int depth);
+
+// Append a child list to the index array; returns its offset
+static uint32_t put_list(CacheWriter *w, ASTNode **nodes, int count, int depth) {
+    uint32_t *refs = malloc((count ? count : 1) * sizeof(uint32_t));
+    for (int i = 0; i < count; i++) {
+        refs[i] = put_node(w, nodes[i], depth + 1);
+    }
+    if (w->index_count + count > w->index_capacity) {
+        w->index_capacity = (w->index_count + count) * 2 + 16;
+        w->index = realloc(w->index, w->index_capacity * sizeof(uint32_t));
+    }
+    uint32_t offset = w->index_count;
+    memcpy(w->index + offset, refs, count * sizeof(uint32_t));
+    w->index_count += count;
+    free(refs);
+    return offset;
+}
+
+static uint32_t put_node(CacheWriter *w, ASTNode *node, int depth) {
+    if (!node || w->failed) {
+        return 0;
+    }
+    if (depth > AST_CACHE_MAX_DEPTH) {
+        w->failed = 1;
+        return 0;
+    }
+
+    // Reserve the slot first so that nodes are laid out in pre-order
+    if (w->node_count == w->node_capacity) {
+        w->node_capacity = w->node_capacity ? w->node_capacity * 2 : 64;
+        w->nodes = realloc(w->nodes, w->node_capacity * sizeof(CachedNode));
+    }
+    uint32_t idx = w->node_count++;
+
+    CachedNode rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = (uint16_t)node->type;
+    rec.line = node->line;
+    rec.column = node->column;
+
+    switch (node->type) {
+    case NODE_PROGRAM:
+        rec.count[0] = node->data.program.import_count;
+        rec.list[0] = put_list(w, node->data.program.imports, rec.count[0], depth);
+        rec.count[1] = node->data.program.function_count;
+        rec.list[1] = put_list(w, node->data.program.functions, rec.count[1], depth);
+        break;
+    case NODE_IMPORT:
+        rec.small = (uint16_t)node->data.import.import_type;
+        rec.str[0] = put_string(w, node->data.import.path);
+        break;
+    case NODE_FUNCTION:
+        rec.str[0] = put_string(w, node->data.function.name);
+        rec.str[1] = put_string(w, node->data.function.return_type);
+        rec.count[0] = node->data.function.param_count;
+        rec.list[0] = put_list(w, node->data.function.params, rec.count[0], depth);
+        rec.kid[0] = put_node(w, node->data.function.body, depth + 1);
+        break;
+    case NODE_PARAMETER:
+        rec.str[0] = put_string(w, node->data.parameter.name);
+        rec.str[1] = put_string(w, node->data.parameter.type);
+        break;
+    case NODE_VARIABLE_DECL:
+        rec.str[0] = put_string(w, node->data.variable_decl.name);
+        rec.str[1] = put_string(w, node->data.variable_decl.type);
+        rec.ival = node->data.variable_decl.is_mutable;
+        rec.kid[0] = put_node(w, node->data.variable_decl.value, depth + 1);
+        break;
+    case NODE_ASSIGNMENT:
+        rec.str[0] = put_string(w, node->data.assignment.variable_name);
+        rec.kid[0] = put_node(w, node->data.assignment.value, depth + 1);
+        break;
+    case NODE_POINTER_ASSIGNMENT:
+        rec.kid[0] = put_node(w, node->data.pointer_assignment.target, depth + 1);
+        rec.kid[1] = put_node(w, node->data.pointer_assignment.value, depth + 1);
+        break;
+    case NODE_RETURN:
+        rec.kid[0] = put_node(w, node->data.return_stmt.value, depth + 1);
+        break;
+    case NODE_CALL:
+        rec.str[0] = put_string(w, node->data.call.name);
+        rec.count[0] = node->data.call.arg_count;
+        rec.list[0] = put_list(w, node->data.call.args, rec.count[0], depth);
+        break;
+    case NODE_IDENTIFIER:
+        rec.str[0] = put_string(w, node->data.identifier.name);
+        break;
+    case NODE_LITERAL:
+        rec.str[0] = put_string(w, node->data.literal.value);
+        rec.str[1] = put_string(w, node->data.literal.type);
+        break;
+    case NODE_BINARY_OP:
+        rec.small = (uint16_t)node->data.binary_op.operator;
+        rec.kid[0] = put_node(w, node->data.binary_op.left, depth + 1);
+        rec.kid[1] = put_node(w, node->data.binary_op.right, depth + 1);
+        break;
+    case NODE_UNARY_OP:
+        rec.small = (uint16_t)node->data.unary_op.operator;
+        rec.kid[0] = put_node(w, node->data.unary_op.operand, depth + 1);
+        break;
+    case NODE_BLOCK:
+        rec.count[0] = node->data.block.statement_count;
+        rec.list[0] = put_list(w, node->data.block.statements, rec.count[0], depth);
+        break;
+    case NODE_STRUCT:
+        rec.str[0] = put_string(w, node->data.struct_decl.name);
+        rec.count[0] = node->data.struct_decl.field_count;
+        rec.list[0] = put_list(w, node->data.struct_decl.fields, rec.count[0], depth);
+        rec.count[1] = node->data.struct_decl.method_count;
+        rec.list[1] = put_list(w, node->data.struct_decl.methods, rec.count[1], depth);
+        break;
+    case NODE_STRUCT_FIELD:
+        rec.str[0] = put_string(w, node->data.struct_field.name);
+        rec.str[1] = put_string(w, node->data.struct_field.type);
+        break;
+    case NODE_STRUCT_METHOD:
+        rec.small = (uint16_t)node->data.struct_method.visibility;
+        rec.str[0] = put_string(w, node->data.struct_method.name);
+        rec.str[1] = put_string(w, node->data.struct_method.return_type);
+        rec.count[0] = node->data.struct_method.param_count;
+        rec.list[0] = put_list(w, node->data.struct_method.params, rec.count[0], depth);
+        rec.kid[0] = put_node(w, node->data.struct_method.body, depth + 1);
+        break;
+    case NODE_FIELD_ACCESS:
+        rec.kid[0] = put_node(w, node->data.field_access.object, depth + 1);
+        rec.str[0] = put_string(w, node->data.field_access.field_name);
+        break;
+    case NODE_METHOD_CALL:
+        rec.kid[0] = put_node(w, node->data.method_call.object, depth + 1);
+        rec.str[0] = put_string(w, node->data.method_call.method_name);
+        rec.count[0] = node->data.method_call.arg_count;
+        rec.list[0] = put_list(w, node->data.method_call.args, rec.count[0], depth);
+        break;
+    case NODE_STRUCT_LITERAL: {
+        int count = node->data.struct_literal.field_count;
+        rec.str[0] = put_string(w, node->data.struct_literal.struct_type_name);
+        rec.count[0] = count;
+        rec.list[0] = put_list(w, node->data.struct_literal.field_values, count, depth);
+        // Field names are string offsets stored in the index array
+        uint32_t *names = malloc((count ? count : 1) * sizeof(uint32_t));
+        for (int i = 0; i < count; i++) {
+            names[i] = put_string(w, node->data.struct_literal.field_names[i]);
+        }
+        if (w->index_count + count > w->index_capacity) {
+            w->index_capacity = (w->index_count + count) * 2 + 16;
+            w->index = realloc(w->index, w->index_capacity * sizeof(uint32_t));
+        }
+        rec.list[1] = w->index_count;
+        rec.count[1] = count;
+        memcpy(w->index + w->index_count, names, count * sizeof(uint32_t));
+        w->index_count += count;
+        free(names);
+        break;
+    }
+    case NODE_ENUM:
+        rec.str[0] = put_string(w, node->data.enum_decl.name);
+        rec.count[0] = node->data.enum_decl.variant_count;
+        rec.list[0] = put_list(w, node->data.enum_decl.variants, rec.count[0], depth);
+        break;
+    case NODE_ENUM_VARIANT:
+        rec.str[0] = put_string(w, node->data.enum_variant.name);
+        break;
+    case NODE_IF:
+        rec.kid[0] = put_node(w, node->data.if_stmt.condition, depth + 1);
+        rec.kid[1] = put_node(w, node->data.if_stmt.then_block, depth + 1);
+        rec.kid[2] = put_node(w, node->data.if_stmt.else_block, depth + 1);
+        break;
+    case NODE_UNLESS:
+        rec.kid[0] = put_node(w, node->data.unless_stmt.condition, depth + 1);
+        rec.kid[1] = put_node(w, node->data.unless_stmt.then_block, depth + 1);
+        rec.kid[2] = put_node(w, node->data.unless_stmt.else_block, depth + 1);
+        break;
+    case NODE_FOR:
+        rec.kid[0] = put_node(w, node->data.for_stmt.init, depth + 1);
+        rec.kid[1] = put_node(w, node->data.for_stmt.condition, depth + 1);
+        rec.kid[2] = put_node(w, node->data.for_stmt.update, depth + 1);
+        rec.kid[3] = put_node(w, node->data.for_stmt.body, depth + 1);
+        break;
+    case NODE_WHILE:
+        rec.kid[0] = put_node(w, node->data.while_stmt.condition, depth + 1);
+        rec.kid[1] = put_node(w, node->data.while_stmt.body, depth + 1);
+        break;
+    case NODE_SWITCH:
+        rec.kid[0] = put_node(w, node->data.switch_stmt.expression, depth + 1);
+        rec.count[0] = node->data.switch_stmt.case_count;
+        rec.list[0] = put_list(w, node->data.switch_stmt.cases, rec.count[0], depth);
+        rec.kid[1] = put_node(w, node->data.switch_stmt.default_case, depth + 1);
+        break;
+    case NODE_SWITCH_CASE:
+        rec.kid[0] = put_node(w, node->data.switch_case.value, depth + 1);
+        rec.count[0] = node->data.switch_case.statement_count;
+        rec.list[0] = put_list(w, node->data.switch_case.statements, rec.count[0], depth);
+        break;
+    case NODE_MATCH:
+        rec.kid[0] = put_node(w, node->data.match_stmt.expression, depth + 1);
+        rec.count[0] = node->data.match_stmt.case_count;
+        rec.list[0] = put_list(w, node->data.match_stmt.cases, rec.count[0], depth);
+        break;
+    case NODE_MATCH_CASE:
+        rec.kid[0] = put_node(w, node->data.match_case.pattern, depth + 1);
+        rec.kid[1] = put_node(w, node->data.match_case.body, depth + 1);
+        break;
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        break;
+    }
+
+    w->nodes[idx] = rec;
+    return idx + 1;
+}
+
+int write_ast_cache(ASTNode *program, const char *path,
+                    uint64_t source_hash, uint64_t source_size) {
+    CacheWriter w;
+    memset(&w, 0, sizeof(w));
+    put_string(&w, "");  // Offset 0 is reserved for NULL
+
+    uint32_t root = put_node(&w, program, 0);
+    if (w.failed || root == 0) {
+        free(w.nodes);
+        free(w.index);
+        free(w.strings);
+        return 1;
+    }
+
+    // Layout: header, nodes, index array, strings; sections 8-byte aligned
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GLOIN_AST_CACHE_MAGIC, sizeof(header.magic));
+    header.endian = AST_CACHE_ENDIAN_MARK;
+    header.version = GLOIN_AST_CACHE_VERSION;
+    header.source_size = source_size;
+    header.source_hash = source_hash;
+    header.node_count = w.node_count;
+    header.node_offset = sizeof(CacheHeader);
+    header.index_count = w.index_count;
+    header.index_offset =
+        (header.node_offset + w.node_count * sizeof(CachedNode) + 7) & ~7u;
+    header.string_size = w.string_size;
+    header.string_offset =
+        (header.index_offset + w.index_count * sizeof(uint32_t) + 7) & ~7u;
+    header.root = root - 1;
+    header.compiler_id = compiler_build_id();
+
+    size_t size = header.string_offset + w.string_size;
+    unsigned char *image = calloc(1, size);
+    memcpy(image + header.node_offset, w.nodes, w.node_count * sizeof(CachedNode));
+    memcpy(image + header.index_offset, w.index, w.index_count * sizeof(uint32_t));
+    memcpy(image + header.string_offset, w.strings, w.string_size);
+    header.checksum = hash_bytes(image + sizeof(CacheHeader),
+                                 size - sizeof(CacheHeader), 0);
+    memcpy(image, &header, sizeof(header));
+
+    free(w.nodes);
+    free(w.index);
+    free(w.strings);
+
+    // Write to a temporary file and rename it into place
+    char *tmp_path = temporary_path(path);
+    FILE *file = fopen(tmp_path, "wb");
+    int failed = !file;
+    if (file) {
+        failed |= fwrite(image, 1, size, file) != size;
+        failed |= fclose(file) != 0;
+    }
+    if (!failed) {
+        failed = rename(tmp_path, path) != 0;
+    }
+    if (failed) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    free(image);
+    return failed;
+}
+
+// Loader
+
+typedef struct {
+    const CachedNode *nodes;
+    uint32_t node_count;
+    const uint32_t *index;
+    uint32_t index_count;
+    const char *strings;
+    uint32_t string_size;
+    unsigned char *used;  // Each record may be referenced exactly once
+    int failed;
+} CacheReader;
+
+// What a child slot may hold
+typedef enum {
+    EXPECT_EXPRESSION,  // Anything codegen_expression accepts
+    EXPECT_STATEMENT,   // Anything codegen_statement accepts
+    EXPECT_TOP_LEVEL,   // Program-level declarations
+    EXPECT_EXACT        // Exactly the given node type
+} Expectation;
+
+static int is_expression_type(NodeType type) {
+    switch (type) {
+    case NODE_LITERAL:
+    case NODE_IDENTIFIER:
+    case NODE_BINARY_OP:
+    case NODE_UNARY_OP:
+    case NODE_CALL:
+    case NODE_FIELD_ACCESS:
+    case NODE_METHOD_CALL:
+    case NODE_STRUCT_LITERAL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_statement_type(NodeType type) {
+    switch (type) {
+    case NODE_VARIABLE_DECL:
+    case NODE_ASSIGNMENT:
+    case NODE_POINTER_ASSIGNMENT:
+    case NODE_RETURN:
+    case NODE_BLOCK:
+    case NODE_IF:
+    case NODE_UNLESS:
+    case NODE_FOR:
+    case NODE_WHILE:
+    case NODE_SWITCH:
+    case NODE_MATCH:
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        return 1;
+    default:
+        return is_expression_type(type);
+    }
+}
+
+static const char *get_string(CacheReader *r, uint32_t offset) {
+    // The blob is NUL-terminated, so any in-range offset is a valid string
+    if (offset == 0 || offset >= r->string_size) {
+        r->failed = 1;
+        return NULL;
+    }
+    return r->strings + offset;
+}
+
+static int check_list(CacheReader *r, uint32_t offset, uint32_t count) {
+    if (offset > r->index_count || count > r->index_count - offset) {
+        r->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static ASTNode *load_node(CacheReader *r, uint32_t ref, uint32_t parent,
+                          int depth, int required, Expectation expect,
+                          NodeType exact);
+
+#define LOAD(ref, required, expect, exact) \
+    load_node(r, (ref), idx, depth + 1, (required), (expect), (exact))
+
+// Strings required by the create_* constructors
+#define STR(i) get_string(r, rec->str[i])
+
+static ASTNode *load_node(CacheReader *r, uint32_t ref, uint32_t parent,
+                          int depth, int required, Expectation expect,
+                          NodeType exact) {
+    if (r->failed) {
+        return NULL;
+    }
+    if (ref == 0) {
+        r->failed |= required;
+        return NULL;
+    }
+
+    uint32_t idx = ref - 1;
+    // Children always follow their parent, which rules out cycles
+    if (idx >= r->node_count || (parent != UINT32_MAX && idx <= parent) ||
+        r->used[idx] || depth > AST_CACHE_MAX_DEPTH) {
+        r->failed = 1;
+        return NULL;
+    }
+    r->used[idx] = 1;
+
+    const CachedNode *rec = &r->nodes[idx];
+    NodeType type = (NodeType)rec->type;
+    if (rec->type > NODE_CONTINUE ||
+        (expect == EXPECT_EXACT && type != exact) ||
+        (expect == EXPECT_EXPRESSION && !is_expression_type(type)) ||
+        (expect == EXPECT_STATEMENT && !is_statement_type(type)) ||
+        (expect == EXPECT_TOP_LEVEL && type != NODE_FUNCTION &&
+         type != NODE_STRUCT && type != NODE_ENUM && type != NODE_VARIABLE_DECL)) {
+        r->failed = 1;
+        return NULL;
+    }
+
+    // Validate strings and list ranges before building anything
+    for (int i = 0; i < 2; i++) {
+        if (rec->count[i] && !check_list(r, rec->list[i], rec->count[i])) {
+            return NULL;
+        }
+    }
+
+    ASTNode *node = NULL;
+    switch (type) {
+    case NODE_PROGRAM: {
+        if (parent != UINT32_MAX) {
+            r->failed = 1;
+            return NULL;
+        }
+        node = create_program_node();
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *import = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_IMPORT);
+            if (import) add_import_to_program(node, import);
+        }
+        for (uint32_t i = 0; i < rec->count[1] && !r->failed; i++) {
+            ASTNode *decl = LOAD(r->index[rec->list[1] + i], 1, EXPECT_TOP_LEVEL, 0);
+            if (decl) add_function_to_program(node, decl);
+        }
+        break;
+    }
+    case NODE_IMPORT: {
+        const char *path = STR(0);
+        if (!path || rec->small > IMPORT_LOCAL) {
+            r->failed = 1;
+            return NULL;
+        }
+        node = create_import_node((ImportType)rec->small, path);
+        break;
+    }
+    case NODE_FUNCTION: {
+        const char *name = STR(0), *return_type = STR(1);
+        if (!name || !return_type) return NULL;
+        node = create_function_node(name, return_type);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *param = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_PARAMETER);
+            if (param) add_parameter_to_function(node, param);
+        }
+        node->data.function.body = LOAD(rec->kid[0], 0, EXPECT_EXACT, NODE_BLOCK);
+        break;
+    }
+    case NODE_PARAMETER: {
+        const char *name = STR(0), *param_type = STR(1);
+        if (!name || !param_type) return NULL;
+        node = create_parameter_node(name, param_type);
+        break;
+    }
+    case NODE_VARIABLE_DECL: {
+        const char *name = STR(0), *var_type = STR(1);
+        if (!name || !var_type || rec->ival < -1 || rec->ival > 1) {
+            r->failed = 1;
+            return NULL;
+        }
+        ASTNode *value = LOAD(rec->kid[0], 0, EXPECT_EXPRESSION, 0);
+        node = create_variable_decl_node(name, var_type, value, rec->ival);
+        break;
+    }
+    case NODE_ASSIGNMENT: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_assignment_node(name, LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0));
+        break;
+    }
+    case NODE_POINTER_ASSIGNMENT: {
+        ASTNode *target = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        ASTNode *value = LOAD(rec->kid[1], 1, EXPECT_EXPRESSION, 0);
+        node = create_pointer_assignment_node(target, value);
+        break;
+    }
+    case NODE_RETURN:
+        node = create_return_node(LOAD(rec->kid[0], 0, EXPECT_EXPRESSION, 0));
+        break;
+    case NODE_CALL: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_call_node(name);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *arg = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXPRESSION, 0);
+            if (arg) add_arg_to_call(node, arg);
+        }
+        break;
+    }
+    case NODE_IDENTIFIER: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_identifier_node(name);
+        break;
+    }
+    case NODE_LITERAL: {
+        const char *value = STR(0), *literal_type = STR(1);
+        if (!value || !literal_type) return NULL;
+        node = create_literal_node(value, literal_type);
+        break;
+    }
+    case NODE_BINARY_OP: {
+        if (rec->small > OP_GE) {
+            r->failed = 1;
+            return NULL;
+        }
+        ASTNode *left = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        ASTNode *right = LOAD(rec->kid[1], 1, EXPECT_EXPRESSION, 0);
+        node = create_binary_op_node((BinaryOperator)rec->small, left, right);
+        break;
+    }
+    case NODE_UNARY_OP:
+        if (rec->small > UNARY_DEREFERENCE) {
+            r->failed = 1;
+            return NULL;
+        }
+        node = create_unary_op_node((UnaryOperator)rec->small,
+                                    LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0));
+        break;
+    case NODE_BLOCK:
+        node = create_block_node();
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *statement = LOAD(r->index[rec->list[0] + i], 1, EXPECT_STATEMENT, 0);
+            if (statement) add_statement_to_block(node, statement);
+        }
+        break;
+    case NODE_STRUCT: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_struct_node(name);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *field = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_STRUCT_FIELD);
+            if (field) add_field_to_struct(node, field);
+        }
+        for (uint32_t i = 0; i < rec->count[1] && !r->failed; i++) {
+            ASTNode *method = LOAD(r->index[rec->list[1] + i], 1, EXPECT_EXACT, NODE_STRUCT_METHOD);
+            if (method) add_method_to_struct(node, method);
+        }
+        break;
+    }
+    case NODE_STRUCT_FIELD: {
+        const char *name = STR(0), *field_type = STR(1);
+        if (!name || !field_type) return NULL;
+        node = create_struct_field_node(name, field_type);
+        break;
+    }
+    case NODE_STRUCT_METHOD: {
+        const char *name = STR(0), *return_type = STR(1);
+        if (!name || !return_type || rec->small > VISIBILITY_PRIVATE) {
+            r->failed = 1;
+            return NULL;
+        }
+        node = create_struct_method_node(name, return_type, (Visibility)rec->small);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *param = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_PARAMETER);
+            if (param) add_parameter_to_struct_method(node, param);
+        }
+        node->data.struct_method.body = LOAD(rec->kid[0], 0, EXPECT_EXACT, NODE_BLOCK);
+        break;
+    }
+    case NODE_FIELD_ACCESS: {
+        ASTNode *object = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        const char *field_name = STR(0);
+        if (!field_name) {
+            free_ast_node(object);
+            return NULL;
+        }
+        node = create_field_access_node(object, field_name);
+        break;
+    }
+    case NODE_METHOD_CALL: {
+        ASTNode *object = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        const char *method_name = STR(0);
+        if (!method_name) {
+            free_ast_node(object);
+            return NULL;
+        }
+        node = create_method_call_node(object, method_name);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *arg = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXPRESSION, 0);
+            if (arg) add_arg_to_method_call(node, arg);
+        }
+        break;
+    }
+    case NODE_STRUCT_LITERAL: {
+        const char *name = STR(0);
+        if (!name || rec->count[0] != rec->count[1]) {
+            r->failed = 1;
+            return NULL;
+        }
+        node = create_struct_literal_node(name);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            const char *field_name = get_string(r, r->index[rec->list[1] + i]);
+            ASTNode *value = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXPRESSION, 0);
+            if (field_name && value) {
+                add_field_to_struct_literal(node, field_name, value);
+            } else {
+                free_ast_node(value);
+            }
+        }
+        break;
+    }
+    case NODE_ENUM: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_enum_node(name);
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *variant = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_ENUM_VARIANT);
+            if (variant) add_enum_variant(node, variant);
+        }
+        break;
+    }
+    case NODE_ENUM_VARIANT: {
+        const char *name = STR(0);
+        if (!name) return NULL;
+        node = create_enum_variant_node(name);
+        break;
+    }
+    case NODE_IF:
+    case NODE_UNLESS: {
+        ASTNode *condition = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        ASTNode *then_block = LOAD(rec->kid[1], 1, EXPECT_EXACT, NODE_BLOCK);
+        ASTNode *else_block = LOAD(rec->kid[2], 0, EXPECT_EXACT, NODE_BLOCK);
+        node = type == NODE_IF ? create_if_node(condition, then_block, else_block)
+                               : create_unless_node(condition, then_block, else_block);
+        break;
+    }
+    case NODE_FOR: {
+        ASTNode *init = LOAD(rec->kid[0], 0, EXPECT_STATEMENT, 0);
+        ASTNode *condition = LOAD(rec->kid[1], 0, EXPECT_EXPRESSION, 0);
+        ASTNode *update = LOAD(rec->kid[2], 0, EXPECT_STATEMENT, 0);
+        ASTNode *body = LOAD(rec->kid[3], 1, EXPECT_EXACT, NODE_BLOCK);
+        node = create_for_node(init, condition, update, body);
+        break;
+    }
+    case NODE_WHILE: {
+        ASTNode *condition = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        ASTNode *body = LOAD(rec->kid[1], 1, EXPECT_EXACT, NODE_BLOCK);
+        node = create_while_node(condition, body);
+        break;
+    }
+    case NODE_SWITCH:
+        node = create_switch_node(LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0));
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *switch_case = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_SWITCH_CASE);
+            if (switch_case) add_case_to_switch(node, switch_case);
+        }
+        set_switch_default(node, LOAD(rec->kid[1], 0, EXPECT_EXACT, NODE_SWITCH_CASE));
+        break;
+    case NODE_SWITCH_CASE:
+        node = create_switch_case_node(LOAD(rec->kid[0], 0, EXPECT_EXPRESSION, 0));
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *statement = LOAD(r->index[rec->list[0] + i], 1, EXPECT_STATEMENT, 0);
+            if (statement) add_statement_to_switch_case(node, statement);
+        }
+        break;
+    case NODE_MATCH:
+        node = create_match_node(LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0));
+        for (uint32_t i = 0; i < rec->count[0] && !r->failed; i++) {
+            ASTNode *match_case = LOAD(r->index[rec->list[0] + i], 1, EXPECT_EXACT, NODE_MATCH_CASE);
+            if (match_case) add_case_to_match(node, match_case);
+        }
+        break;
+    case NODE_MATCH_CASE: {
+        ASTNode *pattern = LOAD(rec->kid[0], 1, EXPECT_EXPRESSION, 0);
+        ASTNode *body = LOAD(rec->kid[1], 1, EXPECT_EXACT, NODE_BLOCK);
+        node = create_match_case_node(pattern, body);
+        break;
+    }
+    case NODE_BREAK:
+        node = create_break_node();
+        break;
+    case NODE_CONTINUE:
+        node = create_continue_node();
+        break;
+    }
+
+    set_node_location(node, rec->line, rec->column);
+    return node;
+}
+
+#undef LOAD
+#undef STR
+
+ASTNode *decode_ast_cache(const void *data, size_t size,
+                          uint64_t source_hash, uint64_t source_size) {
+    CacheHeader header;
+    if (size < sizeof(header)) {
+        return NULL;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, GLOIN_AST_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.endian != AST_CACHE_ENDIAN_MARK ||
+        header.version != GLOIN_AST_CACHE_VERSION ||
+        header.compiler_id != compiler_build_id() ||
+        header.source_hash != source_hash || header.source_size != source_size) {
+        return NULL;
+    }
+
+    // Section bounds, computed in 64 bits so they cannot wrap
+    uint64_t node_end = (uint64_t)header.node_offset +
+                        (uint64_t)header.node_count * sizeof(CachedNode);
+    uint64_t index_end = (uint64_t)header.index_offset +
+                         (uint64_t)header.index_count * sizeof(uint32_t);
+    uint64_t string_end = (uint64_t)header.string_offset + header.string_size;
+    if (header.node_offset < sizeof(header) || header.node_offset % 8 != 0 ||
+        header.index_offset % 8 != 0 || node_end > size || index_end > size ||
+        string_end > size || header.index_offset < node_end ||
+        header.string_offset < index_end || header.string_size == 0 ||
+        header.root >= header.node_count) {
+        return NULL;
+    }
+
+    const unsigned char *bytes = data;
+    if (hash_bytes(bytes + sizeof(header), size - sizeof(header), 0) !=
+        header.checksum) {
+        return NULL;
+    }
+
+    CacheReader reader;
+    reader.nodes = (const CachedNode *)(bytes + header.node_offset);
+    reader.node_count = header.node_count;
+    reader.index = (const uint32_t *)(bytes + header.index_offset);
+    reader.index_count = header.index_count;
+    reader.strings = (const char *)(bytes + header.string_offset);
+    reader.string_size = header.string_size;
+    reader.used = calloc(header.node_count ? header.node_count : 1, 1);
+    reader.failed = reader.strings[reader.string_size - 1] != '\0';
+
+    ASTNode *program = load_node(&reader, header.root + 1, UINT32_MAX, 0, 1,
+                                 EXPECT_EXACT, NODE_PROGRAM);
+    free(reader.used);
+
+    if (reader.failed) {
+        free_ast_node(program);
+        return NULL;
+    }
+    return program;
+}
+
+ASTNode *load_ast_cache(const char *path, uint64_t source_hash,
+                        uint64_t source_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    ASTNode *program = decode_ast_cache(image, st.st_size, source_hash, source_size);
+    munmap(image, st.st_size);
+    return program;
+}
+
+// Resident trees
+
+typedef struct {
+    char *path;  // Canonical source path
+    uint64_t source_hash;
+    uint64_t source_size;
+    ASTNode *program;
+} ResidentAST;
+
+static ResidentAST *resident;
+static int resident_count;
+static int resident_capacity;
+static void (*cache_observer)(const char *source_path);
+
+static int find_resident(const char *path) {
+    for (int i = 0; i < resident_count; i++) {
+        if (strcmp(resident[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void remove_resident(int i) {
+    free(resident[i].path);
+    free_ast_node(resident[i].program);
+    resident[i] = resident[--resident_count];
+}
+
+// Tell the observer that the cache file of a source is up to date
+static void notify_observer(const char *source_path) {
+    if (!cache_observer) {
+        return;
+    }
+    char *canonical = realpath(source_path, NULL);
+    if (canonical) {
+        cache_observer(canonical);
+        free(canonical);
+    }
+}
+
+ASTNode *find_cached_ast(const char *source_path, const char *cache_path,
+                         uint64_t source_hash, uint64_t source_size) {
+    if (resident_count > 0) {
+        char *canonical = realpath(source_path, NULL);
+        int i = canonical ? find_resident(canonical) : -1;
+        free(canonical);
+        if (i >= 0 && resident[i].source_hash == source_hash &&
+            resident[i].source_size == source_size) {
+            ASTNode *program = resident[i].program;
+            resident[i].program = NULL;
+            remove_resident(i);
+            return program;
+        }
+    }
+    ASTNode *program = cache_path ? load_ast_cache(cache_path, source_hash, source_size)
+                                  : NULL;
+    if (program) {
+        notify_observer(source_path);
+    }
+    return program;
+}
+
+void store_parsed_ast(const char *source_path, const char *cache_path,
+                      ASTNode *program, uint64_t source_hash,
+                      uint64_t source_size) {
+    if (!cache_path ||
+        write_ast_cache(program, cache_path, source_hash, source_size) != 0) {
+        return;
+    }
+    notify_observer(source_path);
+}
+
+int make_ast_resident(const char *source_path) {
+    char *canonical = realpath(source_path, NULL);
+    if (!canonical) {
+        return 1;
+    }
+
+    FILE *file = fopen(canonical, "rb");
+    if (!file) {
+        free(canonical);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *content = malloc(length + 1);
+    size_t read = fread(content, 1, length, file);
+    content[read] = '\0';
+    fclose(file);
+
+    // Hash exactly what parse_file() hashes
+    size_t size = strlen(content);
+    uint64_t hash = hash_bytes(content, size, 0);
+    free(content);
+
+    int i = find_resident(canonical);
+    if (i >= 0 && resident[i].source_hash == hash && resident[i].source_size == size) {
+        free(canonical);
+        return 0;
+    }
+
+    char *cache_path = module_cache_path(canonical, ".gloinast");
+    ASTNode *program = cache_path ? load_ast_cache(cache_path, hash, size) : NULL;
+    free(cache_path);
+    if (i >= 0) {
+        remove_resident(i);
+    }
+    if (!program) {
+        free(canonical);
+        return 1;
+    }
+
+    if (resident_count == resident_capacity) {
+        resident_capacity = resident_capacity ? resident_capacity * 2 : 16;
+        resident = realloc(resident, resident_capacity * sizeof(ResidentAST));
+    }
+    resident[resident_count].path = canonical;
+    resident[resident_count].source_hash = hash;
+    resident[resident_count].source_size = size;
+    resident[resident_count].program = program;
+    resident_count++;
+    return 0;
+}
+
+void set_ast_cache_observer(void (*observer)(const char *source_path)) {
+    cache_observer = observer;
+}
@@ -1,17 +1,39 @@
 #define _GNU_SOURCE
 #include "codegen.h"
+#include "debuginfo.h"
+#include "pgo.h"
+#include "profile.h"
+#include "diagnostics.h"
+#include "fold.h"
+#include "memstats.h"
+#include "parallel.h"
 #include "parser.h"
+#include "passes.h"
+#include "timing.h"
+#include "trace.h"
 #include "types.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-CodeGen *create_codegen(const char *module_name) {
-  CodeGen *codegen = malloc(sizeof(CodeGen));
+// LLVM's target registry is process-wide and must be initialized once.
+// Modules are only compiled for the host, so its target is the only one
+// registered, the first time a target machine is created.
+static pthread_once_t targets_once = PTHREAD_ONCE_INIT;
 
-  // Initialize LLVM
+static void initialize_targets(void) {
   LLVMInitializeNativeTarget();
   LLVMInitializeNativeAsmPrinter();
+}
+
+void initialize_native_target(void) {
+  pthread_once(&targets_once, initialize_targets);
+}
+
+CodeGen *create_codegen(const char *module_name) {
+  CodeGen *codegen = malloc(sizeof(CodeGen));
 
   // Create context, module, and builder
   codegen->context = LLVMContextCreate();
@@ -22,144 +44,132 @@ CodeGen *create_codegen(const char *module_name) {
 
   // Initialize symbol tables
   codegen->variable_count = 0;
+  codegen->peak_variable_count = 0;
   codegen->function_count = 0;
+  memset(codegen->runtime_functions, 0, sizeof(codegen->runtime_functions));
   codegen->loop_depth = 0;
   codegen->has_error = 0;
 
-  // Add standard library functions
-  add_builtin_functions(codegen);
+  // Import graph, rooted at the file being compiled once it is known
+  codegen->imports = create_import_graph();
+  codegen->owns_imports = 1;
+  codegen->source_path = NULL;
+
+  // Emit unoptimized IR as one object unless asked otherwise
+  codegen->optimization_level = 0;
+  codegen->codegen_threads = 0;
+  codegen->debug_info = 0;
+  codegen->profile = 0;
+  codegen->profile_generate = NULL;
+  codegen->profile_use = NULL;
+  codegen->whole_program = 0;
+  codegen->reachable = NULL;
+  codegen->lto = LTO_NONE;
+  codegen->emit_bitcode = 0;
+  codegen->di_builder = NULL;
+  codegen->di_layout = NULL;
+  codegen->di_file = NULL;
+  codegen->di_scope = NULL;
 
   return codegen;
 }
 
-void add_builtin_functions(CodeGen *codegen) {
-  // Add printf function
-  LLVMTypeRef printf_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef printf_type = LLVMFunctionType(
-      LLVMInt32TypeInContext(codegen->context), // return type: int
-      printf_args, 1, 1                         // variadic function
-  );
-  LLVMValueRef printf_func =
-      LLVMAddFunction(codegen->module, "printf", printf_type);
-
-  // Add puts function
-  LLVMTypeRef puts_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef puts_type = LLVMFunctionType(
-      LLVMInt32TypeInContext(codegen->context), // return type: int
-      puts_args, 1, 0                           // not variadic
-  );
-  LLVMValueRef puts_func = LLVMAddFunction(codegen->module, "puts", puts_type);
-
-  // Add strlen function
-  LLVMTypeRef strlen_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef strlen_type = LLVMFunctionType(
-      LLVMInt64TypeInContext(codegen->context), // return type: size_t (i64)
-      strlen_args, 1, 0                         // not variadic
-  );
-  LLVMValueRef strlen_func =
-      LLVMAddFunction(codegen->module, "strlen", strlen_type);
-
-  // Add scanf function
-  LLVMTypeRef scanf_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef scanf_type = LLVMFunctionType(
-      LLVMInt32TypeInContext(codegen->context), // return type: int
-      scanf_args, 1, 1                          // variadic function
-  );
-  LLVMValueRef scanf_func =
-      LLVMAddFunction(codegen->module, "scanf", scanf_type);
-
-  // Add getline function
-  LLVMTypeRef getline_args[] = {
-      LLVMPointerType(
-          LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0),
-          0),                                                       // char**
-      LLVMPointerType(LLVMInt64TypeInContext(codegen->context), 0), // size_t*
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0)   // FILE*
-  };
-  LLVMTypeRef getline_type = LLVMFunctionType(
-      LLVMInt64TypeInContext(codegen->context), // return type: ssize_t (i64)
-      getline_args, 3, 0                        // not variadic
-  );
-  LLVMValueRef getline_func =
-      LLVMAddFunction(codegen->module, "getline", getline_type);
-
-  // Add atoi function (string to int)
-  LLVMTypeRef atoi_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef atoi_type = LLVMFunctionType(
-      LLVMInt32TypeInContext(codegen->context), // return type: int
-      atoi_args, 1, 0                           // not variadic
-  );
-  LLVMValueRef atoi_func = LLVMAddFunction(codegen->module, "atoi", atoi_type);
-
-  // Add atol function (string to long)
-  LLVMTypeRef atol_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // char*
-  };
-  LLVMTypeRef atol_type = LLVMFunctionType(
-      LLVMInt64TypeInContext(codegen->context), // return type: long
-      atol_args, 1, 0                           // not variadic
-  );
-  LLVMValueRef atol_func = LLVMAddFunction(codegen->module, "atol", atol_type);
-
-  // Add sprintf function (for number to string conversion)
-  LLVMTypeRef sprintf_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0), // char*
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0)  // char*
-  };
-  LLVMTypeRef sprintf_type = LLVMFunctionType(
-      LLVMInt32TypeInContext(codegen->context), // return type: int
-      sprintf_args, 2, 1                        // variadic function
-  );
-  LLVMValueRef sprintf_func =
-      LLVMAddFunction(codegen->module, "sprintf", sprintf_type);
-
-  // Add malloc function
-  LLVMTypeRef malloc_args[] = {
-      LLVMInt64TypeInContext(codegen->context) // size_t (i64)
-  };
-  LLVMTypeRef malloc_type = LLVMFunctionType(
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0), // void* return
-      malloc_args, 1, 0                                            // not variadic
-  );
-  LLVMValueRef malloc_func =
-      LLVMAddFunction(codegen->module, "malloc", malloc_type);
-
-  // Add free function
-  LLVMTypeRef free_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0) // void*
-  };
-  LLVMTypeRef free_type = LLVMFunctionType(
-      LLVMVoidTypeInContext(codegen->context), // void return
-      free_args, 1, 0                          // not variadic
-  );
-  LLVMValueRef free_func = LLVMAddFunction(codegen->module, "free", free_type);
-
-  // Add realloc function  
-  LLVMTypeRef realloc_args[] = {
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0), // void* ptr
-      LLVMInt64TypeInContext(codegen->context)                     // size_t size
-  };
-  LLVMTypeRef realloc_type = LLVMFunctionType(
-      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0), // void* return
-      realloc_args, 2, 0                                           // not variadic
-  );
-  LLVMValueRef realloc_func =
-      LLVMAddFunction(codegen->module, "realloc", realloc_type);
+// C library functions the generated code calls. Parameter and return
+// types are coded as v (void), i (i32), l (i64), p (i8*), P (i8**) and
+// L (i64*); getline's FILE* is passed as an i8*.
+static const struct {
+  const char *name;
+  char return_type;
+  const char *param_types;
+  int variadic;
+} runtime_functions[] = {
+    {"printf", 'i', "p", 1},  {"puts", 'i', "p", 0},
+    {"strlen", 'l', "p", 0},  {"scanf", 'i', "p", 1},
+    {"getline", 'l', "PLp", 0}, {"atoi", 'i', "p", 0},
+    {"atol", 'l', "p", 0},    {"sprintf", 'i', "pp", 1},
+    {"malloc", 'p', "l", 0},  {"free", 'v', "p", 0},
+    {"realloc", 'p', "pl", 0},
+};
+
+static LLVMTypeRef runtime_type(CodeGen *codegen, char code) {
+  LLVMTypeRef i8_ptr =
+      LLVMPointerType(LLVMInt8TypeInContext(codegen->context), 0);
+  switch (code) {
+  case 'v':
+    return LLVMVoidTypeInContext(codegen->context);
+  case 'i':
+    return LLVMInt32TypeInContext(codegen->context);
+  case 'l':
+    return LLVMInt64TypeInContext(codegen->context);
+  case 'P':
+    return LLVMPointerType(i8_ptr, 0);
+  case 'L':
+    return LLVMPointerType(LLVMInt64TypeInContext(codegen->context), 0);
+  default:
+    return i8_ptr;
+  }
+}
+
+_Static_assert(sizeof(runtime_functions) / sizeof(runtime_functions[0]) ==
+                   RUNTIME_FUNCTION_COUNT,
+               "RUNTIME_FUNCTION_COUNT must match runtime_functions");
+
+static int runtime_function_index(const char *name) {
+  for (int i = 0; i < RUNTIME_FUNCTION_COUNT; i++) {
+    if (strcmp(runtime_functions[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Declared in the module on first use, so programs that never read input
+// or allocate carry no declarations for it. The library keeps its symbol:
+// a program function of the same name is renamed (name.1), and calls to it
+// go through the function table.
+LLVMValueRef get_runtime_function(CodeGen *codegen, const char *name) {
+  int i = runtime_function_index(name);
+  if (i < 0) {
+    return NULL;
+  }
+  if (codegen->runtime_functions[i]) {
+    return codegen->runtime_functions[i];
+  }
+  LLVMTypeRef params[4];
+  unsigned param_count = 0;
+  for (const char *code = runtime_functions[i].param_types; *code; code++) {
+    params[param_count++] = runtime_type(codegen, *code);
+  }
+  LLVMTypeRef function_type =
+      LLVMFunctionType(runtime_type(codegen, runtime_functions[i].return_type),
+                       params, param_count, runtime_functions[i].variadic);
+  LLVMValueRef existing = LLVMGetNamedFunction(codegen->module, name);
+  if (existing) {
+    LLVMSetValueName2(existing, "", 0);
+  }
+  LLVMValueRef function = LLVMAddFunction(codegen->module, name, function_type);
+  if (existing) {
+    LLVMSetValueName2(existing, name, strlen(name));
+  }
+  codegen->runtime_functions[i] = function;
+  return function;
+}
+
+// A function of the program already in the module under name, which a
+// definition completes; C library declarations do not count
+static LLVMValueRef get_declared_function(CodeGen *codegen, const char *name) {
+  if (runtime_function_index(name) >= 0) {
+    // The program's function never takes the library's symbol, which the
+    // optimizer may call for printf
+    get_runtime_function(codegen, name);
+    return get_function(codegen, name);
+  }
+  return LLVMGetNamedFunction(codegen->module, name);
 }
 
 LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 1) {
-    fprintf(stderr, "std.print() expects exactly 1 argument\n");
+    report_error("std.print() expects exactly 1 argument\n");
     return NULL;
   }
 
@@ -169,9 +179,9 @@ LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
     return NULL;
 
   // Get printf function
-  LLVMValueRef printf_func = LLVMGetNamedFunction(codegen->module, "printf");
+  LLVMValueRef printf_func = get_runtime_function(codegen, "printf");
   if (!printf_func) {
-    fprintf(stderr, "printf function not found\n");
+    report_error("printf function not found\n");
     return NULL;
   }
 
@@ -197,7 +207,8 @@ LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
     break;
   case TYPE_I128:
     // For now, treat i128 as unsupported (needs custom formatting)
-    fprintf(stderr, "i128 printing not yet implemented - needs custom formatting\n");
+    report_error("i128 printing not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_U8:
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%hhu", "fmt");
@@ -213,7 +224,8 @@ LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
     break;
   case TYPE_U128:
     // For now, treat u128 as unsupported (needs custom formatting)
-    fprintf(stderr, "u128 printing not yet implemented - needs custom formatting\n");
+    report_error("u128 printing not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_BOOL:
     // Convert boolean to string representation
@@ -227,8 +239,9 @@ LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
         LLVMBuildSelect(codegen->builder, arg, true_str, false_str, "bool_str");
     break;
   default:
-    fprintf(stderr, "Unsupported type for std.print(): %s\n",
-            type_to_string(arg_type));
+    report_error("Unsupported type for std.print(): %s\n",
+                 type_to_string(arg_type));
+    codegen->has_error = 1;
     return NULL;
   }
 
@@ -243,7 +256,7 @@ LLVMValueRef codegen_std_print(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 1) {
-    fprintf(stderr, "std.println() expects exactly 1 argument\n");
+    report_error("std.println() expects exactly 1 argument\n");
     return NULL;
   }
 
@@ -253,9 +266,9 @@ LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
     return NULL;
 
   // Get printf function
-  LLVMValueRef printf_func = LLVMGetNamedFunction(codegen->module, "printf");
+  LLVMValueRef printf_func = get_runtime_function(codegen, "printf");
   if (!printf_func) {
-    fprintf(stderr, "printf function not found\n");
+    report_error("printf function not found\n");
     return NULL;
   }
 
@@ -280,7 +293,8 @@ LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%ld\n", "fmt");
     break;
   case TYPE_I128:
-    fprintf(stderr, "i128 printing not yet implemented - needs custom formatting\n");
+    report_error("i128 printing not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_U8:
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%hhu\n", "fmt");
@@ -295,7 +309,8 @@ LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%lu\n", "fmt");
     break;
   case TYPE_U128:
-    fprintf(stderr, "u128 printing not yet implemented - needs custom formatting\n");
+    report_error("u128 printing not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_BOOL:
     // Convert boolean to string representation
@@ -309,8 +324,9 @@ LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
         LLVMBuildSelect(codegen->builder, arg, true_str, false_str, "bool_str");
     break;
   default:
-    fprintf(stderr, "Unsupported type for std.println(): %s\n",
-            type_to_string(arg_type));
+    report_error("Unsupported type for std.println(): %s\n",
+                 type_to_string(arg_type));
+    codegen->has_error = 1;
     return NULL;
   }
 
@@ -325,14 +341,14 @@ LLVMValueRef codegen_std_println(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_input(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 0) {
-    fprintf(stderr, "std.input() expects no arguments\n");
+    report_error("std.input() expects no arguments\n");
     return NULL;
   }
 
   // Get scanf function
-  LLVMValueRef scanf_func = LLVMGetNamedFunction(codegen->module, "scanf");
+  LLVMValueRef scanf_func = get_runtime_function(codegen, "scanf");
   if (!scanf_func) {
-    fprintf(stderr, "scanf function not found\n");
+    report_error("scanf function not found\n");
     return NULL;
   }
 
@@ -364,14 +380,14 @@ LLVMValueRef codegen_std_input(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_readln(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 0) {
-    fprintf(stderr, "std.readln() expects no arguments\n");
+    report_error("std.readln() expects no arguments\n");
     return NULL;
   }
 
   // Get getline function
-  LLVMValueRef getline_func = LLVMGetNamedFunction(codegen->module, "getline");
+  LLVMValueRef getline_func = get_runtime_function(codegen, "getline");
   if (!getline_func) {
-    fprintf(stderr, "getline function not found\n");
+    report_error("getline function not found\n");
     return NULL;
   }
 
@@ -419,7 +435,7 @@ LLVMValueRef codegen_std_readln(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_to_int(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 1) {
-    fprintf(stderr, "std.to_int() expects exactly 1 argument\n");
+    report_error("std.to_int() expects exactly 1 argument\n");
     return NULL;
   }
 
@@ -429,9 +445,9 @@ LLVMValueRef codegen_std_to_int(CodeGen *codegen, ASTNode *call) {
     return NULL;
 
   // Get atoi function
-  LLVMValueRef atoi_func = LLVMGetNamedFunction(codegen->module, "atoi");
+  LLVMValueRef atoi_func = get_runtime_function(codegen, "atoi");
   if (!atoi_func) {
-    fprintf(stderr, "atoi function not found\n");
+    report_error("atoi function not found\n");
     return NULL;
   }
 
@@ -442,7 +458,7 @@ LLVMValueRef codegen_std_to_int(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_to_i64(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 1) {
-    fprintf(stderr, "std.to_i64() expects exactly 1 argument\n");
+    report_error("std.to_i64() expects exactly 1 argument\n");
     return NULL;
   }
 
@@ -452,9 +468,9 @@ LLVMValueRef codegen_std_to_i64(CodeGen *codegen, ASTNode *call) {
     return NULL;
 
   // Get atol function
-  LLVMValueRef atol_func = LLVMGetNamedFunction(codegen->module, "atol");
+  LLVMValueRef atol_func = get_runtime_function(codegen, "atol");
   if (!atol_func) {
-    fprintf(stderr, "atol function not found\n");
+    report_error("atol function not found\n");
     return NULL;
   }
 
@@ -465,7 +481,7 @@ LLVMValueRef codegen_std_to_i64(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
   if (call->data.call.arg_count != 1) {
-    fprintf(stderr, "std.to_string() expects exactly 1 argument\n");
+    report_error("std.to_string() expects exactly 1 argument\n");
     return NULL;
   }
 
@@ -475,9 +491,9 @@ LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
     return NULL;
 
   // Get sprintf function
-  LLVMValueRef sprintf_func = LLVMGetNamedFunction(codegen->module, "sprintf");
+  LLVMValueRef sprintf_func = get_runtime_function(codegen, "sprintf");
   if (!sprintf_func) {
-    fprintf(stderr, "sprintf function not found\n");
+    report_error("sprintf function not found\n");
     return NULL;
   }
 
@@ -509,7 +525,8 @@ LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%ld", "fmt");
     break;
   case TYPE_I128:
-    fprintf(stderr, "i128 to_string not yet implemented - needs custom formatting\n");
+    report_error("i128 to_string not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_U8:
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%hhu", "fmt");
@@ -524,7 +541,8 @@ LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
     format_str = LLVMBuildGlobalStringPtr(codegen->builder, "%lu", "fmt");
     break;
   case TYPE_U128:
-    fprintf(stderr, "u128 to_string not yet implemented - needs custom formatting\n");
+    report_error("u128 to_string not yet implemented - needs custom formatting\n");
+    codegen->has_error = 1;
     return NULL;
   case TYPE_BOOL:
     // Convert boolean to string representation
@@ -541,8 +559,9 @@ LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
     // If already a string, just return it
     return arg;
   default:
-    fprintf(stderr, "Unsupported type for std.to_string(): %s\n",
-            type_to_string(arg_type));
+    report_error("Unsupported type for std.to_string(): %s\n",
+                 type_to_string(arg_type));
+    codegen->has_error = 1;
     return NULL;
   }
 
@@ -559,7 +578,7 @@ LLVMValueRef codegen_std_to_string(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call) {
     if (call->data.call.arg_count != 2) {
-        fprintf(stderr, "cast() expects exactly 2 arguments: cast(value, target_type)\n");
+        report_error("cast() expects exactly 2 arguments: cast(value, target_type)\n");
         return NULL;
     }
 
@@ -582,13 +601,13 @@ LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call) {
                strcmp(target_type_node->data.literal.type, "string") == 0) {
         target_type_name = target_type_node->data.literal.value;
     } else {
-        fprintf(stderr, "cast() second argument must be a type name (identifier or string)\n");
+        report_error("cast() second argument must be a type name (identifier or string)\n");
         return NULL;
     }
     TypeKind target_type = string_to_type(target_type_name);
     
     if (target_type == TYPE_UNKNOWN) {
-        fprintf(stderr, "cast(): unknown target type '%s'\n", target_type_name);
+        report_error("cast(): unknown target type '%s'\n", target_type_name);
         return NULL;
     }
 
@@ -597,7 +616,7 @@ LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call) {
     LLVMTypeRef target_llvm_type = get_llvm_type_from_kind(codegen, target_type);
     
     if (!src_llvm_type || !target_llvm_type) {
-        fprintf(stderr, "cast(): failed to get LLVM types\n");
+        report_error("cast(): failed to get LLVM types\n");
         return NULL;
     }
 
@@ -606,7 +625,7 @@ LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call) {
     const Type *target_info = get_type_info(target_type);
     
     if (!src_info || !target_info) {
-        fprintf(stderr, "cast(): failed to get type information\n");
+        report_error("cast(): failed to get type information\n");
         return NULL;
     }
 
@@ -658,14 +677,14 @@ LLVMValueRef codegen_cast(CodeGen *codegen, ASTNode *call) {
     }
 
     // For now, reject other conversions
-    fprintf(stderr, "cast(): conversion from %s to %s not yet supported\n",
-            type_to_string(src_type), target_type_name);
+    report_error("cast(): conversion from %s to %s not yet supported\n",
+                 type_to_string(src_type), target_type_name);
     return NULL;
 }
 
 LLVMValueRef codegen_std_malloc(CodeGen *codegen, ASTNode *call) {
     if (call->data.call.arg_count != 1) {
-        fprintf(stderr, "std.malloc() expects exactly 1 argument (size)\n");
+        report_error("std.malloc() expects exactly 1 argument (size)\n");
         return NULL;
     }
 
@@ -676,9 +695,9 @@ LLVMValueRef codegen_std_malloc(CodeGen *codegen, ASTNode *call) {
     }
 
     // Get malloc function
-    LLVMValueRef malloc_func = LLVMGetNamedFunction(codegen->module, "malloc");
+    LLVMValueRef malloc_func = get_runtime_function(codegen, "malloc");
     if (!malloc_func) {
-        fprintf(stderr, "malloc function not found\n");
+        report_error("malloc function not found\n");
         return NULL;
     }
 
@@ -697,7 +716,7 @@ LLVMValueRef codegen_std_malloc(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_std_free(CodeGen *codegen, ASTNode *call) {
     if (call->data.call.arg_count != 1) {
-        fprintf(stderr, "std.free() expects exactly 1 argument (pointer)\n");
+        report_error("std.free() expects exactly 1 argument (pointer)\n");
         return NULL;
     }
 
@@ -708,9 +727,9 @@ LLVMValueRef codegen_std_free(CodeGen *codegen, ASTNode *call) {
     }
 
     // Get free function
-    LLVMValueRef free_func = LLVMGetNamedFunction(codegen->module, "free");
+    LLVMValueRef free_func = get_runtime_function(codegen, "free");
     if (!free_func) {
-        fprintf(stderr, "free function not found\n");
+        report_error("free function not found\n");
         return NULL;
     }
 
@@ -727,6 +746,9 @@ void free_codegen(CodeGen *codegen) {
   if (!codegen)
     return;
 
+  record_symbol_tables(codegen);
+  debug_info_finish(codegen);
+
   // Free symbol table entries
   for (int i = 0; i < codegen->variable_count; i++) {
     free(codegen->variables[i].name);
@@ -735,6 +757,15 @@ void free_codegen(CodeGen *codegen) {
     free(codegen->functions[i].name);
   }
 
+  // Imported modules are owned by the import graph
+  if (codegen->owns_imports) {
+    free_import_graph(codegen->imports);
+  }
+  free(codegen->source_path);
+  free(codegen->profile_generate);
+  free(codegen->profile_use);
+  free_reachability(codegen->reachable);
+
   // Free LLVM objects
   LLVMDisposeBuilder(codegen->builder);
   LLVMDisposeModule(codegen->module);
@@ -803,14 +834,14 @@ LLVMTypeRef get_llvm_type_from_kind(CodeGen *codegen, TypeKind type_kind) {
           field_types[i] = get_llvm_type_from_kind(codegen, st->fields[i].type);
         }
 
-        LLVMTypeRef struct_type =
-            LLVMStructType(field_types, st->field_count, 0);
+        LLVMTypeRef struct_type = LLVMStructTypeInContext(
+            codegen->context, field_types, st->field_count, 0);
         free(field_types);
         return struct_type;
       }
     }
 
-    fprintf(stderr, "Unknown type kind: %d\n", type_kind);
+    report_error("Unknown type kind: %d\n", type_kind);
     return LLVMInt32TypeInContext(codegen->context); // Default fallback
   }
 }
@@ -869,9 +900,27 @@ void set_variable_with_type(CodeGen *codegen, const char *name,
     codegen->variables[codegen->variable_count].is_mutable = is_mutable;
     codegen->variables[codegen->variable_count].type_kind = type_kind;
     codegen->variable_count++;
+    if (codegen->variable_count > codegen->peak_variable_count) {
+      codegen->peak_variable_count = codegen->variable_count;
+    }
   }
 }
 
+void save_variables(CodeGen *codegen, VariableScope *scope) {
+  scope->entries = malloc(sizeof(codegen->variables));
+  memcpy(scope->entries, codegen->variables, sizeof(codegen->variables));
+  scope->count = codegen->variable_count;
+}
+
+void restore_variables(CodeGen *codegen, VariableScope *scope) {
+  for (int i = scope->count; i < codegen->variable_count; i++) {
+    free(codegen->variables[i].name);
+  }
+  memcpy(codegen->variables, scope->entries, sizeof(codegen->variables));
+  codegen->variable_count = scope->count;
+  free(scope->entries);
+}
+
 TypeKind get_variable_type_kind(CodeGen *codegen, const char *name) {
   for (int i = 0; i < codegen->variable_count; i++) {
     if (strcmp(codegen->variables[i].name, name) == 0) {
@@ -971,145 +1020,741 @@ void set_function(CodeGen *codegen, const char *name, LLVMValueRef function) {
   }
 }
 
-void process_local_import(CodeGen *codegen, ASTNode *import) {
-  if (import->type != NODE_IMPORT ||
-      import->data.import.import_type != IMPORT_LOCAL) {
-    fprintf(stderr, "Expected local import node\n");
-    return;
+// Store a declaration's initial value, converted to the declared type
+static void store_initial_value(CodeGen *codegen, ASTNode *var_decl,
+                                LLVMTypeRef var_type, LLVMValueRef storage) {
+  LLVMValueRef initial_value = NULL;
+  if (var_decl->data.variable_decl.value) {
+    initial_value =
+        codegen_expression(codegen, var_decl->data.variable_decl.value);
+    if (initial_value) {
+      // Check if this is a struct assignment
+      if (var_decl->data.variable_decl.value->type == NODE_STRUCT_LITERAL) {
+        // For struct literals, we need to copy the struct, not store a pointer
+        LLVMValueRef struct_value = LLVMBuildLoad2(codegen->builder, var_type,
+                                                   initial_value, "struct_val");
+        LLVMBuildStore(codegen->builder, struct_value, storage);
+      } else {
+        // Get the target type and source type
+        TypeKind target_type = var_decl->data.variable_decl.resolved_type;
+        TypeKind source_type = get_expression_type(codegen, var_decl->data.variable_decl.value);
+        
+        // If types don't match, we need to cast
+        if (target_type != source_type && source_type != TYPE_UNKNOWN) {
+          LLVMTypeRef target_llvm_type = get_llvm_type_from_kind(codegen, target_type);
+          const Type *src_info = get_type_info(source_type);
+          const Type *target_info = get_type_info(target_type);
+          
+          if (src_info && target_info && src_info->is_numeric && target_info->is_numeric) {
+            // Perform automatic type conversion for numeric types
+            if (src_info->size < target_info->size) {
+              // Widening conversion
+              if (src_info->is_signed && target_info->is_signed) {
+                initial_value = LLVMBuildSExt(codegen->builder, initial_value, target_llvm_type, "auto_sext");
+              } else if (!src_info->is_signed && !target_info->is_signed) {
+                initial_value = LLVMBuildZExt(codegen->builder, initial_value, target_llvm_type, "auto_zext");
+              } else {
+                initial_value = LLVMBuildIntCast(codegen->builder, initial_value, target_llvm_type, "auto_cast");
+              }
+            } else if (src_info->size > target_info->size) {
+              // Narrowing conversion (truncation)
+              initial_value = LLVMBuildTrunc(codegen->builder, initial_value, target_llvm_type, "auto_trunc");
+            } else {
+              // Same size, different signedness
+              initial_value = LLVMBuildBitCast(codegen->builder, initial_value, target_llvm_type, "auto_bitcast");
+            }
+          }
+        }
+        
+        LLVMBuildStore(codegen->builder, initial_value, storage);
+      }
+    }
   }
+}
 
-  // Build file path: import path + .gloin extension
-  char *path = import->data.import.path;
-  char *file_path = malloc(strlen(path) + 7); // +7 for ".gloin\0"
-  sprintf(file_path, "%s.gloin", path);
+// A string literal as a constant pointer to its characters
+static LLVMValueRef constant_string(CodeGen *codegen, const char *text) {
+  LLVMValueRef characters =
+      LLVMConstStringInContext(codegen->context, text, strlen(text), 0);
+  LLVMValueRef storage =
+      LLVMAddGlobal(codegen->module, LLVMTypeOf(characters), "str");
+  LLVMSetInitializer(storage, characters);
+  LLVMSetGlobalConstant(storage, 1);
+  LLVMSetLinkage(storage, LLVMPrivateLinkage);
+  LLVMSetUnnamedAddress(storage, LLVMGlobalUnnamedAddr);
+  LLVMValueRef zero = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), 0, 0);
+  LLVMValueRef indices[] = {zero, zero};
+  return LLVMConstInBoundsGEP2(LLVMTypeOf(characters), storage, indices, 2);
+}
+
+// The initializer of a top-level variable as a constant of its type, or
+// NULL when it has to run. Numbers convert as codegen_variable_decl
+// converts them.
+static LLVMValueRef constant_initializer(CodeGen *codegen, ASTNode *decl,
+                                         LLVMTypeRef type) {
+  ASTNode *value = decl->data.variable_decl.value;
+  if (!value || value->type != NODE_LITERAL) {
+    return NULL;
+  }
+  TypeKind target = decl->data.variable_decl.resolved_type;
+  TypeKind source = value->data.literal.resolved_type;
+  if (source == TYPE_STRING) {
+    return target == TYPE_STRING ? constant_string(codegen, value->data.literal.value)
+                                 : NULL;
+  }
+  if (source == target) {
+    return codegen_literal(codegen, value);
+  }
+  if (is_integer_type(source) && is_integer_type(target)) {
+    return LLVMConstIntCast(codegen_literal(codegen, value), type,
+                            !(is_unsigned_type(source) && is_unsigned_type(target)));
+  }
+  return NULL;
+}
+
+// Top-level variables become internal globals of the module, visible to
+// all of its functions. Literal initializers are folded into the global,
+// which stays constant unless declared `mut`; the rest run in the module's
+// init function.
+static void declare_globals(CodeGen *codegen, ASTNode *program) {
+  for (int i = 0; i < program->data.program.function_count; i++) {
+    ASTNode *decl = program->data.program.functions[i];
+    if (decl->type != NODE_VARIABLE_DECL) {
+      continue;
+    }
+    const char *name = decl->data.variable_decl.name;
+    LLVMTypeRef type = get_llvm_type(codegen, decl->data.variable_decl.type);
+    LLVMValueRef global = LLVMAddGlobal(codegen->module, type, name);
+    LLVMSetLinkage(global, LLVMInternalLinkage);
+    LLVMValueRef initializer = constant_initializer(codegen, decl, type);
+    LLVMSetInitializer(global, initializer ? initializer : LLVMConstNull(type));
+    LLVMSetGlobalConstant(global, initializer && decl->data.variable_decl.is_mutable != 1);
+    set_variable_with_type(codegen, name, global, type,
+                           decl->data.variable_decl.is_mutable,
+                           decl->data.variable_decl.resolved_type);
+  }
+}
+
+// Have the module's constructors, which run before main, call function
+static void add_global_constructor(CodeGen *codegen, LLVMValueRef function) {
+  LLVMContextRef context = codegen->context;
+  LLVMTypeRef i8_pointer = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+  LLVMTypeRef fields[] = {LLVMInt32TypeInContext(context),
+                          LLVMPointerType(LLVMGlobalGetValueType(function), 0),
+                          i8_pointer};
+  LLVMTypeRef entry_type = LLVMStructTypeInContext(context, fields, 3, 0);
+
+  // An appending global cannot grow, so replace it with a longer one
+  LLVMValueRef old = LLVMGetNamedGlobal(codegen->module, "llvm.global_ctors");
+  int count = old ? LLVMGetArrayLength(LLVMGlobalGetValueType(old)) : 0;
+  LLVMValueRef *entries = malloc((count + 1) * sizeof(LLVMValueRef));
+  for (int i = 0; i < count; i++) {
+    entries[i] = LLVMGetOperand(LLVMGetInitializer(old), i);
+  }
+  LLVMValueRef values[] = {LLVMConstInt(fields[0], 65535, 0), function,
+                           LLVMConstNull(i8_pointer)};
+  entries[count] = LLVMConstNamedStruct(entry_type, values, 3);
+  if (old) {
+    LLVMDeleteGlobal(old);
+  }
+  LLVMValueRef array = LLVMConstArray(entry_type, entries, count + 1);
+  LLVMValueRef ctors =
+      LLVMAddGlobal(codegen->module, LLVMTypeOf(array), "llvm.global_ctors");
+  LLVMSetInitializer(ctors, array);
+  LLVMSetLinkage(ctors, LLVMAppendingLinkage);
+  free(entries);
+}
+
+// Run the initializers that are not constant, in declaration order, in an
+// init function called before main
+static void codegen_global_initializers(CodeGen *codegen, ASTNode *program) {
+  LLVMValueRef init = NULL;
+  for (int i = 0; i < program->data.program.function_count && !codegen->has_error; i++) {
+    ASTNode *decl = program->data.program.functions[i];
+    if (decl->type != NODE_VARIABLE_DECL || !decl->data.variable_decl.value) {
+      continue;
+    }
+    LLVMValueRef global = get_variable(codegen, decl->data.variable_decl.name);
+    if (LLVMIsGlobalConstant(global)) {
+      continue;
+    }
+    if (!init) {
+      LLVMTypeRef type =
+          LLVMFunctionType(LLVMVoidTypeInContext(codegen->context), NULL, 0, 0);
+      init = LLVMAddFunction(codegen->module, "gloin.init", type);
+      LLVMSetLinkage(init, LLVMInternalLinkage);
+      LLVMPositionBuilderAtEnd(codegen->builder,
+                               LLVMAppendBasicBlockInContext(codegen->context, init, "entry"));
+      codegen->current_function = init;
+    }
+    store_initial_value(codegen, decl, LLVMGlobalGetValueType(global), global);
+  }
+  if (init) {
+    LLVMBuildRetVoid(codegen->builder);
+    codegen->current_function = NULL;
+    add_global_constructor(codegen, init);
+  }
+}
+
+// Generate the globals, functions and structs of a program, skipping
+// functions that cannot be reached
+static void codegen_declarations(CodeGen *codegen, ASTNode *program) {
+  // The module's globals, then each function with its own locals
+  VariableScope module_scope;
+  save_variables(codegen, &module_scope);
+  declare_globals(codegen, program);
+  for (int i = 0; i < program->data.program.function_count; i++) {
+    ASTNode *node = program->data.program.functions[i];
+    TimePoint start = time_now();
+    VariableScope scope;
+    save_variables(codegen, &scope);
+    if (node->type == NODE_FUNCTION) {
+      if (is_reachable(codegen->reachable, node)) {
+        codegen_function(codegen, node);
+        record_time(TIMING_CODEGEN, node->data.function.name, start);
+      }
+    } else if (node->type == NODE_STRUCT) {
+      codegen_struct(codegen, node);
+      record_time(TIMING_CODEGEN, node->data.struct_decl.name, start);
+    } else if (node->type != NODE_VARIABLE_DECL) {
+      report_error("Unexpected node type in program: %d\n", node->type);
+    }
+    restore_variables(codegen, &scope);
+    if (codegen->has_error) {
+      break;
+    }
+  }
+  if (!codegen->has_error) {
+    codegen_global_initializers(codegen, program);
+  }
+  restore_variables(codegen, &module_scope);
+}
+
+// Declare the functions, structs and public methods of a module interface
+// in the current LLVM module
+static void declare_interface(CodeGen *codegen, ModuleInterface *iface) {
+  // Struct layouts first, since signatures may refer to them
+  for (int i = 0; i < iface->struct_count; i++) {
+    InterfaceStruct *st = &iface->structs[i];
+    if (find_struct_by_name(st->name)) {
+      continue;
+    }
+    StructField *fields = malloc((st->field_count ? st->field_count : 1) *
+                                 sizeof(StructField));
+    for (int j = 0; j < st->field_count; j++) {
+      fields[j].name = st->field_names[j];
+      fields[j].type = string_to_type(st->field_types[j]);
+      fields[j].offset = 0;
+    }
+    register_struct_type(st->name, fields, st->field_count);
+    free(fields);
+  }
+
+  for (int i = 0; i < iface->function_count; i++) {
+    InterfaceFunction *fn = &iface->functions[i];
+    if (get_function(codegen, fn->name)) {
+      continue;
+    }
+    LLVMTypeRef *param_types =
+        malloc((fn->param_count ? fn->param_count : 1) * sizeof(LLVMTypeRef));
+    for (int j = 0; j < fn->param_count; j++) {
+      param_types[j] = get_llvm_type(codegen, fn->param_types[j]);
+    }
+    LLVMTypeRef function_type =
+        LLVMFunctionType(get_llvm_type(codegen, fn->return_type), param_types,
+                         fn->param_count, 0);
+    LLVMValueRef function = get_declared_function(codegen, fn->name);
+    if (!function) {
+      function = LLVMAddFunction(codegen->module, fn->name, function_type);
+    }
+    set_function(codegen, fn->name, function);
+    free(param_types);
+  }
+
+  // Methods are called by their mangled StructName_methodName symbol
+  for (int i = 0; i < iface->struct_count; i++) {
+    InterfaceStruct *ist = &iface->structs[i];
+    StructType *st = find_struct_by_name(ist->name);
+    LLVMTypeRef *field_types =
+        malloc((st->field_count ? st->field_count : 1) * sizeof(LLVMTypeRef));
+    for (int j = 0; j < st->field_count; j++) {
+      field_types[j] = get_llvm_type_from_kind(codegen, st->fields[j].type);
+    }
+    LLVMTypeRef struct_type =
+        LLVMStructTypeInContext(codegen->context, field_types, st->field_count,
+                                0);
+
+    for (int j = 0; j < ist->method_count; j++) {
+      InterfaceFunction *method = &ist->methods[j];
+      char *mangled_name = malloc(strlen(ist->name) + strlen(method->name) + 2);
+      sprintf(mangled_name, "%s_%s", ist->name, method->name);
+
+      if (!LLVMGetNamedFunction(codegen->module, mangled_name)) {
+        LLVMTypeRef *param_types =
+            malloc((method->param_count + 1) * sizeof(LLVMTypeRef));
+        param_types[0] = LLVMPointerType(struct_type, 0);
+        for (int k = 0; k < method->param_count; k++) {
+          param_types[k + 1] = get_llvm_type(codegen, method->param_types[k]);
+        }
+        LLVMTypeRef function_type =
+            LLVMFunctionType(get_llvm_type(codegen, method->return_type),
+                             param_types, method->param_count + 1, 0);
+        LLVMAddFunction(codegen->module, mangled_name, function_type);
+        free(param_types);
+      }
+      free(mangled_name);
+    }
+    free(field_types);
+  }
+}
+
+// Make a module and everything it imports visible to the current module
+static void declare_module(CodeGen *codegen, ImportModule *module) {
+  for (int i = 0; i < module->dep_count; i++) {
+    declare_module(codegen, module->deps[i]);
+  }
+  if (module->interface) {
+    declare_interface(codegen, module->interface);
+  }
+}
+
+static ImportModule *process_import_file(CodeGen *codegen,
+                                         const char *file_path);
+
+// Compile an imported module into its own object file and write its
+// interface next to it
+static int compile_module(CodeGen *codegen, ImportModule *module,
+                          const char *interface_path) {
+  // Stamp the source before reading it, so an edit made while compiling
+  // leaves the cache entry stale rather than wrong
+  SourceStamp stamp;
+  if (get_source_stamp(module->path, &stamp) != 0) {
+    report_error("Cannot open import file: %s\n", module->path);
+    return 1;
+  }
+
+  double span = trace_begin();
+  ASTNode *program = parse_file(module->path);
+  if (!program) {
+    report_error("Failed to parse imported file: %s\n", module->path);
+    return 1;
+  }
+  module->program = program;
+  module->owns_program = 1;
+
+  CodeGen *module_codegen = create_codegen(module->path);
+  free_import_graph(module_codegen->imports);
+  module_codegen->imports = codegen->imports;
+  module_codegen->owns_imports = 0;
+  module_codegen->optimization_level = codegen->optimization_level;
+  module_codegen->debug_info = codegen->debug_info;
+  module_codegen->profile = codegen->profile;
+  module_codegen->lto = codegen->lto;
+  module_codegen->emit_bitcode = codegen->emit_bitcode;
+  module_codegen->source_path = strdup(module->path);
+  debug_info_begin(module_codegen);
+
+  codegen_imports(module_codegen, program);
+  if (!module_codegen->has_error) {
+    TimePoint start = time_now();
+    resolve_types(program);
+    record_time(TIMING_RESOLVE_TYPES, module->path, start);
+    start = time_now();
+    if (fold_constants(program)) {
+      module_codegen->has_error = 1;
+    }
+    record_time(TIMING_FOLD_CONSTANTS, module->path, start);
+    if (!module_codegen->has_error) {
+      codegen_declarations(module_codegen, program);
+    }
+  }
+
+  if (!module_codegen->has_error) {
+    debug_info_finish(module_codegen);
+    char *error = NULL;
+    TimePoint start = time_now();
+    int invalid = LLVMVerifyModule(module_codegen->module,
+                                   LLVMReturnStatusAction, &error);
+    record_time(TIMING_VERIFY, module->path, start);
+    if (invalid) {
+      report_error("Invalid module generated for %s:\n%s", module->path,
+                   error);
+      module_codegen->has_error = 1;
+    }
+    LLVMDisposeMessage(error);
+  }
+
+  // Modules for -flto and --emit=bc are kept as bitcode
+  if (!module_codegen->has_error) {
+    int write_failed =
+        module_codegen->lto != LTO_NONE || module_codegen->emit_bitcode
+            ? write_bitcode_file(module_codegen, module->object_path)
+            : write_object_file(module_codegen, module->object_path);
+    if (write_failed) {
+      module_codegen->has_error = 1;
+    }
+  }
+
+  int failed = module_codegen->has_error;
+  free_codegen(module_codegen);
+  trace_end(span, "import", "compile module", module->path, NULL);
+  if (failed) {
+    return 1;
+  }
+
+  // Record the exports of each dependency this module was built against
+  ModuleInterface *iface = build_module_interface(program);
+  for (int i = 0; i < iface->dep_count; i++) {
+    char *dep_path = resolve_import_path(iface->deps[i].import_type,
+                                         iface->deps[i].path, module->path);
+    ImportModule *dep = import_graph_find(codegen->imports, dep_path);
+    if (dep && dep->interface) {
+      iface->deps[i].interface_hash = dep->interface->interface_hash;
+    }
+    free(dep_path);
+  }
+  if (write_module_interface(iface, interface_path, &stamp) != 0) {
+    report_error("Warning: could not write interface file %s\n",
+                 interface_path);
+  }
+  module->interface = iface;
+  return 0;
+}
+
+// Parse a module for --whole-program, which generates its code into the
+// importer's LLVM module later on (see codegen_imported_programs)
+static int parse_module(CodeGen *codegen, ImportModule *module) {
+  ASTNode *program = parse_file(module->path);
+  if (!program) {
+    report_error("Failed to parse imported file: %s\n", module->path);
+    return 1;
+  }
+  module->program = program;
+  module->owns_program = 1;
+
+  codegen_imports(codegen, program);
+  if (codegen->has_error) {
+    return 1;
+  }
+  TimePoint start = time_now();
+  resolve_types(program);
+  record_time(TIMING_RESOLVE_TYPES, module->path, start);
+  start = time_now();
+  int failed = fold_constants(program);
+  record_time(TIMING_FOLD_CONSTANTS, module->path, start);
+  if (failed) {
+    return 1;
+  }
+  module->interface = build_module_interface(program);
+  return 0;
+}
+
+// Load a module from its cached interface, or rebuild it if the interface
+// is missing, stale, or was built against different dependency exports
+static int load_or_compile_module(CodeGen *codegen, ImportModule *module) {
+  if (codegen->whole_program) {
+    return parse_module(codegen, module);
+  }
+
+  // Each -O level, with and without -g, --profile and -flto, keeps its own
+  // object or bitcode, and its own interface to vouch for it
+  char variant[32] = "";
+  if (codegen->optimization_level > 0) {
+    snprintf(variant, sizeof(variant), ".O%d", codegen->optimization_level);
+  }
+  if (codegen->debug_info) {
+    strcat(variant, ".g");
+  }
+  if (codegen->profile) {
+    strcat(variant, ".prof");
+  }
+  if (codegen->lto == LTO_FULL) {
+    strcat(variant, ".lto");
+  } else if (codegen->lto == LTO_THIN) {
+    strcat(variant, ".thinlto");
+  } else if (codegen->emit_bitcode) {
+    strcat(variant, ".ir");
+  }
+  int bitcode = codegen->lto != LTO_NONE || codegen->emit_bitcode;
+  char interface_ext[48];
+  char object_ext[48];
+  snprintf(interface_ext, sizeof(interface_ext), "%s.gloini", variant);
+  snprintf(object_ext, sizeof(object_ext), "%s.%s", variant,
+           bitcode ? "bc" : "o");
+  char *interface_path = module_cache_path(module->path, interface_ext);
+  module->object_path = module_cache_path(module->path, object_ext);
+  if (!interface_path || !module->object_path) {
+    report_error("Cannot create a cache directory for %s\n", module->path);
+    free(interface_path);
+    return 1;
+  }
+
+  ModuleInterface *iface = NULL;
+  if (access(module->object_path, R_OK) == 0) {
+    iface = load_module_interface(interface_path, module->path);
+  }
+
+  if (iface) {
+    for (int i = 0; i < iface->dep_count; i++) {
+      char *dep_path = resolve_import_path(iface->deps[i].import_type,
+                                           iface->deps[i].path, module->path);
+      ImportModule *dep = process_import_file(codegen, dep_path);
+      free(dep_path);
+      if (!dep) {
+        free_module_interface(iface);
+        free(interface_path);
+        return 1;
+      }
+      if (!dep->interface ||
+          dep->interface->interface_hash != iface->deps[i].interface_hash) {
+        free_module_interface(iface);
+        iface = NULL;
+        break;
+      }
+    }
+  }
+
+  int result = 0;
+  if (iface) {
+    module->interface = iface;
+  } else {
+    result = compile_module(codegen, module, interface_path);
+  }
+  free(interface_path);
+  return result;
+}
+
+// Bring an imported module into the current module, unless the import
+// graph already holds it. Returns NULL on error.
+static ImportModule *process_import_file(CodeGen *codegen,
+                                         const char *file_path) {
+  ImportGraph *graph = codegen->imports;
+  ImportModule *importer = import_graph_current(graph);
 
   // Check if file exists
   FILE *file = fopen(file_path, "r");
   if (!file) {
-    fprintf(stderr, "Cannot open import file: %s\n", file_path);
-    free(file_path);
-    return;
+    report_error("Cannot open import file: %s\n", file_path);
+    codegen->has_error = 1;
+    return NULL;
   }
   fclose(file);
 
-  // Parse the imported file
-  ASTNode *imported_program = parse_file(file_path);
-  free(file_path);
+  ImportModule *module = import_graph_find(graph, file_path);
+  if (module) {
+    if (module->state == MODULE_VISITING) {
+      report_import_cycle(graph, module);
+      codegen->has_error = 1;
+      return NULL;
+    }
+    // Already processed for another importer; share it
+    import_graph_add_dependency(importer, module);
+    declare_module(codegen, module);
+    return module;
+  }
 
-  if (!imported_program) {
-    fprintf(stderr, "Failed to parse imported file\n");
-    return;
+  module = import_graph_add(graph, file_path, NULL, 0);
+  import_graph_add_dependency(importer, module);
+
+  import_graph_push(graph, module);
+  int failed = load_or_compile_module(codegen, module);
+  import_graph_pop(graph);
+
+  if (failed) {
+    codegen->has_error = 1;
+    return NULL;
   }
+  declare_module(codegen, module);
+  return module;
+}
 
-  // Add imported functions to the current module
-  for (int i = 0; i < imported_program->data.program.function_count; i++) {
-    ASTNode *func = imported_program->data.program.functions[i];
-    if (func->type == NODE_FUNCTION) {
-      // Generate the function in the current module
-      codegen_function(codegen, func);
-    }
+void process_local_import(CodeGen *codegen, ASTNode *import) {
+  if (import->type != NODE_IMPORT ||
+      import->data.import.import_type != IMPORT_LOCAL) {
+    report_error("Expected local import node\n");
+    return;
   }
 
-  // TODO: Clean up the imported AST properly
+  // Resolve relative to the module doing the import
+  ImportModule *importer = import_graph_current(codegen->imports);
+  char *file_path = resolve_import_path(IMPORT_LOCAL, import->data.import.path,
+                                        importer ? importer->path : NULL);
+
+  double span = trace_begin();
+  process_import_file(codegen, file_path);
+  trace_end(span, "import", import->data.import.path, file_path, NULL);
+  free(file_path);
 }
 
 void process_external_import(CodeGen *codegen, ASTNode *import) {
   if (import->type != NODE_IMPORT ||
       import->data.import.import_type != IMPORT_EXTERNAL) {
-    fprintf(stderr, "Expected external import node\n");
+    report_error("Expected external import node\n");
     return;
   }
 
+  double span = trace_begin();
+
   // Build file path: includes/package_name.gloin
   char *package_name = import->data.import.path;
-  char *file_path =
-      malloc(strlen(package_name) + 17); // +17 for "includes/" + ".gloin\0"
-  sprintf(file_path, "includes/%s.gloin", package_name);
+  char *file_path = resolve_import_path(IMPORT_EXTERNAL, package_name, NULL);
 
   // Check if file exists
   FILE *file = fopen(file_path, "r");
   if (!file) {
-    fprintf(stderr, "Cannot open external package: %s\n", file_path);
-    fprintf(stderr,
-            "Make sure the package is installed in includes/ directory\n");
-    fprintf(stderr, "You can install it with: mine dig <package_url>\n");
+    report_error("Cannot open external package: %s\n", file_path);
+    report_error("Make sure the package is installed in includes/ directory\n");
+    report_error("You can install it with: mine dig <package_url>\n");
     free(file_path);
     return;
   }
   fclose(file);
 
-  // TODO: Validate package against armory.toml dependencies
-  // For now, we'll just check if armory.toml exists and warn if the package
-  // isn't listed
-  FILE *armory_file = fopen("armory.toml", "r");
-  if (armory_file) {
-    fclose(armory_file);
-    // Could add validation here in the future
-    printf("Info: Using external package '%s' (check armory.toml for version "
-           "info)\n",
-           package_name);
+  // Packages shared by several importers are only announced once
+  if (!import_graph_find(codegen->imports, file_path)) {
+    // TODO: Validate package against armory.toml dependencies
+    // For now, we'll just check if armory.toml exists and warn if the package
+    // isn't listed
+    FILE *armory_file = fopen("armory.toml", "r");
+    if (armory_file) {
+      fclose(armory_file);
+      // Could add validation here in the future
+      report_info("Info: Using external package '%s' (check armory.toml for "
+                  "version info)\n",
+                  package_name);
+    }
   }
 
-  // Parse the external package file
-  ASTNode *imported_program = parse_file(file_path);
+  process_import_file(codegen, file_path);
+  trace_end(span, "import", package_name, file_path, NULL);
   free(file_path);
+}
 
-  if (!imported_program) {
-    fprintf(stderr, "Failed to parse external package\n");
-    return;
+void codegen_imports(CodeGen *codegen, ASTNode *program) {
+  for (int i = 0; i < program->data.program.import_count; i++) {
+    ASTNode *import = program->data.program.imports[i];
+    if (import->data.import.import_type == IMPORT_LOCAL) {
+      process_local_import(codegen, import);
+    } else if (import->data.import.import_type == IMPORT_EXTERNAL) {
+      process_external_import(codegen, import);
+    }
+    // TODO: Actually handle std imports
+    // Skip std imports (already handled by built-in functions)
+    if (codegen->has_error) {
+      return;
+    }
   }
+}
 
-  // Add imported functions to the current module
-  for (int i = 0; i < imported_program->data.program.function_count; i++) {
-    ASTNode *func = imported_program->data.program.functions[i];
-    if (func->type == NODE_FUNCTION) {
-      // Generate the function in the current module
-      codegen_function(codegen, func);
+// Find what main can reach across the program and its imports, and
+// generate the reachable parts of every imported module (--whole-program)
+static void codegen_imported_programs(CodeGen *codegen, ASTNode *program) {
+  ImportGraph *graph = codegen->imports;
+  ASTNode **programs = malloc((graph->module_count + 1) * sizeof(ASTNode *));
+  int program_count = 0;
+  programs[program_count++] = program;
+  for (int i = 0; i < graph->module_count; i++) {
+    ASTNode *module_program = graph->modules[i]->program;
+    if (module_program && module_program != program) {
+      programs[program_count++] = module_program;
+    }
+  }
+  codegen->reachable = compute_reachability(programs, program_count, "main");
+  free(programs);
+
+  // Imported modules come first, so their initializers run before those
+  // of the modules importing them
+  ImportModule **order = malloc((graph->module_count + 1) * sizeof(ImportModule *));
+  int order_count = import_graph_order(graph, order);
+  for (int i = 0; i < order_count && !codegen->has_error; i++) {
+    ImportModule *module = order[i];
+    if (module->program && module->program != program) {
+      debug_info_file(codegen, module->path);
+      codegen_declarations(codegen, module->program);
     }
   }
+  free(order);
+  debug_info_file(codegen, codegen->source_path);
+}
 
-  // TODO: Clean up the imported AST properly
+// Give every defined function but main internal linkage, so the optimizer
+// may inline it into its callers or drop it
+static void internalize_module(CodeGen *codegen) {
+  for (LLVMValueRef function = LLVMGetFirstFunction(codegen->module);
+       function; function = LLVMGetNextFunction(function)) {
+    size_t length;
+    const char *name = LLVMGetValueName2(function, &length);
+    if (LLVMCountBasicBlocks(function) > 0 && strcmp(name, "main") != 0) {
+      LLVMSetLinkage(function, LLVMInternalLinkage);
+    }
+  }
 }
 
 LLVMValueRef codegen_program(CodeGen *codegen, ASTNode *program) {
   if (program->type != NODE_PROGRAM) {
-    fprintf(stderr, "Expected program node\n");
+    report_error("Expected program node\n");
     return NULL;
   }
 
-  // Process imports
-  for (int i = 0; i < program->data.program.import_count; i++) {
-    ASTNode *import = program->data.program.imports[i];
-    if (import->data.import.import_type == IMPORT_LOCAL) {
-      process_local_import(codegen, import);
-    } else if (import->data.import.import_type == IMPORT_EXTERNAL) {
-      process_external_import(codegen, import);
+  // The root file takes part in the import graph so that a dependency
+  // importing it back is reported as a cycle
+  ImportModule *root = NULL;
+  if (codegen->source_path) {
+    root = import_graph_find(codegen->imports, codegen->source_path);
+    if (!root) {
+      root = import_graph_add(codegen->imports, codegen->source_path, program, 0);
     }
-    // TODO: Actually handle std imports
-    // Skip std imports (already handled by built-in functions)
+  }
+
+  // Process imports
+  if (root) {
+    import_graph_push(codegen->imports, root);
+  }
+  codegen_imports(codegen, program);
+  if (root) {
+    import_graph_pop(codegen->imports);
+  }
+  if (codegen->has_error) {
+    return NULL;
   }
 
   // First, perform type checking and resolution
+  TimePoint start = time_now();
   resolve_types(program);
+  record_time(TIMING_RESOLVE_TYPES, codegen->source_path, start);
+  start = time_now();
+  if (fold_constants(program)) {
+    codegen->has_error = 1;
+    return NULL;
+  }
+  record_time(TIMING_FOLD_CONSTANTS, codegen->source_path, start);
+  debug_info_begin(codegen);
 
   // Generate all functions and structs
-  for (int i = 0; i < program->data.program.function_count; i++) {
-    ASTNode *node = program->data.program.functions[i];
-    if (node->type == NODE_FUNCTION) {
-      codegen_function(codegen, node);
-    } else if (node->type == NODE_STRUCT) {
-      codegen_struct(codegen, node);
-    } else {
-      fprintf(stderr, "Unexpected node type in program: %d\n", node->type);
-    }
-    if (codegen->has_error) {
-      return NULL;
-    }
+  if (codegen->whole_program) {
+    codegen_imported_programs(codegen, program);
+  }
+  if (!codegen->has_error) {
+    codegen_declarations(codegen, program);
+  }
+  if (codegen->has_error) {
+    return NULL;
+  }
+  if (codegen->whole_program) {
+    internalize_module(codegen);
   }
 
   // Verify the module
+  debug_info_finish(codegen);
   char *error = NULL;
-  LLVMVerifyModule(codegen->module, LLVMAbortProcessAction, &error);
+  start = time_now();
+  int invalid =
+      LLVMVerifyModule(codegen->module, LLVMReturnStatusAction, &error);
+  record_time(TIMING_VERIFY, codegen->source_path, start);
+  if (invalid) {
+    report_error("Invalid module generated:\n%s", error);
+    codegen->has_error = 1;
+  }
   LLVMDisposeMessage(error);
 
   return NULL; // Program doesn't return a value
@@ -1117,9 +1762,10 @@ LLVMValueRef codegen_program(CodeGen *codegen, ASTNode *program) {
 
 LLVMValueRef codegen_function(CodeGen *codegen, ASTNode *function) {
   if (function->type != NODE_FUNCTION) {
-    fprintf(stderr, "Expected function node\n");
+    report_error("Expected function node\n");
     return NULL;
   }
+  double span = trace_begin();
 
   // Get return type
   LLVMTypeRef return_type =
@@ -1140,19 +1786,26 @@ LLVMValueRef codegen_function(CodeGen *codegen, ASTNode *function) {
   LLVMTypeRef function_type =
       LLVMFunctionType(return_type, param_types, param_count, 0);
 
-  // Create the function
-  LLVMValueRef llvm_function = LLVMAddFunction(
-      codegen->module, function->data.function.name, function_type);
+  // Create the function, completing an earlier declaration if there is one
+  LLVMValueRef llvm_function =
+      get_declared_function(codegen, function->data.function.name);
+  if (!llvm_function || LLVMCountBasicBlocks(llvm_function) > 0) {
+    llvm_function = LLVMAddFunction(
+        codegen->module, function->data.function.name, function_type);
+  }
 
   // Add to function table
   set_function(codegen, function->data.function.name, llvm_function);
 
   // Create basic block
-  LLVMBasicBlockRef entry_block = LLVMAppendBasicBlock(llvm_function, "entry");
+  LLVMBasicBlockRef entry_block =
+      LLVMAppendBasicBlockInContext(codegen->context, llvm_function, "entry");
   LLVMPositionBuilderAtEnd(codegen->builder, entry_block);
 
   // Set current function for variable scoping
   codegen->current_function = llvm_function;
+  debug_info_function(codegen, llvm_function, function->data.function.name,
+                      function);
 
   // Add parameters to symbol table
   for (int i = 0; i < param_count; i++) {
@@ -1169,6 +1822,8 @@ LLVMValueRef codegen_function(CodeGen *codegen, ASTNode *function) {
     // Add to symbol table (parameters are always mutable)
     set_variable_with_type(codegen, param->data.parameter.name, param_alloca, 
                           param_type, 1, param->data.parameter.resolved_type);
+    debug_info_variable(codegen, param_alloca, param->data.parameter.name,
+                        param->data.parameter.resolved_type, function, i + 1);
   }
 
   // Generate function body
@@ -1189,6 +1844,7 @@ LLVMValueRef codegen_function(CodeGen *codegen, ASTNode *function) {
   }
 
   codegen->current_function = NULL;
+  debug_info_end_function(codegen);
 
   // Clean up parameter types array
   if (param_types) {
@@ -1198,12 +1854,14 @@ LLVMValueRef codegen_function(CodeGen *codegen, ASTNode *function) {
   // TODO: Clear function-local variables from symbol table
   // For now, we'll keep it simple and rely on function scope
 
+  trace_end(span, "codegen", function->data.function.name, codegen->source_path,
+            function->data.function.name);
   return llvm_function;
 }
 
 LLVMValueRef codegen_block(CodeGen *codegen, ASTNode *block) {
   if (block->type != NODE_BLOCK) {
-    fprintf(stderr, "Expected block node\n");
+    report_error("Expected block node\n");
     return NULL;
   }
 
@@ -1227,6 +1885,7 @@ LLVMValueRef codegen_block(CodeGen *codegen, ASTNode *block) {
 }
 
 LLVMValueRef codegen_statement(CodeGen *codegen, ASTNode *statement) {
+  debug_info_location(codegen, statement);
   switch (statement->type) {
   case NODE_VARIABLE_DECL:
     return codegen_variable_decl(codegen, statement);
@@ -1286,14 +1945,14 @@ LLVMValueRef codegen_expression(CodeGen *codegen, ASTNode *expression) {
   case NODE_STRUCT_LITERAL:
     return codegen_struct_literal(codegen, expression);
   default:
-    fprintf(stderr, "Unknown expression type: %d\n", expression->type);
+    report_error("Unknown expression type: %d\n", expression->type);
     return NULL;
   }
 }
 
 LLVMValueRef codegen_variable_decl(CodeGen *codegen, ASTNode *var_decl) {
   if (var_decl->type != NODE_VARIABLE_DECL) {
-    fprintf(stderr, "Expected variable declaration node\n");
+    report_error("Expected variable declaration node\n");
     return NULL;
   }
 
@@ -1305,67 +1964,22 @@ LLVMValueRef codegen_variable_decl(CodeGen *codegen, ASTNode *var_decl) {
   LLVMValueRef alloca_inst = LLVMBuildAlloca(codegen->builder, var_type,
                                              var_decl->data.variable_decl.name);
 
-  // Generate initial value
-  LLVMValueRef initial_value = NULL;
-  if (var_decl->data.variable_decl.value) {
-    initial_value =
-        codegen_expression(codegen, var_decl->data.variable_decl.value);
-    if (initial_value) {
-      // Check if this is a struct assignment
-      if (var_decl->data.variable_decl.value->type == NODE_STRUCT_LITERAL) {
-        // For struct literals, we need to copy the struct, not store a pointer
-        LLVMValueRef struct_value = LLVMBuildLoad2(codegen->builder, var_type,
-                                                   initial_value, "struct_val");
-        LLVMBuildStore(codegen->builder, struct_value, alloca_inst);
-      } else {
-        // Get the target type and source type
-        TypeKind target_type = var_decl->data.variable_decl.resolved_type;
-        TypeKind source_type = get_expression_type(codegen, var_decl->data.variable_decl.value);
-        
-        // If types don't match, we need to cast
-        if (target_type != source_type && source_type != TYPE_UNKNOWN) {
-          LLVMTypeRef target_llvm_type = get_llvm_type_from_kind(codegen, target_type);
-          const Type *src_info = get_type_info(source_type);
-          const Type *target_info = get_type_info(target_type);
-          
-          if (src_info && target_info && src_info->is_numeric && target_info->is_numeric) {
-            // Perform automatic type conversion for numeric types
-            if (src_info->size < target_info->size) {
-              // Widening conversion
-              if (src_info->is_signed && target_info->is_signed) {
-                initial_value = LLVMBuildSExt(codegen->builder, initial_value, target_llvm_type, "auto_sext");
-              } else if (!src_info->is_signed && !target_info->is_signed) {
-                initial_value = LLVMBuildZExt(codegen->builder, initial_value, target_llvm_type, "auto_zext");
-              } else {
-                initial_value = LLVMBuildIntCast(codegen->builder, initial_value, target_llvm_type, "auto_cast");
-              }
-            } else if (src_info->size > target_info->size) {
-              // Narrowing conversion (truncation)
-              initial_value = LLVMBuildTrunc(codegen->builder, initial_value, target_llvm_type, "auto_trunc");
-            } else {
-              // Same size, different signedness
-              initial_value = LLVMBuildBitCast(codegen->builder, initial_value, target_llvm_type, "auto_bitcast");
-            }
-          }
-        }
-        
-        LLVMBuildStore(codegen->builder, initial_value, alloca_inst);
-      }
-    }
-  }
+  store_initial_value(codegen, var_decl, var_type, alloca_inst);
 
   // Add to symbol table
   set_variable_with_type(codegen, var_decl->data.variable_decl.name,
                          alloca_inst, var_type,
                          var_decl->data.variable_decl.is_mutable,
                          var_decl->data.variable_decl.resolved_type);
+  debug_info_variable(codegen, alloca_inst, var_decl->data.variable_decl.name,
+                      var_decl->data.variable_decl.resolved_type, var_decl, 0);
 
   return alloca_inst;
 }
 
 LLVMValueRef codegen_assignment(CodeGen *codegen, ASTNode *assignment) {
   if (assignment->type != NODE_ASSIGNMENT) {
-    fprintf(stderr, "Expected assignment statement node\n");
+    report_error("Expected assignment statement node\n");
     return NULL;
   }
 
@@ -1374,14 +1988,19 @@ LLVMValueRef codegen_assignment(CodeGen *codegen, ASTNode *assignment) {
   LLVMValueRef var_alloca = get_variable(codegen, var_name);
 
   if (!var_alloca) {
-    fprintf(stderr, "Error: Undefined variable '%s' in assignment\n", var_name);
+    report_error("Error: Undefined variable '%s' in assignment\n", var_name);
     return NULL;
   }
 
   int mutability = get_variable_mutability(codegen, var_name);
   if (mutability == 0) {
-    fprintf(stderr, "Error: Cannot assign to immutable variable '%s'\n",
-            var_name);
+    report_error("Error: Cannot assign to immutable variable '%s'\n",
+                 var_name);
+    codegen->has_error = 1;
+    return NULL;
+  }
+  if (mutability == -1) {
+    report_error("Error: Cannot assign to constant '%s'\n", var_name);
     codegen->has_error = 1;
     return NULL;
   }
@@ -1390,7 +2009,7 @@ LLVMValueRef codegen_assignment(CodeGen *codegen, ASTNode *assignment) {
   LLVMValueRef new_value =
       codegen_expression(codegen, assignment->data.assignment.value);
   if (!new_value) {
-    fprintf(stderr, "Error: Failed to generate code for assignment value\n");
+    report_error("Error: Failed to generate code for assignment value\n");
     return NULL;
   }
 
@@ -1400,7 +2019,7 @@ LLVMValueRef codegen_assignment(CodeGen *codegen, ASTNode *assignment) {
 
 LLVMValueRef codegen_pointer_assignment(CodeGen *codegen, ASTNode *assignment) {
   if (assignment->type != NODE_POINTER_ASSIGNMENT) {
-    fprintf(stderr, "Expected pointer assignment statement node\n");
+    report_error("Expected pointer assignment statement node\n");
     return NULL;
   }
 
@@ -1408,7 +2027,7 @@ LLVMValueRef codegen_pointer_assignment(CodeGen *codegen, ASTNode *assignment) {
   ASTNode *target = assignment->data.pointer_assignment.target;
   if (target->type != NODE_UNARY_OP ||
       target->data.unary_op.operator != UNARY_DEREFERENCE) {
-    fprintf(stderr, "Error: Pointer assignment target must be a dereference\n");
+    report_error("Error: Pointer assignment target must be a dereference\n");
     return NULL;
   }
 
@@ -1416,8 +2035,7 @@ LLVMValueRef codegen_pointer_assignment(CodeGen *codegen, ASTNode *assignment) {
   LLVMValueRef pointer =
       codegen_expression(codegen, target->data.unary_op.operand);
   if (!pointer) {
-    fprintf(stderr,
-            "Error: Failed to generate code for pointer in assignment\n");
+    report_error("Error: Failed to generate code for pointer in assignment\n");
     return NULL;
   }
 
@@ -1425,8 +2043,8 @@ LLVMValueRef codegen_pointer_assignment(CodeGen *codegen, ASTNode *assignment) {
   LLVMValueRef new_value =
       codegen_expression(codegen, assignment->data.pointer_assignment.value);
   if (!new_value) {
-    fprintf(stderr,
-            "Error: Failed to generate code for pointer assignment value\n");
+    report_error(
+        "Error: Failed to generate code for pointer assignment value\n");
     return NULL;
   }
 
@@ -1436,7 +2054,7 @@ LLVMValueRef codegen_pointer_assignment(CodeGen *codegen, ASTNode *assignment) {
 
 LLVMValueRef codegen_return(CodeGen *codegen, ASTNode *return_stmt) {
   if (return_stmt->type != NODE_RETURN) {
-    fprintf(stderr, "Expected return statement node\n");
+    report_error("Expected return statement node\n");
     return NULL;
   }
 
@@ -1451,7 +2069,7 @@ LLVMValueRef codegen_return(CodeGen *codegen, ASTNode *return_stmt) {
 
 LLVMValueRef codegen_call(CodeGen *codegen, ASTNode *call) {
   if (call->type != NODE_CALL) {
-    fprintf(stderr, "Expected call node\n");
+    report_error("Expected call node\n");
     return NULL;
   }
 
@@ -1481,7 +2099,7 @@ LLVMValueRef codegen_call(CodeGen *codegen, ASTNode *call) {
   // Look up the function
   LLVMValueRef function = get_function(codegen, call->data.call.name);
   if (!function) {
-    fprintf(stderr, "Unknown function: %s\n", call->data.call.name);
+    report_error("Unknown function: %s\n", call->data.call.name);
     return NULL;
   }
 
@@ -1509,7 +2127,7 @@ LLVMValueRef codegen_call(CodeGen *codegen, ASTNode *call) {
 
 LLVMValueRef codegen_literal(CodeGen *codegen, ASTNode *literal) {
   if (literal->type != NODE_LITERAL) {
-    fprintf(stderr, "Expected literal node\n");
+    report_error("Expected literal node\n");
     return NULL;
   }
 
@@ -1524,22 +2142,33 @@ LLVMValueRef codegen_literal(CodeGen *codegen, ASTNode *literal) {
     LLVMValueRef string_const = LLVMBuildGlobalStringPtr(
         codegen->builder, literal->data.literal.value, "str");
     return string_const;
+  }
+
+  // Literals of the other integer and float types come from constant folding
+  TypeKind kind = literal->data.literal.resolved_type;
+  if (is_integer_type(kind) && kind != TYPE_I128) {
+    // strtoull reads negative values as their two's complement
+    unsigned long long value = strtoull(literal->data.literal.value, NULL, 10);
+    return LLVMConstInt(get_llvm_type_from_kind(codegen, kind), value, 0);
+  } else if (kind == TYPE_F32 || kind == TYPE_F64) {
+    return LLVMConstReal(get_llvm_type_from_kind(codegen, kind),
+                         strtod(literal->data.literal.value, NULL));
   } else {
-    fprintf(stderr, "Unknown literal type: %s\n", literal->data.literal.type);
+    report_error("Unknown literal type: %s\n", literal->data.literal.type);
     return NULL;
   }
 }
 
 LLVMValueRef codegen_identifier(CodeGen *codegen, ASTNode *identifier) {
   if (identifier->type != NODE_IDENTIFIER) {
-    fprintf(stderr, "Expected identifier node\n");
+    report_error("Expected identifier node\n");
     return NULL;
   }
 
   // Look up variable
   LLVMValueRef var = get_variable(codegen, identifier->data.identifier.name);
   if (!var) {
-    fprintf(stderr, "Unknown variable: %s\n", identifier->data.identifier.name);
+    report_error("Unknown variable: %s\n", identifier->data.identifier.name);
     return NULL;
   }
 
@@ -1547,8 +2176,8 @@ LLVMValueRef codegen_identifier(CodeGen *codegen, ASTNode *identifier) {
   LLVMTypeRef var_type =
       get_variable_type(codegen, identifier->data.identifier.name);
   if (!var_type) {
-    fprintf(stderr, "Unknown variable type: %s\n",
-            identifier->data.identifier.name);
+    report_error("Unknown variable type: %s\n",
+                 identifier->data.identifier.name);
     return NULL;
   }
 
@@ -1559,7 +2188,7 @@ LLVMValueRef codegen_identifier(CodeGen *codegen, ASTNode *identifier) {
 
 LLVMValueRef codegen_binary_op(CodeGen *codegen, ASTNode *binary_op) {
   if (binary_op->type != NODE_BINARY_OP) {
-    fprintf(stderr, "Expected binary operation node\n");
+    report_error("Expected binary operation node\n");
     return NULL;
   }
 
@@ -1575,19 +2204,19 @@ LLVMValueRef codegen_binary_op(CodeGen *codegen, ASTNode *binary_op) {
 
   if (is_comparison) {
     if (!types_comparable(left_type, right_type)) {
-      fprintf(stderr,
-              "Error: Cannot compare incompatible types '%s' and '%s'\n",
-              type_to_string(left_type), type_to_string(right_type));
+      report_error(
+          "Error: Cannot compare incompatible types '%s' and '%s'\n",
+          type_to_string(left_type), type_to_string(right_type));
       codegen->has_error = 1;
       return NULL;
     }
   } else {
     // Arithmetic operations
     if (!types_compatible(left_type, right_type)) {
-      fprintf(stderr,
-              "Error: Cannot perform arithmetic on incompatible types '%s' and "
-              "'%s'\n",
-              type_to_string(left_type), type_to_string(right_type));
+      report_error(
+          "Error: Cannot perform arithmetic on incompatible types '%s' and "
+          "'%s'\n",
+          type_to_string(left_type), type_to_string(right_type));
       codegen->has_error = 1;
       return NULL;
     }
@@ -1600,7 +2229,7 @@ LLVMValueRef codegen_binary_op(CodeGen *codegen, ASTNode *binary_op) {
       codegen_expression(codegen, binary_op->data.binary_op.right);
 
   if (!left || !right) {
-    fprintf(stderr, "Failed to generate operands for binary operation\n");
+    report_error("Failed to generate operands for binary operation\n");
     return NULL;
   }
 
@@ -1628,15 +2257,15 @@ LLVMValueRef codegen_binary_op(CodeGen *codegen, ASTNode *binary_op) {
   case OP_GE:
     return LLVMBuildICmp(codegen->builder, LLVMIntSGE, left, right, "getmp");
   default:
-    fprintf(stderr, "Unknown binary operator: %d\n",
-            binary_op->data.binary_op.operator);
+    report_error("Unknown binary operator: %d\n",
+                 binary_op->data.binary_op.operator);
     return NULL;
   }
 }
 
 LLVMValueRef codegen_unary_op(CodeGen *codegen, ASTNode *unary_op) {
   if (unary_op->type != NODE_UNARY_OP) {
-    fprintf(stderr, "Expected unary operation node\n");
+    report_error("Expected unary operation node\n");
     return NULL;
   }
 
@@ -1650,15 +2279,23 @@ LLVMValueRef codegen_unary_op(CodeGen *codegen, ASTNode *unary_op) {
       LLVMValueRef var_alloca =
           get_variable(codegen, operand->data.identifier.name);
       if (!var_alloca) {
-        fprintf(stderr,
-                "Error: Variable '%s' not found for address-of operation\n",
-                operand->data.identifier.name);
+        report_error(
+            "Error: Variable '%s' not found for address-of operation\n",
+            operand->data.identifier.name);
+        return NULL;
+      }
+      // Constant globals may live in read-only memory
+      if (LLVMIsAGlobalVariable(var_alloca) &&
+          get_variable_mutability(codegen, operand->data.identifier.name) == -1) {
+        report_error("Error: Cannot take the address of constant '%s'\n",
+                     operand->data.identifier.name);
+        codegen->has_error = 1;
         return NULL;
       }
       return var_alloca; // The alloca itself is the address
     } else {
-      fprintf(stderr,
-              "Error: Address-of operator can only be applied to variables\n");
+      report_error(
+          "Error: Address-of operator can only be applied to variables\n");
       return NULL;
     }
 
@@ -1666,16 +2303,15 @@ LLVMValueRef codegen_unary_op(CodeGen *codegen, ASTNode *unary_op) {
     // For dereference, we need to load from the pointer
     LLVMValueRef ptr_value = codegen_expression(codegen, operand);
     if (!ptr_value) {
-      fprintf(stderr,
-              "Error: Failed to generate code for dereference operand\n");
+      report_error("Error: Failed to generate code for dereference operand\n");
       return NULL;
     }
 
     // Get the pointed-to type for the load instruction
     TypeKind operand_type = get_expression_type(codegen, operand);
     if (!is_pointer_type(operand_type)) {
-      fprintf(stderr, "Error: Cannot dereference non-pointer type '%s'\n",
-              type_to_string(operand_type));
+      report_error("Error: Cannot dereference non-pointer type '%s'\n",
+                   type_to_string(operand_type));
       codegen->has_error = 1;
       return NULL;
     }
@@ -1688,74 +2324,397 @@ LLVMValueRef codegen_unary_op(CodeGen *codegen, ASTNode *unary_op) {
                           "deref");
 
   default:
-    fprintf(stderr, "Unknown unary operator: %d\n",
-            unary_op->data.unary_op.operator);
+    report_error("Unknown unary operator: %d\n",
+                 unary_op->data.unary_op.operator);
     return NULL;
   }
 }
 
 void print_llvm_ir(CodeGen *codegen) {
-  char *ir = LLVMPrintModuleToString(codegen->module);
-  printf("%s\n", ir);
-  LLVMDisposeMessage(ir);
+  // Streamed to stdout ("-") rather than built up as one string
+  char *error_msg = NULL;
+  fflush(stdout);
+  if (LLVMPrintModuleToFile(codegen->module, "-", &error_msg)) {
+    report_error("Error printing LLVM IR: %s\n", error_msg);
+  }
+  LLVMDisposeMessage(error_msg);
 }
 
-int write_object_file(CodeGen *codegen, const char *filename) {
-  char *error_msg;
-
-  // Initialize target
-  LLVMInitializeAllTargetInfos();
-  LLVMInitializeAllTargets();
-  LLVMInitializeAllTargetMCs();
-  LLVMInitializeAllAsmParsers();
-  LLVMInitializeAllAsmPrinters();
+LLVMTargetMachineRef create_target_machine(LLVMModuleRef module,
+                                           int optimization_level,
+                                           char **error_message) {
+  initialize_native_target();
 
   char *target_triple = LLVMGetDefaultTargetTriple();
-  LLVMSetTarget(codegen->module, target_triple);
+  LLVMSetTarget(module, target_triple);
 
   LLVMTargetRef target;
-  if (LLVMGetTargetFromTriple(target_triple, &target, &error_msg)) {
-    fprintf(stderr, "Error getting target: %s\n", error_msg);
+  if (LLVMGetTargetFromTriple(target_triple, &target, error_message)) {
+    LLVMDisposeMessage(target_triple);
+    return NULL;
+  }
+
+  // Without -O the IR is emitted as generated, but instruction selection
+  // keeps running at the default level as it always has
+  LLVMCodeGenOptLevel level = LLVMCodeGenLevelDefault;
+  if (optimization_level == 1) {
+    level = LLVMCodeGenLevelLess;
+  } else if (optimization_level >= 3) {
+    level = LLVMCodeGenLevelAggressive;
+  }
+
+  LLVMTargetMachineRef target_machine =
+      LLVMCreateTargetMachine(target, target_triple, "generic", "", level,
+                              LLVMRelocDefault, LLVMCodeModelDefault);
+  LLVMDisposeMessage(target_triple);
+  return target_machine;
+}
+
+int optimize_module(LLVMModuleRef module, LLVMTargetMachineRef target_machine,
+                    int optimization_level, LTOMode lto,
+                    const PassProfile *profile, char **error_message) {
+  // Bitcode for the LTO link gets the pre-link pipelines, which leave
+  // cross-module work to the link
+  static const char *pipelines[][4] = {
+      {"default<O0>", "default<O1>", "default<O2>", "default<O3>"},
+      {"lto-pre-link<O0>", "lto-pre-link<O1>", "lto-pre-link<O2>",
+       "lto-pre-link<O3>"},
+      {"thinlto-pre-link<O0>", "thinlto-pre-link<O1>", "thinlto-pre-link<O2>",
+       "thinlto-pre-link<O3>"}};
+  // -O0 runs no IR passes, unless they have to add PGO counters
+  if (optimization_level <= 0 && !(profile && profile->generate)) {
+    return 0;
+  }
+  if (optimization_level < 0) {
+    optimization_level = 0;
+  }
+  if (optimization_level > 3) {
+    optimization_level = 3;
+  }
+
+  size_t length;
+  double span = trace_begin();
+  const char *pipeline = pipelines[lto][optimization_level];
+  LLVMErrorRef error =
+      run_pass_pipeline(module, pipeline, target_machine, profile);
+  trace_end(span, "optimize", pipeline,
+            LLVMGetModuleIdentifier(module, &length), NULL);
+  if (error) {
+    *error_message = LLVMGetErrorMessage(error);
+    return 1;
+  }
+  return 0;
+}
+
+// Create a target machine for the host and run the optimization pipeline,
+// with any PGO counters or profile, then add --profile counters and the PGO
+// runtime to the optimized code, reporting any failure
+static LLVMTargetMachineRef prepare_emission(CodeGen *codegen) {
+  char *error_msg = NULL;
+  LLVMTargetMachineRef target_machine = create_target_machine(
+      codegen->module, codegen->optimization_level, &error_msg);
+  if (!target_machine) {
+    report_error("Error getting target: %s\n", error_msg);
     LLVMDisposeMessage(error_msg);
+    return NULL;
+  }
+
+  PassProfile profile = {codegen->profile_generate, codegen->profile_use};
+  if (optimize_module(codegen->module, target_machine,
+                      codegen->optimization_level, LTO_NONE, &profile,
+                      &error_msg) != 0) {
+    report_error("Error optimizing module: %s\n", error_msg);
+    LLVMDisposeErrorMessage(error_msg);
+    LLVMDisposeTargetMachine(target_machine);
+    return NULL;
+  }
+  profile_module(codegen);
+  pgo_add_runtime(codegen);
+  return target_machine;
+}
+
+// Emit an object or assembly file for the optimized module
+static int write_target_file(CodeGen *codegen, const char *filename,
+                             LLVMCodeGenFileType file_type) {
+  const char *kind = file_type == LLVMAssemblyFile ? "assembly" : "object";
+  LLVMTargetMachineRef target_machine = prepare_emission(codegen);
+  if (!target_machine) {
     return 1;
   }
+  record_llvm_module(codegen->module);
 
-  LLVMTargetMachineRef target_machine = LLVMCreateTargetMachine(
-      target, target_triple, "generic", "", LLVMCodeGenLevelDefault,
-      LLVMRelocDefault, LLVMCodeModelDefault);
+  // Emit next to the destination and rename it into place, so that
+  // compilers building the same module concurrently never see a partial
+  // object. Stdout and devices are written directly.
+  int in_place = writes_in_place(filename);
+  char *tmp_path = in_place ? strdup(filename) : temporary_path(filename);
+  char *error_msg;
+  int failed = 0;
+  TimePoint start = time_now();
+  double span = trace_begin();
+  int emit_failed = LLVMTargetMachineEmitToFile(
+      target_machine, codegen->module, tmp_path, file_type, &error_msg);
+  record_time(TIMING_EMIT, filename, start);
+  trace_end(span, "emit",
+            file_type == LLVMAssemblyFile ? "emit assembly" : "emit object",
+            filename, NULL);
+  if (emit_failed) {
+    report_error("Error writing %s file: %s\n", kind, error_msg);
+    LLVMDisposeMessage(error_msg);
+    failed = 1;
+  } else if (!in_place && rename(tmp_path, filename) != 0) {
+    report_error("Error writing %s file: %s\n", kind, filename);
+    failed = 1;
+  }
+  if (failed && !in_place) {
+    remove(tmp_path);
+  }
+
+  free(tmp_path);
+  LLVMDisposeTargetMachine(target_machine);
+  return failed;
+}
+
+int write_object_file(CodeGen *codegen, const char *filename) {
+  return write_target_file(codegen, filename, LLVMObjectFile);
+}
+
+int write_assembly_file(CodeGen *codegen, const char *filename) {
+  return write_target_file(codegen, filename, LLVMAssemblyFile);
+}
 
-  if (LLVMTargetMachineEmitToFile(target_machine, codegen->module,
-                                  (char *)filename, LLVMObjectFile,
-                                  &error_msg)) {
-    fprintf(stderr, "Error writing object file: %s\n", error_msg);
+// Write the optimized module as textual IR, as it would be emitted
+int write_ir_file(CodeGen *codegen, const char *filename) {
+  LLVMTargetMachineRef target_machine = prepare_emission(codegen);
+  if (!target_machine) {
+    return 1;
+  }
+  LLVMDisposeTargetMachine(target_machine);
+  record_llvm_module(codegen->module);
+
+  int in_place = writes_in_place(filename);
+  char *tmp_path = in_place ? strdup(filename) : temporary_path(filename);
+  char *error_msg = NULL;
+  int failed = 0;
+  TimePoint start = time_now();
+  double span = trace_begin();
+  int print_failed =
+      LLVMPrintModuleToFile(codegen->module, tmp_path, &error_msg);
+  record_time(TIMING_EMIT, filename, start);
+  trace_end(span, "emit", "emit IR", filename, NULL);
+  if (print_failed) {
+    report_error("Error writing IR file: %s\n", error_msg);
+    failed = 1;
+  } else if (!in_place && rename(tmp_path, filename) != 0) {
+    report_error("Error writing IR file: %s\n", filename);
+    failed = 1;
+  }
+  if (failed && !in_place) {
+    remove(tmp_path);
+  }
+  LLVMDisposeMessage(error_msg);
+  free(tmp_path);
+  return failed;
+}
+
+// Write the module's bitcode, through the pre-link pipeline under -flto
+int write_bitcode_file(CodeGen *codegen, const char *filename) {
+  char *error_msg = NULL;
+  LLVMTargetMachineRef target_machine = create_target_machine(
+      codegen->module, codegen->optimization_level, &error_msg);
+  if (!target_machine) {
+    report_error("Error getting target: %s\n", error_msg);
     LLVMDisposeMessage(error_msg);
     return 1;
   }
+  // The LTO link lays out the merged code as the target machine does
+  LLVMTargetDataRef layout = LLVMCreateTargetDataLayout(target_machine);
+  LLVMSetModuleDataLayout(codegen->module, layout);
+  LLVMDisposeTargetData(layout);
 
+  PassProfile profile = {NULL, codegen->profile_use};
+  int failed = optimize_module(codegen->module, target_machine,
+                               codegen->optimization_level, codegen->lto,
+                               &profile, &error_msg);
   LLVMDisposeTargetMachine(target_machine);
-  LLVMDisposeMessage(target_triple);
+  if (failed) {
+    report_error("Error optimizing module: %s\n", error_msg);
+    LLVMDisposeErrorMessage(error_msg);
+    return 1;
+  }
+  record_llvm_module(codegen->module);
+
+  // Written next to the destination and renamed into place, as objects are
+  int in_place = writes_in_place(filename);
+  char *tmp_path = in_place ? strdup(filename) : temporary_path(filename);
+  TimePoint start = time_now();
+  double span = trace_begin();
+  failed = write_lto_bitcode(codegen->module, tmp_path, codegen->lto,
+                             &error_msg);
+  record_time(TIMING_EMIT, filename, start);
+  trace_end(span, "emit", "emit bitcode", filename, NULL);
+  if (failed) {
+    report_error("Error writing bitcode file: %s\n", error_msg);
+    free(error_msg);
+  } else if (!in_place && rename(tmp_path, filename) != 0) {
+    report_error("Error writing bitcode file: %s\n", filename);
+    failed = 1;
+  }
+  if (failed && !in_place) {
+    remove(tmp_path);
+  }
+  free(tmp_path);
+  return failed;
+}
 
-  return 0;
+// Write the program's bitcode and run the LTO link over it and the bitcode
+// of every imported module
+static int write_lto_objects(CodeGen *codegen, const char *filename,
+                             char ***objects, int *object_count) {
+  char *bitcode_path = malloc(strlen(filename) + 4);
+  sprintf(bitcode_path, "%s.bc", filename);
+  if (write_bitcode_file(codegen, bitcode_path) != 0) {
+    free(bitcode_path);
+    return 1;
+  }
+
+  // Imports before importers, as the constructors run in input order
+  ImportGraph *graph = codegen->imports;
+  const char **inputs = malloc((graph->module_count + 1) * sizeof(char *));
+  ImportModule **order = malloc((graph->module_count + 1) * sizeof(ImportModule *));
+  int order_count = import_graph_order(graph, order);
+  int input_count = 0;
+  for (int i = 0; i < order_count; i++) {
+    if (order[i]->object_path) {
+      inputs[input_count++] = order[i]->object_path;
+    }
+  }
+  inputs[input_count++] = bitcode_path;
+  free(order);
+
+  // ThinLTO backends are cached next to the program source
+  char *cache_dir = NULL;
+  if (codegen->lto == LTO_THIN && codegen->source_path) {
+    cache_dir = module_cache_path(codegen->source_path, ".thinlto");
+  }
+
+  char *error_msg = NULL;
+  TimePoint start = time_now();
+  double span = trace_begin();
+  int failed = run_lto(inputs, input_count, codegen->lto,
+                       codegen->optimization_level, codegen->codegen_threads,
+                       cache_dir, filename, objects, object_count, &error_msg);
+  record_time(TIMING_LINK, "lto", start);
+  trace_end(span, "link", "lto", filename, NULL);
+  if (failed) {
+    report_error("Error in LTO link: %s\n", error_msg);
+    free(error_msg);
+  }
+
+  remove(bitcode_path);
+  free(bitcode_path);
+  free(cache_dir);
+  free(inputs);
+  return failed;
+}
+
+int emit_object_buffer(CodeGen *codegen, LLVMMemoryBufferRef *buffer) {
+  LLVMTargetMachineRef target_machine = prepare_emission(codegen);
+  if (!target_machine) {
+    return 1;
+  }
+  record_llvm_module(codegen->module);
+
+  char *error_msg;
+  int failed = 0;
+  TimePoint start = time_now();
+  double span = trace_begin();
+  int emit_failed = LLVMTargetMachineEmitToMemoryBuffer(
+      target_machine, codegen->module, LLVMObjectFile, &error_msg, buffer);
+  record_time(TIMING_EMIT, NULL, start);
+  trace_end(span, "emit", "emit object", codegen->source_path, NULL);
+  if (emit_failed) {
+    report_error("Error generating object code: %s\n", error_msg);
+    LLVMDisposeMessage(error_msg);
+    failed = 1;
+  }
+
+  LLVMDisposeTargetMachine(target_machine);
+  return failed;
 }
 
 int write_executable(CodeGen *codegen, const char *filename) {
-  // First write object file
-  char obj_filename[256];
-  snprintf(obj_filename, sizeof(obj_filename), "%s.o", filename);
+  // First write the object files: one, or one per partition
+  char **objects = NULL;
+  int object_count = 0;
+  // Profiles only pair up callers and callees within one object, and PGO
+  // counters and branch weights belong to whole functions
+  if (codegen->lto != LTO_NONE) {
+    if (write_lto_objects(codegen, filename, &objects, &object_count) != 0) {
+      return 1;
+    }
+  } else if (codegen->codegen_threads > 0 && !codegen->profile &&
+             !codegen->profile_generate && !codegen->profile_use) {
+    if (write_partitioned_objects(codegen, filename, codegen->codegen_threads,
+                                  &objects, &object_count) != 0) {
+      return 1;
+    }
+  } else {
+    objects = malloc(sizeof(char *));
+    objects[0] = malloc(strlen(filename) + 3);
+    sprintf(objects[0], "%s.o", filename);
+    object_count = 1;
+    if (write_object_file(codegen, objects[0]) != 0) {
+      free(objects[0]);
+      free(objects);
+      return 1;
+    }
+  }
 
-  if (write_object_file(codegen, obj_filename) != 0) {
-    return 1;
+  // Then link them together with the objects of every imported module
+  // (using system linker); after LTO, the imports are in the objects.
+  // Imports go first, each after its own imports, since constructors run
+  // in link order
+  int link_imports = codegen->lto == LTO_NONE;
+  ImportModule **order =
+      malloc((codegen->imports->module_count + 1) * sizeof(ImportModule *));
+  int order_count = link_imports ? import_graph_order(codegen->imports, order) : 0;
+  size_t command_size = strlen(filename) + 32;
+  for (int i = 0; i < object_count; i++) {
+    command_size += strlen(objects[i]) + 1;
+  }
+  for (int i = 0; i < order_count; i++) {
+    if (order[i]->object_path) {
+      command_size += strlen(order[i]->object_path) + 1;
+    }
   }
 
-  // Then link it (using system linker)
-  char link_command[512];
-  snprintf(link_command, sizeof(link_command), "gcc -no-pie %s -o %s",
-           obj_filename, filename);
+  char *link_command = malloc(command_size);
+  int length = sprintf(link_command, "gcc -no-pie");
+  for (int i = 0; i < order_count; i++) {
+    if (order[i]->object_path) {
+      length += sprintf(link_command + length, " %s", order[i]->object_path);
+    }
+  }
+  for (int i = 0; i < object_count; i++) {
+    length += sprintf(link_command + length, " %s", objects[i]);
+  }
+  sprintf(link_command + length, " -o %s", filename);
+  free(order);
 
+  TimePoint start = time_now();
+  double span = trace_begin();
   int result = system(link_command);
+  record_time(TIMING_LINK, NULL, start);
+  trace_end(span, "link", "link", filename, NULL);
+  free(link_command);
 
-  // Clean up object file
-  remove(obj_filename);
+  // Clean up object files
+  for (int i = 0; i < object_count; i++) {
+    remove(objects[i]);
+    free(objects[i]);
+  }
+  free(objects);
 
   return result;
 }
@@ -1766,15 +2725,15 @@ LLVMValueRef codegen_struct(CodeGen *codegen, ASTNode *struct_decl) {
   // Struct declarations don't generate runtime code,
   // they just register LLVM types
   if (struct_decl->type != NODE_STRUCT) {
-    fprintf(stderr, "Expected struct declaration node\n");
+    report_error("Expected struct declaration node\n");
     return NULL;
   }
 
   // Get the struct type info from our type system
   StructType *st = find_struct_by_name(struct_decl->data.struct_decl.name);
   if (!st) {
-    fprintf(stderr, "Struct type '%s' not found in type system\n",
-            struct_decl->data.struct_decl.name);
+    report_error("Struct type '%s' not found in type system\n",
+                 struct_decl->data.struct_decl.name);
     return NULL;
   }
 
@@ -1784,11 +2743,16 @@ LLVMValueRef codegen_struct(CodeGen *codegen, ASTNode *struct_decl) {
     field_types[i] = get_llvm_type_from_kind(codegen, st->fields[i].type);
   }
 
-  LLVMTypeRef struct_type = LLVMStructType(field_types, st->field_count, 0);
+  LLVMTypeRef struct_type =
+      LLVMStructTypeInContext(codegen->context, field_types, st->field_count,
+                              0);
 
   // Generate method functions
   for (int i = 0; i < struct_decl->data.struct_decl.method_count; i++) {
     ASTNode *method = struct_decl->data.struct_decl.methods[i];
+    if (!is_reachable(codegen->reachable, method)) {
+      continue;
+    }
     codegen_struct_method(codegen, method, struct_decl->data.struct_decl.name,
                           struct_type);
   }
@@ -1801,9 +2765,10 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
                                    const char *struct_name,
                                    LLVMTypeRef struct_type) {
   if (method->type != NODE_STRUCT_METHOD) {
-    fprintf(stderr, "Expected struct method node\n");
+    report_error("Expected struct method node\n");
     return NULL;
   }
+  double span = trace_begin();
 
   // Create mangled method name: StructName_methodName
   char *mangled_name =
@@ -1832,9 +2797,16 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
   LLVMTypeRef function_type =
       LLVMFunctionType(return_type, param_types, total_param_count, 0);
 
-  // Create function
-  LLVMValueRef function =
-      LLVMAddFunction(codegen->module, mangled_name, function_type);
+  // Create the function, completing an earlier declaration if there is one
+  LLVMValueRef function = LLVMGetNamedFunction(codegen->module, mangled_name);
+  if (!function || LLVMCountBasicBlocks(function) > 0) {
+    function = LLVMAddFunction(codegen->module, mangled_name, function_type);
+  }
+  // Private methods stay out of the module interface, so no other object
+  // can call them
+  if (method->data.struct_method.visibility == VISIBILITY_PRIVATE) {
+    LLVMSetLinkage(function, LLVMInternalLinkage);
+  }
 
   // Set parameter names
   LLVMSetValueName(LLVMGetParam(function, 0), "self");
@@ -1844,8 +2816,11 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
   }
 
   // Create basic block
-  LLVMBasicBlockRef entry = LLVMAppendBasicBlock(function, "entry");
+  LLVMBasicBlockRef entry =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "entry");
   LLVMPositionBuilderAtEnd(codegen->builder, entry);
+  debug_info_function(codegen, function, method->data.struct_method.name,
+                      method);
 
   // Save current variable scope
   int saved_var_count = codegen->variable_count;
@@ -1866,6 +2841,8 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
 
     set_variable_with_type(codegen, param->data.parameter.name, param_alloca,
                            param_type, 1, param->data.parameter.resolved_type);
+    debug_info_variable(codegen, param_alloca, param->data.parameter.name,
+                        param->data.parameter.resolved_type, method, i + 2);
   }
 
   // Add struct fields as accessible variables (through self pointer)
@@ -1874,8 +2851,8 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
     for (int i = 0; i < st->field_count; i++) {
       // Create GEP to access field through self pointer
       LLVMValueRef indices[2];
-      indices[0] = LLVMConstInt(LLVMInt32Type(), 0, 0);
-      indices[1] = LLVMConstInt(LLVMInt32Type(), i, 0);
+      indices[0] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), 0, 0);
+      indices[1] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), i, 0);
 
       LLVMValueRef field_ptr =
           LLVMBuildGEP2(codegen->builder, struct_type, self_param, indices, 2,
@@ -1900,7 +2877,9 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
 
   // Restore variable scope
   codegen->variable_count = saved_var_count;
+  debug_info_end_function(codegen);
 
+  trace_end(span, "codegen", mangled_name, codegen->source_path, mangled_name);
   free(param_types);
   free(mangled_name);
   return function;
@@ -1908,7 +2887,7 @@ LLVMValueRef codegen_struct_method(CodeGen *codegen, ASTNode *method,
 
 LLVMValueRef codegen_enum(CodeGen *codegen, ASTNode *enum_decl) {
   if (enum_decl->type != NODE_ENUM) {
-    fprintf(stderr, "Expected enum declaration node\n");
+    report_error("Expected enum declaration node\n");
     return NULL;
   }
 
@@ -1934,13 +2913,13 @@ LLVMValueRef codegen_enum(CodeGen *codegen, ASTNode *enum_decl) {
     free(full_name);
   }
   
-  printf("Generated enum %s with %d variants\n", enum_name, enum_decl->data.enum_decl.variant_count);
+  report_info("Generated enum %s with %d variants\n", enum_name, enum_decl->data.enum_decl.variant_count);
   return NULL;  // Enum declarations don't return values
 }
 
 LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
   if (field_access->type != NODE_FIELD_ACCESS) {
-    fprintf(stderr, "Expected field access node\n");
+    report_error("Expected field access node\n");
     return NULL;
   }
 
@@ -1952,7 +2931,7 @@ LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
         field_access->data.field_access.object->data.identifier.name;
     object_ptr = get_variable(codegen, var_name);
     if (!object_ptr) {
-      fprintf(stderr, "Unknown variable: %s\n", var_name);
+      report_error("Unknown variable: %s\n", var_name);
       return NULL;
     }
   } else {
@@ -1976,14 +2955,14 @@ LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
   }
 
   if (!is_struct_type(object_type)) {
-    fprintf(stderr, "Cannot access field on non-struct type\n");
+    report_error("Cannot access field on non-struct type\n");
     return NULL;
   }
 
   // Get field index (not byte offset)
   StructType *st = get_struct_type(object_type);
   if (!st) {
-    fprintf(stderr, "Failed to get struct type info\n");
+    report_error("Failed to get struct type info\n");
     return NULL;
   }
 
@@ -1997,8 +2976,8 @@ LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
   }
 
   if (field_index < 0) {
-    fprintf(stderr, "Field '%s' not found in struct\n",
-            field_access->data.field_access.field_name);
+    report_error("Field '%s' not found in struct\n",
+                 field_access->data.field_access.field_name);
     return NULL;
   }
 
@@ -2006,8 +2985,10 @@ LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
   LLVMTypeRef struct_llvm_type = get_llvm_type_from_kind(codegen, object_type);
 
   LLVMValueRef indices[2];
-  indices[0] = LLVMConstInt(LLVMInt32Type(), 0, 0); // Dereference pointer
-  indices[1] = LLVMConstInt(LLVMInt32Type(), field_index, 0); // Field index
+  indices[0] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context),
+                            0, 0); // Dereference pointer
+  indices[1] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context),
+                            field_index, 0); // Field index
 
   LLVMValueRef field_ptr = LLVMBuildGEP2(codegen->builder, struct_llvm_type,
                                          object_ptr, indices, 2, "field_ptr");
@@ -2022,7 +3003,7 @@ LLVMValueRef codegen_field_access(CodeGen *codegen, ASTNode *field_access) {
 
 LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
   if (method_call->type != NODE_METHOD_CALL) {
-    fprintf(stderr, "Expected method call node\n");
+    report_error("Expected method call node\n");
     return NULL;
   }
 
@@ -2037,14 +3018,14 @@ LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
   }
 
   if (!is_struct_type(object_type)) {
-    fprintf(stderr, "Cannot call method on non-struct type\n");
+    report_error("Cannot call method on non-struct type\n");
     return NULL;
   }
 
   // Get struct type info
   StructType *st = get_struct_type(object_type);
   if (!st) {
-    fprintf(stderr, "Failed to get struct type info for method call\n");
+    report_error("Failed to get struct type info for method call\n");
     return NULL;
   }
 
@@ -2057,8 +3038,8 @@ LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
   // Look up the function in the module
   LLVMValueRef function = LLVMGetNamedFunction(codegen->module, mangled_name);
   if (!function) {
-    fprintf(stderr, "Method '%s' not found for struct '%s'\n",
-            method_call->data.method_call.method_name, st->name);
+    report_error("Method '%s' not found for struct '%s'\n",
+                 method_call->data.method_call.method_name, st->name);
     free(mangled_name);
     return NULL;
   }
@@ -2074,14 +3055,14 @@ LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
         method_call->data.method_call.object->data.identifier.name;
     args[0] = get_variable(codegen, var_name);
     if (!args[0]) {
-      fprintf(stderr, "Unknown variable: %s\n", var_name);
+      report_error("Unknown variable: %s\n", var_name);
       free(args);
       free(mangled_name);
       return NULL;
     }
   } else {
     // For other expressions, this would need more sophisticated handling
-    fprintf(stderr, "Method calls on complex expressions not yet supported\n");
+    report_error("Method calls on complex expressions not yet supported\n");
     free(args);
     free(mangled_name);
     return NULL;
@@ -2092,7 +3073,7 @@ LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
     args[i + 1] =
         codegen_expression(codegen, method_call->data.method_call.args[i]);
     if (!args[i + 1]) {
-      fprintf(stderr, "Failed to generate code for method argument %d\n", i);
+      report_error("Failed to generate code for method argument %d\n", i);
       free(args);
       free(mangled_name);
       return NULL;
@@ -2112,7 +3093,7 @@ LLVMValueRef codegen_method_call(CodeGen *codegen, ASTNode *method_call) {
 
 LLVMValueRef codegen_struct_literal(CodeGen *codegen, ASTNode *struct_literal) {
   if (struct_literal->type != NODE_STRUCT_LITERAL) {
-    fprintf(stderr, "Expected struct literal node\n");
+    report_error("Expected struct literal node\n");
     return NULL;
   }
 
@@ -2120,8 +3101,8 @@ LLVMValueRef codegen_struct_literal(CodeGen *codegen, ASTNode *struct_literal) {
   StructType *st =
       find_struct_by_name(struct_literal->data.struct_literal.struct_type_name);
   if (!st) {
-    fprintf(stderr, "Struct type '%s' not found\n",
-            struct_literal->data.struct_literal.struct_type_name);
+    report_error("Struct type '%s' not found\n",
+                 struct_literal->data.struct_literal.struct_type_name);
     return NULL;
   }
 
@@ -2131,7 +3112,9 @@ LLVMValueRef codegen_struct_literal(CodeGen *codegen, ASTNode *struct_literal) {
     field_types[i] = get_llvm_type_from_kind(codegen, st->fields[i].type);
   }
 
-  LLVMTypeRef struct_type = LLVMStructType(field_types, st->field_count, 0);
+  LLVMTypeRef struct_type =
+      LLVMStructTypeInContext(codegen->context, field_types, st->field_count,
+                              0);
 
   // Allocate space for the struct
   LLVMValueRef struct_alloca =
@@ -2152,8 +3135,8 @@ LLVMValueRef codegen_struct_literal(CodeGen *codegen, ASTNode *struct_literal) {
     }
 
     if (field_index < 0) {
-      fprintf(stderr, "Field '%s' not found in struct '%s'\n", field_name,
-              st->name);
+      report_error("Field '%s' not found in struct '%s'\n", field_name,
+                   st->name);
       free(field_types);
       return NULL;
     }
@@ -2167,8 +3150,9 @@ LLVMValueRef codegen_struct_literal(CodeGen *codegen, ASTNode *struct_literal) {
 
     // Store value in struct
     LLVMValueRef indices[2];
-    indices[0] = LLVMConstInt(LLVMInt32Type(), 0, 0);
-    indices[1] = LLVMConstInt(LLVMInt32Type(), field_index, 0);
+    indices[0] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), 0, 0);
+    indices[1] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context),
+                              field_index, 0);
 
     LLVMValueRef field_ptr = LLVMBuildGEP2(
         codegen->builder, struct_type, struct_alloca, indices, 2, "field_ptr");
@@ -2188,12 +3172,15 @@ LLVMValueRef codegen_if(CodeGen *codegen, ASTNode *if_stmt) {
 
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
-  LLVMBasicBlockRef then_block = LLVMAppendBasicBlock(function, "if_then");
+  LLVMBasicBlockRef then_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "if_then");
   LLVMBasicBlockRef else_block = NULL;
-  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(function, "if_merge");
+  LLVMBasicBlockRef merge_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "if_merge");
 
   if (if_stmt->data.if_stmt.else_block) {
-    else_block = LLVMAppendBasicBlock(function, "if_else");
+    else_block =
+        LLVMAppendBasicBlockInContext(codegen->context, function, "if_else");
     // Branch based on condition
     LLVMBuildCondBr(codegen->builder, condition, then_block, else_block);
   } else {
@@ -2270,13 +3257,16 @@ LLVMValueRef codegen_unless(CodeGen *codegen, ASTNode *unless_stmt) {
 
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
-  LLVMBasicBlockRef then_block = LLVMAppendBasicBlock(function, "unless_then");
+  LLVMBasicBlockRef then_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "unless_then");
   LLVMBasicBlockRef else_block = NULL;
   LLVMBasicBlockRef merge_block =
-      LLVMAppendBasicBlock(function, "unless_merge");
+      LLVMAppendBasicBlockInContext(codegen->context, function, "unless_merge");
 
   if (unless_stmt->data.unless_stmt.else_block) {
-    else_block = LLVMAppendBasicBlock(function, "unless_else");
+    else_block =
+        LLVMAppendBasicBlockInContext(codegen->context, function,
+                                      "unless_else");
     // Branch based on condition (reversed logic for unless)
     LLVMBuildCondBr(codegen->builder, condition, else_block, then_block);
   } else {
@@ -2347,11 +3337,16 @@ LLVMValueRef codegen_unless(CodeGen *codegen, ASTNode *unless_stmt) {
 LLVMValueRef codegen_for(CodeGen *codegen, ASTNode *for_stmt) {
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
-  LLVMBasicBlockRef init_block = LLVMAppendBasicBlock(function, "for_init");
-  LLVMBasicBlockRef cond_block = LLVMAppendBasicBlock(function, "for_cond");
-  LLVMBasicBlockRef body_block = LLVMAppendBasicBlock(function, "for_body");
-  LLVMBasicBlockRef update_block = LLVMAppendBasicBlock(function, "for_update");
-  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(function, "for_exit");
+  LLVMBasicBlockRef init_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "for_init");
+  LLVMBasicBlockRef cond_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "for_cond");
+  LLVMBasicBlockRef body_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "for_body");
+  LLVMBasicBlockRef update_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "for_update");
+  LLVMBasicBlockRef exit_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "for_exit");
 
   // Generate initialization
   LLVMBuildBr(codegen->builder, init_block);
@@ -2364,8 +3359,9 @@ LLVMValueRef codegen_for(CodeGen *codegen, ASTNode *for_stmt) {
   // Push loop context (continue goes to update, break goes to exit)
   push_loop_context(codegen, exit_block, update_block);
 
-  // Generate condition check
+  // Generate condition check, located like the update on the loop header
   LLVMPositionBuilderAtEnd(codegen->builder, cond_block);
+  debug_info_location(codegen, for_stmt);
   if (for_stmt->data.for_stmt.condition) {
     LLVMValueRef condition =
         codegen_expression(codegen, for_stmt->data.for_stmt.condition);
@@ -2386,6 +3382,7 @@ LLVMValueRef codegen_for(CodeGen *codegen, ASTNode *for_stmt) {
 
   // Generate update
   LLVMPositionBuilderAtEnd(codegen->builder, update_block);
+  debug_info_location(codegen, for_stmt);
   if (for_stmt->data.for_stmt.update) {
     codegen_expression(codegen, for_stmt->data.for_stmt.update);
   }
@@ -2403,9 +3400,12 @@ LLVMValueRef codegen_for(CodeGen *codegen, ASTNode *for_stmt) {
 LLVMValueRef codegen_while(CodeGen *codegen, ASTNode *while_stmt) {
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
-  LLVMBasicBlockRef cond_block = LLVMAppendBasicBlock(function, "while_cond");
-  LLVMBasicBlockRef body_block = LLVMAppendBasicBlock(function, "while_body");
-  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(function, "while_exit");
+  LLVMBasicBlockRef cond_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "while_cond");
+  LLVMBasicBlockRef body_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "while_body");
+  LLVMBasicBlockRef exit_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "while_exit");
 
   // Push loop context (continue goes to condition, break goes to exit)
   push_loop_context(codegen, exit_block, cond_block);
@@ -2447,11 +3447,14 @@ LLVMValueRef codegen_switch(CodeGen *codegen, ASTNode *switch_stmt) {
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
   LLVMBasicBlockRef default_block = NULL;
-  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(function, "switch_exit");
+  LLVMBasicBlockRef exit_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "switch_exit");
 
   // Create default block (will be used even if no explicit default)
   if (switch_stmt->data.switch_stmt.default_case) {
-    default_block = LLVMAppendBasicBlock(function, "switch_default");
+    default_block =
+        LLVMAppendBasicBlockInContext(codegen->context, function,
+                                      "switch_default");
   } else {
     default_block = exit_block; // No explicit default, jump to exit
   }
@@ -2462,7 +3465,8 @@ LLVMValueRef codegen_switch(CodeGen *codegen, ASTNode *switch_stmt) {
   for (int i = 0; i < switch_stmt->data.switch_stmt.case_count; i++) {
     char block_name[64];
     sprintf(block_name, "switch_case_%d", i);
-    case_blocks[i] = LLVMAppendBasicBlock(function, block_name);
+    case_blocks[i] =
+        LLVMAppendBasicBlockInContext(codegen->context, function, block_name);
   }
 
   // Create the switch instruction
@@ -2520,7 +3524,8 @@ LLVMValueRef codegen_match(CodeGen *codegen, ASTNode *match_stmt) {
 
   // Create basic blocks
   LLVMValueRef function = codegen->current_function;
-  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(function, "match_exit");
+  LLVMBasicBlockRef exit_block =
+      LLVMAppendBasicBlockInContext(codegen->context, function, "match_exit");
   LLVMBasicBlockRef default_block =
       exit_block; // Default to exit if no wildcard
 
@@ -2532,7 +3537,8 @@ LLVMValueRef codegen_match(CodeGen *codegen, ASTNode *match_stmt) {
   for (int i = 0; i < match_stmt->data.match_stmt.case_count; i++) {
     char block_name[64];
     sprintf(block_name, "match_case_%d", i);
-    case_blocks[i] = LLVMAppendBasicBlock(function, block_name);
+    case_blocks[i] =
+        LLVMAppendBasicBlockInContext(codegen->context, function, block_name);
 
     // Check if this is a wildcard pattern
     ASTNode *pattern =
@@ -0,0 +1,649 @@
+#include "daemon.h"
+#include "astcache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <llvm-c/Target.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DAEMON_MAGIC "GLDR"
+#define DAEMON_PROTOCOL_VERSION 2
+
+// Request limits; anything larger is treated as a malformed request
+#define DAEMON_MAX_ARGS 256
+#define DAEMON_MAX_ENV 4096
+#define DAEMON_MAX_STRING 65536
+
+// Request flags
+#define REQUEST_STDIN_TERMINAL 1u  // The client's stdin is a terminal
+
+// Request header, followed by the working directory, then each argument
+// and each environment entry ("NAME=value") as a 32-bit length and its
+// bytes
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t cwd_length;
+    uint32_t argc;
+    uint32_t env_count;
+    uint32_t flags;
+} RequestHeader;
+
+// Frame kinds. The daemon sends output and finally the exit status; the
+// client sends its stdin, ending with an empty frame at end of file.
+#define FRAME_STDOUT 'o'
+#define FRAME_STDERR 'e'
+#define FRAME_EXIT 'x'   // Payload: 32-bit exit status
+#define FRAME_STDIN 'i'
+
+typedef struct {
+    uint8_t kind;
+    uint8_t reserved[3];
+    uint32_t length;
+} FrameHeader;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// Write end of the pipe compilers use to report cached sources
+static int report_fd = -1;
+
+// In a compiler serving a client: whether the client's stdin is a terminal
+static int client_stdin_terminal = -1;
+
+extern char **environ;
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            return 1;
+        }
+        bytes += got;
+        size -= got;
+    }
+    return 0;
+}
+
+static int send_frame(int fd, uint8_t kind, const void *data, uint32_t length) {
+    FrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.kind = kind;
+    header.length = length;
+    if (write_all(fd, &header, sizeof(header)) != 0) {
+        return 1;
+    }
+    return length ? write_all(fd, data, length) : 0;
+}
+
+static int write_string(int fd, const char *str) {
+    uint32_t length = (uint32_t)strlen(str);
+    return write_all(fd, &length, sizeof(length)) || write_all(fd, str, length);
+}
+
+static char *read_string(int fd) {
+    uint32_t length;
+    if (read_all(fd, &length, sizeof(length)) != 0 || length > DAEMON_MAX_STRING) {
+        return NULL;
+    }
+    char *str = malloc(length + 1);
+    if (read_all(fd, str, length) != 0) {
+        free(str);
+        return NULL;
+    }
+    str[length] = '\0';
+    return str;
+}
+
+char *daemon_socket_path(void) {
+    const char *path = getenv("GLOIN_DAEMON_SOCKET");
+    if (path && *path) {
+        return strdup(path);
+    }
+
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char *socket_path;
+    if (dir && *dir) {
+        socket_path = malloc(strlen(dir) + 16);
+        sprintf(socket_path, "%s/gloinc.sock", dir);
+    } else {
+        socket_path = malloc(48);
+        sprintf(socket_path, "/tmp/gloinc-%u.sock", (unsigned)getuid());
+    }
+    return socket_path;
+}
+
+static int make_address(const char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+// Compiler side
+
+int input_is_terminal(int fd) {
+    if (fd == STDIN_FILENO && client_stdin_terminal >= 0) {
+        return client_stdin_terminal;
+    }
+    return isatty(fd);
+}
+
+static void report_source(const char *source_path) {
+    // Lines shorter than PIPE_BUF are written atomically, so reports from
+    // concurrent compilers never interleave
+    size_t length = strlen(source_path);
+    if (report_fd < 0 || length + 1 > PIPE_BUF) {
+        return;
+    }
+    char line[PIPE_BUF];
+    memcpy(line, source_path, length);
+    line[length] = '\n';
+    write_all(report_fd, line, length + 1);
+}
+
+// Read one frame from the client into *payload (resized as needed).
+// Returns 1 when the connection is closed or the frame is malformed.
+static int read_frame(int fd, FrameHeader *frame, char **payload) {
+    if (read_all(fd, frame, sizeof(*frame)) != 0 || frame->length > DAEMON_MAX_STRING) {
+        return 1;
+    }
+    *payload = realloc(*payload, frame->length ? frame->length : 1);
+    return read_all(fd, *payload, frame->length);
+}
+
+// Runs in a forked process per connection: reads the request, runs the
+// compiler in a further child with the client's environment, feeds it
+// the client's stdin and relays its output and exit status
+static void handle_connection(int connection, DaemonCommand command) {
+    struct timeval timeout = {10, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    RequestHeader header;
+    if (read_all(connection, &header, sizeof(header)) != 0 ||
+        memcmp(header.magic, DAEMON_MAGIC, 4) != 0 ||
+        header.version != DAEMON_PROTOCOL_VERSION ||
+        header.cwd_length > DAEMON_MAX_STRING ||
+        header.argc == 0 || header.argc > DAEMON_MAX_ARGS ||
+        header.env_count > DAEMON_MAX_ENV) {
+        return;
+    }
+
+    char *cwd = malloc(header.cwd_length + 1);
+    if (read_all(connection, cwd, header.cwd_length) != 0) {
+        return;
+    }
+    cwd[header.cwd_length] = '\0';
+
+    char **argv = calloc(header.argc + 1, sizeof(char *));
+    for (uint32_t i = 0; i < header.argc; i++) {
+        argv[i] = read_string(connection);
+        if (!argv[i]) {
+            return;
+        }
+    }
+    char **env = calloc(header.env_count + 1, sizeof(char *));
+    for (uint32_t i = 0; i < header.env_count; i++) {
+        env[i] = read_string(connection);
+        if (!env[i]) {
+            return;
+        }
+    }
+
+    int in_pipe[2], out_pipe[2], err_pipe[2];
+    if (pipe(in_pipe) != 0 || pipe(out_pipe) != 0 || pipe(err_pipe) != 0) {
+        return;
+    }
+
+    pid_t compiler = fork();
+    if (compiler < 0) {
+        return;
+    }
+    if (compiler == 0) {
+        close(connection);
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+        close(in_pipe[0]);
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        signal(SIGPIPE, SIG_DFL);
+
+        // Run as the client would have: its environment, its directory
+        clearenv();
+        for (uint32_t i = 0; i < header.env_count; i++) {
+            if (strchr(env[i], '=')) {
+                putenv(env[i]);
+            }
+        }
+        client_stdin_terminal = (header.flags & REQUEST_STDIN_TERMINAL) != 0;
+        if (chdir(cwd) != 0) {
+            fprintf(stderr, "Error: Could not enter directory '%s'\n", cwd);
+            exit(1);
+        }
+        set_ast_cache_observer(report_source);
+        exit(command((int)header.argc, argv));
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    fcntl(in_pipe[1], F_SETFL, fcntl(in_pipe[1], F_GETFL) | O_NONBLOCK);
+
+    // Relay output as it arrives until both streams are closed. Input is
+    // taken from the client one frame at a time, once the compiler has
+    // consumed the previous one.
+    struct pollfd fds[4] = {
+        {out_pipe[0], POLLIN, 0},
+        {err_pipe[0], POLLIN, 0},
+        {connection, POLLIN, 0},
+        {-1, POLLOUT, 0},
+    };
+    int open_streams = 2;
+    int client_gone = 0;
+    char buffer[8192];
+    char *input = NULL;
+    size_t input_length = 0;
+    size_t input_offset = 0;
+    while (open_streams > 0) {
+        fds[2].fd = client_gone || in_pipe[1] < 0 || input_length ? -1 : connection;
+        fds[3].fd = input_length ? in_pipe[1] : -1;
+        if (poll(fds, 4, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents) continue;
+            ssize_t got = read(fds[i].fd, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_streams--;
+                continue;
+            }
+            if (!client_gone &&
+                send_frame(connection, i == 0 ? FRAME_STDOUT : FRAME_STDERR,
+                           buffer, (uint32_t)got) != 0) {
+                // Nobody is waiting for the result any more
+                client_gone = 1;
+                kill(compiler, SIGTERM);
+            }
+        }
+
+        if (fds[2].fd >= 0 && fds[2].revents) {
+            FrameHeader frame;
+            if (read_frame(connection, &frame, &input) != 0 || frame.kind != FRAME_STDIN) {
+                client_gone = 1;
+                kill(compiler, SIGTERM);
+            } else if (frame.length == 0) {
+                close(in_pipe[1]);
+                in_pipe[1] = -1;
+            } else {
+                input_length = frame.length;
+                input_offset = 0;
+            }
+        }
+        if (fds[3].fd >= 0 && fds[3].revents) {
+            ssize_t written = write(in_pipe[1], input + input_offset,
+                                    input_length - input_offset);
+            if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                // The compiler closed its stdin; drop the rest
+                close(in_pipe[1]);
+                in_pipe[1] = -1;
+                input_length = 0;
+            } else if (written > 0) {
+                input_offset += written;
+                if (input_offset == input_length) {
+                    input_length = 0;
+                }
+            }
+        }
+    }
+    if (in_pipe[1] >= 0) {
+        close(in_pipe[1]);
+    }
+    free(input);
+
+    int status = 0;
+    while (waitpid(compiler, &status, 0) < 0 && errno == EINTR) {
+    }
+    int32_t exit_status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                            : 128 + WTERMSIG(status);
+    if (!client_gone) {
+        send_frame(connection, FRAME_EXIT, &exit_status, sizeof(exit_status));
+    }
+}
+
+// Daemon side
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Reports are newline-separated canonical paths; keep the matching trees
+// resident so later compilers skip loading or parsing them
+static void read_reports(int fd, char *pending, size_t *pending_length) {
+    char buffer[PIPE_BUF];
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < got; i++) {
+            if (buffer[i] != '\n') {
+                if (*pending_length < PIPE_BUF - 1) {
+                    pending[(*pending_length)++] = buffer[i];
+                }
+                continue;
+            }
+            pending[*pending_length] = '\0';
+            make_ast_resident(pending);
+            *pending_length = 0;
+        }
+    }
+}
+
+static int bind_socket(const char *socket_path) {
+    struct sockaddr_un address;
+    if (make_address(socket_path, &address) != 0) {
+        return -1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Error: Could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // Only the owner may connect
+    mode_t old_mask = umask(077);
+    int result = bind(listener, (struct sockaddr *)&address, sizeof(address));
+    if (result != 0 && errno == EADDRINUSE) {
+        // Either another daemon is running or a previous one left its
+        // socket behind
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int alive = connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        close(probe);
+        if (alive) {
+            umask(old_mask);
+            fprintf(stderr, "Error: A compile daemon is already listening on %s\n",
+                    socket_path);
+            close(listener);
+            return -1;
+        }
+        unlink(socket_path);
+        result = bind(listener, (struct sockaddr *)&address, sizeof(address));
+    }
+    umask(old_mask);
+
+    if (result != 0 || listen(listener, 16) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", socket_path,
+                strerror(errno));
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+int run_daemon(const char *socket_path, DaemonCommand command) {
+    int listener = bind_socket(socket_path);
+    if (listener < 0) {
+        return 1;
+    }
+
+    int report_pipe[2];
+    if (pipe(report_pipe) != 0) {
+        fprintf(stderr, "Error: Could not create pipe: %s\n", strerror(errno));
+        close(listener);
+        unlink(socket_path);
+        return 1;
+    }
+    fcntl(report_pipe[0], F_SETFL, fcntl(report_pipe[0], F_GETFL) | O_NONBLOCK);
+    report_fd = report_pipe[1];
+
+    // Initialize the native target once; every compiler inherits it
+    LLVMInitializeNativeTarget();
+    LLVMInitializeNativeAsmPrinter();
+
+    // Connection handlers are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    printf("gloinc daemon listening on %s\n", socket_path);
+    fflush(stdout);
+    fflush(stderr);
+
+    char pending[PIPE_BUF];
+    size_t pending_length = 0;
+    struct pollfd fds[2] = {
+        {listener, POLLIN, 0},
+        {report_pipe[0], POLLIN, 0},
+    };
+
+    while (!stop_requested) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            read_reports(report_pipe[0], pending, &pending_length);
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            continue;
+        }
+
+        struct ucred peer;
+        socklen_t peer_length = sizeof(peer);
+        if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer, &peer_length) != 0 ||
+            peer.uid != getuid()) {
+            close(connection);
+            continue;
+        }
+
+        pid_t handler = fork();
+        if (handler == 0) {
+            close(listener);
+            close(report_pipe[0]);
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            handle_connection(connection, command);
+            close(connection);
+            _exit(0);
+        }
+        if (handler < 0) {
+            fprintf(stderr, "Error: Could not fork: %s\n", strerror(errno));
+        }
+        close(connection);
+    }
+
+    close(listener);
+    close(report_pipe[0]);
+    close(report_pipe[1]);
+    unlink(socket_path);
+    return 0;
+}
+
+// Client side
+
+int run_daemon_client(const char *socket_path, int argc, char **argv) {
+    struct sockaddr_un address;
+    if (make_address(socket_path, &address) != 0) {
+        return 1;
+    }
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 ||
+        connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error: No compile daemon listening on %s "
+                        "(start one with 'gloinc --daemon')\n", socket_path);
+        if (connection >= 0) close(connection);
+        return 1;
+    }
+
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd) {
+        fprintf(stderr, "Error: Could not determine working directory\n");
+        close(connection);
+        return 1;
+    }
+
+    // Entries the daemon would reject are left out
+    char **env = malloc(DAEMON_MAX_ENV * sizeof(char *));
+    int env_count = 0;
+    for (char **entry = environ; *entry && env_count < DAEMON_MAX_ENV; entry++) {
+        if (strlen(*entry) <= DAEMON_MAX_STRING) {
+            env[env_count++] = *entry;
+        }
+    }
+
+    RequestHeader header;
+    memcpy(header.magic, DAEMON_MAGIC, 4);
+    header.version = DAEMON_PROTOCOL_VERSION;
+    header.cwd_length = (uint32_t)strlen(cwd);
+    header.argc = (uint32_t)argc;
+    header.env_count = (uint32_t)env_count;
+    header.flags = isatty(STDIN_FILENO) ? REQUEST_STDIN_TERMINAL : 0;
+
+    int failed = write_all(connection, &header, sizeof(header)) ||
+                 write_all(connection, cwd, header.cwd_length);
+    for (int i = 0; i < argc && !failed; i++) {
+        failed = write_string(connection, argv[i]);
+    }
+    for (int i = 0; i < env_count && !failed; i++) {
+        failed = write_string(connection, env[i]);
+    }
+    free(env);
+    free(cwd);
+
+    // Forward stdin and relay output until the exit status arrives. A
+    // stdin frame is sent without blocking, a piece at a time, so output
+    // keeps being read while the daemon waits for the compiler to take
+    // its input.
+    int exit_status = -1;
+    char *payload = NULL;
+    struct pollfd fds[2] = {
+        {connection, POLLIN, 0},
+        {STDIN_FILENO, POLLIN, 0},
+    };
+    int input_open = 1;
+    char input[sizeof(FrameHeader) + 8192];
+    size_t input_length = 0;
+    size_t input_offset = 0;
+    while (!failed) {
+        fds[0].events = POLLIN | (input_length ? POLLOUT : 0);
+        fds[1].fd = input_open && !input_length ? STDIN_FILENO : -1;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].fd >= 0 && fds[1].revents) {
+            ssize_t got = read(STDIN_FILENO, input + sizeof(FrameHeader),
+                               sizeof(input) - sizeof(FrameHeader));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                // End of input, or no usable stdin at all
+                input_open = 0;
+                got = 0;
+            }
+            FrameHeader frame;
+            memset(&frame, 0, sizeof(frame));
+            frame.kind = FRAME_STDIN;
+            frame.length = (uint32_t)got;
+            memcpy(input, &frame, sizeof(frame));
+            input_length = sizeof(frame) + got;
+            input_offset = 0;
+        }
+        if (input_length && (fds[0].revents & POLLOUT)) {
+            ssize_t sent = send(connection, input + input_offset,
+                                input_length - input_offset,
+                                MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+                // The compiler is done; its output and status may still
+                // be waiting to be read
+                input_open = 0;
+                input_length = 0;
+            } else if (sent > 0) {
+                input_offset += sent;
+                if (input_offset == input_length) {
+                    input_length = 0;
+                }
+            }
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        FrameHeader frame;
+        if (read_all(connection, &frame, sizeof(frame)) != 0) {
+            break;
+        }
+        payload = realloc(payload, frame.length ? frame.length : 1);
+        if (read_all(connection, payload, frame.length) != 0) {
+            break;
+        }
+        if (frame.kind == FRAME_STDOUT) {
+            fwrite(payload, 1, frame.length, stdout);
+        } else if (frame.kind == FRAME_STDERR) {
+            fflush(stdout);
+            fwrite(payload, 1, frame.length, stderr);
+        } else if (frame.kind == FRAME_EXIT && frame.length == sizeof(int32_t)) {
+            int32_t status;
+            memcpy(&status, payload, sizeof(status));
+            exit_status = status;
+            break;
+        }
+    }
+    free(payload);
+    close(connection);
+
+    if (exit_status < 0) {
+        fprintf(stderr, "Error: Lost connection to the compile daemon\n");
+        return 1;
+    }
+    return exit_status;
+}
@@ -0,0 +1,233 @@
+#include "debuginfo.h"
+#include <llvm-c/DebugInfo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// DWARF base type encodings
+#define DW_ATE_BOOLEAN 0x02
+#define DW_ATE_FLOAT 0x04
+#define DW_ATE_SIGNED 0x05
+#define DW_ATE_SIGNED_CHAR 0x06
+#define DW_ATE_UNSIGNED 0x08
+
+static void add_module_flag(CodeGen *codegen, const char *key,
+                            unsigned value) {
+    LLVMValueRef constant =
+        LLVMConstInt(LLVMInt32TypeInContext(codegen->context), value, 0);
+    LLVMAddModuleFlag(codegen->module, LLVMModuleFlagBehaviorWarning, key,
+                      strlen(key), LLVMValueAsMetadata(constant));
+}
+
+// Relative paths are resolved against the compilation directory, as
+// C compilers record them
+static LLVMMetadataRef create_file(CodeGen *codegen, const char *path) {
+    char directory[4096];
+    if (!getcwd(directory, sizeof(directory))) {
+        strcpy(directory, ".");
+    }
+    return LLVMDIBuilderCreateFile(codegen->di_builder, path, strlen(path),
+                                   directory, strlen(directory));
+}
+
+void debug_info_begin(CodeGen *codegen) {
+    if (!codegen->debug_info || codegen->di_builder) {
+        return;
+    }
+
+    // Type sizes and field offsets come from the layout the module will be
+    // emitted with
+    char *error = NULL;
+    LLVMTargetMachineRef target_machine = create_target_machine(
+        codegen->module, codegen->optimization_level, &error);
+    if (!target_machine) {
+        LLVMDisposeMessage(error);
+        return;
+    }
+    codegen->di_layout = LLVMCreateTargetDataLayout(target_machine);
+    LLVMDisposeTargetMachine(target_machine);
+
+    add_module_flag(codegen, "Dwarf Version", 4);
+    add_module_flag(codegen, "Debug Info Version", LLVMDebugMetadataVersion());
+
+    const char *path = codegen->source_path;
+    size_t path_length;
+    if (!path) {
+        path = LLVMGetModuleIdentifier(codegen->module, &path_length);
+    }
+
+    codegen->di_builder = LLVMCreateDIBuilder(codegen->module);
+    codegen->di_file = create_file(codegen, path);
+    // DWARF has no code for Gloin; C is the closest for debuggers
+    LLVMDIBuilderCreateCompileUnit(
+        codegen->di_builder, LLVMDWARFSourceLanguageC99, codegen->di_file,
+        "gloinc", 6, codegen->optimization_level > 0, "", 0, 0, "", 0,
+        LLVMDWARFEmissionFull, 0, 0, 0, "", 0, "", 0);
+}
+
+void debug_info_file(CodeGen *codegen, const char *path) {
+    if (!codegen->di_builder || !path) {
+        return;
+    }
+    codegen->di_file = create_file(codegen, path);
+}
+
+void debug_info_finish(CodeGen *codegen) {
+    if (!codegen->di_builder) {
+        return;
+    }
+    LLVMDIBuilderFinalize(codegen->di_builder);
+    LLVMDisposeDIBuilder(codegen->di_builder);
+    LLVMDisposeTargetData(codegen->di_layout);
+    codegen->di_builder = NULL;
+    codegen->di_layout = NULL;
+    codegen->di_file = NULL;
+    codegen->di_scope = NULL;
+}
+
+void debug_info_function(CodeGen *codegen, LLVMValueRef function,
+                         const char *name, const ASTNode *node) {
+    if (!codegen->di_builder) {
+        return;
+    }
+    unsigned line = node && node->line > 0 ? node->line : 0;
+    LLVMMetadataRef type = LLVMDIBuilderCreateSubroutineType(
+        codegen->di_builder, codegen->di_file, NULL, 0, LLVMDIFlagZero);
+    size_t linkage_length;
+    const char *linkage_name = LLVMGetValueName2(function, &linkage_length);
+    codegen->di_scope = LLVMDIBuilderCreateFunction(
+        codegen->di_builder, codegen->di_file, name, strlen(name),
+        linkage_name, linkage_length, codegen->di_file, line, type, 0, 1, line,
+        LLVMDIFlagPrototyped, codegen->optimization_level > 0);
+    LLVMSetSubprogram(function, codegen->di_scope);
+    debug_info_location(codegen, node);
+}
+
+void debug_info_end_function(CodeGen *codegen) {
+    if (!codegen->di_scope) {
+        return;
+    }
+    codegen->di_scope = NULL;
+    LLVMSetCurrentDebugLocation2(codegen->builder, NULL);
+}
+
+void debug_info_location(CodeGen *codegen, const ASTNode *node) {
+    if (!codegen->di_scope) {
+        return;
+    }
+    // The subprogram's own line until the first located node
+    unsigned line = LLVMDISubprogramGetLine(codegen->di_scope);
+    unsigned column = 0;
+    if (node && node->line > 0) {
+        line = node->line;
+        column = node->column;
+    } else if (LLVMGetCurrentDebugLocation2(codegen->builder)) {
+        return;
+    }
+    LLVMSetCurrentDebugLocation2(
+        codegen->builder, LLVMDIBuilderCreateDebugLocation(
+                              codegen->context, line, column,
+                              codegen->di_scope, NULL));
+}
+
+static LLVMMetadataRef basic_type(CodeGen *codegen, const char *name,
+                                  TypeKind kind, unsigned encoding) {
+    LLVMTypeRef llvm_type = get_llvm_type_from_kind(codegen, kind);
+    uint64_t bits = LLVMABISizeOfType(codegen->di_layout, llvm_type) * 8;
+    return LLVMDIBuilderCreateBasicType(codegen->di_builder, name,
+                                        strlen(name), bits, encoding,
+                                        LLVMDIFlagZero);
+}
+
+static LLVMMetadataRef di_type(CodeGen *codegen, TypeKind kind);
+
+static LLVMMetadataRef struct_type(CodeGen *codegen, TypeKind kind) {
+    StructType *st = get_struct_type(kind);
+    if (!st) {
+        return NULL;
+    }
+    LLVMTypeRef llvm_type = get_llvm_type_from_kind(codegen, kind);
+    LLVMMetadataRef *members =
+        malloc((st->field_count ? st->field_count : 1) *
+               sizeof(LLVMMetadataRef));
+    for (int i = 0; i < st->field_count; i++) {
+        LLVMTypeRef field_type = LLVMStructGetTypeAtIndex(llvm_type, i);
+        members[i] = LLVMDIBuilderCreateMemberType(
+            codegen->di_builder, codegen->di_file, st->fields[i].name,
+            strlen(st->fields[i].name), codegen->di_file, 0,
+            LLVMABISizeOfType(codegen->di_layout, field_type) * 8,
+            LLVMABIAlignmentOfType(codegen->di_layout, field_type) * 8,
+            LLVMOffsetOfElement(codegen->di_layout, llvm_type, i) * 8,
+            LLVMDIFlagZero, di_type(codegen, st->fields[i].type));
+    }
+    LLVMMetadataRef type = LLVMDIBuilderCreateStructType(
+        codegen->di_builder, codegen->di_file, st->name, strlen(st->name),
+        codegen->di_file, 0, LLVMABISizeOfType(codegen->di_layout, llvm_type) * 8,
+        LLVMABIAlignmentOfType(codegen->di_layout, llvm_type) * 8,
+        LLVMDIFlagZero, NULL, members, st->field_count, 0, NULL, "", 0);
+    free(members);
+    return type;
+}
+
+// NULL for void and unknown types
+static LLVMMetadataRef di_type(CodeGen *codegen, TypeKind kind) {
+    if (is_pointer_type(kind) || kind == TYPE_STRING) {
+        LLVMMetadataRef pointee =
+            kind == TYPE_STRING
+                ? basic_type(codegen, "char", TYPE_CHAR, DW_ATE_SIGNED_CHAR)
+                : di_type(codegen, get_pointed_type(kind));
+        const char *name = kind == TYPE_STRING ? "string" : "";
+        return LLVMDIBuilderCreatePointerType(
+            codegen->di_builder, pointee,
+            LLVMPointerSize(codegen->di_layout) * 8, 0, 0, name, strlen(name));
+    }
+    if (is_struct_type(kind)) {
+        return struct_type(codegen, kind);
+    }
+
+    const char *name = type_to_string(kind);
+    if (kind == TYPE_BOOL) {
+        return basic_type(codegen, name, kind, DW_ATE_BOOLEAN);
+    } else if (kind == TYPE_CHAR) {
+        return basic_type(codegen, name, kind, DW_ATE_SIGNED_CHAR);
+    } else if (is_floating_type(kind)) {
+        return basic_type(codegen, name, kind, DW_ATE_FLOAT);
+    } else if (is_integer_type(kind)) {
+        return basic_type(codegen, name, kind,
+                          is_unsigned_type(kind) ? DW_ATE_UNSIGNED
+                                                 : DW_ATE_SIGNED);
+    }
+    return NULL;
+}
+
+void debug_info_variable(CodeGen *codegen, LLVMValueRef storage,
+                         const char *name, TypeKind type,
+                         const ASTNode *node, int arg_number) {
+    if (!codegen->di_scope) {
+        return;
+    }
+    LLVMMetadataRef di = di_type(codegen, type);
+    if (!di) {
+        return;
+    }
+
+    unsigned line = node && node->line > 0 ? node->line : 0;
+    unsigned column = node && node->line > 0 ? node->column : 0;
+    // Always preserved, so optimized builds still list every variable
+    LLVMMetadataRef variable;
+    if (arg_number > 0) {
+        variable = LLVMDIBuilderCreateParameterVariable(
+            codegen->di_builder, codegen->di_scope, name, strlen(name),
+            arg_number, codegen->di_file, line, di, 1, LLVMDIFlagZero);
+    } else {
+        variable = LLVMDIBuilderCreateAutoVariable(
+            codegen->di_builder, codegen->di_scope, name, strlen(name),
+            codegen->di_file, line, di, 1, LLVMDIFlagZero, 0);
+    }
+    LLVMMetadataRef location = LLVMDIBuilderCreateDebugLocation(
+        codegen->context, line, column, codegen->di_scope, NULL);
+    LLVMDIBuilderInsertDeclareAtEnd(
+        codegen->di_builder, storage, variable,
+        LLVMDIBuilderCreateExpression(codegen->di_builder, NULL, 0), location,
+        LLVMGetInsertBlock(codegen->builder));
+}
@@ -0,0 +1,60 @@
+#include "diagnostics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static __thread DiagnosticBuffer *active_buffer = NULL;
+
+static void append_message(DiagnosticBuffer *buffer, const char *format,
+                           va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length < 0) {
+        return;
+    }
+
+    size_t needed = buffer->length + (size_t)length + 1;
+    if (needed > buffer->capacity) {
+        buffer->capacity = needed * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    vsnprintf(buffer->data + buffer->length, (size_t)length + 1, format, args);
+    buffer->length += (size_t)length;
+}
+
+void report_error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (active_buffer) {
+        append_message(active_buffer, format, args);
+    } else {
+        vfprintf(stderr, format, args);
+    }
+    va_end(args);
+}
+
+void report_info(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (active_buffer) {
+        append_message(active_buffer, format, args);
+    } else {
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+DiagnosticBuffer *set_diagnostic_buffer(DiagnosticBuffer *buffer) {
+    DiagnosticBuffer *previous = active_buffer;
+    active_buffer = buffer;
+    return previous;
+}
+
+void clear_diagnostic_buffer(DiagnosticBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
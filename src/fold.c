@@ -0,0 +1,609 @@
+#include "fold.h"
+#include "diagnostics.h"
+#include "interp.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounds on a comptime evaluation, so a runaway one fails the build
+#define COMPTIME_STEP_LIMIT 100000000
+#define COMPTIME_MEMORY_LIMIT (16 << 20)
+
+// A literal's value. Integers are held sign-extended from the width of a
+// signed type and zero-extended from that of an unsigned one; bools are 0
+// or 1.
+typedef struct {
+    TypeKind type;
+    int64_t integer;
+    double real;  // f32 and f64
+} Constant;
+
+// What a name is known to hold from its declaration on. Names declared
+// again, or declared other than as a folded `def const`, are bound to an
+// unknown value.
+typedef struct {
+    const char *name;
+    Constant value;
+} Binding;
+
+typedef struct {
+    Binding *bindings;  // In declaration order, latest last
+    int binding_count;
+    int binding_capacity;
+    char **pinned;      // Names assigned or with their address taken
+    int pinned_count;
+    int pinned_capacity;
+    ASTNode *program;   // Where comptime calls find their functions
+    int failed;         // A comptime call could not be evaluated
+} Folder;
+
+typedef void (*ChildVisitor)(Folder *folder, ASTNode **slot);
+
+static void *grow(void *items, int *capacity, int count, size_t size) {
+    if (count < *capacity) {
+        return items;
+    }
+    *capacity = *capacity ? *capacity * 2 : 16;
+    return realloc(items, *capacity * size);
+}
+
+static void visit_list(Folder *folder, ASTNode **nodes, int count, ChildVisitor visit) {
+    for (int i = 0; i < count; i++) {
+        visit(folder, &nodes[i]);
+    }
+}
+
+// Visit the child slots of node in the order code generation reaches them
+static void visit_children(Folder *folder, ASTNode *node, ChildVisitor visit) {
+    switch (node->type) {
+    case NODE_PROGRAM:
+        visit_list(folder, node->data.program.functions, node->data.program.function_count,
+                   visit);
+        break;
+    case NODE_FUNCTION:
+        visit(folder, &node->data.function.body);
+        break;
+    case NODE_STRUCT:
+        visit_list(folder, node->data.struct_decl.methods, node->data.struct_decl.method_count,
+                   visit);
+        break;
+    case NODE_STRUCT_METHOD:
+        visit(folder, &node->data.struct_method.body);
+        break;
+    case NODE_BLOCK:
+        visit_list(folder, node->data.block.statements, node->data.block.statement_count, visit);
+        break;
+    case NODE_VARIABLE_DECL:
+        visit(folder, &node->data.variable_decl.value);
+        break;
+    case NODE_ASSIGNMENT:
+        visit(folder, &node->data.assignment.value);
+        break;
+    case NODE_POINTER_ASSIGNMENT:
+        visit(folder, &node->data.pointer_assignment.target);
+        visit(folder, &node->data.pointer_assignment.value);
+        break;
+    case NODE_RETURN:
+        visit(folder, &node->data.return_stmt.value);
+        break;
+    case NODE_CALL:
+        visit_list(folder, node->data.call.args, node->data.call.arg_count, visit);
+        break;
+    case NODE_BINARY_OP:
+        visit(folder, &node->data.binary_op.left);
+        visit(folder, &node->data.binary_op.right);
+        break;
+    case NODE_UNARY_OP:
+        visit(folder, &node->data.unary_op.operand);
+        break;
+    case NODE_FIELD_ACCESS:
+        visit(folder, &node->data.field_access.object);
+        break;
+    case NODE_METHOD_CALL:
+        visit(folder, &node->data.method_call.object);
+        visit_list(folder, node->data.method_call.args, node->data.method_call.arg_count, visit);
+        break;
+    case NODE_STRUCT_LITERAL:
+        visit_list(folder, node->data.struct_literal.field_values,
+                   node->data.struct_literal.field_count, visit);
+        break;
+    case NODE_IF:
+        visit(folder, &node->data.if_stmt.condition);
+        visit(folder, &node->data.if_stmt.then_block);
+        visit(folder, &node->data.if_stmt.else_block);
+        break;
+    case NODE_UNLESS:
+        visit(folder, &node->data.unless_stmt.condition);
+        visit(folder, &node->data.unless_stmt.then_block);
+        visit(folder, &node->data.unless_stmt.else_block);
+        break;
+    case NODE_FOR:
+        visit(folder, &node->data.for_stmt.init);
+        visit(folder, &node->data.for_stmt.condition);
+        visit(folder, &node->data.for_stmt.body);
+        visit(folder, &node->data.for_stmt.update);
+        break;
+    case NODE_WHILE:
+        visit(folder, &node->data.while_stmt.condition);
+        visit(folder, &node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH:
+        visit(folder, &node->data.switch_stmt.expression);
+        visit_list(folder, node->data.switch_stmt.cases, node->data.switch_stmt.case_count,
+                   visit);
+        visit(folder, &node->data.switch_stmt.default_case);
+        break;
+    case NODE_SWITCH_CASE:
+        visit(folder, &node->data.switch_case.value);
+        visit_list(folder, node->data.switch_case.statements,
+                   node->data.switch_case.statement_count, visit);
+        break;
+    case NODE_MATCH:
+        visit(folder, &node->data.match_stmt.expression);
+        visit_list(folder, node->data.match_stmt.cases, node->data.match_stmt.case_count, visit);
+        break;
+    case NODE_MATCH_CASE:
+        visit(folder, &node->data.match_case.pattern);
+        visit(folder, &node->data.match_case.body);
+        break;
+    default:
+        break;
+    }
+}
+
+static void pin(Folder *folder, const char *name) {
+    folder->pinned = grow(folder->pinned, &folder->pinned_capacity, folder->pinned_count,
+                          sizeof(char *));
+    folder->pinned[folder->pinned_count++] = strdup(name);
+}
+
+static int is_pinned(const Folder *folder, const char *name) {
+    for (int i = 0; i < folder->pinned_count; i++) {
+        if (strcmp(folder->pinned[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Record the names whose value can change after their declaration:
+// `def const` can be assigned, and a pointer can write through its address
+static void pin_names(Folder *folder, ASTNode **slot) {
+    ASTNode *node = *slot;
+    if (!node) {
+        return;
+    }
+    if (node->type == NODE_ASSIGNMENT) {
+        pin(folder, node->data.assignment.variable_name);
+    } else if (node->type == NODE_UNARY_OP &&
+               node->data.unary_op.operator == UNARY_ADDRESS_OF &&
+               node->data.unary_op.operand->type == NODE_IDENTIFIER) {
+        pin(folder, node->data.unary_op.operand->data.identifier.name);
+    }
+    visit_children(folder, node, pin_names);
+}
+
+static void bind(Folder *folder, const char *name, const Constant *value) {
+    folder->bindings = grow(folder->bindings, &folder->binding_capacity, folder->binding_count,
+                            sizeof(Binding));
+    folder->bindings[folder->binding_count].name = name;
+    folder->bindings[folder->binding_count].value = *value;
+    folder->binding_count++;
+}
+
+static const Constant *find_constant(const Folder *folder, const char *name) {
+    for (int i = folder->binding_count - 1; i >= 0; i--) {
+        if (strcmp(folder->bindings[i].name, name) == 0) {
+            const Constant *value = &folder->bindings[i].value;
+            return value->type != TYPE_UNKNOWN ? value : NULL;
+        }
+    }
+    return NULL;
+}
+
+// 128-bit integers are left to LLVM
+static int is_folded_integer(TypeKind type) {
+    return is_integer_type(type) && type != TYPE_I128;
+}
+
+static int is_folded_float(TypeKind type) {
+    return type == TYPE_F32 || type == TYPE_F64;
+}
+
+static int integer_bits(TypeKind type) {
+    switch (type) {
+    case TYPE_I8:
+    case TYPE_U8:
+        return 8;
+    case TYPE_I16:
+    case TYPE_U16:
+        return 16;
+    case TYPE_I32:
+    case TYPE_U32:
+        return 32;
+    default:
+        return 64;
+    }
+}
+
+// Truncate to the width of type and extend as it holds values
+static int64_t wrap_integer(uint64_t value, TypeKind type) {
+    int bits = integer_bits(type);
+    if (bits == 64) {
+        return (int64_t)value;
+    }
+    uint64_t mask = (UINT64_C(1) << bits) - 1;
+    value &= mask;
+    if (!is_unsigned_type(type) && (value >> (bits - 1))) {
+        value |= ~mask;
+    }
+    return (int64_t)value;
+}
+
+// The value as a signed integer of its width, as sdiv and icmp slt see it
+static int64_t signed_value(const Constant *constant) {
+    int bits = integer_bits(constant->type);
+    if (bits == 64 || !is_unsigned_type(constant->type)) {
+        return constant->integer;
+    }
+    uint64_t sign = UINT64_C(1) << (bits - 1);
+    return (int64_t)(((uint64_t)constant->integer ^ sign) - sign);
+}
+
+static int literal_constant(const ASTNode *node, Constant *constant) {
+    if (!node || node->type != NODE_LITERAL) {
+        return 0;
+    }
+    TypeKind type = node->data.literal.resolved_type;
+    const char *text = node->data.literal.value;
+    constant->type = type;
+    constant->integer = 0;
+    constant->real = 0;
+    if (type == TYPE_BOOL) {
+        constant->integer = strcmp(text, "true") == 0;
+    } else if (is_folded_integer(type)) {
+        // Negative values read back too, as strtoull negates them
+        constant->integer = wrap_integer(strtoull(text, NULL, 10), type);
+    } else if (is_folded_float(type)) {
+        constant->real = strtod(text, NULL);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Replace the node in slot, keeping its source position
+static void replace_node(ASTNode **slot, ASTNode *replacement) {
+    ASTNode *node = *slot;
+    set_node_location(replacement, node->line, node->column);
+    free_ast_node(node);
+    *slot = replacement;
+}
+
+static void replace_with_constant(ASTNode **slot, const Constant *constant) {
+    char text[64];
+    if (constant->type == TYPE_BOOL) {
+        snprintf(text, sizeof(text), "%s", constant->integer ? "true" : "false");
+    } else if (is_folded_float(constant->type)) {
+        snprintf(text, sizeof(text), "%.17g", constant->real);
+    } else if (is_unsigned_type(constant->type)) {
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)constant->integer);
+    } else {
+        snprintf(text, sizeof(text), "%lld", (long long)constant->integer);
+    }
+    replace_node(slot, create_literal_node(text, type_to_string(constant->type)));
+}
+
+// Convert an initializer to the declared type as codegen_variable_decl
+// does: widening sign-extends unless both types are unsigned
+static int convert_constant(Constant *constant, TypeKind type) {
+    if (constant->type == type) {
+        return 1;
+    }
+    if (!is_folded_integer(constant->type) || !is_folded_integer(type)) {
+        return 0;
+    }
+    uint64_t value = is_unsigned_type(constant->type) && is_unsigned_type(type)
+                         ? (uint64_t)constant->integer
+                         : (uint64_t)signed_value(constant);
+    constant->type = type;
+    constant->integer = wrap_integer(value, type);
+    return 1;
+}
+
+static int evaluate_float(BinaryOperator op, double left, double right, Constant *result) {
+    double value;
+    switch (op) {
+    case OP_ADD:
+        value = left + right;
+        break;
+    case OP_SUB:
+        value = left - right;
+        break;
+    case OP_MUL:
+        value = left * right;
+        break;
+    case OP_DIV:
+        value = left / right;
+        break;
+    case OP_EQ:
+        result->integer = left == right;
+        return 1;
+    case OP_NE:
+        result->integer = left != right;
+        return 1;
+    case OP_LT:
+        result->integer = left < right;
+        return 1;
+    case OP_GT:
+        result->integer = left > right;
+        return 1;
+    case OP_LE:
+        result->integer = left <= right;
+        return 1;
+    case OP_GE:
+        result->integer = left >= right;
+        return 1;
+    default:
+        return 0;
+    }
+    // f32 operations round once, to the nearest float of the exact result
+    if (result->type == TYPE_F32) {
+        value = (float)value;
+    }
+    if (!isfinite(value)) {
+        return 0;
+    }
+    result->real = value;
+    return 1;
+}
+
+static int evaluate_integer(BinaryOperator op, const Constant *left, const Constant *right,
+                            Constant *result) {
+    uint64_t a = (uint64_t)left->integer;
+    uint64_t b = (uint64_t)right->integer;
+    int64_t signed_a = signed_value(left);
+    int64_t signed_b = signed_value(right);
+    uint64_t value;
+    switch (op) {
+    case OP_ADD:
+        value = a + b;
+        break;
+    case OP_SUB:
+        value = a - b;
+        break;
+    case OP_MUL:
+        value = a * b;
+        break;
+    case OP_DIV: {
+        // Division by zero and the one overflowing quotient are undefined
+        int bits = integer_bits(left->type);
+        int64_t min = bits == 64 ? INT64_MIN : -(INT64_C(1) << (bits - 1));
+        if (signed_b == 0 || (signed_b == -1 && signed_a == min)) {
+            return 0;
+        }
+        value = (uint64_t)(signed_a / signed_b);
+        break;
+    }
+    case OP_EQ:
+        result->integer = a == b;
+        return 1;
+    case OP_NE:
+        result->integer = a != b;
+        return 1;
+    case OP_LT:
+        result->integer = signed_a < signed_b;
+        return 1;
+    case OP_GT:
+        result->integer = signed_a > signed_b;
+        return 1;
+    case OP_LE:
+        result->integer = signed_a <= signed_b;
+        return 1;
+    case OP_GE:
+        result->integer = signed_a >= signed_b;
+        return 1;
+    default:
+        return 0;
+    }
+    result->integer = wrap_integer(value, result->type);
+    return 1;
+}
+
+static int evaluate(BinaryOperator op, const Constant *left, const Constant *right,
+                    Constant *result) {
+    if (left->type != right->type) {
+        return 0;
+    }
+    result->type = op >= OP_EQ ? TYPE_BOOL : left->type;
+    result->integer = 0;
+    result->real = 0;
+    if (left->type == TYPE_BOOL) {
+        if (op != OP_EQ && op != OP_NE) {
+            return 0;
+        }
+        result->integer = (left->integer == right->integer) == (op == OP_EQ);
+        return 1;
+    }
+    if (is_folded_float(left->type)) {
+        return evaluate_float(op, left->real, right->real, result);
+    }
+    return evaluate_integer(op, left, right, result);
+}
+
+static void fold_node(Folder *folder, ASTNode **slot);
+
+// Replace a conditional statement by the branch a constant condition takes
+static void take_branch(Folder *folder, ASTNode **slot, ASTNode **branch) {
+    ASTNode *taken = *branch;
+    *branch = NULL;
+    replace_node(slot, taken ? taken : create_block_node());
+    fold_node(folder, slot);
+}
+
+// Replace `comptime f(args)`, its arguments folded, by the value f returns
+static void evaluate_comptime(Folder *folder, ASTNode **slot) {
+    ASTNode *call = (*slot)->data.call.args[0];
+    for (int i = 0; i < call->data.call.arg_count; i++) {
+        if (call->data.call.args[i]->type != NODE_LITERAL) {
+            report_error("Error: Arguments of comptime calls must be constants at line %d\n",
+                         (*slot)->line);
+            folder->failed = 1;
+            return;
+        }
+    }
+    InterpLimits limits = {COMPTIME_STEP_LIMIT, COMPTIME_MEMORY_LIMIT};
+    int64_t value;
+    TypeKind type;
+    if (interp_evaluate(folder->program, call, &limits, &value, &type)) {
+        report_error("Error: comptime %s failed at line %d\n", call->data.call.name,
+                     (*slot)->line);
+        folder->failed = 1;
+        return;
+    }
+    Constant result = {type, type == TYPE_BOOL ? value != 0 : wrap_integer((uint64_t)value, type), 0};
+    replace_with_constant(slot, &result);
+}
+
+static void fold_node(Folder *folder, ASTNode **slot) {
+    ASTNode *node = *slot;
+    if (!node) {
+        return;
+    }
+    Constant left;
+    Constant right;
+    switch (node->type) {
+    case NODE_PROGRAM:
+        // Top-level variables come first, as code generation declares
+        // them before any function
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < node->data.program.function_count; i++) {
+                ASTNode **item = &node->data.program.functions[i];
+                if (((*item)->type == NODE_VARIABLE_DECL) == (pass == 0)) {
+                    fold_node(folder, item);
+                }
+            }
+        }
+        break;
+    case NODE_STRUCT: {
+        // Inside methods, fields are in scope by name
+        int saved_count = folder->binding_count;
+        left.type = TYPE_UNKNOWN;
+        for (int i = 0; i < node->data.struct_decl.field_count; i++) {
+            bind(folder, node->data.struct_decl.fields[i]->data.struct_field.name, &left);
+        }
+        visit_children(folder, node, fold_node);
+        folder->binding_count = saved_count;
+        break;
+    }
+    case NODE_FUNCTION:
+    case NODE_STRUCT_METHOD: {
+        // Constants are local to the function declaring them, and
+        // parameters hide top-level ones
+        int saved_count = folder->binding_count;
+        int is_method = node->type == NODE_STRUCT_METHOD;
+        ASTNode **params = is_method ? node->data.struct_method.params
+                                     : node->data.function.params;
+        int param_count = is_method ? node->data.struct_method.param_count
+                                    : node->data.function.param_count;
+        left.type = TYPE_UNKNOWN;
+        for (int i = 0; i < param_count; i++) {
+            bind(folder, params[i]->data.parameter.name, &left);
+        }
+        visit_children(folder, node, fold_node);
+        folder->binding_count = saved_count;
+        break;
+    }
+    case NODE_IDENTIFIER: {
+        const Constant *value = find_constant(folder, node->data.identifier.name);
+        if (value) {
+            replace_with_constant(slot, value);
+        }
+        break;
+    }
+    case NODE_VARIABLE_DECL: {
+        // The initializer still sees an earlier variable of the same name
+        fold_node(folder, &node->data.variable_decl.value);
+        Constant value = {TYPE_UNKNOWN, 0, 0};
+        if (node->data.variable_decl.is_mutable != -1 ||
+            is_pinned(folder, node->data.variable_decl.name) ||
+            !literal_constant(node->data.variable_decl.value, &value) ||
+            !convert_constant(&value, node->data.variable_decl.resolved_type)) {
+            value.type = TYPE_UNKNOWN;
+        }
+        bind(folder, node->data.variable_decl.name, &value);
+        break;
+    }
+    case NODE_CALL:
+        visit_children(folder, node, fold_node);
+        if (strcmp(node->data.call.name, "comptime") == 0) {
+            evaluate_comptime(folder, slot);
+        }
+        break;
+    case NODE_BINARY_OP: {
+        visit_children(folder, node, fold_node);
+        BinaryOperator op = node->data.binary_op.operator;
+        node->data.binary_op.resolved_type =
+            get_binary_result_type(get_node_type(node->data.binary_op.left),
+                                   get_node_type(node->data.binary_op.right), op >= OP_EQ);
+        Constant result;
+        if (literal_constant(node->data.binary_op.left, &left) &&
+            literal_constant(node->data.binary_op.right, &right) &&
+            evaluate(op, &left, &right, &result)) {
+            replace_with_constant(slot, &result);
+        }
+        break;
+    }
+    case NODE_IF:
+        fold_node(folder, &node->data.if_stmt.condition);
+        if (literal_constant(node->data.if_stmt.condition, &left) && left.type == TYPE_BOOL) {
+            take_branch(folder, slot, left.integer ? &node->data.if_stmt.then_block
+                                                   : &node->data.if_stmt.else_block);
+        } else {
+            fold_node(folder, &node->data.if_stmt.then_block);
+            fold_node(folder, &node->data.if_stmt.else_block);
+        }
+        break;
+    case NODE_UNLESS:
+        fold_node(folder, &node->data.unless_stmt.condition);
+        if (literal_constant(node->data.unless_stmt.condition, &left) &&
+            left.type == TYPE_BOOL) {
+            take_branch(folder, slot, left.integer ? &node->data.unless_stmt.else_block
+                                                   : &node->data.unless_stmt.then_block);
+        } else {
+            fold_node(folder, &node->data.unless_stmt.then_block);
+            fold_node(folder, &node->data.unless_stmt.else_block);
+        }
+        break;
+    case NODE_WHILE:
+        fold_node(folder, &node->data.while_stmt.condition);
+        if (literal_constant(node->data.while_stmt.condition, &left) &&
+            left.type == TYPE_BOOL && !left.integer) {
+            replace_node(slot, create_block_node());
+        } else {
+            fold_node(folder, &node->data.while_stmt.body);
+        }
+        break;
+    default:
+        visit_children(folder, node, fold_node);
+        break;
+    }
+}
+
+int fold_constants(ASTNode *program) {
+    if (!program) {
+        return 0;
+    }
+    Folder folder = {0};
+    folder.program = program;
+    pin_names(&folder, &program);
+    fold_node(&folder, &program);
+    for (int i = 0; i < folder.pinned_count; i++) {
+        free(folder.pinned[i]);
+    }
+    free(folder.pinned);
+    free(folder.bindings);
+    return folder.failed;
+}
@@ -0,0 +1,158 @@
+#include "gloin.h"
+#include "codegen.h"
+#include "diagnostics.h"
+#include "parser.h"
+#include "types.h"
+#include <llvm-c/BitWriter.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct GloinSession {
+    TypeRegistry *types;
+    DiagnosticBuffer diagnostics;
+
+    // Last compilation
+    CodeGen *codegen;
+    ASTNode *program;
+    char **import_objects;
+    int import_object_count;
+};
+
+GloinSession *gloin_session_create(void) {
+    GloinSession *session = calloc(1, sizeof(GloinSession));
+    session->types = create_type_registry();
+    return session;
+}
+
+// Drop the results of the previous compilation
+static void reset_session(GloinSession *session) {
+    free_codegen(session->codegen);
+    session->codegen = NULL;
+    free_ast_node(session->program);
+    session->program = NULL;
+    for (int i = 0; i < session->import_object_count; i++) {
+        free(session->import_objects[i]);
+    }
+    free(session->import_objects);
+    session->import_objects = NULL;
+    session->import_object_count = 0;
+    clear_type_registry(session->types);
+    clear_diagnostic_buffer(&session->diagnostics);
+}
+
+void gloin_session_destroy(GloinSession *session) {
+    if (!session) return;
+    reset_session(session);
+    free_type_registry(session->types);
+    free(session);
+}
+
+static void copy_to_buffer(GloinBuffer *output, const char *data, size_t size) {
+    // Always NUL-terminated, so textual output can be used as a string
+    output->data = malloc(size + 1);
+    memcpy(output->data, data, size);
+    output->data[size] = '\0';
+    output->size = size;
+}
+
+static int emit_output(CodeGen *codegen, GloinOutputKind kind,
+                       GloinBuffer *output) {
+    LLVMMemoryBufferRef buffer = NULL;
+    switch (kind) {
+    case GLOIN_OUTPUT_LLVM_IR: {
+        char *ir = LLVMPrintModuleToString(codegen->module);
+        copy_to_buffer(output, ir, strlen(ir));
+        LLVMDisposeMessage(ir);
+        return 0;
+    }
+    case GLOIN_OUTPUT_BITCODE:
+        buffer = LLVMWriteBitcodeToMemoryBuffer(codegen->module);
+        break;
+    case GLOIN_OUTPUT_OBJECT:
+        if (emit_object_buffer(codegen, &buffer) != 0) {
+            return 1;
+        }
+        break;
+    }
+    if (!buffer) {
+        report_error("Unknown output kind: %d\n", (int)kind);
+        return 1;
+    }
+
+    copy_to_buffer(output, LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer));
+    LLVMDisposeMemoryBuffer(buffer);
+    return 0;
+}
+
+static void collect_import_objects(GloinSession *session, CodeGen *codegen) {
+    ImportGraph *graph = codegen->imports;
+    session->import_objects = malloc((graph->module_count + 1) * sizeof(char *));
+    for (int i = 0; i < graph->module_count; i++) {
+        if (graph->modules[i]->object_path) {
+            session->import_objects[session->import_object_count++] =
+                strdup(graph->modules[i]->object_path);
+        }
+    }
+    session->import_objects[session->import_object_count] = NULL;
+}
+
+int gloin_compile_buffer(GloinSession *session, const char *source,
+                         size_t length, const char *source_name,
+                         GloinOutputKind kind, GloinBuffer *output) {
+    output->data = NULL;
+    output->size = 0;
+    reset_session(session);
+
+    // Route the type system and messages of this thread to the session
+    TypeRegistry *previous_types = set_type_registry(session->types);
+    DiagnosticBuffer *previous_diagnostics =
+        set_diagnostic_buffer(&session->diagnostics);
+
+    // The lexer expects NUL-terminated input
+    char *text = malloc(length + 1);
+    memcpy(text, source, length);
+    text[length] = '\0';
+
+    Lexer *lexer = create_lexer(text);
+    Parser *parser = create_parser(lexer);
+    session->program = parse_program(parser);
+    free_parser(parser);
+    free_lexer(lexer);
+    free(text);
+
+    int failed = session->program == NULL;
+    if (!failed) {
+        session->codegen = create_codegen(source_name ? source_name : "gloin_module");
+        session->codegen->source_path = source_name ? strdup(source_name) : NULL;
+        codegen_program(session->codegen, session->program);
+        failed = session->codegen->has_error;
+        collect_import_objects(session, session->codegen);
+    }
+    if (!failed) {
+        failed = emit_output(session->codegen, kind, output);
+    }
+
+    set_diagnostic_buffer(previous_diagnostics);
+    set_type_registry(previous_types);
+    return failed;
+}
+
+const char *gloin_session_diagnostics(GloinSession *session) {
+    return session->diagnostics.data ? session->diagnostics.data : "";
+}
+
+LLVMModuleRef gloin_session_module(GloinSession *session) {
+    return session->codegen ? session->codegen->module : NULL;
+}
+
+const char *const *gloin_session_import_objects(GloinSession *session,
+                                                int *count) {
+    *count = session->import_object_count;
+    return (const char *const *)session->import_objects;
+}
+
+void gloin_buffer_free(GloinBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+}
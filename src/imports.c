@@ -0,0 +1,200 @@
+#include "imports.h"
+#include "diagnostics.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+ImportGraph *create_import_graph(void) {
+    ImportGraph *graph = malloc(sizeof(ImportGraph));
+    graph->modules = NULL;
+    graph->module_count = 0;
+    graph->module_capacity = 0;
+    graph->stack = NULL;
+    graph->stack_depth = 0;
+    graph->stack_capacity = 0;
+    return graph;
+}
+
+void free_import_graph(ImportGraph *graph) {
+    if (!graph)
+        return;
+
+    for (int i = 0; i < graph->module_count; i++) {
+        ImportModule *module = graph->modules[i];
+        if (module->owns_program) {
+            free_ast_node(module->program);
+        }
+        free_module_interface(module->interface);
+        free(module->object_path);
+        free(module->deps);
+        free(module->path);
+        free(module);
+    }
+    free(graph->modules);
+    free(graph->stack);
+    free(graph);
+}
+
+static int file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+char *resolve_import_path(ImportType import_type, const char *path,
+                          const char *importer_path) {
+    if (import_type == IMPORT_EXTERNAL) {
+        // includes/package_name.gloin, relative to the project root
+        char *file_path = malloc(strlen(path) + 16); // "includes/" + ".gloin\0"
+        sprintf(file_path, "includes/%s.gloin", path);
+        return file_path;
+    }
+
+    // Local import: try the importing file's directory first
+    if (importer_path) {
+        const char *slash = strrchr(importer_path, '/');
+        if (slash) {
+            int dir_len = (int)(slash - importer_path);
+            char *file_path = malloc(dir_len + strlen(path) + 8); // "/" + ".gloin\0"
+            sprintf(file_path, "%.*s/%s.gloin", dir_len, importer_path, path);
+            if (file_exists(file_path)) {
+                return file_path;
+            }
+            free(file_path);
+        }
+    }
+
+    // Fall back to the working directory
+    char *file_path = malloc(strlen(path) + 7); // ".gloin\0"
+    sprintf(file_path, "%s.gloin", path);
+    return file_path;
+}
+
+ImportModule *import_graph_find(ImportGraph *graph, const char *file_path) {
+    struct stat st;
+    if (stat(file_path, &st) != 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < graph->module_count; i++) {
+        ImportModule *module = graph->modules[i];
+        if (module->device == st.st_dev && module->inode == st.st_ino) {
+            return module;
+        }
+    }
+    return NULL;
+}
+
+ImportModule *import_graph_add(ImportGraph *graph, const char *file_path,
+                               ASTNode *program, int owns_program) {
+    struct stat st;
+    if (stat(file_path, &st) != 0) {
+        return NULL;
+    }
+
+    ImportModule *module = malloc(sizeof(ImportModule));
+    char *canonical = realpath(file_path, NULL);
+    module->path = canonical ? canonical : strdup(file_path);
+    module->device = st.st_dev;
+    module->inode = st.st_ino;
+    module->program = program;
+    module->owns_program = owns_program;
+    module->state = MODULE_VISITING;
+    module->interface = NULL;
+    module->object_path = NULL;
+    module->deps = NULL;
+    module->dep_count = 0;
+    module->dep_capacity = 0;
+
+    if (graph->module_count == graph->module_capacity) {
+        graph->module_capacity = graph->module_capacity ? graph->module_capacity * 2 : 8;
+        graph->modules = realloc(graph->modules,
+                                 graph->module_capacity * sizeof(ImportModule *));
+    }
+    graph->modules[graph->module_count++] = module;
+    return module;
+}
+
+void import_graph_add_dependency(ImportModule *importer, ImportModule *module) {
+    if (!importer)
+        return;
+
+    for (int i = 0; i < importer->dep_count; i++) {
+        if (importer->deps[i] == module) {
+            return;
+        }
+    }
+    if (importer->dep_count == importer->dep_capacity) {
+        importer->dep_capacity = importer->dep_capacity ? importer->dep_capacity * 2 : 4;
+        importer->deps = realloc(importer->deps,
+                                 importer->dep_capacity * sizeof(ImportModule *));
+    }
+    importer->deps[importer->dep_count++] = module;
+}
+
+static int contains_module(ImportModule **modules, int count, ImportModule *module) {
+    for (int i = 0; i < count; i++) {
+        if (modules[i] == module) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void order_module(ImportModule *module, ImportModule **seen, int *seen_count,
+                         ImportModule **order, int *count) {
+    if (contains_module(seen, *seen_count, module)) {
+        return;
+    }
+    seen[(*seen_count)++] = module;
+    for (int i = 0; i < module->dep_count; i++) {
+        order_module(module->deps[i], seen, seen_count, order, count);
+    }
+    order[(*count)++] = module;
+}
+
+int import_graph_order(ImportGraph *graph, ImportModule **order) {
+    ImportModule **seen = malloc((graph->module_count + 1) * sizeof(ImportModule *));
+    int seen_count = 0;
+    int count = 0;
+    for (int i = 0; i < graph->module_count; i++) {
+        order_module(graph->modules[i], seen, &seen_count, order, &count);
+    }
+    free(seen);
+    return count;
+}
+
+void import_graph_push(ImportGraph *graph, ImportModule *module) {
+    if (graph->stack_depth == graph->stack_capacity) {
+        graph->stack_capacity = graph->stack_capacity ? graph->stack_capacity * 2 : 8;
+        graph->stack = realloc(graph->stack,
+                               graph->stack_capacity * sizeof(ImportModule *));
+    }
+    graph->stack[graph->stack_depth++] = module;
+    module->state = MODULE_VISITING;
+}
+
+void import_graph_pop(ImportGraph *graph) {
+    if (graph->stack_depth > 0) {
+        graph->stack[--graph->stack_depth]->state = MODULE_DONE;
+    }
+}
+
+ImportModule *import_graph_current(ImportGraph *graph) {
+    return graph->stack_depth > 0 ? graph->stack[graph->stack_depth - 1] : NULL;
+}
+
+void report_import_cycle(ImportGraph *graph, ImportModule *module) {
+    // Print the chain from the first occurrence of the module back to itself
+    int start = 0;
+    while (start < graph->stack_depth && graph->stack[start] != module) {
+        start++;
+    }
+
+    report_error("Error: import cycle detected:\n");
+    for (int i = start; i < graph->stack_depth; i++) {
+        report_error("  %s imports\n", graph->stack[i]->path);
+    }
+    report_error("  %s\n", module->path);
+}
@@ -0,0 +1,559 @@
+#include "interface.h"
+#include <elf.h>
+#include <errno.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Fixed-size header at the start of every interface file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t payload_size;
+    SourceStamp stamp;
+    uint64_t interface_hash;
+    uint64_t compiler_id;  // compiler_build_id() of the writer
+} InterfaceHeader;
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+    // FNV-1a, 64-bit
+    const unsigned char *bytes = data;
+    uint64_t hash = seed ? seed : 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#ifndef GLOIN_VERSION
+#define GLOIN_VERSION "unknown"
+#endif
+#ifndef GLOIN_LLVM_VERSION
+#define GLOIN_LLVM_VERSION "unknown"
+#endif
+
+static pthread_once_t build_id_once = PTHREAD_ONCE_INIT;
+static uint64_t build_id;
+
+// The linker's NT_GNU_BUILD_ID note of the executable, which changes with
+// every change to the compiler's code. The first object listed is the
+// executable.
+static int hash_executable_build_id(struct dl_phdr_info *info, size_t size, void *data) {
+    (void)size;
+    (void)data;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_NOTE) {
+            continue;
+        }
+        const char *note = (const char *)(info->dlpi_addr + phdr->p_vaddr);
+        const char *end = note + phdr->p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *header = (const ElfW(Nhdr) *)note;
+            const char *name = note + sizeof(ElfW(Nhdr));
+            const char *desc = name + ((header->n_namesz + 3) & ~3u);
+            if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+                memcmp(name, "GNU", 4) == 0 && desc + header->n_descsz <= end) {
+                build_id = hash_bytes(desc, header->n_descsz, build_id);
+                return 1;
+            }
+            note = desc + ((header->n_descsz + 3) & ~3u);
+        }
+    }
+    return 1;
+}
+
+static void compute_build_id(void) {
+    const char *version = GLOIN_VERSION " " GLOIN_LLVM_VERSION;
+    build_id = hash_bytes(version, strlen(version), 0);
+    dl_iterate_phdr(hash_executable_build_id, NULL);
+}
+
+uint64_t compiler_build_id(void) {
+    pthread_once(&build_id_once, compute_build_id);
+    return build_id;
+}
+
+int get_source_stamp(const char *source_path, SourceStamp *stamp) {
+    struct stat st;
+    if (stat(source_path, &st) != 0) {
+        return 1;
+    }
+
+    FILE *file = fopen(source_path, "rb");
+    if (!file) {
+        return 1;
+    }
+
+    char *content = malloc(st.st_size + 1);
+    size_t read = fread(content, 1, st.st_size, file);
+    fclose(file);
+
+    stamp->size = (uint64_t)st.st_size;
+    stamp->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    stamp->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    stamp->hash = hash_bytes(content, read, 0);
+    free(content);
+    return read == (size_t)st.st_size ? 0 : 1;
+}
+
+static int ensure_directory(const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        return S_ISDIR(st.st_mode) && access(path, W_OK) == 0 ? 0 : 1;
+    }
+    // Another compiler may create it at the same time
+    return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : 1;
+}
+
+char *temporary_path(const char *path) {
+    // Unique per process and per call, so threads compiling the same
+    // module never share a temporary file
+    static unsigned counter = 0;
+    unsigned sequence = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    char *tmp_path = malloc(strlen(path) + 40);
+    sprintf(tmp_path, "%s.tmp.%ld.%u", path, (long)getpid(), sequence);
+    return tmp_path;
+}
+
+int writes_in_place(const char *path) {
+    struct stat st;
+    if (strcmp(path, "-") == 0) {
+        return 1;
+    }
+    return stat(path, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+char *module_cache_path(const char *source_path, const char *extension) {
+    const char *slash = strrchr(source_path, '/');
+    const char *base = slash ? slash + 1 : source_path;
+    int dir_len = slash ? (int)(slash - source_path) : 1;
+    const char *dir = slash ? source_path : ".";
+
+    int base_len = (int)strlen(base);
+    if (base_len > 6 && strcmp(base + base_len - 6, ".gloin") == 0) {
+        base_len -= 6;
+    }
+
+    // Preferred location: .gloin-cache next to the module
+    char *cache_dir = malloc(dir_len + 14); // "/.gloin-cache\0"
+    sprintf(cache_dir, "%.*s/.gloin-cache", dir_len, dir);
+    if (ensure_directory(cache_dir) != 0) {
+        // Read-only source tree: fall back to a per-user temporary cache,
+        // one subdirectory per source directory
+        free(cache_dir);
+        const char *tmp = getenv("TMPDIR");
+        if (!tmp || !*tmp) {
+            tmp = "/tmp";
+        }
+        char *user_dir = malloc(strlen(tmp) + 32);
+        sprintf(user_dir, "%s/gloin-cache-%u", tmp, (unsigned)getuid());
+        if (ensure_directory(user_dir) != 0) {
+            free(user_dir);
+            return NULL;
+        }
+        cache_dir = malloc(strlen(user_dir) + 18);
+        sprintf(cache_dir, "%s/%016llx", user_dir,
+                (unsigned long long)hash_bytes(dir, dir_len, 0));
+        free(user_dir);
+        if (ensure_directory(cache_dir) != 0) {
+            free(cache_dir);
+            return NULL;
+        }
+    }
+
+    char *path = malloc(strlen(cache_dir) + base_len + strlen(extension) + 2);
+    sprintf(path, "%s/%.*s%s", cache_dir, base_len, base, extension);
+    free(cache_dir);
+    return path;
+}
+
+// Interface construction
+
+static void fill_function(InterfaceFunction *fn, const char *name,
+                          const char *return_type, ASTNode **params,
+                          int param_count) {
+    fn->name = strdup(name);
+    fn->return_type = strdup(return_type);
+    fn->param_count = param_count;
+    fn->param_types = param_count ? malloc(param_count * sizeof(char *)) : NULL;
+    for (int i = 0; i < param_count; i++) {
+        fn->param_types[i] = strdup(params[i]->data.parameter.type);
+    }
+}
+
+ModuleInterface *build_module_interface(ASTNode *program) {
+    ModuleInterface *iface = calloc(1, sizeof(ModuleInterface));
+    int count = program->data.program.function_count;
+
+    // Module dependencies; @std is built into the compiler
+    int import_count = program->data.program.import_count;
+    iface->deps = calloc(import_count ? import_count : 1,
+                         sizeof(InterfaceDependency));
+    for (int i = 0; i < import_count; i++) {
+        ASTNode *import = program->data.program.imports[i];
+        if (import->data.import.import_type == IMPORT_STD) {
+            continue;
+        }
+        InterfaceDependency *dep = &iface->deps[iface->dep_count++];
+        dep->import_type = import->data.import.import_type;
+        dep->path = strdup(import->data.import.path);
+    }
+
+    iface->functions = calloc(count ? count : 1, sizeof(InterfaceFunction));
+    iface->structs = calloc(count ? count : 1, sizeof(InterfaceStruct));
+
+    for (int i = 0; i < count; i++) {
+        ASTNode *node = program->data.program.functions[i];
+        if (node->type == NODE_FUNCTION) {
+            // Top-level functions have no visibility modifier and are
+            // always exported
+            fill_function(&iface->functions[iface->function_count++],
+                          node->data.function.name,
+                          node->data.function.return_type,
+                          node->data.function.params,
+                          node->data.function.param_count);
+        } else if (node->type == NODE_STRUCT) {
+            InterfaceStruct *st = &iface->structs[iface->struct_count++];
+            int field_count = node->data.struct_decl.field_count;
+            int method_count = node->data.struct_decl.method_count;
+
+            st->name = strdup(node->data.struct_decl.name);
+            st->field_count = field_count;
+            st->field_names = malloc((field_count ? field_count : 1) * sizeof(char *));
+            st->field_types = malloc((field_count ? field_count : 1) * sizeof(char *));
+            for (int j = 0; j < field_count; j++) {
+                ASTNode *field = node->data.struct_decl.fields[j];
+                st->field_names[j] = strdup(field->data.struct_field.name);
+                st->field_types[j] = strdup(field->data.struct_field.type);
+            }
+
+            st->methods = calloc(method_count ? method_count : 1,
+                                 sizeof(InterfaceFunction));
+            for (int j = 0; j < method_count; j++) {
+                ASTNode *method = node->data.struct_decl.methods[j];
+                if (method->data.struct_method.visibility != VISIBILITY_PUBLIC) {
+                    continue;
+                }
+                fill_function(&st->methods[st->method_count++],
+                              method->data.struct_method.name,
+                              method->data.struct_method.return_type,
+                              method->data.struct_method.params,
+                              method->data.struct_method.param_count);
+            }
+        }
+    }
+
+    return iface;
+}
+
+static void free_function(InterfaceFunction *fn) {
+    free(fn->name);
+    free(fn->return_type);
+    for (int i = 0; i < fn->param_count; i++) {
+        free(fn->param_types[i]);
+    }
+    free(fn->param_types);
+}
+
+void free_module_interface(ModuleInterface *iface) {
+    if (!iface)
+        return;
+
+    for (int i = 0; i < iface->dep_count; i++) {
+        free(iface->deps[i].path);
+    }
+    free(iface->deps);
+
+    for (int i = 0; i < iface->function_count; i++) {
+        free_function(&iface->functions[i]);
+    }
+    free(iface->functions);
+
+    for (int i = 0; i < iface->struct_count; i++) {
+        InterfaceStruct *st = &iface->structs[i];
+        free(st->name);
+        for (int j = 0; j < st->field_count; j++) {
+            free(st->field_names[j]);
+            free(st->field_types[j]);
+        }
+        free(st->field_names);
+        free(st->field_types);
+        for (int j = 0; j < st->method_count; j++) {
+            free_function(&st->methods[j]);
+        }
+        free(st->methods);
+    }
+    free(iface->structs);
+    free(iface);
+}
+
+// Writer
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+static void put_bytes(ByteBuffer *buf, const void *data, size_t size) {
+    if (buf->size + size > buf->capacity) {
+        buf->capacity = (buf->size + size) * 2 + 64;
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+static void put_u32(ByteBuffer *buf, uint32_t value) {
+    put_bytes(buf, &value, sizeof(value));
+}
+
+static void put_u64(ByteBuffer *buf, uint64_t value) {
+    put_bytes(buf, &value, sizeof(value));
+}
+
+static void put_string(ByteBuffer *buf, const char *str) {
+    uint32_t len = (uint32_t)strlen(str);
+    put_u32(buf, len);
+    put_bytes(buf, str, len);
+}
+
+static void put_function(ByteBuffer *buf, InterfaceFunction *fn) {
+    put_string(buf, fn->name);
+    put_string(buf, fn->return_type);
+    put_u32(buf, (uint32_t)fn->param_count);
+    for (int i = 0; i < fn->param_count; i++) {
+        put_string(buf, fn->param_types[i]);
+    }
+}
+
+int write_module_interface(ModuleInterface *iface, const char *path,
+                           const SourceStamp *stamp) {
+    // Exports first, so that their hash covers a contiguous byte range
+    ByteBuffer buf = {NULL, 0, 0};
+    put_u32(&buf, (uint32_t)iface->function_count);
+    for (int i = 0; i < iface->function_count; i++) {
+        put_function(&buf, &iface->functions[i]);
+    }
+    put_u32(&buf, (uint32_t)iface->struct_count);
+    for (int i = 0; i < iface->struct_count; i++) {
+        InterfaceStruct *st = &iface->structs[i];
+        put_string(&buf, st->name);
+        put_u32(&buf, (uint32_t)st->field_count);
+        for (int j = 0; j < st->field_count; j++) {
+            put_string(&buf, st->field_names[j]);
+            put_string(&buf, st->field_types[j]);
+        }
+        put_u32(&buf, (uint32_t)st->method_count);
+        for (int j = 0; j < st->method_count; j++) {
+            put_function(&buf, &st->methods[j]);
+        }
+    }
+    iface->interface_hash = hash_bytes(buf.data, buf.size, 0);
+
+    put_u32(&buf, (uint32_t)iface->dep_count);
+    for (int i = 0; i < iface->dep_count; i++) {
+        put_u32(&buf, (uint32_t)iface->deps[i].import_type);
+        put_string(&buf, iface->deps[i].path);
+        put_u64(&buf, iface->deps[i].interface_hash);
+    }
+
+    InterfaceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GLOIN_INTERFACE_MAGIC, sizeof(header.magic));
+    header.version = GLOIN_INTERFACE_VERSION;
+    header.payload_size = (uint32_t)buf.size;
+    header.stamp = *stamp;
+    header.interface_hash = iface->interface_hash;
+    header.compiler_id = compiler_build_id();
+
+    // Write to a temporary file and rename it into place so that a
+    // concurrent reader never observes a partial interface
+    char *tmp_path = temporary_path(path);
+    FILE *file = fopen(tmp_path, "wb");
+    int failed = !file;
+    if (file) {
+        failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+        failed |= fwrite(buf.data, 1, buf.size, file) != buf.size;
+        failed |= fclose(file) != 0;
+    }
+    if (!failed) {
+        failed = rename(tmp_path, path) != 0;
+    }
+    if (failed) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    free(buf.data);
+    return failed;
+}
+
+// Reader. Every read is bounds checked; a malformed file is treated as a
+// cache miss.
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    int failed;
+} ByteReader;
+
+static int get_bytes(ByteReader *r, void *out, size_t size) {
+    if (r->failed || size > r->size - r->pos) {
+        r->failed = 1;
+        return 1;
+    }
+    memcpy(out, r->data + r->pos, size);
+    r->pos += size;
+    return 0;
+}
+
+static uint32_t get_u32(ByteReader *r) {
+    uint32_t value = 0;
+    get_bytes(r, &value, sizeof(value));
+    return value;
+}
+
+static uint64_t get_u64(ByteReader *r) {
+    uint64_t value = 0;
+    get_bytes(r, &value, sizeof(value));
+    return value;
+}
+
+static char *get_string(ByteReader *r) {
+    uint32_t len = get_u32(r);
+    if (r->failed || len > r->size - r->pos) {
+        r->failed = 1;
+        return strdup("");
+    }
+    char *str = malloc(len + 1);
+    memcpy(str, r->data + r->pos, len);
+    str[len] = '\0';
+    r->pos += len;
+    return str;
+}
+
+// Element counts can never exceed the remaining bytes
+static int get_count(ByteReader *r) {
+    uint32_t count = get_u32(r);
+    if (r->failed || count > r->size - r->pos) {
+        r->failed = 1;
+        return 0;
+    }
+    return (int)count;
+}
+
+static void get_function(ByteReader *r, InterfaceFunction *fn) {
+    fn->name = get_string(r);
+    fn->return_type = get_string(r);
+    fn->param_count = get_count(r);
+    fn->param_types = malloc((fn->param_count ? fn->param_count : 1) * sizeof(char *));
+    for (int i = 0; i < fn->param_count; i++) {
+        fn->param_types[i] = get_string(r);
+    }
+}
+
+static ModuleInterface *decode_interface(ByteReader *r) {
+    ModuleInterface *iface = calloc(1, sizeof(ModuleInterface));
+
+    int function_count = get_count(r);
+    iface->functions = calloc(function_count ? function_count : 1,
+                              sizeof(InterfaceFunction));
+    for (int i = 0; i < function_count && !r->failed; i++) {
+        get_function(r, &iface->functions[iface->function_count++]);
+    }
+
+    int struct_count = get_count(r);
+    iface->structs = calloc(struct_count ? struct_count : 1, sizeof(InterfaceStruct));
+    for (int i = 0; i < struct_count && !r->failed; i++) {
+        InterfaceStruct *st = &iface->structs[iface->struct_count++];
+        st->name = get_string(r);
+        int field_count = get_count(r);
+        st->field_names = calloc(field_count ? field_count : 1, sizeof(char *));
+        st->field_types = calloc(field_count ? field_count : 1, sizeof(char *));
+        for (int j = 0; j < field_count && !r->failed; j++) {
+            st->field_names[j] = get_string(r);
+            st->field_types[j] = get_string(r);
+            st->field_count++;
+        }
+        int method_count = get_count(r);
+        st->methods = calloc(method_count ? method_count : 1, sizeof(InterfaceFunction));
+        for (int j = 0; j < method_count && !r->failed; j++) {
+            get_function(r, &st->methods[st->method_count++]);
+        }
+    }
+
+    int dep_count = get_count(r);
+    iface->deps = calloc(dep_count ? dep_count : 1, sizeof(InterfaceDependency));
+    for (int i = 0; i < dep_count && !r->failed; i++) {
+        InterfaceDependency *dep = &iface->deps[iface->dep_count++];
+        uint32_t import_type = get_u32(r);
+        dep->import_type = import_type <= IMPORT_LOCAL ? (ImportType)import_type : IMPORT_LOCAL;
+        dep->path = get_string(r);
+        dep->interface_hash = get_u64(r);
+        r->failed |= import_type > IMPORT_LOCAL;
+    }
+
+    if (r->failed || r->pos != r->size) {
+        free_module_interface(iface);
+        return NULL;
+    }
+    return iface;
+}
+
+ModuleInterface *load_module_interface(const char *path, const char *source_path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    InterfaceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, GLOIN_INTERFACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != GLOIN_INTERFACE_VERSION ||
+        header.compiler_id != compiler_build_id()) {
+        fclose(file);
+        return NULL;
+    }
+
+    // Cheap staleness check first: size and modification time
+    struct stat st;
+    if (stat(source_path, &st) != 0 || (uint64_t)st.st_size != header.stamp.size) {
+        fclose(file);
+        return NULL;
+    }
+    if ((int64_t)st.st_mtim.tv_sec != header.stamp.mtime_sec ||
+        (int64_t)st.st_mtim.tv_nsec != header.stamp.mtime_nsec) {
+        // Touched but maybe unchanged: compare content hashes
+        SourceStamp current;
+        if (get_source_stamp(source_path, &current) != 0 ||
+            current.hash != header.stamp.hash) {
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    unsigned char *payload = malloc(header.payload_size ? header.payload_size : 1);
+    size_t read = fread(payload, 1, header.payload_size, file);
+    int trailing = fgetc(file) != EOF;
+    fclose(file);
+    if (read != header.payload_size || trailing) {
+        free(payload);
+        return NULL;
+    }
+
+    ByteReader reader = {payload, header.payload_size, 0, 0};
+    ModuleInterface *iface = decode_interface(&reader);
+    if (iface) {
+        iface->interface_hash = header.interface_hash;
+    }
+    free(payload);
+    return iface;
+}
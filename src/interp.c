@@ -0,0 +1,2878 @@
+#include "interp.h"
+#include "diagnostics.h"
+#include "fold.h"
+#include "imports.h"
+#include "parser.h"
+#include "reachability.h"
+#include "timing.h"
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Registers hold 64-bit values. Integers are kept sign-extended from the
+// width of their type, which makes signed comparisons and division on the
+// whole register agree with LLVM's; bools are 0 or 1, and strings, pointers
+// and structs are host addresses (a struct is the address of its bytes).
+//
+// Operands: a is a register, b and c are registers, immediates, frame
+// offsets or jump targets, and width is the number of bits a result is
+// wrapped to or a load or store moves.
+#define INTERP_OPCODES(X)                                                   \
+    X(LOADI)   /* a = b */                                                  \
+    X(LOADK)   /* a = constants[b] */                                       \
+    X(MOVE)    /* a = R[b] */                                               \
+    X(ADD)     /* a = R[b] + R[c] */                                        \
+    X(SUB)                                                                  \
+    X(MUL)                                                                  \
+    X(DIV)                                                                  \
+    X(ADDI)    /* a = R[b] + c */                                           \
+    X(EQ)      /* a = R[b] == R[c] */                                       \
+    X(NE)                                                                   \
+    X(LT)                                                                   \
+    X(GT)                                                                   \
+    X(LE)                                                                   \
+    X(GE)                                                                   \
+    X(JMP)     /* goto b */                                                 \
+    X(JMPF)    /* if (!R[a]) goto b */                                      \
+    X(JMPT)    /* if (R[a]) goto b */                                       \
+    X(JEQ)     /* if (R[a] == R[b]) goto c */                               \
+    X(JNE)                                                                  \
+    X(JLT)                                                                  \
+    X(JGT)                                                                  \
+    X(JLE)                                                                  \
+    X(JGE)                                                                  \
+    X(JEQI)    /* if (R[a] == b) goto c */                                  \
+    X(LOOP)    /* Loop back edge, counted toward tiering; b is the */      \
+               /* function's loops[] entry, -1 for none */                 \
+    X(WRAP)    /* a = R[b], sign-extended or truncated */                   \
+    X(ZEXT)    /* a = low c bits of R[b] */                                 \
+    X(LOAD)    /* a = *(R[b] + c) */                                        \
+    X(STORE)   /* *(R[b] + c) = R[a] */                                     \
+    X(LOADL)   /* a = frame[b] */                                           \
+    X(STOREL)  /* frame[b] = R[a] */                                        \
+    X(ADDR)    /* a = &frame[b] */                                          \
+    X(LOADG)   /* a = globals[b] */                                         \
+    X(STOREG)  /* globals[b] = R[a] */                                      \
+    X(ADDRG)   /* a = &globals[b] */                                        \
+    X(COPY)    /* memcpy(R[a], R[b], c) */                                  \
+    X(CALL)    /* a = functions[b](R[c], R[c + 1], ...) */                  \
+    X(RET)     /* return R[a] */                                            \
+    X(RETV)                                                                 \
+    X(PRINT)   /* printf(formats[b], R[a]), newline when c */               \
+    X(FORMAT)  /* a = sprintf(&frame[c], formats[width], R[b]) */           \
+    X(INPUT)   /* a = scanf into &frame[b] */                               \
+    X(READLN)  /* a = getline from stdin */                                 \
+    X(ATOI)    /* a = atoi(R[b]) */                                         \
+    X(ATOL)                                                                 \
+    X(MALLOC)  /* a = malloc(R[b]) */                                       \
+    X(FREE)    /* free(R[a]) */
+
+typedef enum {
+#define OPCODE_ENUM(name) BC_##name,
+    INTERP_OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+    BC_COUNT
+} Opcode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t width;
+    uint16_t a;
+    int32_t b;
+    int32_t c;
+} Instr;
+
+// How std.print, std.println and std.to_string show a value
+typedef enum {
+    FORMAT_STRING,
+    FORMAT_BOOL,
+    FORMAT_I8,
+    FORMAT_I16,
+    FORMAT_I32,
+    FORMAT_I64,
+    FORMAT_U8,
+    FORMAT_U16,
+    FORMAT_U32,
+    FORMAT_U64
+} ValueFormat;
+
+static const char *const formats[] = {
+    "%s", "%s", "%hhd", "%hd", "%d", "%ld", "%hhu", "%hu", "%u", "%lu",
+};
+static const char *const line_formats[] = {
+    "%s\n", "%s\n", "%hhd\n", "%hd\n", "%d\n", "%ld\n", "%hhu\n", "%hu\n",
+    "%u\n", "%lu\n",
+};
+
+// An outermost loop of a function, which tiering can leave for native
+// code at its back edge. The function's variables are then all in
+// registers, and are handed to the native code in this order.
+typedef struct {
+    ASTNode *node;        // NODE_FOR or NODE_WHILE
+    char **names;
+    TypeKind *types;
+    int *registers;
+    int variable_count;
+    InterpNative native;  // Runs the rest of the function from the back edge
+} InterpLoop;
+
+typedef struct {
+    char *name;           // StructName_method for methods
+    ASTNode *node;        // NODE_FUNCTION or NODE_STRUCT_METHOD
+    TypeKind self_type;   // Struct of a method's self
+    int module;           // Defining module, for private methods
+    int arity;            // Arguments, self included
+    TypeKind return_type;
+    Instr *code;
+    int code_length;
+    int code_capacity;
+    int register_count;
+    int frame_size;       // Bytes of memory for variables that need one
+
+    // Tiering: calls and loop iterations so far, whether the hook has been
+    // told, and the native code that replaces the bytecode once compiled
+    uint32_t heat;
+    int is_hot;
+    InterpNative native;
+    InterpLoop *loops;
+    int loop_count;
+    int loop_capacity;
+} InterpFunction;
+
+// A top-level variable, at offset in the program's global memory
+typedef struct {
+    ASTNode *node;        // NODE_VARIABLE_DECL
+    int module;
+    int offset;
+} InterpGlobal;
+
+struct InterpProgram {
+    InterpFunction *functions;
+    int function_count;
+    int function_capacity;
+    InterpGlobal *globals;
+    int global_count;
+    int global_capacity;
+    uint8_t *global_memory;
+    int global_size;
+    int init_function;    // Runs the globals' initializers, -1 if none
+    int64_t *constants;
+    int constant_count;
+    int constant_capacity;
+    char **strings;       // String literals, shared by equal literals
+    int string_count;
+    int string_capacity;
+    int main_function;
+    ImportGraph *imports;  // Owns the imported syntax trees
+    ASTNode **modules;     // Imports first, the root program last
+    int module_count;
+
+    uint32_t hot_threshold;  // 0 when not tiering
+    InterpHotHook hot_hook;
+    void *hot_context;
+    uint64_t step_limit;     // Loop iterations and calls allowed, 0 for any
+    uint64_t steps;
+
+    // Stacks of the running program. Native code calling back into the
+    // interpreter continues on them above the frame that called it.
+    int64_t *register_stack;
+    uint8_t *memory_stack;
+    int64_t *register_end;
+    uint8_t *memory_end;
+    struct Frame *frames;
+    int64_t *register_top;
+    uint8_t *memory_top;
+    int frame_top;
+    int nesting;           // Interpreter activations below native code
+    jmp_buf error_exit;    // Where runtime errors unwind to
+};
+
+// Where a variable lives. Variables whose address is taken and structs
+// need memory; fields inside a method are reached through self, and
+// top-level variables live in global memory.
+typedef enum {
+    VAR_REGISTER,
+    VAR_FRAME,
+    VAR_FIELD,
+    VAR_GLOBAL
+} VarStorage;
+
+typedef struct {
+    char *name;
+    VarStorage storage;
+    int location;      // Register, frame, self or global memory offset
+    TypeKind type;     // The type the compiler's checks see
+    TypeKind actual;   // The type of the value stored
+    int is_mutable;    // As in the declaration: 1 mut, 0 immutable, -1 const
+} Variable;
+
+typedef struct {
+    int *breaks;       // Jumps to patch to the loop exit
+    int break_count;
+    int break_capacity;
+    int *continues;    // Jumps to patch to the next iteration
+    int continue_count;
+    int continue_capacity;
+} Loop;
+
+typedef struct {
+    int size;
+    int align;
+    int *offsets;
+    int state;         // 0 not laid out, 1 in progress, 2 done
+} StructLayout;
+
+typedef struct {
+    InterpProgram *program;
+    ASTNode **modules;  // Imports first, the root program last
+    int module_count;
+    int module_capacity;
+
+    // The function being compiled
+    InterpFunction *function;
+    Variable *variables;
+    int variable_count;
+    int variable_capacity;
+    char **address_taken;  // Names used with &
+    int address_taken_count;
+    int address_taken_capacity;
+    Loop *loops;
+    int loop_depth;
+    int loop_capacity;
+    int locals_top;      // Registers below are variables, above temporaries
+    int next_register;
+    int terminated;      // The code emitted last cannot fall through
+
+    StructLayout layouts[TYPE_UNKNOWN - TYPE_STRUCT_START];
+    int has_error;       // Errors that fail the whole program
+} Compiler;
+
+static void *grow(void *items, int *capacity, int count, size_t size) {
+    if (count < *capacity) {
+        return items;
+    }
+    *capacity = *capacity ? *capacity * 2 : 8;
+    return realloc(items, *capacity * size);
+}
+
+// Value layout
+
+static int is_unsupported_type(TypeKind type) {
+    return is_floating_type(type) || type == TYPE_F128 || type == TYPE_I128 ||
+           type == TYPE_U128;
+}
+
+// Bits a value of the type occupies in a register. Unknown types are
+// treated as i32, as the LLVM backend does after reporting them.
+static int value_bits(TypeKind type) {
+    switch (type) {
+    case TYPE_VOID:
+        return 0;
+    case TYPE_BOOL:
+        return 1;
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_CHAR:
+        return 8;
+    case TYPE_I16:
+    case TYPE_U16:
+        return 16;
+    case TYPE_I32:
+    case TYPE_U32:
+    case TYPE_UNKNOWN:
+        return 32;
+    default:
+        return 64;
+    }
+}
+
+// A value as a register of that many bits holds it
+static inline int64_t wrap(uint64_t value, int bits) {
+    if (bits >= 64 || bits == 0) {
+        return (int64_t)value;
+    }
+    if (bits == 1) {
+        return value & 1;
+    }
+    int shift = 64 - bits;
+    return (int64_t)(value << shift) >> shift;
+}
+
+static StructLayout *struct_layout(Compiler *c, TypeKind type);
+
+static int type_size(Compiler *c, TypeKind type) {
+    if (is_struct_type(type)) {
+        StructLayout *layout = struct_layout(c, type);
+        return layout ? layout->size : 0;
+    }
+    int bits = value_bits(type);
+    return bits == 1 ? 1 : bits / 8;
+}
+
+static int type_align(Compiler *c, TypeKind type) {
+    if (is_struct_type(type)) {
+        StructLayout *layout = struct_layout(c, type);
+        return layout ? layout->align : 1;
+    }
+    int size = type_size(c, type);
+    return size ? size : 1;
+}
+
+// Fields are laid out in order at their natural alignment
+static StructLayout *struct_layout(Compiler *c, TypeKind type) {
+    StructLayout *layout = &c->layouts[type - TYPE_STRUCT_START];
+    if (layout->state == 2) {
+        return layout;
+    }
+    StructType *st = get_struct_type(type);
+    if (!st || layout->state == 1) {
+        report_error("Error: Cannot lay out struct '%s'\n", type_to_string(type));
+        c->has_error = 1;
+        return NULL;
+    }
+    layout->state = 1;
+    layout->offsets = malloc((st->field_count ? st->field_count : 1) * sizeof(int));
+    int offset = 0;
+    int align = 1;
+    for (int i = 0; i < st->field_count; i++) {
+        int field_align = type_align(c, st->fields[i].type);
+        offset = (offset + field_align - 1) / field_align * field_align;
+        layout->offsets[i] = offset;
+        offset += type_size(c, st->fields[i].type);
+        if (field_align > align) {
+            align = field_align;
+        }
+    }
+    layout->size = (offset + align - 1) / align * align;
+    layout->align = align;
+    layout->state = 2;
+    return layout;
+}
+
+static int field_index(TypeKind type, const char *name) {
+    StructType *st = get_struct_type(type);
+    for (int i = 0; st && i < st->field_count; i++) {
+        if (strcmp(st->fields[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Code emission
+
+static int emit(Compiler *c, Opcode op, int width, int a, int b, int cc) {
+    InterpFunction *fn = c->function;
+    fn->code = grow(fn->code, &fn->code_capacity, fn->code_length, sizeof(Instr));
+    Instr *instr = &fn->code[fn->code_length];
+    instr->op = op;
+    instr->width = width;
+    instr->a = a;
+    instr->b = b;
+    instr->c = cc;
+    return fn->code_length++;
+}
+
+static int is_jump_with_target_in_c(Opcode op) {
+    return (op >= BC_JEQ && op <= BC_JGE) || op == BC_JEQI;
+}
+
+static void patch_jump(Compiler *c, int at, int target) {
+    Instr *instr = &c->function->code[at];
+    if (is_jump_with_target_in_c(instr->op)) {
+        instr->c = target;
+    } else {
+        instr->b = target;
+    }
+}
+
+static int here(Compiler *c) {
+    return c->function->code_length;
+}
+
+static int new_register(Compiler *c) {
+    int reg = c->next_register++;
+    if (c->next_register > c->function->register_count) {
+        c->function->register_count = c->next_register;
+    }
+    if (reg > UINT16_MAX) {
+        report_error("Error: Function %s needs too many registers\n", c->function->name);
+        c->has_error = 1;
+        return 0;
+    }
+    return reg;
+}
+
+static int new_frame_slot(Compiler *c, int size, int align) {
+    int offset = (c->function->frame_size + align - 1) / align * align;
+    c->function->frame_size = offset + size;
+    return offset;
+}
+
+static int add_constant(Compiler *c, int64_t value) {
+    InterpProgram *program = c->program;
+    for (int i = 0; i < program->constant_count; i++) {
+        if (program->constants[i] == value) {
+            return i;
+        }
+    }
+    program->constants = grow(program->constants, &program->constant_capacity,
+                              program->constant_count, sizeof(int64_t));
+    program->constants[program->constant_count] = value;
+    return program->constant_count++;
+}
+
+// Equal literals share storage, as the linker merges them in executables
+static int add_string(Compiler *c, const char *value) {
+    InterpProgram *program = c->program;
+    for (int i = 0; i < program->string_count; i++) {
+        if (strcmp(program->strings[i], value) == 0) {
+            return add_constant(c, (int64_t)(intptr_t)program->strings[i]);
+        }
+    }
+    program->strings = grow(program->strings, &program->string_capacity,
+                            program->string_count, sizeof(char *));
+    char *copy = strdup(value);
+    program->strings[program->string_count++] = copy;
+    return add_constant(c, (int64_t)(intptr_t)copy);
+}
+
+// Variables
+
+static Variable *find_variable(Compiler *c, const char *name) {
+    for (int i = 0; i < c->variable_count; i++) {
+        if (strcmp(c->variables[i].name, name) == 0) {
+            return &c->variables[i];
+        }
+    }
+    return NULL;
+}
+
+// A name declared again refers to the new variable from then on
+static Variable *set_variable(Compiler *c, const char *name, VarStorage storage,
+                              int location, TypeKind type, TypeKind actual,
+                              int is_mutable) {
+    Variable *var = find_variable(c, name);
+    if (!var) {
+        c->variables = grow(c->variables, &c->variable_capacity, c->variable_count,
+                            sizeof(Variable));
+        var = &c->variables[c->variable_count++];
+        var->name = strdup(name);
+    }
+    var->storage = storage;
+    var->location = location;
+    var->type = type;
+    var->actual = actual;
+    var->is_mutable = is_mutable;
+    return var;
+}
+
+static int is_address_taken(Compiler *c, const char *name) {
+    for (int i = 0; i < c->address_taken_count; i++) {
+        if (strcmp(c->address_taken[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void find_address_taken_list(Compiler *c, ASTNode **nodes, int count);
+
+// Collect the variables a function uses with &, which then live in memory
+static void find_address_taken(Compiler *c, ASTNode *node) {
+    if (!node) {
+        return;
+    }
+    switch (node->type) {
+    case NODE_BLOCK:
+        find_address_taken_list(c, node->data.block.statements,
+                                node->data.block.statement_count);
+        break;
+    case NODE_VARIABLE_DECL:
+        find_address_taken(c, node->data.variable_decl.value);
+        break;
+    case NODE_ASSIGNMENT:
+        find_address_taken(c, node->data.assignment.value);
+        break;
+    case NODE_POINTER_ASSIGNMENT:
+        find_address_taken(c, node->data.pointer_assignment.target);
+        find_address_taken(c, node->data.pointer_assignment.value);
+        break;
+    case NODE_RETURN:
+        find_address_taken(c, node->data.return_stmt.value);
+        break;
+    case NODE_CALL:
+        find_address_taken_list(c, node->data.call.args, node->data.call.arg_count);
+        break;
+    case NODE_BINARY_OP:
+        find_address_taken(c, node->data.binary_op.left);
+        find_address_taken(c, node->data.binary_op.right);
+        break;
+    case NODE_UNARY_OP: {
+        ASTNode *operand = node->data.unary_op.operand;
+        if (node->data.unary_op.operator == UNARY_ADDRESS_OF &&
+            operand->type == NODE_IDENTIFIER &&
+            !is_address_taken(c, operand->data.identifier.name)) {
+            c->address_taken = grow(c->address_taken, &c->address_taken_capacity,
+                                    c->address_taken_count, sizeof(char *));
+            c->address_taken[c->address_taken_count++] = operand->data.identifier.name;
+        }
+        find_address_taken(c, operand);
+        break;
+    }
+    case NODE_FIELD_ACCESS:
+        find_address_taken(c, node->data.field_access.object);
+        break;
+    case NODE_METHOD_CALL:
+        find_address_taken(c, node->data.method_call.object);
+        find_address_taken_list(c, node->data.method_call.args,
+                                node->data.method_call.arg_count);
+        break;
+    case NODE_STRUCT_LITERAL:
+        find_address_taken_list(c, node->data.struct_literal.field_values,
+                                node->data.struct_literal.field_count);
+        break;
+    case NODE_IF:
+        find_address_taken(c, node->data.if_stmt.condition);
+        find_address_taken(c, node->data.if_stmt.then_block);
+        find_address_taken(c, node->data.if_stmt.else_block);
+        break;
+    case NODE_UNLESS:
+        find_address_taken(c, node->data.unless_stmt.condition);
+        find_address_taken(c, node->data.unless_stmt.then_block);
+        find_address_taken(c, node->data.unless_stmt.else_block);
+        break;
+    case NODE_FOR:
+        find_address_taken(c, node->data.for_stmt.init);
+        find_address_taken(c, node->data.for_stmt.condition);
+        find_address_taken(c, node->data.for_stmt.update);
+        find_address_taken(c, node->data.for_stmt.body);
+        break;
+    case NODE_WHILE:
+        find_address_taken(c, node->data.while_stmt.condition);
+        find_address_taken(c, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH:
+        find_address_taken(c, node->data.switch_stmt.expression);
+        find_address_taken_list(c, node->data.switch_stmt.cases,
+                                node->data.switch_stmt.case_count);
+        find_address_taken(c, node->data.switch_stmt.default_case);
+        break;
+    case NODE_SWITCH_CASE:
+        find_address_taken_list(c, node->data.switch_case.statements,
+                                node->data.switch_case.statement_count);
+        break;
+    case NODE_MATCH:
+        find_address_taken(c, node->data.match_stmt.expression);
+        find_address_taken_list(c, node->data.match_stmt.cases,
+                                node->data.match_stmt.case_count);
+        break;
+    case NODE_MATCH_CASE:
+        find_address_taken(c, node->data.match_case.body);
+        break;
+    default:
+        break;
+    }
+}
+
+static void find_address_taken_list(Compiler *c, ASTNode **nodes, int count) {
+    for (int i = 0; i < count; i++) {
+        find_address_taken(c, nodes[i]);
+    }
+}
+
+// Type checks. Expressions are checked against the types the LLVM backend
+// sees (get_expression_type), so both accept the same programs.
+
+static TypeKind checked_type(Compiler *c, ASTNode *node) {
+    if (!node) {
+        return TYPE_UNKNOWN;
+    }
+    switch (node->type) {
+    case NODE_LITERAL:
+        return node->data.literal.resolved_type;
+    case NODE_IDENTIFIER: {
+        Variable *var = find_variable(c, node->data.identifier.name);
+        return var ? var->type : TYPE_UNKNOWN;
+    }
+    case NODE_BINARY_OP: {
+        if (node->data.binary_op.resolved_type != TYPE_UNKNOWN) {
+            return node->data.binary_op.resolved_type;
+        }
+        if (node->data.binary_op.operator >= OP_EQ) {
+            return TYPE_BOOL;
+        }
+        TypeKind left = checked_type(c, node->data.binary_op.left);
+        return left != TYPE_UNKNOWN ? left : checked_type(c, node->data.binary_op.right);
+    }
+    case NODE_UNARY_OP:
+        return node->data.unary_op.resolved_type;
+    case NODE_CALL: {
+        const char *name = node->data.call.name;
+        if (strcmp(name, "std.to_string") == 0 || strcmp(name, "std.input") == 0 ||
+            strcmp(name, "std.readln") == 0) {
+            return TYPE_STRING;
+        } else if (strcmp(name, "std.to_int") == 0) {
+            return TYPE_I32;
+        } else if (strcmp(name, "std.to_i64") == 0) {
+            return TYPE_I64;
+        } else if (strcmp(name, "cast") == 0 && node->data.call.arg_count >= 2) {
+            ASTNode *target = node->data.call.args[1];
+            if (target->type == NODE_LITERAL &&
+                strcmp(target->data.literal.type, "string") == 0) {
+                return string_to_type(target->data.literal.value);
+            }
+        }
+        return TYPE_UNKNOWN;
+    }
+    default:
+        return TYPE_UNKNOWN;
+    }
+}
+
+static int format_for(TypeKind type) {
+    switch (type) {
+    case TYPE_STRING:
+        return FORMAT_STRING;
+    case TYPE_BOOL:
+        return FORMAT_BOOL;
+    case TYPE_I8:
+        return FORMAT_I8;
+    case TYPE_I16:
+        return FORMAT_I16;
+    case TYPE_I32:
+        return FORMAT_I32;
+    case TYPE_I64:
+        return FORMAT_I64;
+    case TYPE_U8:
+        return FORMAT_U8;
+    case TYPE_U16:
+        return FORMAT_U16;
+    case TYPE_U32:
+        return FORMAT_U32;
+    case TYPE_U64:
+        return FORMAT_U64;
+    default:
+        return -1;
+    }
+}
+
+// Expressions. Each returns the register holding its value, or -1 after
+// reporting an error. With dest >= 0 the value is left in dest.
+
+static int compile_expression(Compiler *c, ASTNode *node, int dest, TypeKind *actual);
+static int compile_assignment(Compiler *c, ASTNode *node);
+
+static int target_register(Compiler *c, int dest) {
+    return dest >= 0 ? dest : new_register(c);
+}
+
+static int move_to(Compiler *c, int reg, int dest) {
+    if (dest >= 0 && dest != reg) {
+        emit(c, BC_MOVE, 0, dest, reg, 0);
+        return dest;
+    }
+    return reg;
+}
+
+// Load a variable's value; a struct's value is its address
+// Globals of types the interpreter lacks are only an error once used
+static void check_global_type(Compiler *c, Variable *var) {
+    if (var->storage == VAR_GLOBAL && is_unsupported_type(var->actual)) {
+        report_error("Error: %s values are not supported by the interpreter\n",
+                     type_to_string(var->actual));
+        c->has_error = 1;
+    }
+}
+
+static int load_variable(Compiler *c, Variable *var, int dest) {
+    check_global_type(c, var);
+    int struct_value = is_struct_type(var->actual);
+    int width = value_bits(var->actual);
+    switch (var->storage) {
+    case VAR_REGISTER:
+        return move_to(c, var->location, dest);
+    case VAR_FRAME:
+        dest = target_register(c, dest);
+        emit(c, struct_value ? BC_ADDR : BC_LOADL, width, dest, var->location, 0);
+        return dest;
+    case VAR_GLOBAL:
+        dest = target_register(c, dest);
+        emit(c, struct_value ? BC_ADDRG : BC_LOADG, width, dest, var->location, 0);
+        return dest;
+    case VAR_FIELD:
+    default:
+        dest = target_register(c, dest);
+        if (struct_value) {
+            emit(c, BC_ADDI, 64, dest, 0, var->location);
+        } else {
+            emit(c, BC_LOAD, width, dest, 0, var->location);
+        }
+        return dest;
+    }
+}
+
+static int variable_address(Compiler *c, Variable *var, int dest) {
+    check_global_type(c, var);
+    dest = target_register(c, dest);
+    if (var->storage == VAR_FIELD) {
+        emit(c, BC_ADDI, 64, dest, 0, var->location);
+    } else if (var->storage == VAR_GLOBAL) {
+        emit(c, BC_ADDRG, 0, dest, var->location, 0);
+    } else {
+        emit(c, BC_ADDR, 0, dest, var->location, 0);
+    }
+    return dest;
+}
+
+static void store_variable(Compiler *c, Variable *var, int value) {
+    check_global_type(c, var);
+    if (is_struct_type(var->actual)) {
+        int address = variable_address(c, var, -1);
+        emit(c, BC_COPY, 0, address, value, type_size(c, var->actual));
+        return;
+    }
+    int width = value_bits(var->actual);
+    switch (var->storage) {
+    case VAR_REGISTER:
+        if (value != var->location) {
+            emit(c, BC_MOVE, 0, var->location, value, 0);
+        }
+        break;
+    case VAR_FRAME:
+        emit(c, BC_STOREL, width, value, var->location, 0);
+        break;
+    case VAR_FIELD:
+        emit(c, BC_STORE, width, value, 0, var->location);
+        break;
+    case VAR_GLOBAL:
+        emit(c, BC_STOREG, width, value, var->location, 0);
+        break;
+    }
+}
+
+// Copy a struct returned by a call out of the callee's frame before the
+// next call reuses it
+static int copy_struct_result(Compiler *c, int reg, TypeKind type, int dest) {
+    int slot = new_frame_slot(c, type_size(c, type), type_align(c, type));
+    dest = target_register(c, dest);
+    int address = dest == reg ? new_register(c) : dest;
+    emit(c, BC_ADDR, 0, address, slot, 0);
+    emit(c, BC_COPY, 0, address, reg, type_size(c, type));
+    return move_to(c, address, dest);
+}
+
+// The register value of an integer or bool literal. Literals of types
+// other than i32 come from constant folding.
+static int integer_literal(ASTNode *node, int64_t *value) {
+    TypeKind type = node->data.literal.resolved_type;
+    if (type == TYPE_BOOL) {
+        *value = strcmp(node->data.literal.value, "true") == 0;
+        return 1;
+    }
+    if (!is_integer_type(type) || is_unsupported_type(type)) {
+        return 0;
+    }
+    // strtoull reads negative values as their two's complement
+    *value = wrap(strtoull(node->data.literal.value, NULL, 10), value_bits(type));
+    return 1;
+}
+
+static int compile_literal(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    const char *type = node->data.literal.type;
+    int64_t value;
+    if (integer_literal(node, &value)) {
+        *actual = node->data.literal.resolved_type;
+        dest = target_register(c, dest);
+        if (value == (int32_t)value) {
+            emit(c, BC_LOADI, 0, dest, (int32_t)value, 0);
+        } else {
+            emit(c, BC_LOADK, 0, dest, add_constant(c, value), 0);
+        }
+        return dest;
+    } else if (strcmp(type, "string") == 0) {
+        *actual = TYPE_STRING;
+        dest = target_register(c, dest);
+        emit(c, BC_LOADK, 0, dest, add_string(c, node->data.literal.value), 0);
+        return dest;
+    }
+    report_error("Unknown literal type: %s\n", type);
+    return -1;
+}
+
+static int compile_identifier(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    Variable *var = find_variable(c, node->data.identifier.name);
+    if (!var) {
+        report_error("Unknown variable: %s\n", node->data.identifier.name);
+        return -1;
+    }
+    *actual = var->actual;
+    return load_variable(c, var, dest);
+}
+
+static int is_comparison(BinaryOperator op) {
+    return op >= OP_EQ && op <= OP_GE;
+}
+
+static int check_binary_op(Compiler *c, ASTNode *node) {
+    TypeKind left = checked_type(c, node->data.binary_op.left);
+    TypeKind right = checked_type(c, node->data.binary_op.right);
+    if (is_comparison(node->data.binary_op.operator)) {
+        if (!types_comparable(left, right)) {
+            report_error("Error: Cannot compare incompatible types '%s' and '%s'\n",
+                         type_to_string(left), type_to_string(right));
+            c->has_error = 1;
+            return 0;
+        }
+    } else if (!types_compatible(left, right)) {
+        report_error("Error: Cannot perform arithmetic on incompatible types '%s' and '%s'\n",
+                     type_to_string(left), type_to_string(right));
+        c->has_error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// A non-negative i32 literal, which fits an immediate operand
+static int small_literal(ASTNode *node, int32_t *value) {
+    if (node->type != NODE_LITERAL || strcmp(node->data.literal.type, "i32") != 0) {
+        return 0;
+    }
+    *value = atoi(node->data.literal.value);
+    return *value >= 0;
+}
+
+static int compile_binary_op(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    if (!check_binary_op(c, node)) {
+        return -1;
+    }
+    BinaryOperator op = node->data.binary_op.operator;
+    TypeKind left_type;
+    TypeKind right_type;
+    int left = compile_expression(c, node->data.binary_op.left, -1, &left_type);
+    if (left < 0) {
+        report_error("Failed to generate operands for binary operation\n");
+        return -1;
+    }
+    int width = value_bits(left_type);
+    int32_t immediate;
+    if ((op == OP_ADD || op == OP_SUB) && small_literal(node->data.binary_op.right, &immediate)) {
+        *actual = left_type;
+        dest = target_register(c, dest);
+        emit(c, BC_ADDI, width, dest, left, op == OP_ADD ? immediate : -immediate);
+        return dest;
+    }
+    int right = compile_expression(c, node->data.binary_op.right, -1, &right_type);
+    if (right < 0) {
+        report_error("Failed to generate operands for binary operation\n");
+        return -1;
+    }
+
+    static const Opcode opcodes[] = {
+        [OP_ADD] = BC_ADD, [OP_SUB] = BC_SUB, [OP_MUL] = BC_MUL, [OP_DIV] = BC_DIV,
+        [OP_EQ] = BC_EQ,   [OP_NE] = BC_NE,   [OP_LT] = BC_LT,   [OP_GT] = BC_GT,
+        [OP_LE] = BC_LE,   [OP_GE] = BC_GE,
+    };
+    *actual = is_comparison(op) ? TYPE_BOOL : left_type;
+    dest = target_register(c, dest);
+    emit(c, opcodes[op], width, dest, left, right);
+    return dest;
+}
+
+static int compile_unary_op(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    ASTNode *operand = node->data.unary_op.operand;
+    if (node->data.unary_op.operator == UNARY_ADDRESS_OF) {
+        if (operand->type != NODE_IDENTIFIER) {
+            report_error("Error: Address-of operator can only be applied to variables\n");
+            return -1;
+        }
+        Variable *var = find_variable(c, operand->data.identifier.name);
+        if (!var) {
+            report_error("Error: Variable '%s' not found for address-of operation\n",
+                         operand->data.identifier.name);
+            return -1;
+        }
+        if (var->storage == VAR_GLOBAL && var->is_mutable == -1) {
+            report_error("Error: Cannot take the address of constant '%s'\n",
+                         operand->data.identifier.name);
+            c->has_error = 1;
+            return -1;
+        }
+        TypeKind pointer = make_pointer_type(var->actual);
+        *actual = pointer != TYPE_UNKNOWN ? pointer : TYPE_PTR_VOID;
+        return variable_address(c, var, dest);
+    }
+
+    TypeKind pointer_type;
+    int pointer = compile_expression(c, operand, -1, &pointer_type);
+    if (pointer < 0) {
+        report_error("Error: Failed to generate code for dereference operand\n");
+        return -1;
+    }
+    TypeKind operand_type = checked_type(c, operand);
+    if (!is_pointer_type(operand_type)) {
+        report_error("Error: Cannot dereference non-pointer type '%s'\n",
+                     type_to_string(operand_type));
+        c->has_error = 1;
+        return -1;
+    }
+    *actual = get_pointed_type(operand_type);
+    if (*actual == TYPE_VOID || is_unsupported_type(*actual)) {
+        report_error("Error: Cannot load a %s value\n", type_to_string(*actual));
+        return -1;
+    }
+    dest = target_register(c, dest);
+    emit(c, BC_LOAD, value_bits(*actual), dest, pointer, 0);
+    return dest;
+}
+
+// Integer conversion between types of the given sizes and signedness, as
+// the LLVM backend builds it: sext/zext to widen (sext when the signedness
+// differs), trunc to narrow, nothing for the same size
+static void emit_conversion(Compiler *c, int reg, TypeKind from, TypeKind to) {
+    const Type *from_info = get_type_info(from);
+    const Type *to_info = get_type_info(to);
+    if (from_info->size < to_info->size && !from_info->is_signed && !to_info->is_signed) {
+        emit(c, BC_ZEXT, value_bits(to), reg, reg, value_bits(from));
+    } else if (from_info->size != to_info->size) {
+        emit(c, BC_WRAP, value_bits(to), reg, reg, 0);
+    }
+}
+
+static int expect_args(ASTNode *call, int count, const char *usage) {
+    if (call->data.call.arg_count != count) {
+        report_error("%s", usage);
+        return 0;
+    }
+    return 1;
+}
+
+static int compile_print(Compiler *c, ASTNode *node, int newline, int dest) {
+    const char *name = newline ? "std.println" : "std.print";
+    if (node->data.call.arg_count != 1) {
+        report_error("%s() expects exactly 1 argument\n", name);
+        return -1;
+    }
+    TypeKind value_type;
+    int value = compile_expression(c, node->data.call.args[0], -1, &value_type);
+    if (value < 0) {
+        return -1;
+    }
+    TypeKind type = checked_type(c, node->data.call.args[0]);
+    int format = format_for(type);
+    if (format < 0) {
+        if (type == TYPE_I128 || type == TYPE_U128) {
+            report_error("%s printing not yet implemented - needs custom formatting\n",
+                         type == TYPE_I128 ? "i128" : "u128");
+        } else {
+            report_error("Unsupported type for %s(): %s\n", name, type_to_string(type));
+        }
+        c->has_error = 1;
+        return -1;
+    }
+    emit(c, BC_PRINT, 0, value, format, newline);
+    return target_register(c, dest);
+}
+
+static int compile_to_string(Compiler *c, ASTNode *node, int dest) {
+    if (!expect_args(node, 1, "std.to_string() expects exactly 1 argument\n")) {
+        return -1;
+    }
+    TypeKind value_type;
+    int value = compile_expression(c, node->data.call.args[0], -1, &value_type);
+    if (value < 0) {
+        return -1;
+    }
+    TypeKind type = checked_type(c, node->data.call.args[0]);
+    if (type == TYPE_STRING) {
+        return move_to(c, value, dest);
+    }
+    int format = format_for(type);
+    if (format < 0) {
+        if (type == TYPE_I128 || type == TYPE_U128) {
+            report_error("%s to_string not yet implemented - needs custom formatting\n",
+                         type == TYPE_I128 ? "i128" : "u128");
+        } else {
+            report_error("Unsupported type for std.to_string(): %s\n", type_to_string(type));
+        }
+        c->has_error = 1;
+        return -1;
+    }
+    dest = target_register(c, dest);
+    emit(c, BC_FORMAT, format, dest, value, new_frame_slot(c, 32, 1));
+    return dest;
+}
+
+static int compile_cast(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    if (!expect_args(node, 2, "cast() expects exactly 2 arguments: cast(value, target_type)\n")) {
+        return -1;
+    }
+    TypeKind value_type;
+    int value = compile_expression(c, node->data.call.args[0], -1, &value_type);
+    if (value < 0) {
+        return -1;
+    }
+    TypeKind source = checked_type(c, node->data.call.args[0]);
+
+    ASTNode *target_node = node->data.call.args[1];
+    const char *target_name;
+    if (target_node->type == NODE_IDENTIFIER) {
+        target_name = target_node->data.identifier.name;
+    } else if (target_node->type == NODE_LITERAL &&
+               strcmp(target_node->data.literal.type, "string") == 0) {
+        target_name = target_node->data.literal.value;
+    } else {
+        report_error("cast() second argument must be a type name (identifier or string)\n");
+        return -1;
+    }
+    TypeKind target = string_to_type(target_name);
+    if (target == TYPE_UNKNOWN) {
+        report_error("cast(): unknown target type '%s'\n", target_name);
+        return -1;
+    }
+    if (is_unsupported_type(source) || is_unsupported_type(target)) {
+        report_error("Error: %s values are not supported by the interpreter\n",
+                     type_to_string(is_unsupported_type(source) ? source : target));
+        c->has_error = 1;
+        return -1;
+    }
+
+    *actual = target;
+    if (source == target) {
+        return move_to(c, value, dest);
+    }
+    const Type *source_info = get_type_info(source);
+    const Type *target_info = get_type_info(target);
+    if (source_info->is_numeric && target_info->is_numeric) {
+        dest = move_to(c, value, target_register(c, dest));
+        emit_conversion(c, dest, source, target);
+        return dest;
+    }
+    if (is_pointer_type(source) || is_pointer_type(target)) {
+        return move_to(c, value, dest);
+    }
+    report_error("cast(): conversion from %s to %s not yet supported\n",
+                 type_to_string(source), target_name);
+    return -1;
+}
+
+// std.* builtins and cast(). Returns -2 when the call is not one.
+static int compile_builtin(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    const char *name = node->data.call.name;
+    TypeKind arg_type;
+    int arg;
+
+    if (strcmp(name, "comptime") == 0) {
+        // Reached while evaluating another comptime call, before folding
+        // has replaced this one; it runs as an ordinary call
+        return compile_expression(c, node->data.call.args[0], dest, actual);
+    } else if (strcmp(name, "std.print") == 0 || strcmp(name, "std.println") == 0) {
+        *actual = TYPE_I32;
+        return compile_print(c, node, name[9] == 'l', dest);
+    } else if (strcmp(name, "std.input") == 0) {
+        if (!expect_args(node, 0, "std.input() expects no arguments\n")) {
+            return -1;
+        }
+        *actual = TYPE_STRING;
+        dest = target_register(c, dest);
+        emit(c, BC_INPUT, 0, dest, new_frame_slot(c, 256, 1), 0);
+        return dest;
+    } else if (strcmp(name, "std.readln") == 0) {
+        if (!expect_args(node, 0, "std.readln() expects no arguments\n")) {
+            return -1;
+        }
+        *actual = TYPE_STRING;
+        dest = target_register(c, dest);
+        emit(c, BC_READLN, 0, dest, 0, 0);
+        return dest;
+    } else if (strcmp(name, "std.to_int") == 0 || strcmp(name, "std.to_i64") == 0) {
+        int is_i64 = strcmp(name, "std.to_i64") == 0;
+        if (!expect_args(node, 1, is_i64 ? "std.to_i64() expects exactly 1 argument\n"
+                                         : "std.to_int() expects exactly 1 argument\n") ||
+            (arg = compile_expression(c, node->data.call.args[0], -1, &arg_type)) < 0) {
+            return -1;
+        }
+        *actual = is_i64 ? TYPE_I64 : TYPE_I32;
+        dest = target_register(c, dest);
+        emit(c, is_i64 ? BC_ATOL : BC_ATOI, 0, dest, arg, 0);
+        return dest;
+    } else if (strcmp(name, "std.to_string") == 0) {
+        *actual = TYPE_STRING;
+        return compile_to_string(c, node, dest);
+    } else if (strcmp(name, "cast") == 0) {
+        return compile_cast(c, node, dest, actual);
+    } else if (strcmp(name, "std.malloc") == 0) {
+        // Sizes are extended to i64 as they are, signed
+        if (!expect_args(node, 1, "std.malloc() expects exactly 1 argument (size)\n") ||
+            (arg = compile_expression(c, node->data.call.args[0], -1, &arg_type)) < 0) {
+            return -1;
+        }
+        *actual = TYPE_PTR_I8;
+        dest = target_register(c, dest);
+        emit(c, BC_MALLOC, 0, dest, arg, 0);
+        return dest;
+    } else if (strcmp(name, "std.free") == 0) {
+        if (!expect_args(node, 1, "std.free() expects exactly 1 argument (pointer)\n") ||
+            (arg = compile_expression(c, node->data.call.args[0], -1, &arg_type)) < 0) {
+            return -1;
+        }
+        *actual = TYPE_VOID;
+        emit(c, BC_FREE, 0, arg, 0, 0);
+        return target_register(c, dest);
+    }
+    return -2;
+}
+
+static int find_function(InterpProgram *program, const char *name) {
+    for (int i = 0; i < program->function_count; i++) {
+        if (strcmp(program->functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Evaluate arguments into consecutive registers and call. self, when not
+// negative, is the register holding a method's object address.
+static int emit_call(Compiler *c, int function, int self, ASTNode **args, int arg_count,
+                     int dest, TypeKind *actual) {
+    InterpFunction *callee = &c->program->functions[function];
+    if (arg_count + (self >= 0) != callee->arity) {
+        report_error("Error: %s expects %d arguments, got %d\n", callee->name,
+                     callee->arity - (self >= 0), arg_count);
+        return -1;
+    }
+    int base = c->next_register;
+    for (int i = 0; i < callee->arity; i++) {
+        new_register(c);
+    }
+    int first = 0;
+    if (self >= 0) {
+        emit(c, BC_MOVE, 0, base, self, 0);
+        first = 1;
+    }
+    for (int i = 0; i < arg_count; i++) {
+        TypeKind arg_type;
+        if (compile_expression(c, args[i], base + first + i, &arg_type) < 0) {
+            return -1;
+        }
+        c->next_register = base + callee->arity;
+    }
+
+    *actual = callee->return_type;
+    dest = target_register(c, dest);
+    emit(c, BC_CALL, 0, dest, function, base);
+    if (is_struct_type(callee->return_type)) {
+        return copy_struct_result(c, dest, callee->return_type, dest);
+    }
+    return dest;
+}
+
+static int compile_call(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    int result = compile_builtin(c, node, dest, actual);
+    if (result != -2) {
+        return result;
+    }
+    int function = find_function(c->program, node->data.call.name);
+    if (function < 0 || c->program->functions[function].self_type != TYPE_UNKNOWN) {
+        report_error("Unknown function: %s\n", node->data.call.name);
+        return -1;
+    }
+    return emit_call(c, function, -1, node->data.call.args, node->data.call.arg_count,
+                     dest, actual);
+}
+
+static int compile_field_access(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    ASTNode *object = node->data.field_access.object;
+    if (object->type != NODE_IDENTIFIER) {
+        report_error("Cannot access field on non-struct type\n");
+        return -1;
+    }
+    Variable *var = find_variable(c, object->data.identifier.name);
+    if (!var) {
+        report_error("Unknown variable: %s\n", object->data.identifier.name);
+        return -1;
+    }
+    if (!is_struct_type(var->type)) {
+        report_error("Cannot access field on non-struct type\n");
+        return -1;
+    }
+    int index = field_index(var->type, node->data.field_access.field_name);
+    if (index < 0) {
+        report_error("Field '%s' not found in struct\n", node->data.field_access.field_name);
+        return -1;
+    }
+    StructLayout *layout = struct_layout(c, var->type);
+    if (!layout) {
+        return -1;
+    }
+    *actual = get_struct_type(var->type)->fields[index].type;
+    int offset = layout->offsets[index];
+    int width = value_bits(*actual);
+    int struct_value = is_struct_type(*actual);
+    dest = target_register(c, dest);
+    if (var->storage == VAR_FRAME) {
+        emit(c, struct_value ? BC_ADDR : BC_LOADL, width, dest, var->location + offset, 0);
+    } else if (var->storage == VAR_GLOBAL) {
+        emit(c, struct_value ? BC_ADDRG : BC_LOADG, width, dest, var->location + offset, 0);
+    } else if (var->storage == VAR_FIELD) {
+        emit(c, struct_value ? BC_ADDI : BC_LOAD, struct_value ? 64 : width, dest, 0,
+             var->location + offset);
+    } else {
+        emit(c, struct_value ? BC_ADDI : BC_LOAD, struct_value ? 64 : width, dest,
+             var->location, offset);
+    }
+    return dest;
+}
+
+static int compile_method_call(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    ASTNode *object = node->data.method_call.object;
+    Variable *var = object->type == NODE_IDENTIFIER
+                        ? find_variable(c, object->data.identifier.name)
+                        : NULL;
+    TypeKind object_type = var ? var->type : TYPE_UNKNOWN;
+    if (!is_struct_type(object_type)) {
+        report_error("Cannot call method on non-struct type\n");
+        return -1;
+    }
+
+    // Private methods are only visible in their own module
+    StructType *st = get_struct_type(object_type);
+    char *mangled = malloc(strlen(st->name) + strlen(node->data.method_call.method_name) + 2);
+    sprintf(mangled, "%s_%s", st->name, node->data.method_call.method_name);
+    int function = find_function(c->program, mangled);
+    free(mangled);
+    InterpFunction *method = function >= 0 ? &c->program->functions[function] : NULL;
+    if (!method || (method->node->type == NODE_STRUCT_METHOD &&
+                    method->node->data.struct_method.visibility == VISIBILITY_PRIVATE &&
+                    method->module != c->function->module)) {
+        report_error("Method '%s' not found for struct '%s'\n",
+                     node->data.method_call.method_name, st->name);
+        return -1;
+    }
+
+    int self = variable_address(c, var, -1);
+    return emit_call(c, function, self, node->data.method_call.args,
+                     node->data.method_call.arg_count, dest, actual);
+}
+
+static int compile_struct_literal(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    StructType *st = find_struct_by_name(node->data.struct_literal.struct_type_name);
+    if (!st) {
+        report_error("Struct type '%s' not found\n", node->data.struct_literal.struct_type_name);
+        return -1;
+    }
+    TypeKind type = st->type_id;
+    StructLayout *layout = struct_layout(c, type);
+    if (!layout) {
+        return -1;
+    }
+    int slot = new_frame_slot(c, layout->size, layout->align);
+    int mark = c->next_register;
+    for (int i = 0; i < node->data.struct_literal.field_count; i++) {
+        const char *field_name = node->data.struct_literal.field_names[i];
+        int index = field_index(type, field_name);
+        if (index < 0) {
+            report_error("Field '%s' not found in struct '%s'\n", field_name, st->name);
+            return -1;
+        }
+        TypeKind field_type = st->fields[index].type;
+        TypeKind value_type;
+        int value = compile_expression(c, node->data.struct_literal.field_values[i], -1,
+                                       &value_type);
+        if (value < 0) {
+            return -1;
+        }
+        int offset = slot + layout->offsets[index];
+        if (is_struct_type(field_type)) {
+            int address = new_register(c);
+            emit(c, BC_ADDR, 0, address, offset, 0);
+            emit(c, BC_COPY, 0, address, value, type_size(c, field_type));
+        } else {
+            emit(c, BC_STOREL, value_bits(field_type), value, offset, 0);
+        }
+        c->next_register = mark;
+    }
+    *actual = type;
+    dest = target_register(c, dest);
+    emit(c, BC_ADDR, 0, dest, slot, 0);
+    return dest;
+}
+
+static int compile_expression(Compiler *c, ASTNode *node, int dest, TypeKind *actual) {
+    switch (node->type) {
+    case NODE_LITERAL:
+        return compile_literal(c, node, dest, actual);
+    case NODE_IDENTIFIER:
+        return compile_identifier(c, node, dest, actual);
+    case NODE_CALL:
+        return compile_call(c, node, dest, actual);
+    case NODE_BINARY_OP:
+        return compile_binary_op(c, node, dest, actual);
+    case NODE_UNARY_OP:
+        return compile_unary_op(c, node, dest, actual);
+    case NODE_ASSIGNMENT:
+        *actual = TYPE_VOID;
+        return compile_assignment(c, node) ? target_register(c, dest) : -1;
+    case NODE_FIELD_ACCESS:
+        return compile_field_access(c, node, dest, actual);
+    case NODE_METHOD_CALL:
+        return compile_method_call(c, node, dest, actual);
+    case NODE_STRUCT_LITERAL:
+        return compile_struct_literal(c, node, dest, actual);
+    default:
+        report_error("Unknown expression type: %d\n", node->type);
+        return -1;
+    }
+}
+
+// Emit a jump taken when the condition is `when`; returns it for patching
+static int compile_branch(Compiler *c, ASTNode *condition, int when) {
+    if (condition->type == NODE_BINARY_OP && is_comparison(condition->data.binary_op.operator)) {
+        if (!check_binary_op(c, condition)) {
+            return -1;
+        }
+        TypeKind left_type;
+        TypeKind right_type;
+        int left = compile_expression(c, condition->data.binary_op.left, -1, &left_type);
+        int right = left < 0 ? -1
+                             : compile_expression(c, condition->data.binary_op.right, -1,
+                                                  &right_type);
+        if (right < 0) {
+            report_error("Failed to generate operands for binary operation\n");
+            return -1;
+        }
+        static const Opcode jumps[] = {
+            [OP_EQ] = BC_JEQ, [OP_NE] = BC_JNE, [OP_LT] = BC_JLT,
+            [OP_GT] = BC_JGT, [OP_LE] = BC_JLE, [OP_GE] = BC_JGE,
+        };
+        static const BinaryOperator negated[] = {
+            [OP_EQ] = OP_NE, [OP_NE] = OP_EQ, [OP_LT] = OP_GE,
+            [OP_GT] = OP_LE, [OP_LE] = OP_GT, [OP_GE] = OP_LT,
+        };
+        BinaryOperator op = condition->data.binary_op.operator;
+        return emit(c, jumps[when ? op : negated[op]], 0, left, right, 0);
+    }
+    TypeKind type;
+    int value = compile_expression(c, condition, -1, &type);
+    if (value < 0) {
+        return -1;
+    }
+    return emit(c, when ? BC_JMPT : BC_JMPF, 0, value, 0, 0);
+}
+
+// Statements. Each returns 0 when it failed as a whole, in which case its
+// code is dropped and compilation carries on, as the LLVM backend does.
+
+static void compile_statement(Compiler *c, ASTNode *node);
+
+static void compile_statements(Compiler *c, ASTNode **statements, int count) {
+    for (int i = 0; i < count && !c->terminated && !c->has_error; i++) {
+        compile_statement(c, statements[i]);
+    }
+}
+
+static void compile_body(Compiler *c, ASTNode *node) {
+    if (node->type == NODE_BLOCK) {
+        compile_statements(c, node->data.block.statements, node->data.block.statement_count);
+    } else {
+        compile_statement(c, node);
+    }
+}
+
+// Evaluate an initializer, converted to the declared type as numbers are
+static int compile_initial_value(Compiler *c, ASTNode *value_node, TypeKind type, int dest) {
+    TypeKind source = checked_type(c, value_node);
+    int convert = value_node->type != NODE_STRUCT_LITERAL && source != type &&
+                  source != TYPE_UNKNOWN && get_type_info(source)->is_numeric &&
+                  get_type_info(type)->is_numeric;
+    TypeKind value_type;
+    int value = compile_expression(c, value_node, dest, &value_type);
+    if (value >= 0 && convert) {
+        emit_conversion(c, value, source, type);
+    }
+    return value;
+}
+
+static int compile_variable_decl(Compiler *c, ASTNode *node) {
+    TypeKind type = node->data.variable_decl.resolved_type;
+    if (is_unsupported_type(type)) {
+        report_error("Error: %s values are not supported by the interpreter\n",
+                     type_to_string(type));
+        c->has_error = 1;
+        return 0;
+    }
+    const char *name = node->data.variable_decl.name;
+    VarStorage storage = VAR_REGISTER;
+    int location;
+    if (is_struct_type(type) || is_address_taken(c, name)) {
+        storage = VAR_FRAME;
+        location = new_frame_slot(c, type_size(c, type), type_align(c, type));
+    } else {
+        location = c->locals_top++;
+        c->next_register = c->locals_top;
+        new_register(c);
+        c->next_register = c->locals_top;
+    }
+
+    // The initializer still sees an earlier variable of the same name
+    ASTNode *value_node = node->data.variable_decl.value;
+    int value = -1;
+    if (value_node) {
+        value = compile_initial_value(c, value_node, type,
+                                      storage == VAR_REGISTER ? location : -1);
+    }
+    Variable *var = set_variable(c, name, storage, location, type, type,
+                                 node->data.variable_decl.is_mutable);
+    if (value >= 0) {
+        store_variable(c, var, value);
+    }
+    return 1;
+}
+
+static int compile_assignment(Compiler *c, ASTNode *node) {
+    const char *name = node->data.assignment.variable_name;
+    Variable *var = find_variable(c, name);
+    if (!var) {
+        report_error("Error: Undefined variable '%s' in assignment\n", name);
+        return 0;
+    }
+    if (var->is_mutable == 0) {
+        report_error("Error: Cannot assign to immutable variable '%s'\n", name);
+        c->has_error = 1;
+        return 0;
+    }
+    if (var->is_mutable == -1) {
+        report_error("Error: Cannot assign to constant '%s'\n", name);
+        c->has_error = 1;
+        return 0;
+    }
+    TypeKind value_type;
+    int value = compile_expression(c, node->data.assignment.value,
+                                   var->storage == VAR_REGISTER ? var->location : -1,
+                                   &value_type);
+    if (value < 0) {
+        report_error("Error: Failed to generate code for assignment value\n");
+        return 0;
+    }
+    store_variable(c, var, value);
+    return 1;
+}
+
+static int compile_pointer_assignment(Compiler *c, ASTNode *node) {
+    ASTNode *target = node->data.pointer_assignment.target;
+    if (target->type != NODE_UNARY_OP || target->data.unary_op.operator != UNARY_DEREFERENCE) {
+        report_error("Error: Pointer assignment target must be a dereference\n");
+        return 0;
+    }
+    TypeKind pointer_type;
+    int pointer = compile_expression(c, target->data.unary_op.operand, -1, &pointer_type);
+    if (pointer < 0) {
+        report_error("Error: Failed to generate code for pointer in assignment\n");
+        return 0;
+    }
+    TypeKind value_type;
+    int value = compile_expression(c, node->data.pointer_assignment.value, -1, &value_type);
+    if (value < 0) {
+        report_error("Error: Failed to generate code for pointer assignment value\n");
+        return 0;
+    }
+    // The store has the width of the value, as in the LLVM backend
+    if (is_struct_type(value_type)) {
+        emit(c, BC_COPY, 0, pointer, value, type_size(c, value_type));
+    } else {
+        emit(c, BC_STORE, value_bits(value_type), value, pointer, 0);
+    }
+    return 1;
+}
+
+static int compile_return(Compiler *c, ASTNode *node) {
+    if (!node->data.return_stmt.value) {
+        emit(c, BC_RETV, 0, 0, 0, 0);
+    } else {
+        TypeKind type;
+        int value = compile_expression(c, node->data.return_stmt.value, -1, &type);
+        if (value < 0) {
+            return 0;
+        }
+        emit(c, BC_RET, 0, value, 0, 0);
+    }
+    c->terminated = 1;
+    return 1;
+}
+
+// if and unless; unless runs its then block when the condition is false
+static int compile_if(Compiler *c, ASTNode *condition, ASTNode *then_block,
+                      ASTNode *else_block, int unless) {
+    int skip_then = compile_branch(c, condition, unless);
+    if (skip_then < 0) {
+        return 0;
+    }
+    compile_statement(c, then_block);
+    int then_terminated = c->terminated;
+    c->terminated = 0;
+    if (!else_block) {
+        patch_jump(c, skip_then, here(c));
+        return 1;
+    }
+    int skip_else = then_terminated ? -1 : emit(c, BC_JMP, 0, 0, 0, 0);
+    patch_jump(c, skip_then, here(c));
+    compile_statement(c, else_block);
+    if (skip_else >= 0) {
+        patch_jump(c, skip_else, here(c));
+    }
+    c->terminated = then_terminated && c->terminated;
+    return 1;
+}
+
+static Loop *push_loop(Compiler *c) {
+    c->loops = grow(c->loops, &c->loop_capacity, c->loop_depth, sizeof(Loop));
+    Loop *loop = &c->loops[c->loop_depth++];
+    memset(loop, 0, sizeof(Loop));
+    return loop;
+}
+
+static void pop_loop(Compiler *c, int break_target, int continue_target) {
+    Loop *loop = &c->loops[--c->loop_depth];
+    for (int i = 0; i < loop->break_count; i++) {
+        patch_jump(c, loop->breaks[i], break_target);
+    }
+    for (int i = 0; i < loop->continue_count; i++) {
+        patch_jump(c, loop->continues[i], continue_target);
+    }
+    free(loop->breaks);
+    free(loop->continues);
+}
+
+// Record an outermost loop of a function for on-stack replacement, with
+// the variables live at its back edge. Returns -1 when one of them lives
+// in the frame, whose address native code could not share.
+static int add_native_loop(Compiler *c, ASTNode *node) {
+    InterpFunction *fn = c->function;
+    if (c->loop_depth != 1 || fn->node->type != NODE_FUNCTION) {
+        return -1;
+    }
+    int count = 0;
+    for (int i = 0; i < c->variable_count; i++) {
+        Variable *var = &c->variables[i];
+        if (var->storage == VAR_FRAME ||
+            (var->storage == VAR_REGISTER &&
+             (var->actual == TYPE_UNKNOWN || is_struct_type(var->actual)))) {
+            return -1;
+        }
+        count += var->storage == VAR_REGISTER;
+    }
+    fn->loops = grow(fn->loops, &fn->loop_capacity, fn->loop_count, sizeof(InterpLoop));
+    InterpLoop *loop = &fn->loops[fn->loop_count];
+    loop->node = node;
+    loop->names = malloc((count ? count : 1) * sizeof(char *));
+    loop->types = malloc((count ? count : 1) * sizeof(TypeKind));
+    loop->registers = malloc((count ? count : 1) * sizeof(int));
+    loop->variable_count = 0;
+    loop->native = NULL;
+    for (int i = 0; i < c->variable_count; i++) {
+        Variable *var = &c->variables[i];
+        if (var->storage == VAR_REGISTER) {
+            loop->names[loop->variable_count] = strdup(var->name);
+            loop->types[loop->variable_count] = var->actual;
+            loop->registers[loop->variable_count++] = var->location;
+        }
+    }
+    return fn->loop_count++;
+}
+
+// Loops test their condition at the bottom, so an iteration takes one
+// jump. The back edge is counted just before the test, which entering
+// the loop skips.
+static int compile_loop(Compiler *c, ASTNode *node, ASTNode *condition, ASTNode *update,
+                        ASTNode *body) {
+    int enter = emit(c, BC_JMP, 0, 0, 0, 0);
+    int body_start = here(c);
+    push_loop(c);
+    compile_statement(c, body);
+    c->terminated = 0;
+    int next = here(c);
+    if (update) {
+        compile_statement(c, update);
+        c->terminated = 0;
+    }
+    emit(c, BC_LOOP, 0, 0, add_native_loop(c, node), 0);
+    patch_jump(c, enter, here(c));
+    c->next_register = c->locals_top;
+    int repeat = condition ? compile_branch(c, condition, 1) : emit(c, BC_JMP, 0, 0, 0, 0);
+    if (repeat < 0) {
+        pop_loop(c, here(c), next);
+        return 0;
+    }
+    patch_jump(c, repeat, body_start);
+    pop_loop(c, here(c), next);
+    return 1;
+}
+
+static int constant_case(Compiler *c, ASTNode *value, int32_t *constant) {
+    int64_t literal;
+    if (value->type == NODE_LITERAL && integer_literal(value, &literal) &&
+        literal == (int32_t)literal) {
+        *constant = (int32_t)literal;
+        return 1;
+    }
+    report_error("Error: Case values must be integer or bool literals\n");
+    c->has_error = 1;
+    return 0;
+}
+
+// switch and match: a chain of compares to the case bodies, which never
+// fall through; break inside them leaves the enclosing loop
+static int compile_switch(Compiler *c, ASTNode *expression, ASTNode **cases, int case_count,
+                          ASTNode *default_case, int is_match) {
+    TypeKind type;
+    int value = compile_expression(c, expression, -1, &type);
+    if (value < 0) {
+        return 0;
+    }
+    int *jumps = malloc((case_count + 1) * sizeof(int));
+    int default_index = -1;
+    for (int i = 0; i < case_count; i++) {
+        ASTNode *pattern = is_match ? cases[i]->data.match_case.pattern
+                                    : cases[i]->data.switch_case.value;
+        int32_t constant;
+        jumps[i] = -1;
+        if (is_match && pattern->type == NODE_IDENTIFIER &&
+            strcmp(pattern->data.identifier.name, "_") == 0) {
+            default_index = i;
+        } else if (constant_case(c, pattern, &constant)) {
+            jumps[i] = emit(c, BC_JEQI, 0, value, constant, 0);
+        } else {
+            free(jumps);
+            return 0;
+        }
+    }
+    int to_default = emit(c, BC_JMP, 0, 0, 0, 0);
+
+    int *exits = malloc((case_count + 1) * sizeof(int));
+    int exit_count = 0;
+    for (int i = 0; i <= case_count; i++) {
+        int start = here(c);
+        c->next_register = c->locals_top;
+        if (i < case_count && is_match) {
+            compile_statement(c, cases[i]->data.match_case.body);
+        } else if (i < case_count) {
+            compile_statements(c, cases[i]->data.switch_case.statements,
+                               cases[i]->data.switch_case.statement_count);
+        } else if (default_case) {
+            compile_statements(c, default_case->data.switch_case.statements,
+                               default_case->data.switch_case.statement_count);
+        } else {
+            break;
+        }
+        if (i < case_count && jumps[i] >= 0) {
+            patch_jump(c, jumps[i], start);
+        }
+        if (i == default_index || i == case_count) {
+            patch_jump(c, to_default, start);
+            to_default = -1;
+        }
+        if (!c->terminated) {
+            exits[exit_count++] = emit(c, BC_JMP, 0, 0, 0, 0);
+        }
+        c->terminated = 0;
+    }
+    if (to_default >= 0) {
+        patch_jump(c, to_default, here(c));
+    }
+    for (int i = 0; i < exit_count; i++) {
+        patch_jump(c, exits[i], here(c));
+    }
+    free(jumps);
+    free(exits);
+    return 1;
+}
+
+static int compile_jump_out(Compiler *c, int is_break) {
+    if (c->loop_depth == 0) {
+        report_error("Error: %s outside of a loop\n", is_break ? "break" : "continue");
+        c->has_error = 1;
+        return 0;
+    }
+    Loop *loop = &c->loops[c->loop_depth - 1];
+    int jump = emit(c, BC_JMP, 0, 0, 0, 0);
+    if (is_break) {
+        loop->breaks = grow(loop->breaks, &loop->break_capacity, loop->break_count, sizeof(int));
+        loop->breaks[loop->break_count++] = jump;
+    } else {
+        loop->continues = grow(loop->continues, &loop->continue_capacity, loop->continue_count,
+                               sizeof(int));
+        loop->continues[loop->continue_count++] = jump;
+    }
+    c->terminated = 1;
+    return 1;
+}
+
+static int compile_statement_node(Compiler *c, ASTNode *node) {
+    TypeKind type;
+    switch (node->type) {
+    case NODE_VARIABLE_DECL:
+        return compile_variable_decl(c, node);
+    case NODE_ASSIGNMENT:
+        return compile_assignment(c, node);
+    case NODE_POINTER_ASSIGNMENT:
+        return compile_pointer_assignment(c, node);
+    case NODE_RETURN:
+        return compile_return(c, node);
+    case NODE_BLOCK:
+        compile_body(c, node);
+        return 1;
+    case NODE_IF:
+        return compile_if(c, node->data.if_stmt.condition, node->data.if_stmt.then_block,
+                          node->data.if_stmt.else_block, 0);
+    case NODE_UNLESS:
+        return compile_if(c, node->data.unless_stmt.condition,
+                          node->data.unless_stmt.then_block,
+                          node->data.unless_stmt.else_block, 1);
+    case NODE_FOR:
+        if (node->data.for_stmt.init) {
+            compile_statement(c, node->data.for_stmt.init);
+        }
+        return compile_loop(c, node, node->data.for_stmt.condition, node->data.for_stmt.update,
+                            node->data.for_stmt.body);
+    case NODE_WHILE:
+        return compile_loop(c, node, node->data.while_stmt.condition, NULL,
+                            node->data.while_stmt.body);
+    case NODE_SWITCH:
+        return compile_switch(c, node->data.switch_stmt.expression,
+                              node->data.switch_stmt.cases, node->data.switch_stmt.case_count,
+                              node->data.switch_stmt.default_case, 0);
+    case NODE_MATCH:
+        return compile_switch(c, node->data.match_stmt.expression,
+                              node->data.match_stmt.cases, node->data.match_stmt.case_count,
+                              NULL, 1);
+    case NODE_BREAK:
+        return compile_jump_out(c, 1);
+    case NODE_CONTINUE:
+        return compile_jump_out(c, 0);
+    case NODE_ENUM:
+        // Enum variants cannot be referred to yet
+        return 1;
+    default:
+        return compile_expression(c, node, -1, &type) >= 0;
+    }
+}
+
+static void compile_statement(Compiler *c, ASTNode *node) {
+    int start = here(c);
+    int terminated = c->terminated;
+    Loop *loop = c->loop_depth ? &c->loops[c->loop_depth - 1] : NULL;
+    int break_count = loop ? loop->break_count : 0;
+    int continue_count = loop ? loop->continue_count : 0;
+
+    c->next_register = c->locals_top;
+    if (!compile_statement_node(c, node)) {
+        c->function->code_length = start;
+        c->terminated = terminated;
+        if (loop) {
+            loop->break_count = break_count;
+            loop->continue_count = continue_count;
+        }
+    }
+    c->next_register = c->locals_top;
+}
+
+static void declare_parameter(Compiler *c, ASTNode *param, int reg) {
+    TypeKind type = param->data.parameter.resolved_type;
+    TypeKind actual = string_to_type(param->data.parameter.type);
+    const char *name = param->data.parameter.name;
+    if (is_unsupported_type(actual)) {
+        report_error("Error: %s values are not supported by the interpreter\n",
+                     type_to_string(actual));
+        c->has_error = 1;
+        return;
+    }
+    if (is_struct_type(actual)) {
+        // Passed by value: the caller hands over the address of its copy
+        int slot = new_frame_slot(c, type_size(c, actual), type_align(c, actual));
+        int address = new_register(c);
+        emit(c, BC_ADDR, 0, address, slot, 0);
+        emit(c, BC_COPY, 0, address, reg, type_size(c, actual));
+        set_variable(c, name, VAR_FRAME, slot, type, actual, 1);
+    } else if (is_address_taken(c, name)) {
+        int slot = new_frame_slot(c, type_size(c, actual), type_align(c, actual));
+        emit(c, BC_STOREL, value_bits(actual), reg, slot, 0);
+        set_variable(c, name, VAR_FRAME, slot, type, actual, 1);
+    } else {
+        set_variable(c, name, VAR_REGISTER, reg, type, actual, 1);
+    }
+}
+
+// Start on a function of a module, which sees that module's globals
+static void begin_function(Compiler *c, InterpFunction *fn, int module) {
+    c->function = fn;
+    for (int i = 0; i < c->variable_count; i++) {
+        free(c->variables[i].name);
+    }
+    c->variable_count = 0;
+    for (int i = 0; i < c->program->global_count; i++) {
+        InterpGlobal *global = &c->program->globals[i];
+        if (global->module == module) {
+            ASTNode *decl = global->node;
+            TypeKind type = decl->data.variable_decl.resolved_type;
+            set_variable(c, decl->data.variable_decl.name, VAR_GLOBAL, global->offset, type,
+                         type, decl->data.variable_decl.is_mutable);
+        }
+    }
+}
+
+static void compile_function(Compiler *c, InterpFunction *fn) {
+    TimePoint start = time_now();
+    ASTNode *node = fn->node;
+    int is_method = node->type == NODE_STRUCT_METHOD;
+    ASTNode **params = is_method ? node->data.struct_method.params : node->data.function.params;
+    int param_count = is_method ? node->data.struct_method.param_count
+                                : node->data.function.param_count;
+    ASTNode *body = is_method ? node->data.struct_method.body : node->data.function.body;
+
+    begin_function(c, fn, fn->module);
+    c->address_taken_count = 0;
+    c->loop_depth = 0;
+    c->terminated = 0;
+    c->locals_top = fn->arity;
+    c->next_register = fn->arity;
+    fn->register_count = fn->arity;
+    find_address_taken(c, body);
+
+    // Parameters come first, hiding globals; a method's fields, reached
+    // through self in register 0, shadow parameters of the same name
+    for (int i = 0; i < param_count; i++) {
+        declare_parameter(c, params[i], i + is_method);
+    }
+    if (is_method) {
+        StructType *st = get_struct_type(fn->self_type);
+        StructLayout *layout = struct_layout(c, fn->self_type);
+        for (int i = 0; st && layout && i < st->field_count; i++) {
+            set_variable(c, st->fields[i].name, VAR_FIELD, layout->offsets[i],
+                         st->fields[i].type, st->fields[i].type, 1);
+        }
+    }
+    c->next_register = c->locals_top;
+
+    if (body) {
+        compile_body(c, body);
+    }
+    if (!c->terminated) {
+        if (fn->return_type == TYPE_VOID) {
+            emit(c, BC_RETV, 0, 0, 0, 0);
+        } else {
+            int zero = new_register(c);
+            emit(c, BC_LOADI, 0, zero, 0, 0);
+            emit(c, BC_RET, 0, zero, 0, 0);
+        }
+    }
+    record_time(TIMING_CODEGEN, fn->name, start);
+}
+
+// Modules
+
+static void add_function(Compiler *c, const char *name, ASTNode *node, TypeKind self_type,
+                         int module) {
+    InterpProgram *program = c->program;
+    program->functions = grow(program->functions, &program->function_capacity,
+                              program->function_count, sizeof(InterpFunction));
+    InterpFunction *fn = &program->functions[program->function_count++];
+    memset(fn, 0, sizeof(InterpFunction));
+    fn->name = strdup(name);
+    fn->node = node;
+    fn->self_type = self_type;
+    fn->module = module;
+    if (node->type == NODE_STRUCT_METHOD) {
+        fn->arity = node->data.struct_method.param_count + 1;
+        fn->return_type = string_to_type(node->data.struct_method.return_type);
+    } else if (node->type == NODE_FUNCTION) {
+        fn->arity = node->data.function.param_count;
+        fn->return_type = string_to_type(node->data.function.return_type);
+    } else {
+        // The globals' initializers, for a program node
+        fn->return_type = TYPE_VOID;
+    }
+}
+
+static void add_global(Compiler *c, ASTNode *node, int module) {
+    InterpProgram *program = c->program;
+    TypeKind type = node->data.variable_decl.resolved_type;
+    int align = type_align(c, type);
+    program->global_size = (program->global_size + align - 1) / align * align;
+    program->globals = grow(program->globals, &program->global_capacity,
+                            program->global_count, sizeof(InterpGlobal));
+    InterpGlobal *global = &program->globals[program->global_count++];
+    global->node = node;
+    global->module = module;
+    global->offset = program->global_size;
+    program->global_size += type_size(c, type);
+}
+
+// Functions, methods and globals of every module, so calls resolve in any
+// order. Where names clash, the definition seen first is the one called.
+static void declare_module(Compiler *c, ASTNode *program, int module, int is_root) {
+    for (int i = 0; i < program->data.program.function_count; i++) {
+        ASTNode *node = program->data.program.functions[i];
+        if (node->type == NODE_FUNCTION) {
+            add_function(c, node->data.function.name, node, TYPE_UNKNOWN, module);
+        } else if (node->type == NODE_STRUCT) {
+            StructType *st = find_struct_by_name(node->data.struct_decl.name);
+            if (!st) {
+                report_error("Struct type '%s' not found in type system\n",
+                             node->data.struct_decl.name);
+                continue;
+            }
+            for (int j = 0; j < node->data.struct_decl.method_count; j++) {
+                ASTNode *method = node->data.struct_decl.methods[j];
+                char *mangled = malloc(strlen(st->name) +
+                                       strlen(method->data.struct_method.name) + 2);
+                sprintf(mangled, "%s_%s", st->name, method->data.struct_method.name);
+                add_function(c, mangled, method, st->type_id, module);
+                free(mangled);
+            }
+        } else if (node->type == NODE_VARIABLE_DECL) {
+            add_global(c, node, module);
+        } else if (is_root) {
+            report_error("Unexpected node type in program: %d\n", node->type);
+        }
+    }
+}
+
+// Run the initializers of every module's globals, imports first, in one
+// function called before main. Literal initializers go first, as compiled
+// code has those values in place before anything runs.
+static void compile_initializers(Compiler *c, ASTNode *root) {
+    InterpProgram *program = c->program;
+    if (program->global_count == 0) {
+        return;
+    }
+
+    TimePoint start = time_now();
+    program->init_function = program->function_count;
+    add_function(c, "gloin.init", root, TYPE_UNKNOWN, -1);
+    InterpFunction *fn = &program->functions[program->init_function];
+    begin_function(c, fn, -1);
+    c->address_taken_count = 0;
+    c->loop_depth = 0;
+    c->terminated = 0;
+    c->locals_top = 0;
+    c->next_register = 0;
+    int module = -1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < program->global_count && !c->has_error; i++) {
+            InterpGlobal *global = &program->globals[i];
+            ASTNode *value = global->node->data.variable_decl.value;
+            TypeKind type = global->node->data.variable_decl.resolved_type;
+            if (!value || (value->type == NODE_LITERAL) != (pass == 0) ||
+                is_unsupported_type(type)) {
+                continue;
+            }
+            if (global->module != module) {
+                module = global->module;
+                begin_function(c, fn, module);
+            }
+            int reg = compile_initial_value(c, value, type, -1);
+            if (reg < 0) {
+                c->has_error = 1;
+                break;
+            }
+            Variable var = {NULL, VAR_GLOBAL, global->offset, type, type, 1};
+            store_variable(c, &var, reg);
+            c->next_register = c->locals_top;
+        }
+    }
+    emit(c, BC_RETV, 0, 0, 0, 0);
+    record_time(TIMING_CODEGEN, fn->name, start);
+}
+
+static void add_module(Compiler *c, ASTNode *program) {
+    c->modules = grow(c->modules, &c->module_capacity, c->module_count, sizeof(ASTNode *));
+    c->modules[c->module_count++] = program;
+}
+
+// Parse the imports of a program depth first, so every module follows the
+// modules it imports
+static int load_imports(Compiler *c, ImportGraph *graph, ImportModule *importer,
+                        ASTNode *program) {
+    for (int i = 0; i < program->data.program.import_count; i++) {
+        ASTNode *import = program->data.program.imports[i];
+        ImportType import_type = import->data.import.import_type;
+        if (import_type == IMPORT_STD) {
+            continue;
+        }
+        char *path = resolve_import_path(import_type, import->data.import.path,
+                                         importer ? importer->path : NULL);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            if (import_type == IMPORT_EXTERNAL) {
+                report_error("Cannot open external package: %s\n", path);
+                report_error("Make sure the package is installed in includes/ directory\n");
+                report_error("You can install it with: mine dig <package_url>\n");
+                free(path);
+                continue;
+            }
+            report_error("Cannot open import file: %s\n", path);
+            free(path);
+            return 1;
+        }
+        fclose(file);
+
+        ImportModule *module = import_graph_find(graph, path);
+        if (module) {
+            free(path);
+            if (module->state == MODULE_VISITING) {
+                report_import_cycle(graph, module);
+                return 1;
+            }
+            import_graph_add_dependency(importer, module);
+            continue;
+        }
+        module = import_graph_add(graph, path, NULL, 0);
+        free(path);
+        import_graph_add_dependency(importer, module);
+        import_graph_push(graph, module);
+        module->program = parse_file(module->path);
+        if (!module->program) {
+            report_error("Failed to parse imported file: %s\n", module->path);
+            import_graph_pop(graph);
+            return 1;
+        }
+        module->owns_program = 1;
+        int failed = load_imports(c, graph, module, module->program);
+        if (!failed) {
+            TimePoint start = time_now();
+            resolve_types(module->program);
+            record_time(TIMING_RESOLVE_TYPES, module->path, start);
+            start = time_now();
+            failed = fold_constants(module->program);
+            record_time(TIMING_FOLD_CONSTANTS, module->path, start);
+            add_module(c, module->program);
+        }
+        import_graph_pop(graph);
+        if (failed) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Free a compiler, handing its modules to the program it compiled
+static void free_compiler(Compiler *c) {
+    for (int i = 0; i < c->variable_count; i++) {
+        free(c->variables[i].name);
+    }
+    for (int i = 0; i < TYPE_UNKNOWN - TYPE_STRUCT_START; i++) {
+        free(c->layouts[i].offsets);
+    }
+    free(c->variables);
+    free(c->address_taken);
+    free(c->loops);
+    c->program->modules = c->modules;
+    c->program->module_count = c->module_count;
+    free(c);
+}
+
+InterpProgram *interp_compile(ASTNode *program, const char *source_path) {
+    if (program->type != NODE_PROGRAM) {
+        report_error("Expected program node\n");
+        return NULL;
+    }
+    InterpProgram *result = calloc(1, sizeof(InterpProgram));
+    result->imports = create_import_graph();
+    result->main_function = -1;
+    result->init_function = -1;
+    Compiler *c = calloc(1, sizeof(Compiler));
+    c->program = result;
+
+    ImportModule *root = source_path
+                             ? import_graph_add(result->imports, source_path, program, 0)
+                             : NULL;
+    if (root) {
+        import_graph_push(result->imports, root);
+    }
+    int failed = load_imports(c, result->imports, root, program);
+    if (root) {
+        import_graph_pop(result->imports);
+    }
+
+    if (!failed) {
+        TimePoint start = time_now();
+        resolve_types(program);
+        record_time(TIMING_RESOLVE_TYPES, source_path, start);
+        start = time_now();
+        failed = fold_constants(program);
+        record_time(TIMING_FOLD_CONSTANTS, source_path, start);
+        add_module(c, program);
+        for (int i = 0; i < c->module_count; i++) {
+            declare_module(c, c->modules[i], i, i == c->module_count - 1);
+        }
+
+        // The root's main is the program's entry point
+        for (int i = 0; i < result->function_count; i++) {
+            InterpFunction *fn = &result->functions[i];
+            if (fn->module == c->module_count - 1 && fn->self_type == TYPE_UNKNOWN &&
+                strcmp(fn->name, "main") == 0) {
+                result->main_function = i;
+                break;
+            }
+        }
+        for (int i = 0; i < result->function_count && !failed && !c->has_error; i++) {
+            compile_function(c, &result->functions[i]);
+        }
+        if (!failed && !c->has_error) {
+            compile_initializers(c, program);
+            result->global_memory = calloc(result->global_size ? result->global_size : 1, 1);
+        }
+        failed = failed || c->has_error;
+        if (!failed && result->main_function < 0) {
+            report_error("Error: No main function\n");
+            failed = 1;
+        }
+    }
+
+    free_compiler(c);
+    if (failed) {
+        free_interp_program(result);
+        return NULL;
+    }
+    return result;
+}
+
+void free_interp_program(InterpProgram *program) {
+    if (!program) {
+        return;
+    }
+    for (int i = 0; i < program->function_count; i++) {
+        InterpFunction *fn = &program->functions[i];
+        for (int j = 0; j < fn->loop_count; j++) {
+            for (int k = 0; k < fn->loops[j].variable_count; k++) {
+                free(fn->loops[j].names[k]);
+            }
+            free(fn->loops[j].names);
+            free(fn->loops[j].types);
+            free(fn->loops[j].registers);
+        }
+        free(fn->loops);
+        free(fn->name);
+        free(fn->code);
+    }
+    for (int i = 0; i < program->string_count; i++) {
+        free(program->strings[i]);
+    }
+    free(program->functions);
+    free(program->globals);
+    free(program->global_memory);
+    free(program->constants);
+    free(program->strings);
+    free(program->modules);
+    free_import_graph(program->imports);
+    free(program);
+}
+
+// Execution
+
+#define REGISTER_STACK_SIZE (1 << 20)  // Registers, 8 MB
+#define MEMORY_STACK_SIZE (8 << 20)    // Bytes
+#define CALL_STACK_SIZE (1 << 16)      // Frames
+#define MAX_NESTING 4096               // Interpreter activations under native code
+
+typedef struct Frame {
+    InterpFunction *function;
+    const Instr *return_ip;
+    int64_t *registers;
+    uint8_t *memory;
+    int result;  // Register of the call's value
+} Frame;
+
+static inline int64_t load_value(const uint8_t *address, int bits) {
+    switch (bits) {
+    case 1:
+        return *address & 1;
+    case 8:
+        return *(const int8_t *)address;
+    case 16: {
+        int16_t value;
+        memcpy(&value, address, sizeof(value));
+        return value;
+    }
+    case 32: {
+        int32_t value;
+        memcpy(&value, address, sizeof(value));
+        return value;
+    }
+    default: {
+        int64_t value;
+        memcpy(&value, address, sizeof(value));
+        return value;
+    }
+    }
+}
+
+static inline void store_value(uint8_t *address, int bits, int64_t value) {
+    switch (bits) {
+    case 1:
+    case 8:
+        *address = (uint8_t)value;
+        break;
+    case 16: {
+        int16_t narrow = (int16_t)value;
+        memcpy(address, &narrow, sizeof(narrow));
+        break;
+    }
+    case 32: {
+        int32_t narrow = (int32_t)value;
+        memcpy(address, &narrow, sizeof(narrow));
+        break;
+    }
+    default:
+        memcpy(address, &value, sizeof(value));
+        break;
+    }
+}
+
+static void print_value(int format, int newline, int64_t value) {
+    const char *spec = newline ? line_formats[format] : formats[format];
+    switch (format) {
+    case FORMAT_STRING:
+        printf(spec, (const char *)(intptr_t)value);
+        break;
+    case FORMAT_BOOL:
+        printf(spec, value ? "true" : "false");
+        break;
+    case FORMAT_I64:
+    case FORMAT_U64:
+        printf(spec, (long)value);
+        break;
+    default:
+        printf(spec, (int)value);
+        break;
+    }
+}
+
+static void format_value(char *buffer, int format, int64_t value) {
+    switch (format) {
+    case FORMAT_BOOL:
+        sprintf(buffer, "%s", value ? "true" : "false");
+        break;
+    case FORMAT_I64:
+    case FORMAT_U64:
+        sprintf(buffer, formats[format], (long)value);
+        break;
+    default:
+        sprintf(buffer, formats[format], (int)value);
+        break;
+    }
+}
+
+static inline size_t frame_bytes(const InterpFunction *fn) {
+    return ((size_t)fn->frame_size + 15) & ~(size_t)15;
+}
+
+// Threaded dispatch: every handler jumps straight to the next one through
+// a table of label addresses. Compilers without computed goto get a switch.
+#if defined(__GNUC__)
+#define INTERP_THREADED 1
+#endif
+
+#ifdef INTERP_THREADED
+#define TARGET(name) do_##name:
+#define DISPATCH() goto *dispatch_table[ip->op]
+#else
+#define TARGET(name) case BC_##name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()   \
+    do {         \
+        ip++;    \
+        DISPATCH(); \
+    } while (0)
+#define JUMP(target)              \
+    do {                          \
+        ip = code + (target);     \
+        DISPATCH();               \
+    } while (0)
+#define R registers
+
+static void heat_up(InterpProgram *program, InterpFunction *function, uint32_t amount) {
+    function->heat += amount;
+    if (function->heat >= program->hot_threshold && !function->is_hot) {
+        function->is_hot = 1;
+        program->hot_hook(program->hot_context, (int)(function - program->functions));
+    }
+}
+
+// Run a function on the program's stacks, above whatever is running
+static int64_t execute(InterpProgram *program, int index, const int64_t *args) {
+#ifdef INTERP_THREADED
+#define OPCODE_LABEL(name) &&do_##name,
+    static const void *const dispatch_table[] = {INTERP_OPCODES(OPCODE_LABEL)};
+#undef OPCODE_LABEL
+#endif
+    int64_t *register_end = program->register_end;
+    uint8_t *memory_end = program->memory_end;
+    const int64_t *constants = program->constants;
+    InterpFunction *functions = program->functions;
+    Frame *frames = program->frames;
+    const char *error = NULL;
+    int base_depth = program->frame_top;
+    int depth = base_depth;
+    int64_t value;
+
+    InterpFunction *function = &functions[index];
+    const Instr *code = function->code;
+    const Instr *ip = code;
+    int64_t *registers = program->register_top;
+    uint8_t *memory = program->memory_top;
+    if (registers + function->register_count > register_end ||
+        memory + frame_bytes(function) > memory_end) {
+        error = "stack overflow";
+        goto fail;
+    }
+    memset(registers, 0, function->register_count * sizeof(int64_t));
+    if (args) {
+        memcpy(registers, args, function->arity * sizeof(int64_t));
+    }
+    memset(memory, 0, function->frame_size);
+
+#ifdef INTERP_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (ip->op) {
+#endif
+    TARGET(LOADI) {
+        R[ip->a] = ip->b;
+        NEXT();
+    }
+    TARGET(LOADK) {
+        R[ip->a] = constants[ip->b];
+        NEXT();
+    }
+    TARGET(MOVE) {
+        R[ip->a] = R[ip->b];
+        NEXT();
+    }
+    TARGET(ADD) {
+        R[ip->a] = wrap((uint64_t)R[ip->b] + (uint64_t)R[ip->c], ip->width);
+        NEXT();
+    }
+    TARGET(SUB) {
+        R[ip->a] = wrap((uint64_t)R[ip->b] - (uint64_t)R[ip->c], ip->width);
+        NEXT();
+    }
+    TARGET(MUL) {
+        R[ip->a] = wrap((uint64_t)R[ip->b] * (uint64_t)R[ip->c], ip->width);
+        NEXT();
+    }
+    TARGET(DIV) {
+        int64_t divisor = R[ip->c];
+        if (divisor == 0) {
+            error = "division by zero";
+            goto fail;
+        }
+        R[ip->a] = wrap(divisor == -1 ? 0 - (uint64_t)R[ip->b] : (uint64_t)(R[ip->b] / divisor),
+                        ip->width);
+        NEXT();
+    }
+    TARGET(ADDI) {
+        R[ip->a] = wrap((uint64_t)R[ip->b] + (uint64_t)(int64_t)ip->c, ip->width);
+        NEXT();
+    }
+    TARGET(EQ) {
+        R[ip->a] = R[ip->b] == R[ip->c];
+        NEXT();
+    }
+    TARGET(NE) {
+        R[ip->a] = R[ip->b] != R[ip->c];
+        NEXT();
+    }
+    TARGET(LT) {
+        R[ip->a] = R[ip->b] < R[ip->c];
+        NEXT();
+    }
+    TARGET(GT) {
+        R[ip->a] = R[ip->b] > R[ip->c];
+        NEXT();
+    }
+    TARGET(LE) {
+        R[ip->a] = R[ip->b] <= R[ip->c];
+        NEXT();
+    }
+    TARGET(GE) {
+        R[ip->a] = R[ip->b] >= R[ip->c];
+        NEXT();
+    }
+    TARGET(JMP) {
+        JUMP(ip->b);
+    }
+    TARGET(JMPF) {
+        if (!R[ip->a]) {
+            JUMP(ip->b);
+        }
+        NEXT();
+    }
+    TARGET(JMPT) {
+        if (R[ip->a]) {
+            JUMP(ip->b);
+        }
+        NEXT();
+    }
+    TARGET(JEQ) {
+        if (R[ip->a] == R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JNE) {
+        if (R[ip->a] != R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JLT) {
+        if (R[ip->a] < R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JGT) {
+        if (R[ip->a] > R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JLE) {
+        if (R[ip->a] <= R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JGE) {
+        if (R[ip->a] >= R[ip->b]) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(JEQI) {
+        if (R[ip->a] == ip->b) {
+            JUMP(ip->c);
+        }
+        NEXT();
+    }
+    TARGET(WRAP) {
+        R[ip->a] = wrap((uint64_t)R[ip->b], ip->width);
+        NEXT();
+    }
+    TARGET(ZEXT) {
+        uint64_t mask = ip->c >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << ip->c) - 1;
+        R[ip->a] = wrap((uint64_t)R[ip->b] & mask, ip->width);
+        NEXT();
+    }
+    TARGET(LOAD) {
+        R[ip->a] = load_value((const uint8_t *)(intptr_t)R[ip->b] + ip->c, ip->width);
+        NEXT();
+    }
+    TARGET(STORE) {
+        store_value((uint8_t *)(intptr_t)R[ip->b] + ip->c, ip->width, R[ip->a]);
+        NEXT();
+    }
+    TARGET(LOADL) {
+        R[ip->a] = load_value(memory + ip->b, ip->width);
+        NEXT();
+    }
+    TARGET(STOREL) {
+        store_value(memory + ip->b, ip->width, R[ip->a]);
+        NEXT();
+    }
+    TARGET(ADDR) {
+        R[ip->a] = (int64_t)(intptr_t)(memory + ip->b);
+        NEXT();
+    }
+    TARGET(LOADG) {
+        R[ip->a] = load_value(program->global_memory + ip->b, ip->width);
+        NEXT();
+    }
+    TARGET(STOREG) {
+        store_value(program->global_memory + ip->b, ip->width, R[ip->a]);
+        NEXT();
+    }
+    TARGET(ADDRG) {
+        R[ip->a] = (int64_t)(intptr_t)(program->global_memory + ip->b);
+        NEXT();
+    }
+    TARGET(COPY) {
+        memmove((void *)(intptr_t)R[ip->a], (const void *)(intptr_t)R[ip->b], ip->c);
+        NEXT();
+    }
+    TARGET(LOOP) {
+        if (program->hot_threshold) {
+            heat_up(program, function, 1);
+            InterpLoop *loop = ip->b >= 0 ? &function->loops[ip->b] : NULL;
+            InterpNative native = loop ? __atomic_load_n(&loop->native, __ATOMIC_ACQUIRE) : NULL;
+            int64_t *args = registers + function->register_count;
+            if (native && args + loop->variable_count <= register_end) {
+                // The rest of the function runs natively, from the test
+                for (int i = 0; i < loop->variable_count; i++) {
+                    args[i] = R[loop->registers[i]];
+                }
+                program->register_top = args + loop->variable_count;
+                program->memory_top = memory + frame_bytes(function);
+                program->frame_top = depth;
+                value = native(args);
+                goto return_value;
+            }
+        }
+        if (program->step_limit && ++program->steps > program->step_limit) {
+            error = "step limit exceeded";
+            goto fail;
+        }
+        NEXT();
+    }
+    TARGET(CALL) {
+        InterpFunction *callee = &functions[ip->b];
+        InterpNative native = __atomic_load_n(&callee->native, __ATOMIC_ACQUIRE);
+        if (native) {
+            // Native code may call back into the interpreter above this frame
+            program->register_top = registers + function->register_count;
+            program->memory_top = memory + frame_bytes(function);
+            program->frame_top = depth;
+            R[ip->a] = native(registers + ip->c);
+            NEXT();
+        }
+        if (program->hot_threshold) {
+            heat_up(program, callee, 1);
+        }
+        if (program->step_limit && ++program->steps > program->step_limit) {
+            error = "step limit exceeded";
+            goto fail;
+        }
+        int64_t *callee_registers = registers + function->register_count;
+        uint8_t *callee_memory = memory + frame_bytes(function);
+        if (depth == CALL_STACK_SIZE ||
+            callee_registers + callee->register_count > register_end ||
+            callee_memory + frame_bytes(callee) > memory_end) {
+            error = "stack overflow";
+            goto fail;
+        }
+        Frame *frame = &frames[depth++];
+        frame->function = function;
+        frame->return_ip = ip + 1;
+        frame->registers = registers;
+        frame->memory = memory;
+        frame->result = ip->a;
+
+        const int64_t *args = registers + ip->c;
+        memset(callee_registers, 0, callee->register_count * sizeof(int64_t));
+        memcpy(callee_registers, args, callee->arity * sizeof(int64_t));
+        memset(callee_memory, 0, callee->frame_size);
+        function = callee;
+        code = callee->code;
+        registers = callee_registers;
+        memory = callee_memory;
+        JUMP(0);
+    }
+    TARGET(RET) {
+        value = R[ip->a];
+        goto return_value;
+    }
+    TARGET(RETV) {
+        value = 0;
+        goto return_value;
+    }
+    TARGET(PRINT) {
+        print_value(ip->b, ip->c, R[ip->a]);
+        NEXT();
+    }
+    TARGET(FORMAT) {
+        char *buffer = (char *)memory + ip->c;
+        format_value(buffer, ip->width, R[ip->b]);
+        R[ip->a] = (int64_t)(intptr_t)buffer;
+        NEXT();
+    }
+    TARGET(INPUT) {
+        char *buffer = (char *)memory + ip->b;
+        if (scanf("%255s", buffer) != 1) {
+            buffer[0] = '\0';
+        }
+        R[ip->a] = (int64_t)(intptr_t)buffer;
+        NEXT();
+    }
+    TARGET(READLN) {
+        char *line = NULL;
+        size_t size = 0;
+        if (getline(&line, &size, stdin) < 0 && line) {
+            line[0] = '\0';
+        }
+        R[ip->a] = (int64_t)(intptr_t)line;
+        NEXT();
+    }
+    TARGET(ATOI) {
+        R[ip->a] = atoi((const char *)(intptr_t)R[ip->b]);
+        NEXT();
+    }
+    TARGET(ATOL) {
+        R[ip->a] = atol((const char *)(intptr_t)R[ip->b]);
+        NEXT();
+    }
+    TARGET(MALLOC) {
+        R[ip->a] = (int64_t)(intptr_t)malloc((size_t)R[ip->b]);
+        NEXT();
+    }
+    TARGET(FREE) {
+        free((void *)(intptr_t)R[ip->a]);
+        NEXT();
+    }
+#ifndef INTERP_THREADED
+    default:
+        error = "invalid instruction";
+        goto fail;
+    }
+#endif
+
+return_value:
+    if (depth > base_depth) {
+        Frame *frame = &frames[--depth];
+        function = frame->function;
+        code = function->code;
+        registers = frame->registers;
+        memory = frame->memory;
+        ip = frame->return_ip;
+        R[frame->result] = value;
+        DISPATCH();
+    }
+    return value;
+
+fail:
+    fflush(stdout);
+    report_error("Error: %s in %s\n", error, function->name);
+    longjmp(program->error_exit, 1);
+}
+
+// Run a function on stacks of the given sizes, made for the call
+static int run_function(InterpProgram *program, int function, const int64_t *args,
+                        size_t register_count, size_t memory_size, int64_t *result) {
+    program->register_stack = malloc(register_count * sizeof(int64_t));
+    program->memory_stack = malloc(memory_size);
+    program->register_end = program->register_stack + register_count;
+    program->memory_end = program->memory_stack + memory_size;
+    program->frames = malloc(CALL_STACK_SIZE * sizeof(Frame));
+    program->register_top = program->register_stack;
+    program->memory_top = program->memory_stack;
+    program->frame_top = 0;
+    program->nesting = 0;
+
+    int failed = setjmp(program->error_exit);
+    if (!failed) {
+        *result = execute(program, function, args);
+    }
+    free(program->register_stack);
+    free(program->memory_stack);
+    free(program->frames);
+    program->register_stack = NULL;
+    program->memory_stack = NULL;
+    program->frames = NULL;
+    return failed;
+}
+
+int interp_run(InterpProgram *program, int *exit_code) {
+    int64_t result = 0;
+    int failed = 0;
+    if (program->init_function >= 0) {
+        failed = run_function(program, program->init_function, NULL, REGISTER_STACK_SIZE,
+                              MEMORY_STACK_SIZE, &result);
+    }
+    if (!failed) {
+        failed = run_function(program, program->main_function, NULL, REGISTER_STACK_SIZE,
+                              MEMORY_STACK_SIZE, &result);
+    }
+    if (!failed) {
+        *exit_code = (int)result;
+    }
+    return failed;
+}
+
+static int is_comptime_type(TypeKind type) {
+    return type == TYPE_BOOL || (is_integer_type(type) && !is_unsupported_type(type));
+}
+
+// Whether compiled code does input, output or allocation, or uses
+// globals, which only have their values once the program runs
+static int has_effects(const InterpFunction *fn) {
+    for (int i = 0; i < fn->code_length; i++) {
+        switch (fn->code[i].op) {
+        case BC_PRINT:
+        case BC_INPUT:
+        case BC_READLN:
+        case BC_MALLOC:
+        case BC_FREE:
+        case BC_LOADG:
+        case BC_STOREG:
+        case BC_ADDRG:
+            return 1;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+int interp_evaluate(ASTNode *program, ASTNode *call, const InterpLimits *limits,
+                    int64_t *result, TypeKind *result_type) {
+    const char *name = call->data.call.name;
+    InterpProgram *evaluator = calloc(1, sizeof(InterpProgram));
+    evaluator->main_function = -1;
+    evaluator->init_function = -1;
+    Compiler *c = calloc(1, sizeof(Compiler));
+    c->program = evaluator;
+    add_module(c, program);
+    declare_module(c, program, 0, 0);
+
+    int function = find_function(evaluator, name);
+    InterpFunction *fn = function >= 0 ? &evaluator->functions[function] : NULL;
+    int failed = 1;
+    int64_t *args = calloc(call->data.call.arg_count + 1, sizeof(int64_t));
+    if (!fn || fn->self_type != TYPE_UNKNOWN) {
+        report_error("Error: comptime can only call functions of the same file, not %s\n", name);
+    } else if (fn->arity != call->data.call.arg_count) {
+        report_error("Error: %s expects %d arguments, got %d\n", name, fn->arity,
+                     call->data.call.arg_count);
+    } else if (!is_comptime_type(fn->return_type)) {
+        report_error("Error: comptime %s must return an integer or bool\n", name);
+    } else {
+        failed = 0;
+        for (int i = 0; i < fn->arity && !failed; i++) {
+            TypeKind type = fn->node->data.function.params[i]->data.parameter.resolved_type;
+            if (!is_comptime_type(type) || !integer_literal(call->data.call.args[i], &args[i])) {
+                report_error("Error: Argument %d of comptime %s must be an integer or bool "
+                             "constant\n", i + 1, name);
+                failed = 1;
+            }
+            args[i] = wrap((uint64_t)args[i], value_bits(type));
+        }
+    }
+
+    // Only what the function reaches is compiled, and it must be pure
+    if (!failed) {
+        Reachability *reachable = compute_reachability(&program, 1, name);
+        for (int i = 0; i < evaluator->function_count && !c->has_error; i++) {
+            InterpFunction *callee = &evaluator->functions[i];
+            if (is_reachable(reachable, callee->node)) {
+                compile_function(c, callee);
+                if (!c->has_error && has_effects(callee)) {
+                    report_error("Error: %s cannot run at compile time: it does input, "
+                                 "output or allocation, or uses globals\n", callee->name);
+                    c->has_error = 1;
+                }
+            }
+        }
+        free_reachability(reachable);
+        failed = c->has_error;
+    }
+    if (!failed) {
+        evaluator->step_limit = limits->steps;
+        size_t half = limits->memory / 2;
+        failed = run_function(evaluator, function, args, half / sizeof(int64_t), half, result);
+        *result_type = fn->return_type;
+    }
+    free(args);
+    free_compiler(c);
+    free_interp_program(evaluator);
+    return failed;
+}
+
+int64_t interp_call(InterpProgram *program, int function, const int64_t *args) {
+    InterpFunction *callee = &program->functions[function];
+    InterpNative native = __atomic_load_n(&callee->native, __ATOMIC_ACQUIRE);
+    if (native) {
+        return native(args);
+    }
+    if (program->nesting == MAX_NESTING) {
+        fflush(stdout);
+        report_error("Error: stack overflow in %s\n", callee->name);
+        longjmp(program->error_exit, 1);
+    }
+    if (program->hot_threshold) {
+        heat_up(program, callee, 1);
+    }
+    program->nesting++;
+    int64_t result = execute(program, function, args);
+    program->nesting--;
+    return result;
+}
+
+void interp_set_tiering(InterpProgram *program, uint32_t threshold, InterpHotHook hook,
+                        void *context) {
+    program->hot_threshold = hook ? threshold : 0;
+    program->hot_hook = hook;
+    program->hot_context = context;
+}
+
+void interp_set_native(InterpProgram *program, int function, InterpNative native) {
+    __atomic_store_n(&program->functions[function].native, native, __ATOMIC_RELEASE);
+}
+
+void interp_set_loop_native(InterpProgram *program, int function, int loop,
+                            InterpNative native) {
+    __atomic_store_n(&program->functions[function].loops[loop].native, native, __ATOMIC_RELEASE);
+}
+
+int interp_loop_count(const InterpProgram *program, int function) {
+    return program->functions[function].loop_count;
+}
+
+ASTNode *interp_loop_node(const InterpProgram *program, int function, int loop) {
+    return program->functions[function].loops[loop].node;
+}
+
+int interp_loop_variable_count(const InterpProgram *program, int function, int loop) {
+    return program->functions[function].loops[loop].variable_count;
+}
+
+const char *interp_loop_variable(const InterpProgram *program, int function, int loop,
+                                 int variable, TypeKind *type) {
+    const InterpLoop *l = &program->functions[function].loops[loop];
+    *type = l->types[variable];
+    return l->names[variable];
+}
+
+int interp_function_count(const InterpProgram *program) {
+    return program->function_count;
+}
+
+ASTNode *interp_function_node(const InterpProgram *program, int function) {
+    return program->functions[function].node;
+}
+
+int interp_find_function(const InterpProgram *program, const char *name) {
+    return find_function((InterpProgram *)program, name);
+}
+
+int interp_module_count(const InterpProgram *program) {
+    return program->module_count;
+}
+
+ASTNode *interp_module(const InterpProgram *program, int module) {
+    return program->modules[module];
+}
+
+int interp_function_module(const InterpProgram *program, int function) {
+    return program->functions[function].module;
+}
+
+int interp_global_count(const InterpProgram *program) {
+    return program->global_count;
+}
+
+ASTNode *interp_global_node(const InterpProgram *program, int global) {
+    return program->globals[global].node;
+}
+
+int interp_global_module(const InterpProgram *program, int global) {
+    return program->globals[global].module;
+}
+
+void *interp_global_address(const InterpProgram *program, int global) {
+    return program->global_memory + program->globals[global].offset;
+}
@@ -0,0 +1,73 @@
+#include "jit.h"
+#include "codegen.h"
+#include "diagnostics.h"
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/Orc.h>
+#include <stdint.h>
+
+static int consume_error(LLVMErrorRef error) {
+    if (!error) {
+        return 0;
+    }
+    char *message = LLVMGetErrorMessage(error);
+    report_error("Error: %s\n", message);
+    LLVMDisposeErrorMessage(message);
+    return 1;
+}
+
+LLVMOrcLLJITRef create_jit(void) {
+    initialize_native_target();
+    LLVMOrcLLJITRef jit;
+    if (consume_error(LLVMOrcCreateLLJIT(&jit, NULL))) {
+        return NULL;
+    }
+    // Generated code calls the C library of this process
+    LLVMOrcDefinitionGeneratorRef generator;
+    if (consume_error(LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(
+            &generator, LLVMOrcLLJITGetGlobalPrefix(jit), NULL, NULL))) {
+        consume_error(LLVMOrcDisposeLLJIT(jit));
+        return NULL;
+    }
+    LLVMOrcJITDylibAddGenerator(LLVMOrcLLJITGetMainJITDylib(jit), generator);
+    return jit;
+}
+
+void free_jit(LLVMOrcLLJITRef jit) {
+    if (jit) {
+        consume_error(LLVMOrcDisposeLLJIT(jit));
+    }
+}
+
+int jit_add_module(LLVMOrcLLJITRef jit, LLVMModuleRef module) {
+    // The JIT owns the contexts of its modules, so the module moves into
+    // one of its own as bitcode
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+    LLVMOrcThreadSafeContextRef context = LLVMOrcCreateNewThreadSafeContext();
+    LLVMModuleRef copy;
+    int failed = LLVMParseBitcodeInContext2(LLVMOrcThreadSafeContextGetContext(context),
+                                            bitcode, &copy);
+    LLVMDisposeMemoryBuffer(bitcode);
+    if (failed) {
+        report_error("Error: Cannot copy module into the JIT\n");
+    } else {
+        LLVMOrcThreadSafeModuleRef thread_safe_module = LLVMOrcCreateNewThreadSafeModule(copy, context);
+        if (consume_error(LLVMOrcLLJITAddLLVMIRModule(jit, LLVMOrcLLJITGetMainJITDylib(jit),
+                                                      thread_safe_module))) {
+            LLVMOrcDisposeThreadSafeModule(thread_safe_module);
+            failed = 1;
+        }
+    }
+    // Modules added keep the context alive
+    LLVMOrcDisposeThreadSafeContext(context);
+    return failed;
+}
+
+void *jit_lookup(LLVMOrcLLJITRef jit, const char *name) {
+    LLVMOrcExecutorAddress address;
+    if (consume_error(LLVMOrcLLJITLookup(jit, &address, name))) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)address;
+}
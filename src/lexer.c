@@ -186,15 +186,18 @@ TokenType get_keyword_type(const char *identifier) {
     if (strcmp(identifier, "deferred") == 0) return TOKEN_DEFERRED;
     if (strcmp(identifier, "spawnable") == 0) return TOKEN_SPAWNABLE;
     if (strcmp(identifier, "run") == 0) return TOKEN_RUN;
+    if (strcmp(identifier, "comptime") == 0) return TOKEN_COMPTIME;
     return TOKEN_IDENTIFIER;
 }
 
 Token next_token(Lexer *lexer) {
     Token token;
-    token.line = lexer->line;
-    token.column = lexer->column;
     
     while (lexer->current_char != '\0') {
+        // Tokens start after any whitespace and comments skipped below
+        token.line = lexer->line;
+        token.column = lexer->column;
+        
         if (lexer->current_char == ' ' || lexer->current_char == '\t' || lexer->current_char == '\r') {
             skip_whitespace(lexer);
             continue;
@@ -421,6 +424,8 @@ Token next_token(Lexer *lexer) {
     
     token.type = TOKEN_EOF;
     token.value = strdup("");
+    token.line = lexer->line;
+    token.column = lexer->column;
     return token;
 }
 
@@ -479,6 +484,7 @@ const char *token_type_to_string(TokenType type) {
         case TOKEN_DEFERRED: return "DEFERRED";
         case TOKEN_SPAWNABLE: return "SPAWNABLE";
         case TOKEN_RUN: return "RUN";
+        case TOKEN_COMPTIME: return "COMPTIME";
         case TOKEN_IDENTIFIER: return "IDENTIFIER";
         case TOKEN_STRING: return "STRING";
         case TOKEN_NUMBER: return "NUMBER";
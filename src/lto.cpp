@@ -0,0 +1,169 @@
+#include "lto.h"
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/Caching.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static int fail(char **error_message, const std::string &message) {
+    *error_message = strdup(message.c_str());
+    return 1;
+}
+
+int write_lto_bitcode(LLVMModuleRef module, const char *path, LTOMode mode,
+                      char **error_message) {
+    Module *m = unwrap(module);
+    std::error_code error_code;
+    raw_fd_ostream out(path, error_code, sys::fs::OF_None);
+    if (error_code) {
+        return fail(error_message, std::string(path) + ": " + error_code.message());
+    }
+    if (mode == LTO_THIN) {
+        ProfileSummaryInfo summary_info(*m);
+        ModuleSummaryIndex index = buildModuleSummaryIndex(*m, nullptr, &summary_info);
+        // The module hash keys the ThinLTO backend cache
+        WriteBitcodeToFile(*m, out, false, &index, true);
+    } else {
+        WriteBitcodeToFile(*m, out);
+    }
+    out.close();
+    if (out.has_error()) {
+        std::string message = std::string(path) + ": " + out.error().message();
+        out.clear_error();
+        return fail(error_message, message);
+    }
+    return 0;
+}
+
+// Objects come out of the LTO link as streams, or as buffers when the
+// ThinLTO cache has them
+static Error write_buffer(const std::string &path, StringRef contents) {
+    std::error_code error_code;
+    raw_fd_ostream out(path, error_code, sys::fs::OF_None);
+    if (error_code) {
+        return errorCodeToError(error_code);
+    }
+    out << contents;
+    return Error::success();
+}
+
+int run_lto(const char *const *inputs, int input_count, LTOMode mode,
+            int optimization_level, int threads, const char *cache_dir,
+            const char *output_prefix, char ***objects, int *object_count,
+            char **error_message) {
+    // The same target and code generation levels as create_target_machine
+    lto::Config config;
+    config.CPU = "generic";
+    config.RelocModel = None;
+    config.DefaultTriple = sys::getDefaultTargetTriple();
+    config.OptLevel = optimization_level;
+    config.CGOptLevel = optimization_level == 1   ? CodeGenOpt::Less
+                        : optimization_level >= 3 ? CodeGenOpt::Aggressive
+                                                  : CodeGenOpt::Default;
+
+    ThreadPoolStrategy parallelism = threads > 0
+                                         ? hardware_concurrency(threads)
+                                         : heavyweight_hardware_concurrency();
+    lto::LTO lto(std::move(config), lto::createInProcessThinBackend(parallelism),
+                 mode == LTO_FULL && threads > 0 ? threads : 1);
+
+    // Every module is in the link, so the first definition of a symbol is
+    // the one that prevails, and only main is called from native code
+    std::vector<std::unique_ptr<MemoryBuffer>> buffers;
+    std::set<std::string> defined;
+    for (int i = 0; i < input_count; i++) {
+        std::string input = inputs[i];
+        auto buffer = MemoryBuffer::getFile(input);
+        if (!buffer) {
+            return fail(error_message, input + ": " + buffer.getError().message());
+        }
+        auto file = lto::InputFile::create((*buffer)->getMemBufferRef());
+        if (!file) {
+            return fail(error_message, input + ": " + toString(file.takeError()));
+        }
+        std::vector<lto::SymbolResolution> resolutions;
+        for (const lto::InputFile::Symbol &symbol : (*file)->symbols()) {
+            lto::SymbolResolution resolution;
+            if (!symbol.isUndefined()) {
+                resolution.Prevailing = defined.insert(symbol.getName().str()).second;
+                resolution.FinalDefinitionInLinkageUnit = true;
+            }
+            resolution.VisibleToRegularObj = symbol.getName() == "main";
+            resolutions.push_back(resolution);
+        }
+        buffers.push_back(std::move(*buffer));
+        if (Error error = lto.add(std::move(*file), resolutions)) {
+            return fail(error_message, input + ": " + toString(std::move(error)));
+        }
+    }
+
+    std::vector<std::string> paths(lto.getMaxTasks());
+    auto object_path = [&](unsigned task) {
+        paths[task] = std::string(output_prefix) + ".lto." + std::to_string(task) + ".o";
+        return paths[task];
+    };
+    AddStreamFn add_stream = [&](unsigned task) -> Expected<std::unique_ptr<CachedFileStream>> {
+        std::string path = object_path(task);
+        std::error_code error_code;
+        auto out = std::make_unique<raw_fd_ostream>(path, error_code, sys::fs::OF_None);
+        if (error_code) {
+            return errorCodeToError(error_code);
+        }
+        return std::make_unique<CachedFileStream>(std::move(out), path);
+    };
+
+    // Backends finish on several threads
+    FileCache cache;
+    std::mutex cache_mutex;
+    std::string cache_error;
+    if (cache_dir) {
+        auto local_cache = localCache(
+            "ThinLTO", "Thin", cache_dir,
+            [&](size_t task, std::unique_ptr<MemoryBuffer> buffer) {
+                if (Error error = write_buffer(object_path(task), buffer->getBuffer())) {
+                    std::lock_guard<std::mutex> lock(cache_mutex);
+                    cache_error = toString(std::move(error));
+                }
+            });
+        if (!local_cache) {
+            return fail(error_message, toString(local_cache.takeError()));
+        }
+        cache = std::move(*local_cache);
+    }
+
+    if (Error error = lto.run(add_stream, cache)) {
+        return fail(error_message, toString(std::move(error)));
+    }
+    if (!cache_error.empty()) {
+        return fail(error_message, cache_error);
+    }
+    if (cache_dir) {
+        pruneCache(cache_dir, CachePruningPolicy());
+    }
+
+    // Tasks with nothing to compile leave no object
+    *objects = static_cast<char **>(malloc(paths.size() * sizeof(char *)));
+    *object_count = 0;
+    for (const std::string &path : paths) {
+        if (!path.empty()) {
+            (*objects)[(*object_count)++] = strdup(path.c_str());
+        }
+    }
+    return 0;
+}
@@ -2,50 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
 #include "lexer.h"
 #include "parser.h"
 #include "ast.h"
 #include "codegen.h"
-
-char *read_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error: Could not open file %s\n", filename);
-        return NULL;
-    }
-    
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    char *content = malloc(length + 1);
-    fread(content, 1, length, file);
-    content[length] = '\0';
-    
-    fclose(file);
-    return content;
-}
-
-ASTNode *parse_file(const char *filename) {
-    char *content = read_file(filename);
-    if (!content) {
-        return NULL;
-    }
-    
-    Lexer *lexer = create_lexer(content);
-    Parser *parser = create_parser(lexer);
-    
-    ASTNode *ast = parse_program(parser);
-    
-    // Clean up lexer and parser, but keep the AST
-    free_parser(parser);
-    free_lexer(lexer);
-    free(content);
-    
-    return ast;
-}
+#include "daemon.h"
+#include "interp.h"
+#include "memstats.h"
+#include "profdata.h"
+#include "repl.h"
+#include "tier.h"
+#include "timing.h"
+#include "trace.h"
 
 typedef struct {
     char *name;
@@ -61,6 +32,44 @@ typedef struct {
     int dependency_count;
 } ArmoryConfig;
 
+// What a compile writes (--emit, -c)
+typedef enum {
+    EMIT_EXECUTABLE,
+    EMIT_LLVM_IR,
+    EMIT_LLVM_BC,
+    EMIT_ASM,
+    EMIT_OBJ
+} EmitKind;
+
+static const struct {
+    const char *name;       // --emit=<name>
+    const char *extension;  // Appended to the default output name
+    const char *description;
+    int (*write)(CodeGen *codegen, const char *filename);
+} emit_kinds[] = {
+    [EMIT_EXECUTABLE] = {"exe", "", "executable", write_executable},
+    [EMIT_LLVM_IR] = {"llvm-ir", ".ll", "LLVM IR", write_ir_file},
+    [EMIT_LLVM_BC] = {"llvm-bc", ".bc", "bitcode", write_bitcode_file},
+    [EMIT_ASM] = {"asm", ".s", "assembly", write_assembly_file},
+    [EMIT_OBJ] = {"obj", ".o", "object file", write_object_file},
+};
+
+typedef struct {
+    char *input_file;
+    char *output_name;       // Derived from the input file when NULL
+    int debug_mode;          // Show details and compile
+    int ast_only_mode;       // Show AST/LLVM IR but don't compile
+    int optimization_level;
+    int codegen_threads;     // 0 emits a single object
+    int debug_info;          // -g
+    int profile;             // --profile
+    char *profile_generate;  // Raw PGO profile the program writes
+    char *profile_use;       // Merged PGO profile to optimize with
+    int whole_program;       // --whole-program
+    LTOMode lto;             // -flto
+    EmitKind emit;           // Executable unless --emit or -c
+} CompileOptions;
+
 ArmoryConfig *parse_armory_toml(const char *filename) {
     FILE *file = fopen(filename, "r");
     if (!file) {
@@ -496,63 +505,31 @@ int init_project(const char *project_name) {
     return 0;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "  %s init [project_name]           # Initialize new project\n", argv[0]);
-        fprintf(stderr, "  %s <filename> [options] [out]    # Compile Gloin file\n", argv[0]);
-        fprintf(stderr, "\nOptions:\n");
-        fprintf(stderr, "  --debug                          # Show AST, LLVM IR and compile\n");
-        fprintf(stderr, "  --ast, --parse-only             # Show AST and LLVM IR without compiling\n");
-        fprintf(stderr, "  -o, --output <name>             # Specify output executable name\n");
-        fprintf(stderr, "\nExamples:\n");
-        fprintf(stderr, "  %s main.gloin                   # Compile to './main'\n", argv[0]);
-        fprintf(stderr, "  %s main.gloin -o myapp          # Compile to './myapp'\n", argv[0]);
-        fprintf(stderr, "  %s main.gloin --debug           # Show details and compile\n", argv[0]);
-        fprintf(stderr, "  %s main.gloin --ast             # Show AST and LLVM IR only\n", argv[0]);
-        return 1;
+// Merges a comma-separated list of PGO profiles into output
+static int merge_profile_list(const char *list, const char *output) {
+    char *copy = strdup(list);
+    const char *inputs[64];
+    int count = 0;
+    for (char *input = strtok(copy, ","); input && count < 64;
+         input = strtok(NULL, ",")) {
+        inputs[count++] = input;
     }
-    
-    // Handle init command
-    if (strcmp(argv[1], "init") == 0) {
-        const char *project_name = (argc > 2) ? argv[2] : ".";
-        return init_project(project_name);
-    }
-    
-    // Handle file compilation (original functionality)
-    if (argc > 6) {
-        fprintf(stderr, "Too many arguments\n");
-        return 1;
-    }
-    
-    char *input_file = argv[1];
-    int debug_mode = 0;        // Show details and compile
-    int ast_only_mode = 0;     // Show AST/LLVM IR but don't compile
-    char *output_name = NULL;  // Will be derived from input file if not specified
-    
-    // Parse command line arguments
-    for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "--debug") == 0) {
-            debug_mode = 1;
-        } else if (strcmp(argv[i], "--ast") == 0 || strcmp(argv[i], "--parse-only") == 0) {
-            ast_only_mode = 1;
-        } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
-            if (i + 1 < argc) {
-                output_name = argv[++i];
-            } else {
-                fprintf(stderr, "Error: %s requires an argument\n", argv[i]);
-                return 1;
-            }
-        } else {
-            // If no flag, treat as output name for backward compatibility
-            if (!output_name) {
-                output_name = argv[i]; // Don't use strdup here
-            } else {
-                fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
-                return 1;
-            }
-        }
+    char *error = NULL;
+    int failed = merge_pgo_profiles(inputs, count, output, &error);
+    if (failed) {
+        fprintf(stderr, "Error: Cannot read profile: %s\n", error);
+        free(error);
     }
+    free(copy);
+    return failed;
+}
+
+// Compiles one file as the command line asked
+static int compile_file(const CompileOptions *options) {
+    char *input_file = options->input_file;
+    char *output_name = options->output_name;
+    int debug_mode = options->debug_mode;
+    int ast_only_mode = options->ast_only_mode;
     
     // Derive output name from input file if not specified (and we're compiling)
     char *allocated_output_name = NULL;  // Track if we allocated memory
@@ -565,26 +542,28 @@ int main(int argc, char *argv[]) {
         if (dot && strcmp(dot, ".gloin") == 0) {
             *dot = '\0';
         }
-    }
-    
-    char *content = read_file(input_file);
-    if (!content) {
-        if (allocated_output_name) {
-            free(allocated_output_name);
-        }
-        return 1;
+        const char *extension = emit_kinds[options->emit].extension;
+        allocated_output_name = realloc(allocated_output_name,
+                                        strlen(output_name) + strlen(extension) + 1);
+        output_name = allocated_output_name;
+        strcat(output_name, extension);
     }
     
     if (debug_mode || ast_only_mode) {
+        char *content = read_file(input_file);
+        if (!content) {
+            if (allocated_output_name) {
+                free(allocated_output_name);
+            }
+            return 1;
+        }
         printf("Parsing file: %s\n", input_file);
         printf("Content:\n%s\n", content);
         printf("---\n");
+        free(content);
     }
     
-    Lexer *lexer = create_lexer(content);
-    Parser *parser = create_parser(lexer);
-    
-    ASTNode *ast = parse_program(parser);
+    ASTNode *ast = parse_file(input_file);
     
     if (debug_mode || ast_only_mode) {
         printf("AST:\n");
@@ -595,9 +574,6 @@ int main(int argc, char *argv[]) {
     // Always compile (unless there were parsing errors)
     if (!ast) {
         fprintf(stderr, "Compilation failed: parsing errors\n");
-        free_parser(parser);
-        free_lexer(lexer);
-        free(content);
         if (allocated_output_name) {
             free(allocated_output_name);
         }
@@ -610,6 +586,20 @@ int main(int argc, char *argv[]) {
     
     // Create code generator
     CodeGen *codegen = create_codegen("gloin_module");
+    codegen->source_path = strdup(input_file);
+    codegen->optimization_level = options->optimization_level;
+    codegen->codegen_threads = options->codegen_threads;
+    codegen->debug_info = options->debug_info;
+    codegen->profile = options->profile;
+    if (options->profile_generate) {
+        codegen->profile_generate = strdup(options->profile_generate);
+    }
+    if (options->profile_use) {
+        codegen->profile_use = strdup(options->profile_use);
+    }
+    codegen->whole_program = options->whole_program;
+    codegen->lto = options->lto;
+    codegen->emit_bitcode = options->emit == EMIT_LLVM_BC;
     
     // Generate code
     codegen_program(codegen, ast);
@@ -617,9 +607,6 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Code generation failed\n");
         free_codegen(codegen);
         free_ast_node(ast);
-        free_parser(parser);
-        free_lexer(lexer);
-        free(content);
         if (allocated_output_name) {
             free(allocated_output_name);
         }
@@ -637,27 +624,22 @@ int main(int argc, char *argv[]) {
         printf("Parse completed successfully (no executable generated)\n");
         free_codegen(codegen);
         free_ast_node(ast);
-        free_parser(parser);
-        free_lexer(lexer);
-        free(content);
         return 0;
     }
     
+    const char *description = emit_kinds[options->emit].description;
     if (debug_mode) {
-        printf("Generating executable: %s\n", output_name);
+        printf("Generating %s: %s\n", description, output_name);
     }
     
-    if (write_executable(codegen, output_name) == 0) {
+    if (emit_kinds[options->emit].write(codegen, output_name) == 0) {
         if (debug_mode) {
-            printf("Successfully generated executable: %s\n", output_name);
+            printf("Successfully generated %s: %s\n", description, output_name);
         }
     } else {
-        fprintf(stderr, "Failed to generate executable\n");
+        fprintf(stderr, "Failed to generate %s\n", description);
         free_codegen(codegen);
         free_ast_node(ast);
-        free_parser(parser);
-        free_lexer(lexer);
-        free(content);
         if (allocated_output_name) {
             free(allocated_output_name);
         }
@@ -667,12 +649,358 @@ int main(int argc, char *argv[]) {
     // Cleanup
     free_codegen(codegen);
     free_ast_node(ast);
-    free_parser(parser);
-    free_lexer(lexer);
-    free(content);
     if (allocated_output_name) {
         free(allocated_output_name);
     }
     
     return 0;
 }
+
+// Compiles and runs a file:
+// `run [--interp|--tiered[=<n>]] [-O<n>] [--time-report[=json]] <file>`.
+// --interp runs it in the bytecode interpreter instead of building an
+// executable; --tiered also compiles functions called or looping n times
+// (default 1000) in the background. Returns the program's exit status.
+static int run_program(int argc, char **argv) {
+    CompileOptions options;
+    memset(&options, 0, sizeof(options));
+    int interpret = 0;
+    uint32_t tier_threshold = 0;  // 0 when not tiering
+    int time_report = 0;  // 1 for text, 2 for JSON
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--interp") == 0) {
+            interpret = 1;
+        } else if (strcmp(argv[i], "--tiered") == 0) {
+            interpret = 1;
+            tier_threshold = TIER_DEFAULT_THRESHOLD;
+        } else if (strncmp(argv[i], "--tiered=", 9) == 0 && atoi(argv[i] + 9) > 0) {
+            interpret = 1;
+            tier_threshold = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+                   argv[i][2] <= '3' && argv[i][3] == '\0') {
+            options.optimization_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            time_report = 1;
+        } else if (strcmp(argv[i], "--time-report=json") == 0) {
+            time_report = 2;
+        } else if (!options.input_file && argv[i][0] != '-') {
+            options.input_file = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!options.input_file) {
+        fprintf(stderr, "Usage: %s run [--interp|--tiered[=<n>]] [-O<n>] <filename>\n", argv[0]);
+        return 1;
+    }
+    
+    TimeReport *report = time_report ? create_time_report() : NULL;
+    set_time_report(report);
+    int result = 1;
+    int exit_code = 0;
+    if (interpret) {
+        ASTNode *ast = parse_file(options.input_file);
+        InterpProgram *program = ast ? interp_compile(ast, options.input_file) : NULL;
+        if (report) {
+            set_time_report(NULL);
+            print_time_report(report, stderr, time_report == 2);
+        }
+        if (program) {
+            TierCompiler *tier = tier_threshold ? create_tier_compiler(program, tier_threshold) : NULL;
+            result = interp_run(program, &exit_code);
+            fflush(stdout);
+            free_tier_compiler(tier);
+        } else {
+            fprintf(stderr, "Compilation failed\n");
+        }
+        free_interp_program(program);
+        free_ast_node(ast);
+    } else {
+        char executable[] = "/tmp/gloin-run-XXXXXX";
+        int fd = mkstemp(executable);
+        if (fd < 0) {
+            fprintf(stderr, "Error: Cannot create a temporary executable\n");
+            set_time_report(NULL);
+            free_time_report(report);
+            return 1;
+        }
+        close(fd);
+        options.output_name = executable;
+        result = compile_file(&options);
+        if (report) {
+            set_time_report(NULL);
+            print_time_report(report, stderr, time_report == 2);
+        }
+        if (result == 0) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                execl(executable, executable, (char *)NULL);
+                _exit(127);
+            }
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+                fprintf(stderr, "Error: Cannot run '%s'\n", options.input_file);
+                result = 1;
+            } else {
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+        } else {
+            fprintf(stderr, "Compilation failed\n");
+        }
+        remove(executable);
+    }
+    free_time_report(report);
+    return result ? 1 : exit_code;
+}
+
+// Runs one gloinc command line; also used by the compile daemon
+static int run_command(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage:\n");
+        fprintf(stderr, "  %s init [project_name]           # Initialize new project\n", argv[0]);
+        fprintf(stderr, "  %s <filename> [options] [out]    # Compile Gloin file\n", argv[0]);
+        fprintf(stderr, "  %s run [--interp] <filename>     # Compile and run, or interpret with --interp\n", argv[0]);
+        fprintf(stderr, "  %s run --tiered[=<n>] <filename> # Interpret, compiling hot functions\n", argv[0]);
+        fprintf(stderr, "  %s repl                          # Start an interactive session\n", argv[0]);
+        fprintf(stderr, "  %s profile-merge <out> <in>...   # Merge PGO profiles\n", argv[0]);
+        fprintf(stderr, "  %s --daemon                      # Serve compile requests\n", argv[0]);
+        fprintf(stderr, "  %s --connect <filename> [...]    # Compile through the daemon\n", argv[0]);
+        fprintf(stderr, "  %s --version                     # Print the compiler and LLVM versions\n", argv[0]);
+        fprintf(stderr, "\nOptions:\n");
+        fprintf(stderr, "  --debug                          # Show AST, LLVM IR and compile\n");
+        fprintf(stderr, "  --ast, --parse-only             # Show AST and LLVM IR without compiling\n");
+        fprintf(stderr, "  -o, --output <name>             # Specify output executable name\n");
+        fprintf(stderr, "  -O0, -O1, -O2, -O3              # Optimization level (default: -O0)\n");
+        fprintf(stderr, "  -g                              # Emit DWARF debug info\n");
+        fprintf(stderr, "  --profile                       # Write a function profile to gloin.prof on exit\n");
+        fprintf(stderr, "  --profile-generate[=<file>]     # Write a PGO profile (gloin.profraw) on exit\n");
+        fprintf(stderr, "  --profile-use=<file>[,...]      # Optimize with PGO profiles\n");
+        fprintf(stderr, "  --whole-program                 # Build imports into one module, dropping unused code\n");
+        fprintf(stderr, "  -flto[=full|thin]               # Optimize across modules at link time\n");
+        fprintf(stderr, "  --emit=llvm-ir|llvm-bc|asm|obj  # Write <name>.ll, .bc, .s or .o instead of linking\n");
+        fprintf(stderr, "  -c                              # Same as --emit=obj\n");
+        fprintf(stderr, "  --codegen-threads=<n>           # Optimize and emit code on n threads\n");
+        fprintf(stderr, "  --time-report[=json]            # Print the time spent in each phase\n");
+        fprintf(stderr, "  --mem-report[=json]             # Print memory use and IR sizes\n");
+        fprintf(stderr, "  --trace-out=<file>              # Write a Chrome trace of the compilation\n");
+        fprintf(stderr, "\nExamples:\n");
+        fprintf(stderr, "  %s main.gloin                   # Compile to './main'\n", argv[0]);
+        fprintf(stderr, "  %s main.gloin -o myapp          # Compile to './myapp'\n", argv[0]);
+        fprintf(stderr, "  %s main.gloin --debug           # Show details and compile\n", argv[0]);
+        fprintf(stderr, "  %s main.gloin --ast             # Show AST and LLVM IR only\n", argv[0]);
+        fprintf(stderr, "  %s run --interp main.gloin      # Run without building an executable\n", argv[0]);
+        return 1;
+    }
+    
+    // Answered before anything touches LLVM
+    if (strcmp(argv[1], "--version") == 0) {
+        printf("gloinc %s (LLVM %s)\n", GLOIN_VERSION, GLOIN_LLVM_VERSION);
+        return 0;
+    }
+    
+    // Handle init command
+    if (strcmp(argv[1], "init") == 0) {
+        const char *project_name = (argc > 2) ? argv[2] : ".";
+        return init_project(project_name);
+    }
+    
+    if (strcmp(argv[1], "run") == 0) {
+        return run_program(argc, argv);
+    }
+    
+    if (strcmp(argv[1], "repl") == 0) {
+        return run_repl(stdin);
+    }
+    
+    if (strcmp(argv[1], "profile-merge") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s profile-merge <output> <profile>...\n", argv[0]);
+            return 1;
+        }
+        char *error = NULL;
+        if (merge_pgo_profiles((const char *const *)argv + 3, argc - 3, argv[2], &error) != 0) {
+            fprintf(stderr, "Error: Cannot merge profiles: %s\n", error);
+            free(error);
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Handle file compilation (original functionality)
+    CompileOptions options;
+    memset(&options, 0, sizeof(options));
+    options.input_file = argv[1];
+    int time_report = 0;       // 1 for text, 2 for JSON
+    int mem_report = 0;        // Likewise
+    char *trace_file = NULL;
+    char *profile_use = NULL;  // Comma-separated raw or indexed profiles
+    
+    // Parse command line arguments
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0) {
+            options.debug_mode = 1;
+        } else if (strcmp(argv[i], "--ast") == 0 || strcmp(argv[i], "--parse-only") == 0) {
+            options.ast_only_mode = 1;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+                   argv[i][2] <= '3' && argv[i][3] == '\0') {
+            options.optimization_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "-g") == 0) {
+            options.debug_info = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.profile = 1;
+        } else if (strcmp(argv[i], "--profile-generate") == 0) {
+            options.profile_generate = "gloin.profraw";
+        } else if (strncmp(argv[i], "--profile-generate=", 19) == 0 && argv[i][19]) {
+            options.profile_generate = argv[i] + 19;
+        } else if (strncmp(argv[i], "--profile-use=", 14) == 0 && argv[i][14]) {
+            profile_use = argv[i] + 14;
+        } else if (strcmp(argv[i], "-flto") == 0 || strcmp(argv[i], "-flto=full") == 0) {
+            options.lto = LTO_FULL;
+        } else if (strcmp(argv[i], "-flto=thin") == 0) {
+            options.lto = LTO_THIN;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            const char *kind = strcmp(argv[i] + 7, "bc") == 0 ? "llvm-bc" : argv[i] + 7;
+            int found = 0;
+            for (int k = 0; k < (int)(sizeof(emit_kinds) / sizeof(emit_kinds[0])); k++) {
+                if (strcmp(kind, emit_kinds[k].name) == 0) {
+                    options.emit = (EmitKind)k;
+                    found = 1;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Error: Unknown output kind '%s'\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0) {
+            options.emit = EMIT_OBJ;
+        } else if (strcmp(argv[i], "--whole-program") == 0) {
+            options.whole_program = 1;
+        } else if (strncmp(argv[i], "--codegen-threads=", 18) == 0) {
+            char *end;
+            long threads = strtol(argv[i] + 18, &end, 10);
+            if (end == argv[i] + 18 || *end != '\0' || threads < 1 || threads > 256) {
+                fprintf(stderr, "Error: Invalid thread count '%s'\n", argv[i] + 18);
+                return 1;
+            }
+            options.codegen_threads = (int)threads;
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            time_report = 1;
+        } else if (strcmp(argv[i], "--time-report=json") == 0) {
+            time_report = 2;
+        } else if (strcmp(argv[i], "--mem-report") == 0) {
+            mem_report = 1;
+        } else if (strcmp(argv[i], "--mem-report=json") == 0) {
+            mem_report = 2;
+        } else if (strncmp(argv[i], "--trace-out=", 12) == 0 && argv[i][12]) {
+            trace_file = argv[i] + 12;
+        } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
+            if (i + 1 < argc) {
+                options.output_name = argv[++i];
+            } else {
+                fprintf(stderr, "Error: %s requires an argument\n", argv[i]);
+                return 1;
+            }
+        } else {
+            // If no flag, treat as output name for backward compatibility
+            if (!options.output_name) {
+                options.output_name = argv[i]; // Don't use strdup here
+            } else {
+                fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+    
+    // Only text goes to stdout
+    if (options.output_name && strcmp(options.output_name, "-") == 0 &&
+        options.emit != EMIT_LLVM_IR && options.emit != EMIT_ASM) {
+        fprintf(stderr, "Error: -o - only writes --emit=llvm-ir or --emit=asm to stdout\n");
+        return 1;
+    }
+    
+    // Both instrument the optimized module right before emission, which the
+    // LTO link does on its own
+    if (options.lto != LTO_NONE && (options.profile || options.profile_generate)) {
+        fprintf(stderr, "Error: -flto cannot be combined with --profile or --profile-generate\n");
+        return 1;
+    }
+    // Under -flto, code is only optimized for good at link time
+    if (options.lto != LTO_NONE && options.emit != EMIT_EXECUTABLE &&
+        options.emit != EMIT_LLVM_BC) {
+        fprintf(stderr, "Error: -flto only links executables or emits llvm-bc\n");
+        return 1;
+    }
+    
+    if (trace_file && start_trace(trace_file) != 0) {
+        fprintf(stderr, "Error: Cannot write trace file '%s'\n", trace_file);
+        return 1;
+    }
+    TimeReport *report = time_report ? create_time_report() : NULL;
+    set_time_report(report);
+    MemReport *memory = mem_report ? create_mem_report() : NULL;
+    set_mem_report(memory);
+    
+    // LLVM reads one indexed profile, so merge whatever was given into one
+    char merged_profile[] = "/tmp/gloin-profile-XXXXXX";
+    if (profile_use) {
+        int fd = mkstemp(merged_profile);
+        if (fd < 0) {
+            fprintf(stderr, "Error: Cannot create a temporary profile\n");
+            return 1;
+        }
+        close(fd);
+        options.profile_use = merged_profile;
+        if (merge_profile_list(profile_use, merged_profile) != 0) {
+            remove(merged_profile);
+            return 1;
+        }
+    }
+    
+    int result = compile_file(&options);
+    if (options.profile_use) {
+        remove(merged_profile);
+    }
+    
+    if (report) {
+        set_time_report(NULL);
+        print_time_report(report, stderr, time_report == 2);
+        free_time_report(report);
+    }
+    if (memory) {
+        set_mem_report(NULL);
+        finish_mem_report(memory);
+        print_mem_report(memory, stderr, mem_report == 2);
+        free_mem_report(memory);
+    }
+    if (trace_file && finish_trace() != 0) {
+        fprintf(stderr, "Error: Cannot write trace file '%s'\n", trace_file);
+        result = 1;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--daemon") == 0) {
+        if (argc > 2) {
+            fprintf(stderr, "Error: --daemon takes no arguments\n");
+            return 1;
+        }
+        char *socket_path = daemon_socket_path();
+        int result = run_daemon(socket_path, run_command);
+        free(socket_path);
+        return result;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--connect") == 0) {
+        // Forward everything after --connect as the daemon's command line
+        argv[1] = argv[0];
+        char *socket_path = daemon_socket_path();
+        int result = run_daemon_client(socket_path, argc - 1, argv + 1);
+        free(socket_path);
+        return result;
+    }
+    
+    return run_command(argc, argv);
+}
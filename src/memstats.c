@@ -0,0 +1,356 @@
+#include "memstats.h"
+#include "types.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+static __thread MemReport *active_report = NULL;
+
+static const char *node_names[AST_NODE_TYPES] = {
+    "program", "import", "function", "parameter", "variable_decl",
+    "assignment", "pointer_assignment", "return", "call", "identifier",
+    "literal", "binary_op", "unary_op", "block", "struct", "struct_field",
+    "struct_method", "field_access", "method_call", "struct_literal", "enum",
+    "enum_variant", "if", "unless", "for", "while", "switch", "switch_case",
+    "match", "match_case", "break", "continue",
+};
+
+MemReport *create_mem_report(void) {
+    return calloc(1, sizeof(MemReport));
+}
+
+void free_mem_report(MemReport *report) {
+    free(report);
+}
+
+MemReport *set_mem_report(MemReport *report) {
+    MemReport *previous = active_report;
+    active_report = report;
+    return previous;
+}
+
+int mem_report_enabled(void) {
+    return active_report != NULL;
+}
+
+static long string_bytes(const char *text) {
+    return text ? (long)strlen(text) + 1 : 0;
+}
+
+static void measure_node(MemReport *report, const ASTNode *node);
+
+// Measures a child array and its nodes; returns the array's own size
+static long measure_list(MemReport *report, ASTNode **nodes, int count) {
+    for (int i = 0; i < count; i++) {
+        measure_node(report, nodes[i]);
+    }
+    return (long)count * (long)sizeof(ASTNode *);
+}
+
+static void measure_node(MemReport *report, const ASTNode *node) {
+    if (!node) {
+        return;
+    }
+
+    long strings = 0;
+    long lists = 0;
+    switch (node->type) {
+    case NODE_PROGRAM:
+        lists += measure_list(report, node->data.program.imports,
+                              node->data.program.import_count);
+        lists += measure_list(report, node->data.program.functions,
+                              node->data.program.function_count);
+        break;
+    case NODE_IMPORT:
+        strings += string_bytes(node->data.import.path);
+        break;
+    case NODE_FUNCTION:
+        strings += string_bytes(node->data.function.name);
+        strings += string_bytes(node->data.function.return_type);
+        lists += measure_list(report, node->data.function.params,
+                              node->data.function.param_count);
+        measure_node(report, node->data.function.body);
+        break;
+    case NODE_PARAMETER:
+        strings += string_bytes(node->data.parameter.name);
+        strings += string_bytes(node->data.parameter.type);
+        break;
+    case NODE_VARIABLE_DECL:
+        strings += string_bytes(node->data.variable_decl.name);
+        strings += string_bytes(node->data.variable_decl.type);
+        measure_node(report, node->data.variable_decl.value);
+        break;
+    case NODE_ASSIGNMENT:
+        strings += string_bytes(node->data.assignment.variable_name);
+        measure_node(report, node->data.assignment.value);
+        break;
+    case NODE_POINTER_ASSIGNMENT:
+        measure_node(report, node->data.pointer_assignment.target);
+        measure_node(report, node->data.pointer_assignment.value);
+        break;
+    case NODE_RETURN:
+        measure_node(report, node->data.return_stmt.value);
+        break;
+    case NODE_CALL:
+        strings += string_bytes(node->data.call.name);
+        lists += measure_list(report, node->data.call.args,
+                              node->data.call.arg_count);
+        break;
+    case NODE_IDENTIFIER:
+        strings += string_bytes(node->data.identifier.name);
+        break;
+    case NODE_LITERAL:
+        strings += string_bytes(node->data.literal.value);
+        strings += string_bytes(node->data.literal.type);
+        break;
+    case NODE_BINARY_OP:
+        measure_node(report, node->data.binary_op.left);
+        measure_node(report, node->data.binary_op.right);
+        break;
+    case NODE_UNARY_OP:
+        measure_node(report, node->data.unary_op.operand);
+        break;
+    case NODE_BLOCK:
+        lists += measure_list(report, node->data.block.statements,
+                              node->data.block.statement_count);
+        break;
+    case NODE_STRUCT:
+        strings += string_bytes(node->data.struct_decl.name);
+        lists += measure_list(report, node->data.struct_decl.fields,
+                              node->data.struct_decl.field_count);
+        lists += measure_list(report, node->data.struct_decl.methods,
+                              node->data.struct_decl.method_count);
+        break;
+    case NODE_STRUCT_FIELD:
+        strings += string_bytes(node->data.struct_field.name);
+        strings += string_bytes(node->data.struct_field.type);
+        break;
+    case NODE_STRUCT_METHOD:
+        strings += string_bytes(node->data.struct_method.name);
+        strings += string_bytes(node->data.struct_method.return_type);
+        lists += measure_list(report, node->data.struct_method.params,
+                              node->data.struct_method.param_count);
+        measure_node(report, node->data.struct_method.body);
+        break;
+    case NODE_FIELD_ACCESS:
+        strings += string_bytes(node->data.field_access.field_name);
+        measure_node(report, node->data.field_access.object);
+        break;
+    case NODE_METHOD_CALL:
+        strings += string_bytes(node->data.method_call.method_name);
+        measure_node(report, node->data.method_call.object);
+        lists += measure_list(report, node->data.method_call.args,
+                              node->data.method_call.arg_count);
+        break;
+    case NODE_STRUCT_LITERAL:
+        strings += string_bytes(node->data.struct_literal.struct_type_name);
+        for (int i = 0; i < node->data.struct_literal.field_count; i++) {
+            strings += string_bytes(node->data.struct_literal.field_names[i]);
+        }
+        lists += (long)node->data.struct_literal.field_count * sizeof(char *);
+        lists += measure_list(report, node->data.struct_literal.field_values,
+                              node->data.struct_literal.field_count);
+        break;
+    case NODE_ENUM:
+        strings += string_bytes(node->data.enum_decl.name);
+        lists += measure_list(report, node->data.enum_decl.variants,
+                              node->data.enum_decl.variant_count);
+        break;
+    case NODE_ENUM_VARIANT:
+        strings += string_bytes(node->data.enum_variant.name);
+        break;
+    case NODE_IF:
+        measure_node(report, node->data.if_stmt.condition);
+        measure_node(report, node->data.if_stmt.then_block);
+        measure_node(report, node->data.if_stmt.else_block);
+        break;
+    case NODE_UNLESS:
+        measure_node(report, node->data.unless_stmt.condition);
+        measure_node(report, node->data.unless_stmt.then_block);
+        measure_node(report, node->data.unless_stmt.else_block);
+        break;
+    case NODE_FOR:
+        measure_node(report, node->data.for_stmt.init);
+        measure_node(report, node->data.for_stmt.condition);
+        measure_node(report, node->data.for_stmt.update);
+        measure_node(report, node->data.for_stmt.body);
+        break;
+    case NODE_WHILE:
+        measure_node(report, node->data.while_stmt.condition);
+        measure_node(report, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH:
+        measure_node(report, node->data.switch_stmt.expression);
+        lists += measure_list(report, node->data.switch_stmt.cases,
+                              node->data.switch_stmt.case_count);
+        measure_node(report, node->data.switch_stmt.default_case);
+        break;
+    case NODE_SWITCH_CASE:
+        measure_node(report, node->data.switch_case.value);
+        lists += measure_list(report, node->data.switch_case.statements,
+                              node->data.switch_case.statement_count);
+        break;
+    case NODE_MATCH:
+        measure_node(report, node->data.match_stmt.expression);
+        lists += measure_list(report, node->data.match_stmt.cases,
+                              node->data.match_stmt.case_count);
+        break;
+    case NODE_MATCH_CASE:
+        measure_node(report, node->data.match_case.pattern);
+        measure_node(report, node->data.match_case.body);
+        break;
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        break;
+    }
+
+    AstNodeStats *stats = &report->nodes[node->type];
+    stats->count++;
+    stats->bytes += (long)sizeof(ASTNode) + lists + strings;
+    report->ast_string_bytes += strings;
+}
+
+void record_syntax_tree(const ASTNode *program) {
+    if (!active_report || !program) {
+        return;
+    }
+    active_report->trees++;
+    measure_node(active_report, program);
+}
+
+void record_token(const Token *token) {
+    if (!active_report) {
+        return;
+    }
+    active_report->tokens++;
+    active_report->token_bytes += string_bytes(token->value);
+}
+
+void record_symbol_tables(const CodeGen *codegen) {
+    if (!active_report) {
+        return;
+    }
+    long bytes = sizeof(codegen->variables) + sizeof(codegen->functions);
+    for (int i = 0; i < codegen->variable_count; i++) {
+        bytes += string_bytes(codegen->variables[i].name);
+    }
+    for (int i = 0; i < codegen->function_count; i++) {
+        bytes += string_bytes(codegen->functions[i].name);
+    }
+    active_report->code_generators++;
+    active_report->symbol_bytes += bytes;
+    active_report->functions += codegen->function_count;
+    if (codegen->peak_variable_count > active_report->peak_variables) {
+        active_report->peak_variables = codegen->peak_variable_count;
+    }
+}
+
+void record_llvm_module(LLVMModuleRef module) {
+    if (!active_report) {
+        return;
+    }
+    active_report->modules++;
+    for (LLVMValueRef function = LLVMGetFirstFunction(module); function;
+         function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) {
+            active_report->llvm_declarations++;
+            continue;
+        }
+        active_report->llvm_functions++;
+        for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+             block = LLVMGetNextBasicBlock(block)) {
+            active_report->llvm_blocks++;
+            for (LLVMValueRef instruction = LLVMGetFirstInstruction(block);
+                 instruction;
+                 instruction = LLVMGetNextInstruction(instruction)) {
+                active_report->llvm_instructions++;
+            }
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(module); global;
+         global = LLVMGetNextGlobal(global)) {
+        active_report->llvm_globals++;
+    }
+}
+
+void finish_mem_report(MemReport *report) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        report->peak_rss = usage.ru_maxrss;
+    }
+    report->structs = current_type_registry()->struct_count;
+}
+
+void print_mem_report(const MemReport *report, FILE *out, int json) {
+    long node_count = 0;
+    long node_bytes = 0;
+    for (int type = 0; type < AST_NODE_TYPES; type++) {
+        node_count += report->nodes[type].count;
+        node_bytes += report->nodes[type].bytes;
+    }
+
+    if (json) {
+        fprintf(out, "{\"peak_rss_kb\":%ld,\"ast\":{\"trees\":%ld,"
+                "\"nodes\":%ld,\"bytes\":%ld,\"string_bytes\":%ld,\"types\":[",
+                report->peak_rss, report->trees, node_count, node_bytes,
+                report->ast_string_bytes);
+        int first = 1;
+        for (int type = 0; type < AST_NODE_TYPES; type++) {
+            if (!report->nodes[type].count) {
+                continue;
+            }
+            fprintf(out, "%s{\"type\":\"%s\",\"count\":%ld,\"bytes\":%ld}",
+                    first ? "" : ",", node_names[type],
+                    report->nodes[type].count, report->nodes[type].bytes);
+            first = 0;
+        }
+        fprintf(out, "]},\"tokens\":{\"count\":%ld,\"bytes\":%ld},",
+                report->tokens, report->token_bytes);
+        fprintf(out, "\"symbols\":{\"code_generators\":%ld,\"bytes\":%ld,"
+                "\"peak_variables\":%d,\"functions\":%ld,\"structs\":%d},",
+                report->code_generators, report->symbol_bytes,
+                report->peak_variables, report->functions, report->structs);
+        fprintf(out, "\"llvm\":{\"modules\":%ld,\"functions\":%ld,"
+                "\"declarations\":%ld,\"globals\":%ld,\"blocks\":%ld,"
+                "\"instructions\":%ld}}\n",
+                report->modules, report->llvm_functions,
+                report->llvm_declarations, report->llvm_globals,
+                report->llvm_blocks, report->llvm_instructions);
+        return;
+    }
+
+    fprintf(out, "===---------------------------------------------------------------------===\n");
+    fprintf(out, "                           Gloin memory report\n");
+    fprintf(out, "===---------------------------------------------------------------------===\n");
+    fprintf(out, "  Peak RSS: %ld KB\n\n", report->peak_rss);
+
+    fprintf(out, "  %-36s %12s %12s\n", "Syntax tree node", "Count", "Bytes");
+    for (int type = 0; type < AST_NODE_TYPES; type++) {
+        if (report->nodes[type].count) {
+            fprintf(out, "  %-36s %12ld %12ld\n", node_names[type],
+                    report->nodes[type].count, report->nodes[type].bytes);
+        }
+    }
+    fprintf(out, "  %-36s %12ld %12ld\n", "total", node_count, node_bytes);
+    fprintf(out, "  %-36s %12s %12ld\n", "  of which strings", "",
+            report->ast_string_bytes);
+    fprintf(out, "  %-36s %12ld\n\n", "syntax trees", report->trees);
+
+    fprintf(out, "  %-36s %12ld %12ld\n", "Tokens", report->tokens,
+            report->token_bytes);
+    fprintf(out, "  %-36s %12ld %12ld\n", "Symbol tables",
+            report->code_generators, report->symbol_bytes);
+    fprintf(out, "    %-34s %12d\n", "largest variable table",
+            report->peak_variables);
+    fprintf(out, "    %-34s %12ld\n", "function entries", report->functions);
+    fprintf(out, "  %-36s %12d\n\n", "Registered structs", report->structs);
+
+    fprintf(out, "  %-36s %12ld\n", "LLVM modules", report->modules);
+    fprintf(out, "    %-34s %12ld\n", "functions", report->llvm_functions);
+    fprintf(out, "    %-34s %12ld\n", "declarations",
+            report->llvm_declarations);
+    fprintf(out, "    %-34s %12ld\n", "globals", report->llvm_globals);
+    fprintf(out, "    %-34s %12ld\n", "basic blocks", report->llvm_blocks);
+    fprintf(out, "    %-34s %12ld\n", "instructions",
+            report->llvm_instructions);
+}
@@ -0,0 +1,315 @@
+#include "parallel.h"
+#include "diagnostics.h"
+#include "memstats.h"
+#include "passes.h"
+#include "timing.h"
+#include "trace.h"
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Partitions aim for this many IR instructions; small modules stay whole
+#define PARTITION_INSTRUCTIONS 16384
+#define MAX_PARTITIONS 16
+
+typedef struct {
+    const char *bitcode;
+    size_t bitcode_size;
+    int optimization_level;
+
+    int function_count;
+    int *function_partition;  // Per function in module order, -1 if declared
+
+    int partition_count;
+    char **paths;
+    char **errors;            // Per partition, NULL on success
+    TimeReport **reports;     // Per partition when timing, else NULL
+    unsigned next_partition;
+} PartitionJob;
+
+static int is_local_linkage(LLVMLinkage linkage) {
+    return linkage == LLVMInternalLinkage || linkage == LLVMPrivateLinkage;
+}
+
+static int count_instructions(LLVMValueRef function) {
+    int count = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+         block = LLVMGetNextBasicBlock(block)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Assign consecutive runs of functions to partitions of roughly equal size.
+// Only the module decides the split, so the thread count cannot change it.
+static int partition_functions(LLVMModuleRef module, PartitionJob *job) {
+    int count = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+         fn = LLVMGetNextFunction(fn)) {
+        count++;
+    }
+
+    job->function_count = count;
+    job->function_partition = malloc((count ? count : 1) * sizeof(int));
+
+    long total = 0;
+    int defined = 0;
+    int index = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+         fn = LLVMGetNextFunction(fn), index++) {
+        if (LLVMIsDeclaration(fn)) {
+            job->function_partition[index] = -1;
+        } else {
+            // Sizes are parked here until the partitions are known
+            job->function_partition[index] = count_instructions(fn) + 1;
+            total += job->function_partition[index];
+            defined++;
+        }
+    }
+
+    long partitions =
+        (total + PARTITION_INSTRUCTIONS - 1) / PARTITION_INSTRUCTIONS;
+    if (partitions > MAX_PARTITIONS) {
+        partitions = MAX_PARTITIONS;
+    }
+    if (partitions > defined) {
+        partitions = defined;
+    }
+    if (partitions < 1) {
+        partitions = 1;
+    }
+
+    // A function goes to the partition its midpoint falls into
+    long before = 0;
+    for (int i = 0; i < count; i++) {
+        int size = job->function_partition[i];
+        if (size < 0) {
+            continue;
+        }
+        job->function_partition[i] =
+            (int)((before + size / 2) * partitions / total);
+        before += size;
+    }
+    return (int)partitions;
+}
+
+// Reduce a copy of the module to the definitions owned by one partition
+static void isolate_partition(LLVMModuleRef module, PartitionJob *job,
+                              int partition) {
+    // Functions: keep our own; the rest stay available for inlining until
+    // the pipeline turns them into declarations
+    int index = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+         fn = LLVMGetNextFunction(fn), index++) {
+        if (index >= job->function_count ||
+            job->function_partition[index] < 0) {
+            continue;
+        }
+        if (is_local_linkage(LLVMGetLinkage(fn))) {
+            LLVMSetLinkage(fn, LLVMExternalLinkage);
+            LLVMSetVisibility(fn, LLVMHiddenVisibility);
+        }
+        if (job->function_partition[index] != partition) {
+            LLVMSetLinkage(fn, LLVMAvailableExternallyLinkage);
+        }
+    }
+
+    // Globals: local constants may be copied into every partition, anything
+    // else must have a single definition, which partition 0 provides
+    LLVMValueRef next;
+    for (LLVMValueRef global = LLVMGetFirstGlobal(module); global;
+         global = next) {
+        next = LLVMGetNextGlobal(global);
+        if (LLVMIsDeclaration(global)) {
+            continue;
+        }
+        LLVMLinkage linkage = LLVMGetLinkage(global);
+        if (linkage == LLVMAppendingLinkage) {
+            // llvm.global_ctors: the constructors run once, from partition 0
+            if (partition != 0) {
+                LLVMDeleteGlobal(global);
+            }
+            continue;
+        }
+        if (is_local_linkage(linkage)) {
+            if (LLVMIsGlobalConstant(global)) {
+                continue;
+            }
+            LLVMSetLinkage(global, LLVMExternalLinkage);
+            LLVMSetVisibility(global, LLVMHiddenVisibility);
+        }
+        if (partition != 0) {
+            LLVMSetLinkage(global, LLVMAvailableExternallyLinkage);
+        }
+    }
+}
+
+// Optimize and emit one partition in a private context. Returns NULL or a
+// malloc'd error message.
+static char *emit_partition(PartitionJob *job, int partition) {
+    char *error_msg = NULL;
+    char *failure = NULL;
+    double span = trace_begin();
+
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRange(
+        job->bitcode, job->bitcode_size, "partition", 0);
+    LLVMModuleRef module = NULL;
+    if (LLVMParseBitcodeInContext2(context, buffer, &module)) {
+        LLVMDisposeMemoryBuffer(buffer);
+        LLVMContextDispose(context);
+        return strdup("cannot read module bitcode");
+    }
+    LLVMDisposeMemoryBuffer(buffer);
+
+    isolate_partition(module, job, partition);
+
+    LLVMTargetMachineRef target_machine =
+        create_target_machine(module, job->optimization_level, &error_msg);
+    if (!target_machine) {
+        failure = strdup(error_msg);
+        LLVMDisposeMessage(error_msg);
+    } else {
+        if (optimize_module(module, target_machine, job->optimization_level,
+                            LTO_NONE, NULL, &error_msg) != 0) {
+            failure = strdup(error_msg);
+            LLVMDisposeErrorMessage(error_msg);
+        } else if (job->optimization_level <= 0) {
+            // The pipeline would have dropped other partitions' code
+            LLVMErrorRef error = run_pass_pipeline(
+                module, "elim-avail-extern,globaldce", target_machine, NULL);
+            if (error) {
+                error_msg = LLVMGetErrorMessage(error);
+                failure = strdup(error_msg);
+                LLVMDisposeErrorMessage(error_msg);
+            }
+        }
+
+        if (!failure) {
+            TimePoint start = time_now();
+            if (LLVMTargetMachineEmitToFile(target_machine, module,
+                                            job->paths[partition],
+                                            LLVMObjectFile, &error_msg)) {
+                failure = strdup(error_msg);
+                LLVMDisposeMessage(error_msg);
+            }
+            record_time(TIMING_EMIT, job->paths[partition], start);
+        }
+        LLVMDisposeTargetMachine(target_machine);
+    }
+
+    LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    trace_end(span, "emit", "partition", job->paths[partition], NULL);
+    return failure;
+}
+
+static void *partition_worker(void *arg) {
+    PartitionJob *job = arg;
+    for (;;) {
+        int partition = (int)__atomic_fetch_add(&job->next_partition, 1,
+                                                __ATOMIC_RELAXED);
+        if (partition >= job->partition_count) {
+            return NULL;
+        }
+        TimeReport *previous =
+            job->reports ? set_time_report(job->reports[partition]) : NULL;
+        job->errors[partition] = emit_partition(job, partition);
+        if (job->reports) {
+            set_time_report(previous);
+        }
+    }
+}
+
+static void *worker_thread(void *arg) {
+    trace_thread_name("codegen worker");
+    return partition_worker(arg);
+}
+
+int write_partitioned_objects(CodeGen *codegen, const char *base, int threads,
+                              char ***paths, int *count) {
+    PartitionJob job;
+    memset(&job, 0, sizeof(job));
+    job.optimization_level = codegen->optimization_level;
+    // Partitions duplicate what they import, so count the whole module
+    record_llvm_module(codegen->module);
+    job.partition_count = partition_functions(codegen->module, &job);
+
+    // Workers read the module from bitcode; contexts are not shareable
+    LLVMMemoryBufferRef bitcode =
+        LLVMWriteBitcodeToMemoryBuffer(codegen->module);
+    job.bitcode = LLVMGetBufferStart(bitcode);
+    job.bitcode_size = LLVMGetBufferSize(bitcode);
+
+    job.paths = malloc(job.partition_count * sizeof(char *));
+    job.errors = calloc(job.partition_count, sizeof(char *));
+    TimeReport *report = current_time_report();
+    if (report) {
+        job.reports = malloc(job.partition_count * sizeof(TimeReport *));
+        for (int i = 0; i < job.partition_count; i++) {
+            job.reports[i] = create_time_report();
+        }
+    }
+    for (int i = 0; i < job.partition_count; i++) {
+        job.paths[i] = malloc(strlen(base) + 16);
+        sprintf(job.paths[i], "%s.%d.o", base, i);
+    }
+
+    if (threads > job.partition_count) {
+        threads = job.partition_count;
+    }
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, worker_thread, &job)) {
+            break;
+        }
+        started++;
+    }
+    partition_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    // Report in partition order so the output does not depend on scheduling
+    if (job.reports) {
+        for (int i = 0; i < job.partition_count; i++) {
+            merge_time_report(report, job.reports[i]);
+            free_time_report(job.reports[i]);
+        }
+        free(job.reports);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < job.partition_count; i++) {
+        if (job.errors[i]) {
+            report_error("Error writing object file %s: %s\n", job.paths[i],
+                         job.errors[i]);
+            free(job.errors[i]);
+            failed = 1;
+        }
+    }
+
+    if (failed) {
+        for (int i = 0; i < job.partition_count; i++) {
+            remove(job.paths[i]);
+            free(job.paths[i]);
+        }
+        free(job.paths);
+    } else {
+        *paths = job.paths;
+        *count = job.partition_count;
+    }
+
+    free(job.errors);
+    free(job.function_partition);
+    LLVMDisposeMemoryBuffer(bitcode);
+    return failed;
+}
@@ -1,17 +1,59 @@
 #define _GNU_SOURCE
 #include "parser.h"
+#include "astcache.h"
+#include "diagnostics.h"
+#include "interface.h"
+#include "memstats.h"
+#include "timing.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// The lexer runs on demand, token by token, unless lexing is timed: reading
+// the clocks around every token would cost more than lexing it, so then
+// the input is lexed in one go, before parsing starts
+static void lex_input(Parser *parser) {
+    TimePoint start = time_now();
+    int capacity = 256;
+    parser->tokens = malloc(capacity * sizeof(Token));
+    do {
+        if (parser->token_count == capacity) {
+            capacity *= 2;
+            parser->tokens = realloc(parser->tokens, capacity * sizeof(Token));
+        }
+        parser->tokens[parser->token_count] = next_token(parser->lexer);
+    } while (parser->tokens[parser->token_count++].type != TOKEN_EOF);
+    add_time(TIMING_LEX, NULL, time_since(start));
+}
+
+static Token lex_token(Parser *parser) {
+    Token token;
+    if (parser->token_index < parser->token_count) {
+        token = parser->tokens[parser->token_index++];
+    } else {
+        token = next_token(parser->lexer);
+    }
+    record_token(&token);
+    return token;
+}
+
 Parser *create_parser(Lexer *lexer) {
-    Parser *parser = malloc(sizeof(Parser));
+    Parser *parser = calloc(1, sizeof(Parser));
     parser->lexer = lexer;
-    parser->current_token = next_token(lexer);
+    if (timing_enabled()) {
+        lex_input(parser);
+    }
+    parser->current_token = lex_token(parser);
     return parser;
 }
 
 void free_parser(Parser *parser) {
+    // Tokens a syntax error left unread
+    for (int i = parser->token_index; i < parser->token_count; i++) {
+        free_token(&parser->tokens[i]);
+    }
+    free(parser->tokens);
     free_token(&parser->current_token);
     free(parser);
 }
@@ -19,125 +61,135 @@ void free_parser(Parser *parser) {
 void eat(Parser *parser, TokenType expected_type) {
     if (parser->current_token.type == expected_type) {
         free_token(&parser->current_token);
-        parser->current_token = next_token(parser->lexer);
+        parser->current_token = lex_token(parser);
     } else {
-        fprintf(stderr, "Parser error: expected %s, got %s at line %d\n",
-                token_type_to_string(expected_type),
-                token_type_to_string(parser->current_token.type),
-                parser->current_token.line);
-        exit(1);
+        report_error("Parser error: expected %s, got %s at line %d\n",
+                     token_type_to_string(expected_type),
+                     token_type_to_string(parser->current_token.type),
+                     parser->current_token.line);
+        parser->has_error = 1;
+        longjmp(parser->error_jump, 1);
     }
 }
 
 void parser_error(Parser *parser, const char *message) {
-    fprintf(stderr, "Parser error: %s at line %d, column %d\n",
-            message, parser->current_token.line, parser->current_token.column);
-    exit(1);
+    report_error("Parser error: %s at line %d, column %d\n",
+                 message, parser->current_token.line, parser->current_token.column);
+    parser->has_error = 1;
+    longjmp(parser->error_jump, 1);
+}
+
+// The type of the token `distance` tokens after the current one, lexed
+// ahead on a copy of the lexer
+static TokenType peek_token(Parser *parser, int distance) {
+    if (parser->token_index < parser->token_count) {
+        int index = parser->token_index - 1 + distance;
+        return index < parser->token_count ? parser->tokens[index].type : TOKEN_EOF;
+    }
+    Lexer saved = *parser->lexer;
+    TokenType type = parser->current_token.type;
+    for (int i = 0; i < distance && type != TOKEN_EOF; i++) {
+        Token token = next_token(parser->lexer);
+        type = token.type;
+        free_token(&token);
+    }
+    *parser->lexer = saved;
+    return type;
+}
+
+static ASTNode *parse_variable_declaration_after_def(Parser *parser);
+
+// Parse one top-level import or declaration into program
+static void parse_declaration(Parser *parser, ASTNode *program) {
+    if (parser->current_token.type == TOKEN_IMPORT) {
+        ASTNode *import = parse_import(parser);
+        add_import_to_program(program, import);
+    } else if (parser->current_token.type == TOKEN_DEF) {
+        // Parse def declarations: const, mut, functions, structs, enums
+        int line = parser->current_token.line;
+        int column = parser->current_token.column;
+        eat(parser, TOKEN_DEF); // Consume DEF token first
+        
+        // Look at the next token to determine what kind of declaration this is
+        if (parser->current_token.type == TOKEN_CONST || parser->current_token.type == TOKEN_MUT) {
+            // Variable declaration: def const/mut name: type = value
+            ASTNode *var_decl = parse_variable_declaration_after_def(parser);
+            if (var_decl) {
+                set_node_location(var_decl, line, column);
+                add_function_to_program(program, var_decl);
+            }
+        } else if (parser->current_token.type == TOKEN_STRUCT) {
+            // Struct declaration: def struct Name { ... }
+            ASTNode *struct_decl = parse_struct_declaration(parser);
+            set_node_location(struct_decl, line, column);
+            add_function_to_program(program, struct_decl);
+        } else if (parser->current_token.type == TOKEN_ENUM) {
+            // Enum declaration: def enum Name { ... }
+            ASTNode *enum_decl = parse_enum_declaration(parser);
+            set_node_location(enum_decl, line, column);
+            add_function_to_program(program, enum_decl);
+        } else if (parser->current_token.type == TOKEN_IDENTIFIER) {
+            // Function declaration: def name(params) -> type { ... }
+            ASTNode *function = parse_function_declaration(parser);
+            set_node_location(function, line, column);
+            add_function_to_program(program, function);
+        } else {
+            parser_error(parser, "Expected const, mut, struct, enum, or function name after 'def'");
+        }
+    } else {
+        parser_error(parser, "Expected import or def declaration");
+    }
 }
 
 ASTNode *parse_program(Parser *parser) {
-    ASTNode *program = create_program_node();
+    ASTNode *volatile program = create_program_node();
     
-    // Skip initial newlines
-    while (parser->current_token.type == TOKEN_NEWLINE) {
-        eat(parser, TOKEN_NEWLINE);
+    // Syntax errors unwind back here
+    if (setjmp(parser->error_jump) != 0) {
+        free_ast_node(program);
+        return NULL;
     }
     
     while (parser->current_token.type != TOKEN_EOF) {
-        if (parser->current_token.type == TOKEN_IMPORT) {
-            ASTNode *import = parse_import(parser);
-            add_import_to_program(program, import);
-        } else if (parser->current_token.type == TOKEN_DEF) {
-            // Parse def declarations: const, mut, functions, structs, enums
-            eat(parser, TOKEN_DEF); // Consume DEF token first
-            
-            // Look at the next token to determine what kind of declaration this is
-            if (parser->current_token.type == TOKEN_CONST || parser->current_token.type == TOKEN_MUT) {
-                // Variable declaration: def const/mut name: type = value
-                // Need to restore DEF token for parse_variable_declaration
-                // Simple approach: create a new token and put it back
-                Token def_token;
-                def_token.type = TOKEN_DEF;
-                def_token.value = strdup("def");
-                def_token.line = parser->current_token.line;
-                def_token.column = parser->current_token.column - 3; // "def" is 3 chars
-                
-                // We need to backup and let parse_variable_declaration handle it properly
-                // For now, manually handle const/mut variable declarations here
-                int is_const = (parser->current_token.type == TOKEN_CONST);
-                eat(parser, parser->current_token.type); // eat const or mut
-                
-                if (parser->current_token.type != TOKEN_IDENTIFIER) {
-                    parser_error(parser, "Expected variable name");
-                }
-                
-                char *var_name = strdup(parser->current_token.value);
-                eat(parser, TOKEN_IDENTIFIER);
-                
-                eat(parser, TOKEN_COLON);
-                
-                // Parse type
-                char *var_type = NULL;
-                if (parser->current_token.type == TOKEN_I8) {
-                    var_type = strdup("i8");
-                    eat(parser, TOKEN_I8);
-                } else if (parser->current_token.type == TOKEN_I16) {
-                    var_type = strdup("i16");
-                    eat(parser, TOKEN_I16);
-                } else if (parser->current_token.type == TOKEN_I32) {
-                    var_type = strdup("i32");
-                    eat(parser, TOKEN_I32);
-                } else if (parser->current_token.type == TOKEN_I64) {
-                    var_type = strdup("i64");
-                    eat(parser, TOKEN_I64);
-                } else if (parser->current_token.type == TOKEN_F32) {
-                    var_type = strdup("f32");
-                    eat(parser, TOKEN_F32);
-                } else if (parser->current_token.type == TOKEN_F64) {
-                    var_type = strdup("f64");
-                    eat(parser, TOKEN_F64);
-                } else if (parser->current_token.type == TOKEN_STRING_TYPE) {
-                    var_type = strdup("string");
-                    eat(parser, TOKEN_STRING_TYPE);
-                } else if (parser->current_token.type == TOKEN_VOID) {
-                    var_type = strdup("void");
-                    eat(parser, TOKEN_VOID);
-                } else if (parser->current_token.type == TOKEN_IDENTIFIER) {
-                    var_type = strdup(parser->current_token.value);
-                    eat(parser, TOKEN_IDENTIFIER);
-                } else {
-                    parser_error(parser, "Expected variable type");
-                }
-                
-                eat(parser, TOKEN_ASSIGN);
-                ASTNode *value = parse_expression(parser);
-                eat(parser, TOKEN_SEMICOLON);
-                
-                ASTNode *var_decl = create_variable_decl_node(var_name, var_type, value, is_const ? -1 : 1);
-                add_function_to_program(program, var_decl);
-                
-                free(var_name);
-                free(var_type);
-                free_token(&def_token);
-            } else if (parser->current_token.type == TOKEN_STRUCT) {
-                // Struct declaration: def struct Name { ... }
-                ASTNode *struct_decl = parse_struct_declaration(parser);
-                add_function_to_program(program, struct_decl);
-            } else if (parser->current_token.type == TOKEN_ENUM) {
-                // Enum declaration: def enum Name { ... }
-                ASTNode *enum_decl = parse_enum_declaration(parser);
-                add_function_to_program(program, enum_decl);
-            } else if (parser->current_token.type == TOKEN_IDENTIFIER) {
-                // Function declaration: def name(params) -> type { ... }
-                ASTNode *function = parse_function_declaration(parser);
-                add_function_to_program(program, function);
-            } else {
-                parser_error(parser, "Expected const, mut, struct, enum, or function name after 'def'");
-            }
-        } else if (parser->current_token.type == TOKEN_NEWLINE) {
+        if (parser->current_token.type == TOKEN_NEWLINE) {
+            eat(parser, TOKEN_NEWLINE);
+        } else {
+            parse_declaration(parser, program);
+        }
+    }
+    
+    return program;
+}
+
+// Whether the current token starts a declaration rather than a statement:
+// an import, or def followed by struct, enum or a function name and '('
+static int at_declaration(Parser *parser) {
+    if (parser->current_token.type == TOKEN_IMPORT) {
+        return 1;
+    }
+    if (parser->current_token.type != TOKEN_DEF) {
+        return 0;
+    }
+    TokenType next = peek_token(parser, 1);
+    return next == TOKEN_STRUCT || next == TOKEN_ENUM ||
+           (next == TOKEN_IDENTIFIER && peek_token(parser, 2) == TOKEN_LPAREN);
+}
+
+ASTNode *parse_partial_program(Parser *parser) {
+    ASTNode *volatile program = create_program_node();
+    
+    if (setjmp(parser->error_jump) != 0) {
+        free_ast_node(program);
+        return NULL;
+    }
+    
+    while (parser->current_token.type != TOKEN_EOF) {
+        if (parser->current_token.type == TOKEN_NEWLINE) {
             eat(parser, TOKEN_NEWLINE);
+        } else if (at_declaration(parser)) {
+            parse_declaration(parser, program);
         } else {
-            parser_error(parser, "Expected import or def declaration");
+            add_function_to_program(program, parse_statement(parser));
         }
     }
     
@@ -434,6 +486,8 @@ ASTNode *parse_struct_declaration(Parser *parser) {
             // Parse method
             Visibility visibility = parser->current_token.type == TOKEN_PUB ? VISIBILITY_PUBLIC : VISIBILITY_PRIVATE;
             TokenType vis_token = parser->current_token.type;
+            int method_line = parser->current_token.line;
+            int method_column = parser->current_token.column;
             eat(parser, vis_token);  // eat pub or priv
             
             if (parser->current_token.type != TOKEN_IDENTIFIER) {
@@ -446,6 +500,7 @@ ASTNode *parse_struct_declaration(Parser *parser) {
             eat(parser, TOKEN_LPAREN);
             
             ASTNode *method = create_struct_method_node(method_name, "void", visibility);
+            set_node_location(method, method_line, method_column);
             
             // Parse parameters
             while (parser->current_token.type != TOKEN_RPAREN) {
@@ -704,7 +759,7 @@ ASTNode *parse_block(Parser *parser) {
     return block;
 }
 
-ASTNode *parse_statement(Parser *parser) {
+static ASTNode *parse_statement_node(Parser *parser) {
     if (parser->current_token.type == TOKEN_DEF) {
         return parse_variable_declaration(parser);
     } else if (parser->current_token.type == TOKEN_RETURN) {
@@ -731,9 +786,22 @@ ASTNode *parse_statement(Parser *parser) {
     }
 }
 
+ASTNode *parse_statement(Parser *parser) {
+    int line = parser->current_token.line;
+    int column = parser->current_token.column;
+    ASTNode *statement = parse_statement_node(parser);
+    set_node_location(statement, line, column);
+    return statement;
+}
+
 ASTNode *parse_variable_declaration(Parser *parser) {
     eat(parser, TOKEN_DEF);
-    
+    return parse_variable_declaration_after_def(parser);
+}
+
+// The rest of a declaration once def is consumed, which top-level
+// declarations need to look past
+static ASTNode *parse_variable_declaration_after_def(Parser *parser) {
     // Check for mutability modifiers
     int is_mutable = 0;  // Default: immutable
     if (parser->current_token.type == TOKEN_MUT) {
@@ -1300,7 +1368,7 @@ ASTNode *parse_multiplicative_expression(Parser *parser) {
     return left;
 }
 
-ASTNode *parse_primary(Parser *parser) {
+static ASTNode *parse_primary_node(Parser *parser) {
     if (parser->current_token.type == TOKEN_AMPERSAND) {
         // Address-of operator
         eat(parser, TOKEN_AMPERSAND);
@@ -1311,6 +1379,17 @@ ASTNode *parse_primary(Parser *parser) {
         eat(parser, TOKEN_MULTIPLY);
         ASTNode *operand = parse_primary(parser);
         return create_unary_op_node(UNARY_DEREFERENCE, operand);
+    } else if (parser->current_token.type == TOKEN_COMPTIME) {
+        // comptime f(...) is a call of the builtin "comptime" with the call
+        // to evaluate while compiling as its argument
+        eat(parser, TOKEN_COMPTIME);
+        ASTNode *call = parse_primary(parser);
+        if (call->type != NODE_CALL) {
+            parser_error(parser, "Expected a function call after 'comptime'");
+        }
+        ASTNode *comptime = create_call_node("comptime");
+        add_arg_to_call(comptime, call);
+        return comptime;
     } else if (parser->current_token.type == TOKEN_LPAREN) {
         eat(parser, TOKEN_LPAREN);
         ASTNode *expr = parse_expression(parser);
@@ -1460,6 +1539,14 @@ ASTNode *parse_primary(Parser *parser) {
     }
 }
 
+ASTNode *parse_primary(Parser *parser) {
+    int line = parser->current_token.line;
+    int column = parser->current_token.column;
+    ASTNode *node = parse_primary_node(parser);
+    set_node_location(node, line, column);
+    return node;
+}
+
 ASTNode *parse_call(Parser *parser, const char *name) {
     ASTNode *call = create_call_node(name);
     
@@ -1480,3 +1567,74 @@ ASTNode *parse_call(Parser *parser, const char *name) {
     
     return call;
 }
+
+char *read_file(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        report_error("Error: Could not open file %s\n", filename);
+        return NULL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    char *content = malloc(length + 1);
+    fread(content, 1, length, file);
+    content[length] = '\0';
+    
+    fclose(file);
+    return content;
+}
+
+ASTNode *parse_file(const char *filename) {
+    double span = trace_begin();
+    TimePoint start = time_now();
+    char *content = read_file(filename);
+    record_time(TIMING_READ, filename, start);
+    if (!content) {
+        return NULL;
+    }
+    
+    // Reuse the cached AST when the source is unchanged
+    size_t size = strlen(content);
+    uint64_t hash = hash_bytes(content, size, 0);
+    int use_cache = getenv("GLOIN_NO_CACHE") == NULL;
+    char *cache_path = use_cache ? module_cache_path(filename, ".gloinast") : NULL;
+    if (use_cache) {
+        start = time_now();
+        ASTNode *cached = find_cached_ast(filename, cache_path, hash, size);
+        record_time(TIMING_LOAD_CACHE, filename, start);
+        if (cached) {
+            record_syntax_tree(cached);
+            free(cache_path);
+            free(content);
+            trace_end(span, "parse", "load cached AST", filename, NULL);
+            return cached;
+        }
+    }
+    
+    // When timed, the input is lexed before the parse starts
+    Lexer *lexer = create_lexer(content);
+    Parser *parser = create_parser(lexer);
+    
+    start = time_now();
+    ASTNode *ast = parse_program(parser);
+    record_time(TIMING_PARSE, filename, start);
+    
+    record_syntax_tree(ast);
+    
+    // A failed write only costs a re-parse next time
+    if (ast && use_cache) {
+        store_parsed_ast(filename, cache_path, ast, hash, size);
+    }
+    
+    // Clean up lexer and parser, but keep the AST
+    free_parser(parser);
+    free_lexer(lexer);
+    free(content);
+    free(cache_path);
+    
+    trace_end(span, "parse", "parse", filename, NULL);
+    return ast;
+}
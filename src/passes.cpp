@@ -0,0 +1,144 @@
+#include "passes.h"
+#include "timing.h"
+#include "trace.h"
+#include <llvm/Analysis/LazyCallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Target/TargetMachine.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Managers and adaptors only wrap the passes that do the work
+static bool is_wrapper_pass(StringRef pass) {
+    return isSpecialPass(pass, {"PassManager", "PassAdaptor",
+                                "AnalysisManagerProxy", "DevirtSCCRepeatedPass",
+                                "ModuleInlinerWrapperPass"});
+}
+
+struct RunningPass {
+    TimePoint start;
+    double span;
+};
+
+// The module and function a pass runs on, to tag its trace span
+static void describe_ir(Any ir, std::string &file, std::string &function) {
+    const Module *module = nullptr;
+    const Function *owner = nullptr;
+    if (any_isa<const Module *>(ir)) {
+        module = any_cast<const Module *>(ir);
+    } else if (any_isa<const Function *>(ir)) {
+        owner = any_cast<const Function *>(ir);
+    } else if (any_isa<const Loop *>(ir)) {
+        owner = any_cast<const Loop *>(ir)->getHeader()->getParent();
+    } else if (any_isa<const LazyCallGraph::SCC *>(ir)) {
+        const LazyCallGraph::SCC *scc = any_cast<const LazyCallGraph::SCC *>(ir);
+        function = scc->getName();
+        if (scc->size() > 0) {
+            module = scc->begin()->getFunction().getParent();
+        }
+    }
+    if (owner) {
+        function = owner->getName().str();
+        module = owner->getParent();
+    }
+    if (module) {
+        file = module->getModuleIdentifier();
+    }
+}
+
+static void observe_passes(PassInstrumentationCallbacks &callbacks,
+                           std::vector<RunningPass> &running) {
+    callbacks.registerBeforeNonSkippedPassCallback(
+        [&running](StringRef pass, Any) {
+            if (!is_wrapper_pass(pass)) {
+                running.push_back({time_now(), trace_begin()});
+            }
+        });
+
+    auto finish = [&running](StringRef pass, const Any *ir) {
+        if (is_wrapper_pass(pass) || running.empty()) {
+            return;
+        }
+        std::string name = pass.str();
+        record_time(TIMING_OPTIMIZE, name.c_str(), running.back().start);
+        if (tracing_enabled()) {
+            // Passes that invalidate their IR unit can no longer name it
+            std::string file, function;
+            if (ir) {
+                describe_ir(*ir, file, function);
+            }
+            trace_end(running.back().span, "pass", name.c_str(),
+                      file.empty() ? nullptr : file.c_str(),
+                      function.empty() ? nullptr : function.c_str());
+        }
+        running.pop_back();
+    };
+    callbacks.registerAfterPassCallback(
+        [finish](StringRef pass, Any ir, const PreservedAnalyses &) {
+            finish(pass, &ir);
+        });
+    callbacks.registerAfterPassInvalidatedCallback(
+        [finish](StringRef pass, const PreservedAnalyses &) {
+            finish(pass, nullptr);
+        });
+}
+
+static Optional<PGOOptions> pgo_options(const PassProfile *profile) {
+    if (profile && profile->generate) {
+        // Gloin has no indirect calls, and the bundled runtime (pgo.h)
+        // writes no value profiles
+        static std::once_flag once;
+        std::call_once(once, [] {
+            const char *args[] = {"gloinc", "-disable-vp"};
+            cl::ParseCommandLineOptions(2, args);
+        });
+        return PGOOptions(profile->generate, "", "", PGOOptions::IRInstr);
+    }
+    if (profile && profile->use) {
+        return PGOOptions(profile->use, "", "", PGOOptions::IRUse);
+    }
+    return None;
+}
+
+LLVMErrorRef run_pass_pipeline(LLVMModuleRef module, const char *passes,
+                               LLVMTargetMachineRef target_machine,
+                               const PassProfile *profile) {
+    TargetMachine *machine = reinterpret_cast<TargetMachine *>(target_machine);
+
+    PassInstrumentationCallbacks callbacks;
+    std::vector<RunningPass> running;
+    if (timing_enabled() || tracing_enabled()) {
+        observe_passes(callbacks, running);
+    }
+
+    PassBuilder builder(machine, PipelineTuningOptions(), pgo_options(profile),
+                        &callbacks);
+    LoopAnalysisManager loop_analyses;
+    FunctionAnalysisManager function_analyses;
+    CGSCCAnalysisManager cgscc_analyses;
+    ModuleAnalysisManager module_analyses;
+    builder.registerLoopAnalyses(loop_analyses);
+    builder.registerFunctionAnalyses(function_analyses);
+    builder.registerCGSCCAnalyses(cgscc_analyses);
+    builder.registerModuleAnalyses(module_analyses);
+    builder.crossRegisterProxies(loop_analyses, function_analyses,
+                                 cgscc_analyses, module_analyses);
+
+    StandardInstrumentations instrumentations(false);
+    instrumentations.registerCallbacks(callbacks, &function_analyses);
+
+    ModulePassManager pass_manager;
+    if (Error error = builder.parsePassPipeline(pass_manager, passes)) {
+        return wrap(std::move(error));
+    }
+    pass_manager.run(*unwrap(module), module_analyses);
+    return LLVMErrorSuccess;
+}
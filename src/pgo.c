@@ -0,0 +1,235 @@
+#include "pgo.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The raw profile format's constants and per-function record, shared with
+// compiler-rt and llvm-profdata
+#include <llvm/ProfileData/InstrProfData.inc>
+
+enum ValueKind {
+#define VALUE_PROF_KIND(Enumerator, Value, Descr) Enumerator = Value,
+#include <llvm/ProfileData/InstrProfData.inc>
+};
+
+typedef void *IntPtrT;
+typedef struct {
+#define INSTR_PROF_DATA(Type, LLVMType, Name, Initializer) Type Name;
+#include <llvm/ProfileData/InstrProfData.inc>
+} ProfileData;
+
+typedef struct {
+    LLVMContextRef context;
+    LLVMModuleRef module;
+    LLVMBuilderRef builder;
+    LLVMTypeRef i8_ptr;
+    LLVMTypeRef i32;
+    LLVMTypeRef i64;
+} Runtime;
+
+static LLVMValueRef get_libc_function(Runtime *r, const char *name,
+                                      LLVMTypeRef return_type,
+                                      LLVMTypeRef *params, int param_count) {
+    LLVMValueRef function = LLVMGetNamedFunction(r->module, name);
+    if (!function) {
+        function = LLVMAddFunction(
+            r->module, name,
+            LLVMFunctionType(return_type, params, param_count, 0));
+    }
+    return function;
+}
+
+static LLVMValueRef build_call(Runtime *r, LLVMValueRef function,
+                               LLVMValueRef *args, int arg_count) {
+    return LLVMBuildCall2(r->builder, LLVMGlobalGetValueType(function),
+                          function, args, arg_count, "");
+}
+
+// The linker defines __start_<section> and __stop_<section> around every
+// section named like a C identifier
+static LLVMValueRef section_bound(Runtime *r, const char *bound,
+                                  const char *section) {
+    char name[64];
+    snprintf(name, sizeof(name), "__%s_%s", bound, section);
+    LLVMValueRef symbol = LLVMGetNamedGlobal(r->module, name);
+    if (!symbol) {
+        symbol = LLVMAddGlobal(r->module, LLVMInt8TypeInContext(r->context), name);
+        LLVMSetVisibility(symbol, LLVMHiddenVisibility);
+    }
+    return LLVMBuildPtrToInt(r->builder, symbol, r->i64, "");
+}
+
+static LLVMValueRef section_size(Runtime *r, const char *section,
+                                 LLVMValueRef *start) {
+    *start = section_bound(r, "start", section);
+    return LLVMBuildSub(r->builder, section_bound(r, "stop", section), *start,
+                        section);
+}
+
+static void write_bytes(Runtime *r, LLVMValueRef fwrite_fn, LLVMValueRef out,
+                        LLVMValueRef bytes, LLVMValueRef size) {
+    LLVMValueRef args[] = {
+        LLVMBuildPointerCast(r->builder, bytes, r->i8_ptr, ""),
+        LLVMConstInt(r->i64, 1, 0),
+        size,
+        out,
+    };
+    build_call(r, fwrite_fn, args, 4);
+}
+
+// void write(): the raw profile of this run, laid out as llvm-profdata
+// reads it: header, data, counters, then names padded to eight bytes
+static LLVMValueRef build_writer(Runtime *r, const char *default_path) {
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(r->context);
+    LLVMValueRef writer = LLVMAddFunction(r->module, "gloin.pgo.write",
+                                          LLVMFunctionType(void_type, NULL, 0, 0));
+    LLVMSetLinkage(writer, LLVMInternalLinkage);
+
+    LLVMTypeRef one_param[] = {r->i8_ptr};
+    LLVMTypeRef two_params[] = {r->i8_ptr, r->i8_ptr};
+    LLVMTypeRef fwrite_params[] = {r->i8_ptr, r->i64, r->i64, r->i8_ptr};
+    LLVMValueRef getenv_fn = get_libc_function(r, "getenv", r->i8_ptr, one_param, 1);
+    LLVMValueRef fopen_fn = get_libc_function(r, "fopen", r->i8_ptr, two_params, 2);
+    LLVMValueRef fclose_fn = get_libc_function(r, "fclose", r->i32, one_param, 1);
+    LLVMValueRef fwrite_fn = get_libc_function(r, "fwrite", r->i64, fwrite_params, 4);
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(r->context, writer, "entry");
+    LLVMBasicBlockRef write = LLVMAppendBasicBlockInContext(r->context, writer, "write");
+    LLVMBasicBlockRef failed = LLVMAppendBasicBlockInContext(r->context, writer, "failed");
+    LLVMPositionBuilderAtEnd(r->builder, entry);
+    LLVMTypeRef header_type = LLVMArrayType(r->i64, 11);
+    LLVMValueRef header = LLVMBuildAlloca(r->builder, header_type, "header");
+    LLVMValueRef variable = LLVMBuildGlobalStringPtr(r->builder, "LLVM_PROFILE_FILE", "");
+    LLVMValueRef path = build_call(r, getenv_fn, &variable, 1);
+    path = LLVMBuildSelect(
+        r->builder, LLVMBuildIsNull(r->builder, path, ""),
+        LLVMBuildGlobalStringPtr(r->builder, default_path, ""), path, "path");
+    LLVMValueRef fopen_args[] = {path, LLVMBuildGlobalStringPtr(r->builder, "wb", "")};
+    LLVMValueRef out = build_call(r, fopen_fn, fopen_args, 2);
+    LLVMBuildCondBr(r->builder, LLVMBuildIsNull(r->builder, out, ""), failed,
+                    write);
+    LLVMPositionBuilderAtEnd(r->builder, failed);
+    LLVMBuildRetVoid(r->builder);
+
+    LLVMPositionBuilderAtEnd(r->builder, write);
+    LLVMValueRef data_start, counters_start, names_start;
+    LLVMValueRef data_size = section_size(
+        r, INSTR_PROF_QUOTE(INSTR_PROF_DATA_COMMON), &data_start);
+    LLVMValueRef counters_size = section_size(
+        r, INSTR_PROF_QUOTE(INSTR_PROF_CNTS_COMMON), &counters_start);
+    LLVMValueRef names_size = section_size(
+        r, INSTR_PROF_QUOTE(INSTR_PROF_NAME_COMMON), &names_start);
+
+    // In the order of INSTR_PROF_RAW_HEADER. The instrumentation defines
+    // the version, with the IR-level variant bits.
+    LLVMValueRef version = LLVMGetNamedGlobal(
+        r->module, INSTR_PROF_QUOTE(INSTR_PROF_RAW_VERSION_VAR));
+    LLVMValueRef zero = LLVMConstInt(r->i64, 0, 0);
+    LLVMValueRef fields[] = {
+        LLVMConstInt(r->i64, INSTR_PROF_RAW_MAGIC_64, 0),
+        version ? LLVMBuildLoad2(r->builder, r->i64, version, "")
+                : LLVMConstInt(r->i64, INSTR_PROF_RAW_VERSION | VARIANT_MASK_IR_PROF, 0),
+        zero,  // BinaryIdsSize
+        LLVMBuildUDiv(r->builder, data_size,
+                      LLVMConstInt(r->i64, sizeof(ProfileData), 0), ""),
+        zero,  // PaddingBytesBeforeCounters
+        LLVMBuildUDiv(r->builder, counters_size,
+                      LLVMConstInt(r->i64, sizeof(uint64_t), 0), ""),
+        zero,  // PaddingBytesAfterCounters
+        names_size,
+        LLVMBuildSub(r->builder, counters_start, data_start, ""),
+        names_start,
+        LLVMConstInt(r->i64, IPVK_Last, 0),
+    };
+    for (int i = 0; i < 11; i++) {
+        LLVMValueRef indices[] = {zero, LLVMConstInt(r->i64, i, 0)};
+        LLVMBuildStore(r->builder, fields[i],
+                       LLVMBuildInBoundsGEP2(r->builder, header_type, header,
+                                             indices, 2, ""));
+    }
+    write_bytes(r, fwrite_fn, out, header, LLVMConstInt(r->i64, 11 * 8, 0));
+    write_bytes(r, fwrite_fn, out,
+                LLVMBuildIntToPtr(r->builder, data_start, r->i8_ptr, ""),
+                data_size);
+    write_bytes(r, fwrite_fn, out,
+                LLVMBuildIntToPtr(r->builder, counters_start, r->i8_ptr, ""),
+                counters_size);
+    write_bytes(r, fwrite_fn, out,
+                LLVMBuildIntToPtr(r->builder, names_start, r->i8_ptr, ""),
+                names_size);
+
+    LLVMTypeRef padding_type = LLVMArrayType(LLVMInt8TypeInContext(r->context), 8);
+    LLVMValueRef padding = LLVMAddGlobal(r->module, padding_type, "gloin.pgo.padding");
+    LLVMSetInitializer(padding, LLVMConstNull(padding_type));
+    LLVMSetLinkage(padding, LLVMPrivateLinkage);
+    LLVMSetGlobalConstant(padding, 1);
+    write_bytes(r, fwrite_fn, out, padding,
+                LLVMBuildAnd(r->builder, LLVMBuildNeg(r->builder, names_size, ""),
+                             LLVMConstInt(r->i64, 7, 0), ""));
+
+    build_call(r, fclose_fn, &out, 1);
+    LLVMBuildRetVoid(r->builder);
+    return writer;
+}
+
+// Append a constructor to llvm.global_ctors, keeping any already there
+static void add_constructor(Runtime *r, LLVMValueRef constructor) {
+    LLVMTypeRef constructor_ptr = LLVMTypeOf(constructor);
+    LLVMTypeRef fields[] = {r->i32, constructor_ptr, r->i8_ptr};
+    LLVMTypeRef entry_type = LLVMStructTypeInContext(r->context, fields, 3, 0);
+    LLVMValueRef values[] = {LLVMConstInt(r->i32, 65535, 0), constructor,
+                             LLVMConstNull(r->i8_ptr)};
+
+    LLVMValueRef old = LLVMGetNamedGlobal(r->module, "llvm.global_ctors");
+    int count = 0;
+    if (old) {
+        count = LLVMGetArrayLength(LLVMGlobalGetValueType(old));
+        entry_type = LLVMGetElementType(LLVMGlobalGetValueType(old));
+    }
+    LLVMValueRef *entries = malloc((count + 1) * sizeof(LLVMValueRef));
+    for (int i = 0; i < count; i++) {
+        entries[i] = LLVMGetOperand(LLVMGetInitializer(old), i);
+    }
+    entries[count] = LLVMConstNamedStruct(entry_type, values, 3);
+    if (old) {
+        LLVMDeleteGlobal(old);
+    }
+    LLVMValueRef ctors = LLVMAddGlobal(
+        r->module, LLVMArrayType(entry_type, count + 1), "llvm.global_ctors");
+    LLVMSetInitializer(ctors, LLVMConstArray(entry_type, entries, count + 1));
+    LLVMSetLinkage(ctors, LLVMAppendingLinkage);
+    free(entries);
+}
+
+void pgo_add_runtime(CodeGen *codegen) {
+    if (!codegen->profile_generate) {
+        return;
+    }
+
+    Runtime r;
+    r.context = codegen->context;
+    r.module = codegen->module;
+    r.builder = LLVMCreateBuilderInContext(r.context);
+    r.i8_ptr = LLVMPointerType(LLVMInt8TypeInContext(r.context), 0);
+    r.i32 = LLVMInt32TypeInContext(r.context);
+    r.i64 = LLVMInt64TypeInContext(r.context);
+
+    LLVMValueRef writer = build_writer(&r, codegen->profile_generate);
+
+    // Registered from a constructor, so the writer runs after main returns
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(r.context);
+    LLVMTypeRef constructor_type = LLVMFunctionType(void_type, NULL, 0, 0);
+    LLVMValueRef constructor =
+        LLVMAddFunction(r.module, "gloin.pgo.register", constructor_type);
+    LLVMSetLinkage(constructor, LLVMInternalLinkage);
+    LLVMPositionBuilderAtEnd(
+        r.builder, LLVMAppendBasicBlockInContext(r.context, constructor, "entry"));
+    LLVMTypeRef atexit_params[] = {LLVMPointerType(constructor_type, 0)};
+    build_call(&r, get_libc_function(&r, "atexit", r.i32, atexit_params, 1),
+               &writer, 1);
+    LLVMBuildRetVoid(r.builder);
+    add_constructor(&r, constructor);
+
+    LLVMDisposeBuilder(r.builder);
+}
@@ -0,0 +1,48 @@
+#include "profdata.h"
+#include <llvm/ProfileData/InstrProfReader.h>
+#include <llvm/ProfileData/InstrProfWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstring>
+#include <string>
+
+using namespace llvm;
+
+static int fail(char **error_message, const std::string &message) {
+    *error_message = strdup(message.c_str());
+    return 1;
+}
+
+int merge_pgo_profiles(const char *const *inputs, int input_count,
+                       const char *output, char **error_message) {
+    InstrProfWriter writer;
+    for (int i = 0; i < input_count; i++) {
+        std::string input = inputs[i];
+        auto reader = InstrProfReader::create(input);
+        if (Error error = reader.takeError()) {
+            return fail(error_message, input + ": " + toString(std::move(error)));
+        }
+        if (Error error = writer.mergeProfileKind((*reader)->getProfileKind())) {
+            return fail(error_message, input + ": " + toString(std::move(error)));
+        }
+        // Counters that overflow on merging saturate, which is what they are
+        // wanted for anyway
+        for (NamedInstrProfRecord &record : **reader) {
+            writer.addRecord(std::move(record), 1,
+                             [](Error error) { consumeError(std::move(error)); });
+        }
+        if (Error error = (*reader)->getError()) {
+            return fail(error_message, input + ": " + toString(std::move(error)));
+        }
+    }
+
+    std::error_code error_code;
+    raw_fd_ostream out(output, error_code, sys::fs::OF_None);
+    if (error_code) {
+        return fail(error_message, std::string(output) + ": " + error_code.message());
+    }
+    if (Error error = writer.write(out)) {
+        return fail(error_message, std::string(output) + ": " + toString(std::move(error)));
+    }
+    return 0;
+}
@@ -0,0 +1,690 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Leaf functions shorter than this many instructions are not instrumented,
+// since two cycle counter reads would cost more than their bodies
+#define PROFILE_LEAF_INSTRUCTIONS 64
+
+// Counter table of a function
+enum {
+    SLOT_CALLS,
+    SLOT_SELF,    // Cycles outside profiled callees
+    SLOT_TOTAL,   // Cycles including callees
+    SLOT_ACTIVE,  // 1 while the outermost activation runs, to spot recursion
+    SLOT_START,   // Cycle counter when the outermost activation started
+    SLOT_CALLER_NESTED,  // Its caller's finished callees so far
+    SLOT_OUTERMOST,      // Outermost activations
+    FUNCTION_SLOTS
+};
+
+// Counter table of a caller-callee pair. A function's calls to itself are
+// not counted at the call; the report works them out from its activations.
+enum {
+    EDGE_CALLS,
+    EDGE_CYCLES,
+    EDGE_RECURSIVE,  // Calls that entered the callee recursively
+    EDGE_SLOTS
+};
+
+// Selects what a module's report function does
+enum { REPORT_SUM, REPORT_FLAT, REPORT_EDGES };
+
+typedef struct {
+    LLVMValueRef function;
+    LLVMValueRef counters;
+} ProfiledFunction;
+
+typedef struct {
+    int caller;
+    int callee;
+    LLVMValueRef counters;
+} ProfiledEdge;
+
+typedef struct {
+    LLVMContextRef context;
+    LLVMModuleRef module;
+    LLVMBuilderRef builder;
+    LLVMTypeRef i8_ptr;
+    LLVMTypeRef i32;
+    LLVMTypeRef i64;
+    LLVMTypeRef read_cycles_type;
+    LLVMValueRef read_cycles;  // llvm.readcyclecounter
+    LLVMValueRef nested;  // Cycles of the running frame's finished callees
+    LLVMValueRef last;    // Cycles of the last profiled call to return
+
+    ProfiledFunction *functions;
+    int function_count;
+    ProfiledEdge *edges;
+    int edge_count;
+} Profiler;
+
+// Thread-local so threads never share a cache line. Gloin only links
+// executables, where local-exec is the cheapest TLS access.
+static LLVMValueRef add_counters(Profiler *p, const char *name, int slots,
+                                 LLVMLinkage linkage) {
+    LLVMTypeRef type = slots > 1 ? LLVMArrayType(p->i64, slots) : p->i64;
+    LLVMValueRef counters = LLVMGetNamedGlobal(p->module, name);
+    if (counters) {
+        return counters;
+    }
+    counters = LLVMAddGlobal(p->module, type, name);
+    LLVMSetInitializer(counters, LLVMConstNull(type));
+    LLVMSetLinkage(counters, linkage);
+    LLVMSetThreadLocal(counters, 1);
+    LLVMSetThreadLocalMode(counters, LLVMLocalExecTLSModel);
+    return counters;
+}
+
+static LLVMValueRef counter_slot(Profiler *p, LLVMValueRef counters,
+                                 int slot) {
+    LLVMValueRef indices[] = {
+        LLVMConstInt(p->i64, 0, 0),
+        LLVMConstInt(p->i64, slot, 0),
+    };
+    return LLVMBuildInBoundsGEP2(p->builder, LLVMGlobalGetValueType(counters),
+                                 counters, indices, 2, "");
+}
+
+// Returns the updated count
+static LLVMValueRef add_to_counter(Profiler *p, LLVMValueRef counter,
+                                   LLVMValueRef amount) {
+    LLVMValueRef value = LLVMBuildLoad2(p->builder, p->i64, counter, "");
+    value = LLVMBuildAdd(p->builder, value, amount, "");
+    LLVMBuildStore(p->builder, value, counter);
+    return value;
+}
+
+static LLVMValueRef build_read_cycles(Profiler *p) {
+    return LLVMBuildCall2(p->builder, p->read_cycles_type, p->read_cycles,
+                          NULL, 0, "prof.cycles");
+}
+
+static LLVMValueRef get_libc_function(Profiler *p, const char *name,
+                                      LLVMTypeRef return_type,
+                                      LLVMTypeRef *params, int param_count,
+                                      int is_var_arg) {
+    LLVMValueRef function = LLVMGetNamedFunction(p->module, name);
+    if (!function) {
+        function = LLVMAddFunction(
+            p->module, name,
+            LLVMFunctionType(return_type, params, param_count, is_var_arg));
+    }
+    return function;
+}
+
+static LLVMValueRef build_libc_call(Profiler *p, LLVMValueRef function,
+                                    LLVMValueRef *args, int arg_count) {
+    return LLVMBuildCall2(p->builder, LLVMGlobalGetValueType(function),
+                          function, args, arg_count, "");
+}
+
+static int is_call_to_function(LLVMValueRef instruction) {
+    return LLVMGetInstructionOpcode(instruction) == LLVMCall &&
+           !LLVMIsAIntrinsicInst(instruction);
+}
+
+static int is_small_leaf(LLVMValueRef function) {
+    int instructions = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+         block = LLVMGetNextBasicBlock(block)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            if (is_call_to_function(inst)) {
+                return 0;
+            }
+            instructions++;
+        }
+    }
+    return instructions < PROFILE_LEAF_INSTRUCTIONS;
+}
+
+static int find_function(Profiler *p, LLVMValueRef function) {
+    for (int i = 0; i < p->function_count; i++) {
+        if (p->functions[i].function == function) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char *function_name(Profiler *p, int index) {
+    size_t length;
+    return LLVMGetValueName2(p->functions[index].function, &length);
+}
+
+// Time the outermost activation from entry to each return. Recursive
+// activations only add to the call count: their cycles are part of the
+// outermost one's anyway, and this keeps the cycle counter and every other
+// store off the recursion. There is one outermost activation at a time, so
+// its state lives in the counter table rather than in registers kept
+// across the body.
+static void instrument_function(Profiler *p, ProfiledFunction *f) {
+    int return_count = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(f->function); block;
+         block = LLVMGetNextBasicBlock(block)) {
+        LLVMValueRef terminator = LLVMGetBasicBlockTerminator(block);
+        return_count += terminator && LLVMGetInstructionOpcode(terminator) == LLVMRet;
+    }
+    LLVMValueRef *returns = malloc((return_count ? return_count : 1) *
+                                   sizeof(LLVMValueRef));
+    return_count = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(f->function); block;
+         block = LLVMGetNextBasicBlock(block)) {
+        LLVMValueRef terminator = LLVMGetBasicBlockTerminator(block);
+        if (terminator && LLVMGetInstructionOpcode(terminator) == LLVMRet) {
+            returns[return_count++] = terminator;
+        }
+    }
+
+    LLVMValueRef zero = LLVMConstInt(p->i64, 0, 0);
+    LLVMValueRef one = LLVMConstInt(p->i64, 1, 0);
+    LLVMBasicBlockRef body = LLVMGetEntryBasicBlock(f->function);
+    LLVMBasicBlockRef entry =
+        LLVMInsertBasicBlockInContext(p->context, body, "prof.entry");
+    LLVMBasicBlockRef start_block =
+        LLVMInsertBasicBlockInContext(p->context, body, "prof.start");
+
+    // Static allocas have to stay in the entry block
+    LLVMPositionBuilderAtEnd(p->builder, entry);
+    LLVMValueRef inst = LLVMGetFirstInstruction(body);
+    while (inst && LLVMIsAAllocaInst(inst)) {
+        LLVMValueRef next = LLVMGetNextInstruction(inst);
+        size_t length;
+        char *name = strdup(LLVMGetValueName2(inst, &length));
+        LLVMInstructionRemoveFromParent(inst);
+        LLVMInsertIntoBuilderWithName(p->builder, inst, name);
+        free(name);
+        inst = next;
+    }
+    LLVMValueRef active = LLVMBuildLoad2(
+        p->builder, p->i64, counter_slot(p, f->counters, SLOT_ACTIVE),
+        "prof.active");
+    add_to_counter(p, counter_slot(p, f->counters, SLOT_CALLS), one);
+    LLVMValueRef outermost =
+        LLVMBuildICmp(p->builder, LLVMIntEQ, active, zero, "prof.outermost");
+    LLVMBuildCondBr(p->builder, outermost, start_block, body);
+
+    LLVMPositionBuilderAtEnd(p->builder, start_block);
+    LLVMBuildStore(p->builder, one, counter_slot(p, f->counters, SLOT_ACTIVE));
+    add_to_counter(p, counter_slot(p, f->counters, SLOT_OUTERMOST), one);
+    LLVMBuildStore(p->builder, build_read_cycles(p),
+                   counter_slot(p, f->counters, SLOT_START));
+    // The caller's finished callees, restored with this call added on return
+    LLVMBuildStore(p->builder, LLVMBuildLoad2(p->builder, p->i64, p->nested, ""),
+                   counter_slot(p, f->counters, SLOT_CALLER_NESTED));
+    LLVMBuildStore(p->builder, zero, p->nested);
+    LLVMBuildBr(p->builder, body);
+
+    for (int i = 0; i < return_count; i++) {
+        LLVMBasicBlockRef timed = LLVMAppendBasicBlockInContext(
+            p->context, f->function, "prof.exit");
+        LLVMBasicBlockRef done = LLVMAppendBasicBlockInContext(
+            p->context, f->function, "prof.return");
+        LLVMPositionBuilderBefore(p->builder, returns[i]);
+        LLVMBuildCondBr(p->builder, outermost, timed, done);
+        LLVMInstructionRemoveFromParent(returns[i]);
+        LLVMPositionBuilderAtEnd(p->builder, done);
+        LLVMInsertIntoBuilder(p->builder, returns[i]);
+
+        LLVMPositionBuilderAtEnd(p->builder, timed);
+        LLVMBuildStore(p->builder, zero,
+                       counter_slot(p, f->counters, SLOT_ACTIVE));
+        LLVMValueRef start = LLVMBuildLoad2(
+            p->builder, p->i64, counter_slot(p, f->counters, SLOT_START), "");
+        LLVMValueRef elapsed =
+            LLVMBuildSub(p->builder, build_read_cycles(p), start, "prof.elapsed");
+        LLVMValueRef callees =
+            LLVMBuildLoad2(p->builder, p->i64, p->nested, "");
+        add_to_counter(p, counter_slot(p, f->counters, SLOT_SELF),
+                       LLVMBuildSub(p->builder, elapsed, callees, ""));
+        add_to_counter(p, counter_slot(p, f->counters, SLOT_TOTAL), elapsed);
+        LLVMValueRef caller_nested = LLVMBuildLoad2(
+            p->builder, p->i64,
+            counter_slot(p, f->counters, SLOT_CALLER_NESTED), "");
+        LLVMBuildStore(p->builder,
+                       LLVMBuildAdd(p->builder, caller_nested, elapsed, ""),
+                       p->nested);
+        LLVMBuildStore(p->builder, elapsed, p->last);
+        LLVMBuildBr(p->builder, done);
+    }
+    free(returns);
+}
+
+static ProfiledEdge *get_edge(Profiler *p, int caller, int callee) {
+    for (int i = 0; i < p->edge_count; i++) {
+        if (p->edges[i].caller == caller && p->edges[i].callee == callee) {
+            return &p->edges[i];
+        }
+    }
+    p->edges = realloc(p->edges, (p->edge_count + 1) * sizeof(ProfiledEdge));
+    ProfiledEdge *edge = &p->edges[p->edge_count++];
+    edge->caller = caller;
+    edge->callee = callee;
+
+    const char *caller_name = function_name(p, caller);
+    const char *callee_name = function_name(p, callee);
+    char *name = malloc(strlen(caller_name) + strlen(callee_name) + 32);
+    sprintf(name, "gloin.profile.edge.%s.%s", caller_name, callee_name);
+    edge->counters = add_counters(p, name, EDGE_SLOTS, LLVMInternalLinkage);
+    free(name);
+    return edge;
+}
+
+// Calls from one profiled function of this module to another are counted
+// per pair, and add the callee's time, left behind in the last counter by
+// an outermost activation, to the pair. A recursive activation leaves the
+// counter alone, and its callee is still active on return, which also
+// counts it as recursive. A function's calls to itself are always
+// recursive and never timed, so they are left uninstrumented.
+static void instrument_calls(Profiler *p, int caller) {
+    LLVMValueRef function = p->functions[caller].function;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+         block = LLVMGetNextBasicBlock(block)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            if (!is_call_to_function(inst)) {
+                continue;
+            }
+            int callee = find_function(p, LLVMGetCalledValue(inst));
+            if (callee < 0) {
+                continue;
+            }
+            ProfiledEdge *edge = get_edge(p, caller, callee);
+            if (callee == caller) {
+                continue;
+            }
+            LLVMPositionBuilderBefore(p->builder, LLVMGetNextInstruction(inst));
+            LLVMValueRef zero = LLVMConstInt(p->i64, 0, 0);
+            LLVMValueRef active = LLVMBuildLoad2(
+                p->builder, p->i64,
+                counter_slot(p, p->functions[callee].counters, SLOT_ACTIVE), "");
+            LLVMValueRef recursive =
+                LLVMBuildICmp(p->builder, LLVMIntNE, active, zero, "prof.recursive");
+            add_to_counter(p, counter_slot(p, edge->counters, EDGE_CALLS),
+                           LLVMConstInt(p->i64, 1, 0));
+            add_to_counter(p, counter_slot(p, edge->counters, EDGE_CYCLES),
+                           LLVMBuildSelect(p->builder, recursive, zero,
+                                           LLVMBuildLoad2(p->builder, p->i64,
+                                                          p->last, ""),
+                                           "prof.call"));
+            add_to_counter(p, counter_slot(p, edge->counters, EDGE_RECURSIVE),
+                           LLVMBuildZExt(p->builder, recursive, p->i64, ""));
+        }
+    }
+}
+
+// Prints a row when the pair or function was called at all
+static void build_report_row(Profiler *p, LLVMValueRef report,
+                             LLVMValueRef calls, LLVMValueRef fprintf_fn,
+                             LLVMValueRef *args, int arg_count) {
+    LLVMBasicBlockRef print = LLVMAppendBasicBlockInContext(p->context, report, "print");
+    LLVMBasicBlockRef next = LLVMAppendBasicBlockInContext(p->context, report, "next");
+    LLVMBuildCondBr(p->builder,
+                    LLVMBuildICmp(p->builder, LLVMIntNE, calls,
+                                  LLVMConstInt(p->i64, 0, 0), ""),
+                    print, next);
+    LLVMPositionBuilderAtEnd(p->builder, print);
+    build_libc_call(p, fprintf_fn, args, arg_count);
+    LLVMBuildBr(p->builder, next);
+    LLVMPositionBuilderAtEnd(p->builder, next);
+}
+
+// A function's calls to itself: its recursive activations, less those that
+// other functions started. Recursion cannot cross modules, since imports
+// cannot form a cycle.
+static LLVMValueRef build_self_calls(Profiler *p, int function) {
+    LLVMValueRef counters = p->functions[function].counters;
+    LLVMValueRef calls = LLVMBuildSub(
+        p->builder,
+        LLVMBuildLoad2(p->builder, p->i64, counter_slot(p, counters, SLOT_CALLS), ""),
+        LLVMBuildLoad2(p->builder, p->i64,
+                       counter_slot(p, counters, SLOT_OUTERMOST), ""),
+        "");
+    for (int i = 0; i < p->edge_count; i++) {
+        ProfiledEdge *edge = &p->edges[i];
+        if (edge->callee == function && edge->caller != function) {
+            LLVMValueRef recursive = LLVMBuildLoad2(
+                p->builder, p->i64,
+                counter_slot(p, edge->counters, EDGE_RECURSIVE), "");
+            calls = LLVMBuildSub(p->builder, calls, recursive, "");
+        }
+    }
+    return calls;
+}
+
+// i64 report(FILE *out, i64 total_cycles, i32 part): the sum of the self
+// cycles for REPORT_SUM, otherwise prints the flat or caller-callee rows
+static LLVMValueRef build_report(Profiler *p, LLVMTypeRef report_type,
+                                 LLVMValueRef fprintf_fn) {
+    LLVMValueRef report =
+        LLVMAddFunction(p->module, "gloin.profile.report", report_type);
+    LLVMSetLinkage(report, LLVMInternalLinkage);
+    LLVMValueRef out = LLVMGetParam(report, 0);
+    LLVMValueRef total_cycles = LLVMGetParam(report, 1);
+    LLVMValueRef zero = LLVMConstInt(p->i64, 0, 0);
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(p->context, report, "entry");
+    LLVMBasicBlockRef sum = LLVMAppendBasicBlockInContext(p->context, report, "sum");
+    LLVMBasicBlockRef flat = LLVMAppendBasicBlockInContext(p->context, report, "flat");
+    LLVMBasicBlockRef edges = LLVMAppendBasicBlockInContext(p->context, report, "edges");
+    LLVMPositionBuilderAtEnd(p->builder, entry);
+    LLVMValueRef part_switch =
+        LLVMBuildSwitch(p->builder, LLVMGetParam(report, 2), sum, 2);
+    LLVMAddCase(part_switch, LLVMConstInt(p->i32, REPORT_FLAT, 0), flat);
+    LLVMAddCase(part_switch, LLVMConstInt(p->i32, REPORT_EDGES, 0), edges);
+
+    LLVMPositionBuilderAtEnd(p->builder, sum);
+    LLVMValueRef self_sum = zero;
+    for (int i = 0; i < p->function_count; i++) {
+        LLVMValueRef self = LLVMBuildLoad2(
+            p->builder, p->i64,
+            counter_slot(p, p->functions[i].counters, SLOT_SELF), "");
+        self_sum = LLVMBuildAdd(p->builder, self_sum, self, "");
+    }
+    LLVMBuildRet(p->builder, self_sum);
+
+    LLVMPositionBuilderAtEnd(p->builder, flat);
+    LLVMTypeRef double_type = LLVMDoubleTypeInContext(p->context);
+    LLVMValueRef flat_format = LLVMBuildGlobalStringPtr(
+        p->builder, "%7.2f %14lu %14lu %10lu  %s\n", "prof.flat");
+    LLVMValueRef divisor = LLVMBuildUIToFP(
+        p->builder,
+        LLVMBuildSelect(p->builder,
+                        LLVMBuildICmp(p->builder, LLVMIntEQ, total_cycles,
+                                      zero, ""),
+                        LLVMConstInt(p->i64, 1, 0), total_cycles, ""),
+        double_type, "");
+    for (int i = 0; i < p->function_count; i++) {
+        LLVMValueRef counters = p->functions[i].counters;
+        LLVMValueRef self = LLVMBuildLoad2(
+            p->builder, p->i64, counter_slot(p, counters, SLOT_SELF), "");
+        LLVMValueRef percent = LLVMBuildFDiv(
+            p->builder,
+            LLVMBuildFMul(p->builder,
+                          LLVMBuildUIToFP(p->builder, self, double_type, ""),
+                          LLVMConstReal(double_type, 100.0), ""),
+            divisor, "");
+        LLVMValueRef args[] = {
+            out,
+            flat_format,
+            percent,
+            self,
+            LLVMBuildLoad2(p->builder, p->i64,
+                           counter_slot(p, counters, SLOT_TOTAL), ""),
+            LLVMBuildLoad2(p->builder, p->i64,
+                           counter_slot(p, counters, SLOT_CALLS), ""),
+            LLVMBuildGlobalStringPtr(p->builder, function_name(p, i),
+                                     "prof.name"),
+        };
+        build_report_row(p, report, args[5], fprintf_fn, args, 7);
+    }
+    LLVMBuildRet(p->builder, zero);
+
+    LLVMPositionBuilderAtEnd(p->builder, edges);
+    LLVMValueRef edge_format = LLVMBuildGlobalStringPtr(
+        p->builder, "%10lu %14lu  %s -> %s\n", "prof.edge");
+    for (int i = 0; i < p->edge_count; i++) {
+        ProfiledEdge *edge = &p->edges[i];
+        LLVMValueRef calls =
+            edge->caller == edge->callee
+                ? build_self_calls(p, edge->callee)
+                : LLVMBuildLoad2(p->builder, p->i64,
+                                 counter_slot(p, edge->counters, EDGE_CALLS), "");
+        LLVMValueRef args[] = {
+            out,
+            edge_format,
+            calls,
+            LLVMBuildLoad2(p->builder, p->i64,
+                           counter_slot(p, edge->counters, EDGE_CYCLES), ""),
+            LLVMBuildGlobalStringPtr(p->builder, function_name(p, edge->caller),
+                                     "prof.caller"),
+            LLVMBuildGlobalStringPtr(p->builder, function_name(p, edge->callee),
+                                     "prof.callee"),
+        };
+        build_report_row(p, report, calls, fprintf_fn, args, 6);
+    }
+    LLVMBuildRet(p->builder, zero);
+    return report;
+}
+
+// Call part on every registered module, adding up what they return
+static LLVMValueRef build_report_walk(Profiler *p, LLVMValueRef writer,
+                                      LLVMTypeRef module_type,
+                                      LLVMTypeRef report_type,
+                                      LLVMValueRef modules, LLVMValueRef out,
+                                      LLVMValueRef total_cycles, int part) {
+    LLVMTypeRef module_ptr = LLVMPointerType(module_type, 0);
+    LLVMBasicBlockRef before = LLVMGetInsertBlock(p->builder);
+    LLVMBasicBlockRef loop = LLVMAppendBasicBlockInContext(p->context, writer, "walk");
+    LLVMBasicBlockRef body = LLVMAppendBasicBlockInContext(p->context, writer, "report");
+    LLVMBasicBlockRef done = LLVMAppendBasicBlockInContext(p->context, writer, "walked");
+    LLVMValueRef first = LLVMBuildLoad2(p->builder, module_ptr, modules, "");
+    LLVMBuildBr(p->builder, loop);
+
+    LLVMPositionBuilderAtEnd(p->builder, loop);
+    LLVMValueRef module = LLVMBuildPhi(p->builder, module_ptr, "module");
+    LLVMValueRef sum = LLVMBuildPhi(p->builder, p->i64, "sum");
+    LLVMBuildCondBr(p->builder, LLVMBuildIsNull(p->builder, module, ""), done,
+                    body);
+
+    LLVMPositionBuilderAtEnd(p->builder, body);
+    LLVMValueRef report = LLVMBuildLoad2(
+        p->builder, LLVMPointerType(report_type, 0),
+        LLVMBuildStructGEP2(p->builder, module_type, module, 1, ""), "");
+    LLVMValueRef args[] = {out, total_cycles, LLVMConstInt(p->i32, part, 0)};
+    LLVMValueRef next_sum = LLVMBuildAdd(
+        p->builder, sum,
+        LLVMBuildCall2(p->builder, report_type, report, args, 3, ""), "");
+    LLVMValueRef next = LLVMBuildLoad2(
+        p->builder, module_ptr,
+        LLVMBuildStructGEP2(p->builder, module_type, module, 0, ""), "");
+    LLVMBuildBr(p->builder, loop);
+
+    LLVMValueRef modules_in[] = {first, next};
+    LLVMValueRef sums_in[] = {LLVMConstInt(p->i64, 0, 0), next_sum};
+    LLVMBasicBlockRef blocks_in[] = {before, body};
+    LLVMAddIncoming(module, modules_in, blocks_in, 2);
+    LLVMAddIncoming(sum, sums_in, blocks_in, 2);
+
+    LLVMPositionBuilderAtEnd(p->builder, done);
+    return sum;
+}
+
+// Every instrumented object carries the writer; the linker keeps one
+static LLVMValueRef build_writer(Profiler *p, LLVMTypeRef module_type,
+                                 LLVMTypeRef report_type,
+                                 LLVMValueRef modules,
+                                 LLVMValueRef fprintf_fn) {
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(p->context);
+    LLVMValueRef writer = LLVMAddFunction(p->module, "gloin_profile_write",
+                                          LLVMFunctionType(void_type, NULL, 0, 0));
+    LLVMSetLinkage(writer, LLVMLinkOnceODRLinkage);
+
+    LLVMTypeRef path_params[] = {p->i8_ptr};
+    LLVMValueRef getenv_fn =
+        get_libc_function(p, "getenv", p->i8_ptr, path_params, 1, 0);
+    LLVMTypeRef fopen_params[] = {p->i8_ptr, p->i8_ptr};
+    LLVMValueRef fopen_fn =
+        get_libc_function(p, "fopen", p->i8_ptr, fopen_params, 2, 0);
+    LLVMValueRef fclose_fn = get_libc_function(p, "fclose", p->i32,
+                                               path_params, 1, 0);
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(p->context, writer, "entry");
+    LLVMBasicBlockRef write = LLVMAppendBasicBlockInContext(p->context, writer, "write");
+    LLVMBasicBlockRef failed = LLVMAppendBasicBlockInContext(p->context, writer, "failed");
+    LLVMPositionBuilderAtEnd(p->builder, entry);
+    LLVMValueRef variable = LLVMBuildGlobalStringPtr(p->builder, "GLOIN_PROFILE", "");
+    LLVMValueRef path = build_libc_call(p, getenv_fn, &variable, 1);
+    path = LLVMBuildSelect(
+        p->builder, LLVMBuildIsNull(p->builder, path, ""),
+        LLVMBuildGlobalStringPtr(p->builder, "gloin.prof", ""), path, "path");
+    LLVMValueRef fopen_args[] = {
+        path, LLVMBuildGlobalStringPtr(p->builder, "w", "")};
+    LLVMValueRef out = build_libc_call(p, fopen_fn, fopen_args, 2);
+    LLVMBuildCondBr(p->builder, LLVMBuildIsNull(p->builder, out, ""), failed,
+                    write);
+    LLVMPositionBuilderAtEnd(p->builder, failed);
+    LLVMBuildRetVoid(p->builder);
+
+    LLVMPositionBuilderAtEnd(p->builder, write);
+    LLVMValueRef zero = LLVMConstInt(p->i64, 0, 0);
+    LLVMValueRef total_cycles = build_report_walk(
+        p, writer, module_type, report_type, modules, out, zero, REPORT_SUM);
+    LLVMValueRef flat_args[] = {
+        out,
+        LLVMBuildGlobalStringPtr(
+            p->builder,
+            "# Gloin profile: %lu cycles\n\n"
+            "# Flat profile\n"
+            "#  self%%    self cycles   total cycles      calls  function\n",
+            ""),
+        total_cycles,
+    };
+    build_libc_call(p, fprintf_fn, flat_args, 3);
+    build_report_walk(p, writer, module_type, report_type, modules, out,
+                      total_cycles, REPORT_FLAT);
+    LLVMValueRef edge_args[] = {
+        out,
+        LLVMBuildGlobalStringPtr(
+            p->builder,
+            "\n# Caller-callee profile\n"
+            "#    calls         cycles  caller -> callee\n",
+            ""),
+    };
+    build_libc_call(p, fprintf_fn, edge_args, 2);
+    build_report_walk(p, writer, module_type, report_type, modules, out,
+                      total_cycles, REPORT_EDGES);
+    build_libc_call(p, fclose_fn, &out, 1);
+    LLVMBuildRetVoid(p->builder);
+    return writer;
+}
+
+// A constructor pushes this module's report on the shared list; the first
+// one to run schedules the writer
+static void build_registration(Profiler *p) {
+    LLVMTypeRef fprintf_params[] = {p->i8_ptr, p->i8_ptr};
+    LLVMValueRef fprintf_fn =
+        get_libc_function(p, "fprintf", p->i32, fprintf_params, 2, 1);
+
+    LLVMTypeRef report_params[] = {p->i8_ptr, p->i64, p->i32};
+    LLVMTypeRef report_type = LLVMFunctionType(p->i64, report_params, 3, 0);
+    LLVMTypeRef module_type =
+        LLVMStructCreateNamed(p->context, "gloin.profile.module");
+    LLVMTypeRef module_ptr = LLVMPointerType(module_type, 0);
+    LLVMTypeRef fields[] = {module_ptr, LLVMPointerType(report_type, 0)};
+    LLVMStructSetBody(module_type, fields, 2, 0);
+
+    LLVMValueRef modules =
+        LLVMAddGlobal(p->module, module_ptr, "gloin_profile_modules");
+    LLVMSetInitializer(modules, LLVMConstNull(module_ptr));
+    LLVMSetLinkage(modules, LLVMLinkOnceODRLinkage);
+
+    LLVMValueRef report = build_report(p, report_type, fprintf_fn);
+    LLVMValueRef writer =
+        build_writer(p, module_type, report_type, modules, fprintf_fn);
+
+    LLVMValueRef entry_fields[] = {LLVMConstNull(module_ptr), report};
+    LLVMValueRef entry =
+        LLVMAddGlobal(p->module, module_type, "gloin.profile.entry");
+    LLVMSetInitializer(entry, LLVMConstNamedStruct(module_type, entry_fields, 2));
+    LLVMSetLinkage(entry, LLVMInternalLinkage);
+
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(p->context);
+    LLVMTypeRef constructor_type = LLVMFunctionType(void_type, NULL, 0, 0);
+    LLVMValueRef constructor =
+        LLVMAddFunction(p->module, "gloin.profile.register", constructor_type);
+    LLVMSetLinkage(constructor, LLVMInternalLinkage);
+    LLVMBasicBlockRef body = LLVMAppendBasicBlockInContext(p->context, constructor, "entry");
+    LLVMBasicBlockRef schedule = LLVMAppendBasicBlockInContext(p->context, constructor, "schedule");
+    LLVMBasicBlockRef done = LLVMAppendBasicBlockInContext(p->context, constructor, "done");
+    LLVMPositionBuilderAtEnd(p->builder, body);
+    LLVMValueRef head = LLVMBuildLoad2(p->builder, module_ptr, modules, "");
+    LLVMBuildStore(p->builder, head,
+                   LLVMBuildStructGEP2(p->builder, module_type, entry, 0, ""));
+    LLVMBuildStore(p->builder, entry, modules);
+    LLVMBuildCondBr(p->builder, LLVMBuildIsNull(p->builder, head, ""),
+                    schedule, done);
+    LLVMPositionBuilderAtEnd(p->builder, schedule);
+    LLVMTypeRef atexit_params[] = {LLVMPointerType(constructor_type, 0)};
+    LLVMValueRef atexit_fn =
+        get_libc_function(p, "atexit", p->i32, atexit_params, 1, 0);
+    build_libc_call(p, atexit_fn, &writer, 1);
+    LLVMBuildBr(p->builder, done);
+    LLVMPositionBuilderAtEnd(p->builder, done);
+    LLVMBuildRetVoid(p->builder);
+
+    LLVMTypeRef ctor_fields[] = {p->i32, LLVMPointerType(constructor_type, 0),
+                                 p->i8_ptr};
+    LLVMTypeRef ctor_type = LLVMStructTypeInContext(p->context, ctor_fields, 3, 0);
+    LLVMValueRef ctor_values[] = {LLVMConstInt(p->i32, 65535, 0), constructor,
+                                  LLVMConstNull(p->i8_ptr)};
+    LLVMValueRef ctor = LLVMConstStructInContext(p->context, ctor_values, 3, 0);
+    LLVMValueRef ctors = LLVMAddGlobal(
+        p->module, LLVMArrayType(ctor_type, 1), "llvm.global_ctors");
+    LLVMSetInitializer(ctors, LLVMConstArray(ctor_type, &ctor, 1));
+    LLVMSetLinkage(ctors, LLVMAppendingLinkage);
+}
+
+void profile_module(CodeGen *codegen) {
+    if (!codegen->profile) {
+        return;
+    }
+
+    Profiler p;
+    memset(&p, 0, sizeof(p));
+    p.context = codegen->context;
+    p.module = codegen->module;
+    p.builder = LLVMCreateBuilderInContext(p.context);
+    p.i8_ptr = LLVMPointerType(LLVMInt8TypeInContext(p.context), 0);
+    p.i32 = LLVMInt32TypeInContext(p.context);
+    p.i64 = LLVMInt64TypeInContext(p.context);
+    const char *intrinsic = "llvm.readcyclecounter";
+    p.read_cycles = LLVMGetIntrinsicDeclaration(
+        p.module, LLVMLookupIntrinsicID(intrinsic, strlen(intrinsic)), NULL, 0);
+    p.read_cycles_type = LLVMGlobalGetValueType(p.read_cycles);
+
+    // Every definition left after optimization came from codegen_function
+    // or codegen_struct_method
+    int defined = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(p.module); fn;
+         fn = LLVMGetNextFunction(fn)) {
+        defined++;
+    }
+    p.functions = malloc((defined ? defined : 1) * sizeof(ProfiledFunction));
+    for (LLVMValueRef fn = LLVMGetFirstFunction(p.module); fn;
+         fn = LLVMGetNextFunction(fn)) {
+        if (LLVMIsDeclaration(fn) || is_small_leaf(fn)) {
+            continue;
+        }
+        size_t length;
+        const char *name = LLVMGetValueName2(fn, &length);
+        char *counters_name = malloc(length + 32);
+        sprintf(counters_name, "gloin.profile.counters.%s", name);
+        ProfiledFunction *f = &p.functions[p.function_count++];
+        f->function = fn;
+        f->counters = add_counters(&p, counters_name, FUNCTION_SLOTS,
+                                   LLVMInternalLinkage);
+        free(counters_name);
+    }
+
+    if (p.function_count > 0) {
+        // Shared by every instrumented object linked together
+        p.nested = add_counters(&p, "gloin_profile_nested", 1,
+                                LLVMLinkOnceODRLinkage);
+        p.last = add_counters(&p, "gloin_profile_last", 1,
+                              LLVMLinkOnceODRLinkage);
+        for (int i = 0; i < p.function_count; i++) {
+            instrument_function(&p, &p.functions[i]);
+        }
+        for (int i = 0; i < p.function_count; i++) {
+            instrument_calls(&p, i);
+        }
+        build_registration(&p);
+    }
+
+    free(p.functions);
+    free(p.edges);
+    LLVMDisposeBuilder(p.builder);
+}
@@ -0,0 +1,222 @@
+#include "reachability.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Every function and method the programs define, to resolve calls against
+typedef struct {
+    ASTNode **functions;
+    int function_count;
+    ASTNode **methods;
+    int method_count;
+} Definitions;
+
+static void mark(Reachability *reachability, const ASTNode *node) {
+    if (is_reachable(reachability, node)) {
+        return;
+    }
+    if (reachability->count == reachability->capacity) {
+        reachability->capacity = reachability->capacity ? reachability->capacity * 2 : 16;
+        reachability->nodes = realloc(reachability->nodes,
+                                      reachability->capacity * sizeof(ASTNode *));
+    }
+    reachability->nodes[reachability->count++] = node;
+}
+
+static void mark_function(Reachability *reachability, const Definitions *defs,
+                          const char *name) {
+    for (int i = 0; i < defs->function_count; i++) {
+        if (strcmp(defs->functions[i]->data.function.name, name) == 0) {
+            mark(reachability, defs->functions[i]);
+        }
+    }
+}
+
+static void mark_method(Reachability *reachability, const Definitions *defs,
+                        const char *name) {
+    for (int i = 0; i < defs->method_count; i++) {
+        if (strcmp(defs->methods[i]->data.struct_method.name, name) == 0) {
+            mark(reachability, defs->methods[i]);
+        }
+    }
+}
+
+static void visit(Reachability *reachability, const Definitions *defs,
+                  const ASTNode *node);
+
+static void visit_list(Reachability *reachability, const Definitions *defs,
+                       ASTNode **nodes, int count) {
+    for (int i = 0; i < count; i++) {
+        visit(reachability, defs, nodes[i]);
+    }
+}
+
+// Mark the callees of every call under node
+static void visit(Reachability *reachability, const Definitions *defs,
+                  const ASTNode *node) {
+    if (!node) {
+        return;
+    }
+    switch (node->type) {
+    case NODE_FUNCTION:
+        visit(reachability, defs, node->data.function.body);
+        break;
+    case NODE_STRUCT_METHOD:
+        visit(reachability, defs, node->data.struct_method.body);
+        break;
+    case NODE_BLOCK:
+        visit_list(reachability, defs, node->data.block.statements,
+                   node->data.block.statement_count);
+        break;
+    case NODE_VARIABLE_DECL:
+        visit(reachability, defs, node->data.variable_decl.value);
+        break;
+    case NODE_ASSIGNMENT:
+        visit(reachability, defs, node->data.assignment.value);
+        break;
+    case NODE_POINTER_ASSIGNMENT:
+        visit(reachability, defs, node->data.pointer_assignment.target);
+        visit(reachability, defs, node->data.pointer_assignment.value);
+        break;
+    case NODE_RETURN:
+        visit(reachability, defs, node->data.return_stmt.value);
+        break;
+    case NODE_CALL:
+        mark_function(reachability, defs, node->data.call.name);
+        visit_list(reachability, defs, node->data.call.args,
+                   node->data.call.arg_count);
+        break;
+    case NODE_BINARY_OP:
+        visit(reachability, defs, node->data.binary_op.left);
+        visit(reachability, defs, node->data.binary_op.right);
+        break;
+    case NODE_UNARY_OP:
+        visit(reachability, defs, node->data.unary_op.operand);
+        break;
+    case NODE_FIELD_ACCESS:
+        visit(reachability, defs, node->data.field_access.object);
+        break;
+    case NODE_METHOD_CALL:
+        mark_method(reachability, defs, node->data.method_call.method_name);
+        visit(reachability, defs, node->data.method_call.object);
+        visit_list(reachability, defs, node->data.method_call.args,
+                   node->data.method_call.arg_count);
+        break;
+    case NODE_STRUCT_LITERAL:
+        visit_list(reachability, defs, node->data.struct_literal.field_values,
+                   node->data.struct_literal.field_count);
+        break;
+    case NODE_IF:
+        visit(reachability, defs, node->data.if_stmt.condition);
+        visit(reachability, defs, node->data.if_stmt.then_block);
+        visit(reachability, defs, node->data.if_stmt.else_block);
+        break;
+    case NODE_UNLESS:
+        visit(reachability, defs, node->data.unless_stmt.condition);
+        visit(reachability, defs, node->data.unless_stmt.then_block);
+        visit(reachability, defs, node->data.unless_stmt.else_block);
+        break;
+    case NODE_FOR:
+        visit(reachability, defs, node->data.for_stmt.init);
+        visit(reachability, defs, node->data.for_stmt.condition);
+        visit(reachability, defs, node->data.for_stmt.update);
+        visit(reachability, defs, node->data.for_stmt.body);
+        break;
+    case NODE_WHILE:
+        visit(reachability, defs, node->data.while_stmt.condition);
+        visit(reachability, defs, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH:
+        visit(reachability, defs, node->data.switch_stmt.expression);
+        visit_list(reachability, defs, node->data.switch_stmt.cases,
+                   node->data.switch_stmt.case_count);
+        visit(reachability, defs, node->data.switch_stmt.default_case);
+        break;
+    case NODE_SWITCH_CASE:
+        visit(reachability, defs, node->data.switch_case.value);
+        visit_list(reachability, defs, node->data.switch_case.statements,
+                   node->data.switch_case.statement_count);
+        break;
+    case NODE_MATCH:
+        visit(reachability, defs, node->data.match_stmt.expression);
+        visit_list(reachability, defs, node->data.match_stmt.cases,
+                   node->data.match_stmt.case_count);
+        break;
+    case NODE_MATCH_CASE:
+        visit(reachability, defs, node->data.match_case.pattern);
+        visit(reachability, defs, node->data.match_case.body);
+        break;
+    default:
+        // Literals, identifiers and declarations call nothing
+        break;
+    }
+}
+
+Reachability *compute_reachability(ASTNode **programs, int program_count,
+                                   const char *entry) {
+    Definitions defs = {0};
+    int capacity = 0;
+    for (int i = 0; i < program_count; i++) {
+        capacity += programs[i]->data.program.function_count;
+        for (int j = 0; j < programs[i]->data.program.function_count; j++) {
+            ASTNode *node = programs[i]->data.program.functions[j];
+            if (node->type == NODE_STRUCT) {
+                capacity += node->data.struct_decl.method_count;
+            }
+        }
+    }
+    defs.functions = malloc((capacity ? capacity : 1) * sizeof(ASTNode *));
+    defs.methods = malloc((capacity ? capacity : 1) * sizeof(ASTNode *));
+    for (int i = 0; i < program_count; i++) {
+        for (int j = 0; j < programs[i]->data.program.function_count; j++) {
+            ASTNode *node = programs[i]->data.program.functions[j];
+            if (node->type == NODE_FUNCTION) {
+                defs.functions[defs.function_count++] = node;
+            } else if (node->type == NODE_STRUCT) {
+                for (int k = 0; k < node->data.struct_decl.method_count; k++) {
+                    defs.methods[defs.method_count++] = node->data.struct_decl.methods[k];
+                }
+            }
+        }
+    }
+
+    // The marked nodes double as the worklist
+    Reachability *reachability = calloc(1, sizeof(Reachability));
+    mark_function(reachability, &defs, entry);
+    if (strcmp(entry, "main") == 0) {
+        for (int i = 0; i < program_count; i++) {
+            for (int j = 0; j < programs[i]->data.program.function_count; j++) {
+                ASTNode *node = programs[i]->data.program.functions[j];
+                if (node->type == NODE_VARIABLE_DECL) {
+                    visit(reachability, &defs, node);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < reachability->count; i++) {
+        visit(reachability, &defs, reachability->nodes[i]);
+    }
+
+    free(defs.functions);
+    free(defs.methods);
+    return reachability;
+}
+
+void free_reachability(Reachability *reachability) {
+    if (!reachability) {
+        return;
+    }
+    free(reachability->nodes);
+    free(reachability);
+}
+
+int is_reachable(const Reachability *reachability, const ASTNode *node) {
+    if (!reachability) {
+        return 1;
+    }
+    for (int i = 0; i < reachability->count; i++) {
+        if (reachability->nodes[i] == node) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,602 @@
+#include "repl.h"
+#include "codegen.h"
+#include "daemon.h"
+#include "diagnostics.h"
+#include "fold.h"
+#include "jit.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A name an earlier input defined, and the symbol its latest definition
+// was compiled to
+typedef struct {
+    char *name;               // As programs refer to it: fib, Point_show, count
+    char *symbol;             // fib.3
+    ASTNode *node;            // Function, struct method or variable declaration
+    const char *struct_name;  // For methods
+} ReplSymbol;
+
+struct ReplSession {
+    LLVMOrcLLJITRef jit;
+    ASTNode **inputs;  // Every compiled input, which the symbols point into
+    int input_count;
+    ReplSymbol *symbols;
+    int symbol_count;
+    int generation;    // Numbers the modules and the symbols they define
+};
+
+ReplSession *create_repl_session(void) {
+    LLVMOrcLLJITRef jit = create_jit();
+    if (!jit) {
+        return NULL;
+    }
+    ReplSession *session = calloc(1, sizeof(ReplSession));
+    session->jit = jit;
+    return session;
+}
+
+void free_repl_session(ReplSession *session) {
+    if (!session) {
+        return;
+    }
+    free_jit(session->jit);
+    for (int i = 0; i < session->symbol_count; i++) {
+        free(session->symbols[i].name);
+        free(session->symbols[i].symbol);
+    }
+    free(session->symbols);
+    for (int i = 0; i < session->input_count; i++) {
+        free_ast_node(session->inputs[i]);
+    }
+    free(session->inputs);
+    free(session);
+}
+
+static char *symbol_name(const char *name, int generation) {
+    char *symbol = malloc(strlen(name) + 16);
+    sprintf(symbol, "%s.%d", name, generation);
+    return symbol;
+}
+
+static void define_symbol(ReplSession *session, const char *name, int generation,
+                          ASTNode *node, const char *struct_name) {
+    ReplSymbol *symbol = NULL;
+    for (int i = 0; i < session->symbol_count && !symbol; i++) {
+        if (strcmp(session->symbols[i].name, name) == 0) {
+            symbol = &session->symbols[i];
+            free(symbol->symbol);
+        }
+    }
+    if (!symbol) {
+        session->symbols = realloc(session->symbols, (session->symbol_count + 1) * sizeof(ReplSymbol));
+        symbol = &session->symbols[session->symbol_count++];
+        symbol->name = strdup(name);
+    }
+    symbol->symbol = symbol_name(name, generation);
+    symbol->node = node;
+    symbol->struct_name = struct_name;
+}
+
+static ASTNode *find_definition(ASTNode *input, NodeType type, const char *name) {
+    for (int i = 0; i < input->data.program.function_count; i++) {
+        ASTNode *node = input->data.program.functions[i];
+        if (node->type == type && type == NODE_FUNCTION &&
+            strcmp(node->data.function.name, name) == 0) {
+            return node;
+        }
+        if (node->type == type && type == NODE_STRUCT &&
+            strcmp(node->data.struct_decl.name, name) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static LLVMTypeRef signature_type(CodeGen *codegen, const char *return_type, ASTNode **params,
+                                  int param_count, LLVMTypeRef self_type) {
+    int offset = self_type ? 1 : 0;
+    LLVMTypeRef *param_types = malloc((param_count + 1) * sizeof(LLVMTypeRef));
+    param_types[0] = self_type;
+    for (int i = 0; i < param_count; i++) {
+        param_types[i + offset] = get_llvm_type(codegen, params[i]->data.parameter.type);
+    }
+    LLVMTypeRef type = LLVMFunctionType(get_llvm_type(codegen, return_type), param_types,
+                                        param_count + offset, 0);
+    free(param_types);
+    return type;
+}
+
+// Declare what earlier inputs defined and this one does not redefine.
+// Methods are found by their plain names, so their declarations are
+// returned to be renamed to their symbols once the module is generated.
+static int declare_symbols(ReplSession *session, CodeGen *codegen, ASTNode *input,
+                           LLVMValueRef *methods, const char **method_symbols) {
+    int method_count = 0;
+    for (int i = 0; i < session->symbol_count; i++) {
+        ReplSymbol *symbol = &session->symbols[i];
+        ASTNode *node = symbol->node;
+        if (node->type == NODE_FUNCTION) {
+            if (find_definition(input, NODE_FUNCTION, symbol->name)) {
+                continue;
+            }
+            LLVMTypeRef type = signature_type(codegen, node->data.function.return_type,
+                                              node->data.function.params,
+                                              node->data.function.param_count, NULL);
+            set_function(codegen, symbol->name, LLVMAddFunction(codegen->module, symbol->symbol, type));
+        } else if (node->type == NODE_STRUCT_METHOD) {
+            if (find_definition(input, NODE_STRUCT, symbol->struct_name)) {
+                continue;
+            }
+            LLVMTypeRef self_type = LLVMPointerType(get_llvm_type(codegen, symbol->struct_name), 0);
+            LLVMTypeRef type = signature_type(codegen, node->data.struct_method.return_type,
+                                              node->data.struct_method.params,
+                                              node->data.struct_method.param_count, self_type);
+            methods[method_count] = LLVMAddFunction(codegen->module, symbol->name, type);
+            method_symbols[method_count++] = symbol->symbol;
+        } else {
+            LLVMTypeRef type = get_llvm_type(codegen, node->data.variable_decl.type);
+            LLVMValueRef global = LLVMAddGlobal(codegen->module, type, symbol->symbol);
+            set_variable_with_type(codegen, symbol->name, global, type,
+                                   node->data.variable_decl.is_mutable,
+                                   node->data.variable_decl.resolved_type);
+        }
+    }
+    return method_count;
+}
+
+// The type a statement's value has, for printing it
+static TypeKind value_type(ReplSession *session, CodeGen *codegen, ASTNode *input, ASTNode *node) {
+    if (node->type == NODE_CALL) {
+        ASTNode *function = find_definition(input, NODE_FUNCTION, node->data.call.name);
+        for (int i = 0; i < session->symbol_count && !function; i++) {
+            if (session->symbols[i].node->type == NODE_FUNCTION &&
+                strcmp(session->symbols[i].name, node->data.call.name) == 0) {
+                function = session->symbols[i].node;
+            }
+        }
+        if (function) {
+            return string_to_type(function->data.function.return_type);
+        }
+    }
+    return get_expression_type(codegen, node);
+}
+
+static int prints_value(ASTNode *statement) {
+    switch (statement->type) {
+    case NODE_CALL:
+        return strncmp(statement->data.call.name, "std.print", 9) != 0 &&
+               strcmp(statement->data.call.name, "std.free") != 0;
+    case NODE_IDENTIFIER:
+    case NODE_LITERAL:
+    case NODE_BINARY_OP:
+    case NODE_UNARY_OP:
+    case NODE_FIELD_ACCESS:
+    case NODE_METHOD_CALL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Print an expression statement's value: integers and bools, and strings
+static void print_value(CodeGen *codegen, LLVMValueRef value, TypeKind type) {
+    LLVMBuilderRef builder = codegen->builder;
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(codegen->context);
+    LLVMTypeRef value_type = LLVMTypeOf(value);
+    LLVMValueRef args[2];
+    if (LLVMGetTypeKind(value_type) == LLVMIntegerTypeKind) {
+        unsigned width = LLVMGetIntTypeWidth(value_type);
+        if (width == 1) {
+            args[0] = LLVMBuildGlobalStringPtr(builder, "%s\n", "fmt");
+            args[1] = LLVMBuildSelect(builder, value, LLVMBuildGlobalStringPtr(builder, "true", "str"),
+                                      LLVMBuildGlobalStringPtr(builder, "false", "str"), "");
+        } else if (is_unsigned_type(type)) {
+            args[0] = LLVMBuildGlobalStringPtr(builder, "%llu\n", "fmt");
+            args[1] = LLVMBuildZExtOrBitCast(builder, value, i64, "");
+        } else {
+            args[0] = LLVMBuildGlobalStringPtr(builder, "%lld\n", "fmt");
+            args[1] = width > 64 ? LLVMBuildTrunc(builder, value, i64, "")
+                                 : LLVMBuildSExtOrBitCast(builder, value, i64, "");
+        }
+    } else if (LLVMGetTypeKind(value_type) == LLVMPointerTypeKind && type == TYPE_STRING) {
+        args[0] = LLVMBuildGlobalStringPtr(builder, "%s\n", "fmt");
+        args[1] = value;
+    } else {
+        return;
+    }
+    LLVMValueRef printf_function = get_runtime_function(codegen, "printf");
+    LLVMBuildCall2(builder, LLVMGlobalGetValueType(printf_function), printf_function, args, 2, "");
+}
+
+// The name a function is defined under, which differs from its symbol
+// when a C library function of the same name took that
+static const char *definition_name(CodeGen *codegen, LLVMValueRef function) {
+    for (int i = 0; i < codegen->function_count; i++) {
+        if (codegen->functions[i].function == function) {
+            return codegen->functions[i].name;
+        }
+    }
+    size_t length;
+    return LLVMGetValueName2(function, &length);
+}
+
+// Run a top-level `def`, whose variable is the global declared for it
+static void run_variable_decl(CodeGen *codegen, ASTNode *decl) {
+    const char *name = decl->data.variable_decl.name;
+    LLVMValueRef global = LLVMGetNamedGlobal(codegen->module, name);
+    LLVMTypeRef type = LLVMGlobalGetValueType(global);
+    LLVMValueRef local = codegen_variable_decl(codegen, decl);
+    LLVMBuildStore(codegen->builder, LLVMBuildLoad2(codegen->builder, type, local, ""), global);
+    set_variable_with_type(codegen, name, global, type, decl->data.variable_decl.is_mutable,
+                           decl->data.variable_decl.resolved_type);
+}
+
+// Generate an input's definitions, and a function running its statements,
+// into a module whose definitions are renamed to this generation's
+// symbols. Returns NULL after reporting errors.
+static CodeGen *compile_input(ReplSession *session, ASTNode *input, int generation,
+                              const char *runner_name) {
+    CodeGen *codegen = create_codegen("repl");
+    LLVMValueRef *methods = malloc((session->symbol_count + 1) * sizeof(LLVMValueRef));
+    const char **method_symbols = malloc((session->symbol_count + 1) * sizeof(char *));
+    int method_count = declare_symbols(session, codegen, input, methods, method_symbols);
+
+    // Variables and functions are declared up front, so that the input's
+    // functions can use them all
+    ASTNode **items = input->data.program.functions;
+    int item_count = input->data.program.function_count;
+    for (int i = 0; i < item_count; i++) {
+        if (items[i]->type == NODE_VARIABLE_DECL) {
+            const char *name = items[i]->data.variable_decl.name;
+            LLVMTypeRef type = get_llvm_type(codegen, items[i]->data.variable_decl.type);
+            LLVMValueRef global = LLVMGetNamedGlobal(codegen->module, name);
+            if (!global) {
+                global = LLVMAddGlobal(codegen->module, type, name);
+                LLVMSetInitializer(global, LLVMConstNull(type));
+            }
+            set_variable_with_type(codegen, name, global, type,
+                                   items[i]->data.variable_decl.is_mutable,
+                                   items[i]->data.variable_decl.resolved_type);
+        } else if (items[i]->type == NODE_FUNCTION) {
+            ASTNode *function = items[i];
+            LLVMTypeRef type = signature_type(codegen, function->data.function.return_type,
+                                              function->data.function.params,
+                                              function->data.function.param_count, NULL);
+            set_function(codegen, function->data.function.name,
+                         LLVMAddFunction(codegen->module, function->data.function.name, type));
+        }
+    }
+
+    for (int i = 0; i < item_count && !codegen->has_error; i++) {
+        VariableScope scope;
+        save_variables(codegen, &scope);
+        if (items[i]->type == NODE_FUNCTION) {
+            codegen_function(codegen, items[i]);
+        } else if (items[i]->type == NODE_STRUCT) {
+            codegen_struct(codegen, items[i]);
+        } else if (items[i]->type == NODE_ENUM) {
+            // Without its note on what was generated
+            DiagnosticBuffer note = {0};
+            DiagnosticBuffer *messages = set_diagnostic_buffer(&note);
+            codegen_enum(codegen, items[i]);
+            set_diagnostic_buffer(messages);
+            clear_diagnostic_buffer(&note);
+        }
+        restore_variables(codegen, &scope);
+    }
+
+    LLVMValueRef runner = LLVMAddFunction(codegen->module, runner_name,
+                                          LLVMFunctionType(LLVMVoidTypeInContext(codegen->context), NULL, 0, 0));
+    LLVMPositionBuilderAtEnd(codegen->builder,
+                             LLVMAppendBasicBlockInContext(codegen->context, runner, "entry"));
+    codegen->current_function = runner;
+    for (int i = 0; i < item_count && !codegen->has_error; i++) {
+        ASTNode *item = items[i];
+        if (item->type == NODE_FUNCTION || item->type == NODE_STRUCT || item->type == NODE_ENUM) {
+            continue;
+        }
+        if (LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(codegen->builder))) {
+            break;
+        }
+        if (item->type == NODE_VARIABLE_DECL) {
+            run_variable_decl(codegen, item);
+        } else if (item->type == NODE_RETURN) {
+            report_error("Error: return outside a function at line %d\n", item->line);
+            codegen->has_error = 1;
+        } else {
+            LLVMValueRef value = codegen_statement(codegen, item);
+            if (value && prints_value(item)) {
+                print_value(codegen, value, value_type(session, codegen, input, item));
+            }
+        }
+    }
+    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(codegen->builder))) {
+        LLVMBuildRetVoid(codegen->builder);
+    }
+    codegen->current_function = NULL;
+
+    // Definitions get this generation's symbols, so they never clash with
+    // those of earlier inputs
+    for (LLVMValueRef function = LLVMGetFirstFunction(codegen->module); function;
+         function = LLVMGetNextFunction(function)) {
+        if (function != runner && LLVMCountBasicBlocks(function) > 0 &&
+            LLVMGetLinkage(function) == LLVMExternalLinkage) {
+            char *symbol = symbol_name(definition_name(codegen, function), generation);
+            LLVMSetValueName2(function, symbol, strlen(symbol));
+            free(symbol);
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(codegen->module); global;
+         global = LLVMGetNextGlobal(global)) {
+        if (LLVMGetInitializer(global) && LLVMGetLinkage(global) == LLVMExternalLinkage) {
+            size_t length;
+            char *symbol = symbol_name(LLVMGetValueName2(global, &length), generation);
+            LLVMSetValueName2(global, symbol, strlen(symbol));
+            free(symbol);
+        }
+    }
+    for (int i = 0; i < method_count; i++) {
+        LLVMSetValueName2(methods[i], method_symbols[i], strlen(method_symbols[i]));
+    }
+    free(methods);
+    free(method_symbols);
+
+    char *error = NULL;
+    if (!codegen->has_error && LLVMVerifyModule(codegen->module, LLVMReturnStatusAction, &error)) {
+        report_error("Invalid module generated:\n%s", error);
+        codegen->has_error = 1;
+    }
+    LLVMDisposeMessage(error);
+    if (codegen->has_error) {
+        free_codegen(codegen);
+        return NULL;
+    }
+    return codegen;
+}
+
+// Record what an input defined, once its module is in the JIT
+static void define_input_symbols(ReplSession *session, ASTNode *input, int generation) {
+    for (int i = 0; i < input->data.program.function_count; i++) {
+        ASTNode *item = input->data.program.functions[i];
+        if (item->type == NODE_FUNCTION) {
+            define_symbol(session, item->data.function.name, generation, item, NULL);
+        } else if (item->type == NODE_VARIABLE_DECL) {
+            define_symbol(session, item->data.variable_decl.name, generation, item, NULL);
+        } else if (item->type == NODE_STRUCT) {
+            // Methods of an earlier layout no longer apply
+            const char *struct_name = item->data.struct_decl.name;
+            int kept = 0;
+            for (int j = 0; j < session->symbol_count; j++) {
+                ReplSymbol *symbol = &session->symbols[j];
+                if (symbol->struct_name && strcmp(symbol->struct_name, struct_name) == 0) {
+                    free(symbol->name);
+                    free(symbol->symbol);
+                } else {
+                    session->symbols[kept++] = *symbol;
+                }
+            }
+            session->symbol_count = kept;
+            for (int j = 0; j < item->data.struct_decl.method_count; j++) {
+                ASTNode *method = item->data.struct_decl.methods[j];
+                if (method->data.struct_method.visibility == VISIBILITY_PRIVATE) {
+                    continue;
+                }
+                char *name = malloc(strlen(struct_name) + strlen(method->data.struct_method.name) + 2);
+                sprintf(name, "%s_%s", struct_name, method->data.struct_method.name);
+                define_symbol(session, name, generation, method, struct_name);
+                free(name);
+            }
+        }
+    }
+}
+
+// Struct types registered by earlier inputs that this input redefines are
+// renamed out of the way, and restored if the input fails
+typedef struct {
+    int struct_count;
+    char **names;  // Original names of the renamed structs, by index
+} RegistryState;
+
+static void hide_redefined_structs(ASTNode *input, int generation, RegistryState *state) {
+    TypeRegistry *registry = current_type_registry();
+    state->struct_count = registry->struct_count;
+    state->names = calloc(registry->struct_count + 1, sizeof(char *));
+    for (int i = 0; i < input->data.program.function_count; i++) {
+        ASTNode *item = input->data.program.functions[i];
+        if (item->type != NODE_STRUCT) {
+            continue;
+        }
+        for (int j = 0; j < registry->struct_count; j++) {
+            StructType *st = &registry->structs[j];
+            if (!state->names[j] && strcmp(st->name, item->data.struct_decl.name) == 0) {
+                state->names[j] = st->name;
+                st->name = symbol_name(st->name, generation);
+            }
+        }
+    }
+}
+
+static void finish_registry_state(RegistryState *state, int failed) {
+    TypeRegistry *registry = current_type_registry();
+    for (int i = 0; i < state->struct_count; i++) {
+        if (state->names[i] && failed) {
+            free(registry->structs[i].name);
+            registry->structs[i].name = state->names[i];
+        } else {
+            free(state->names[i]);
+        }
+    }
+    free(state->names);
+    if (!failed) {
+        return;
+    }
+    for (int i = state->struct_count; i < registry->struct_count; i++) {
+        StructType *st = &registry->structs[i];
+        for (int j = 0; j < st->field_count; j++) {
+            free(st->fields[j].name);
+        }
+        free(st->fields);
+        free(st->name);
+    }
+    registry->struct_count = state->struct_count;
+}
+
+int repl_eval(ReplSession *session, const char *source) {
+    DiagnosticBuffer messages = {0};
+    DiagnosticBuffer *previous = set_diagnostic_buffer(&messages);
+    int generation = ++session->generation;
+
+    Lexer *lexer = create_lexer(source);
+    Parser *parser = create_parser(lexer);
+    ASTNode *input = parse_partial_program(parser);
+    free_parser(parser);
+    free_lexer(lexer);
+
+    for (int i = 0; input && i < input->data.program.import_count; i++) {
+        ASTNode *import = input->data.program.imports[i];
+        if (import->data.import.import_type != IMPORT_STD) {
+            report_error("Error: Only @std can be imported in the REPL\n");
+            free_ast_node(input);
+            input = NULL;
+        }
+    }
+
+    CodeGen *codegen = NULL;
+    void (*runner)(void) = NULL;
+    if (input) {
+        RegistryState registry_state;
+        hide_redefined_structs(input, generation, &registry_state);
+        resolve_types(input);
+        int failed = fold_constants(input);
+
+        char runner_name[32];
+        snprintf(runner_name, sizeof(runner_name), "repl.%d", generation);
+        codegen = failed ? NULL : compile_input(session, input, generation, runner_name);
+        // Code generation reports some errors without failing, but then
+        // has generated code that is missing parts
+        if (codegen && messages.length == 0 &&
+            jit_add_module(session->jit, codegen->module) == 0) {
+            runner = (void (*)(void))jit_lookup(session->jit, runner_name);
+        }
+        free_codegen(codegen);
+        finish_registry_state(&registry_state, runner == NULL);
+    }
+
+    set_diagnostic_buffer(previous);
+    if (!runner) {
+        if (messages.data) {
+            fputs(messages.data, stderr);
+        }
+        clear_diagnostic_buffer(&messages);
+        free_ast_node(input);
+        return 1;
+    }
+    clear_diagnostic_buffer(&messages);
+
+    define_input_symbols(session, input, generation);
+    session->inputs = realloc(session->inputs, (session->input_count + 1) * sizeof(ASTNode *));
+    session->inputs[session->input_count++] = input;
+
+    runner();
+    fflush(stdout);
+    return 0;
+}
+
+// Change in brace depth over a line, outside string literals
+static int brace_depth(const char *line) {
+    int depth = 0;
+    int in_string = 0;
+    for (const char *c = line; *c; c++) {
+        if (in_string) {
+            if (*c == '\\' && c[1]) {
+                c++;
+            } else if (*c == '"') {
+                in_string = 0;
+            }
+        } else if (*c == '"') {
+            in_string = 1;
+        } else if (*c == '{') {
+            depth++;
+        } else if (*c == '}') {
+            depth--;
+        }
+    }
+    return depth;
+}
+
+// Evaluate an input, ending it with the ';' an expression or declaration
+// typed on its own usually lacks
+static void evaluate(ReplSession *session, char *source, size_t length) {
+    while (length > 0 && strchr(" \t\r\n", source[length - 1])) {
+        length--;
+    }
+    source[length] = '\0';
+    const char *start = source + strspn(source, " \t");
+    if (length > 0 && source[length - 1] != ';' && source[length - 1] != '}' &&
+        strncmp(start, "import", 6) != 0) {
+        strcpy(source + length, ";");
+    }
+    repl_eval(session, source);
+}
+
+int run_repl(FILE *input) {
+    ReplSession *session = create_repl_session();
+    if (!session) {
+        return 1;
+    }
+    int interactive = input_is_terminal(fileno(input));
+    char *line = NULL;
+    size_t line_capacity = 0;
+    char *source = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    int depth = 0;
+
+    while (1) {
+        if (interactive) {
+            fputs(length ? "  ...> " : "gloin> ", stdout);
+            fflush(stdout);
+        }
+        ssize_t read = getline(&line, &line_capacity, input);
+        if (read < 0) {
+            break;
+        }
+        if (length == 0) {
+            const char *start = line + strspn(line, " \t");
+            if (strncmp(start, ":quit", 5) == 0 || strncmp(start, ":q\n", 3) == 0) {
+                break;
+            }
+            if (strspn(start, " \t\r\n") == strlen(start)) {
+                continue;
+            }
+        }
+
+        // Room for the line and a ';' evaluate may add
+        if (length + read + 2 > capacity) {
+            capacity = (length + read + 2) * 2;
+            source = realloc(source, capacity);
+        }
+        memcpy(source + length, line, read + 1);
+        length += read;
+        depth += brace_depth(line);
+        if (depth <= 0) {
+            evaluate(session, source, length);
+            length = 0;
+            depth = 0;
+        }
+    }
+    if (length > 0) {
+        evaluate(session, source, length);
+    }
+    if (interactive) {
+        putchar('\n');
+    }
+
+    free(line);
+    free(source);
+    free_repl_session(session);
+    return 0;
+}
@@ -0,0 +1,512 @@
+#include "tier.h"
+#include "codegen.h"
+#include "diagnostics.h"
+#include "jit.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct TierCompiler {
+    InterpProgram *program;
+    TypeRegistry *registry;  // The program's struct types
+    LLVMOrcLLJITRef jit;     // Created with the first compiled function
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;
+    int *queue;              // Hot functions waiting to be compiled
+    int queue_count;
+    int queue_capacity;
+    int stopping;
+    int compiled_count;
+};
+
+// Functions are declared with the same types codegen_function gives them
+static LLVMTypeRef function_type(CodeGen *codegen, ASTNode *function) {
+    int param_count = function->data.function.param_count;
+    LLVMTypeRef *param_types = malloc((param_count ? param_count : 1) * sizeof(LLVMTypeRef));
+    for (int i = 0; i < param_count; i++) {
+        param_types[i] = get_llvm_type(codegen, function->data.function.params[i]->data.parameter.type);
+    }
+    LLVMTypeRef type = LLVMFunctionType(get_llvm_type(codegen, function->data.function.return_type),
+                                        param_types, param_count, 0);
+    free(param_types);
+    return type;
+}
+
+static int is_scalar_type(LLVMTypeRef type) {
+    LLVMTypeKind kind = LLVMGetTypeKind(type);
+    return kind == LLVMIntegerTypeKind || kind == LLVMPointerTypeKind;
+}
+
+// Whether values cross between the interpreter and native code as i64s
+static int has_scalar_signature(LLVMTypeRef type) {
+    LLVMTypeRef return_type = LLVMGetReturnType(type);
+    if (LLVMGetTypeKind(return_type) != LLVMVoidTypeKind && !is_scalar_type(return_type)) {
+        return 0;
+    }
+    int param_count = LLVMCountParamTypes(type);
+    LLVMTypeRef *param_types = malloc((param_count ? param_count : 1) * sizeof(LLVMTypeRef));
+    LLVMGetParamTypes(type, param_types);
+    int scalar = 1;
+    for (int i = 0; i < param_count && scalar; i++) {
+        scalar = is_scalar_type(param_types[i]);
+    }
+    free(param_types);
+    return scalar;
+}
+
+// The interpreter keeps integers sign-extended and bools as 0 or 1
+static LLVMValueRef to_register(CodeGen *codegen, LLVMValueRef value) {
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(codegen->context);
+    LLVMTypeRef type = LLVMTypeOf(value);
+    if (LLVMGetTypeKind(type) == LLVMPointerTypeKind) {
+        return LLVMBuildPtrToInt(codegen->builder, value, i64, "");
+    }
+    unsigned width = LLVMGetIntTypeWidth(type);
+    if (width == 64) {
+        return value;
+    }
+    return width == 1 ? LLVMBuildZExt(codegen->builder, value, i64, "")
+                      : LLVMBuildSExt(codegen->builder, value, i64, "");
+}
+
+static LLVMValueRef from_register(CodeGen *codegen, LLVMValueRef value, LLVMTypeRef type) {
+    if (LLVMGetTypeKind(type) == LLVMPointerTypeKind) {
+        return LLVMBuildIntToPtr(codegen->builder, value, type, "");
+    }
+    if (LLVMGetIntTypeWidth(type) == 64) {
+        return value;
+    }
+    return LLVMBuildTrunc(codegen->builder, value, type, "");
+}
+
+// Define a function as a call back into the interpreter
+static void build_interpreter_stub(TierCompiler *tier, CodeGen *codegen, LLVMValueRef function,
+                                   int index) {
+    LLVMContextRef context = codegen->context;
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(context);
+    LLVMTypeRef i8_ptr = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+    LLVMTypeRef i64_ptr = LLVMPointerType(i64, 0);
+    LLVMTypeRef call_params[] = {i8_ptr, LLVMInt32TypeInContext(context), i64_ptr};
+    LLVMTypeRef call_type = LLVMFunctionType(i64, call_params, 3, 0);
+    LLVMValueRef call_address =
+        LLVMConstIntToPtr(LLVMConstInt(i64, (uintptr_t)interp_call, 0), LLVMPointerType(call_type, 0));
+
+    LLVMPositionBuilderAtEnd(codegen->builder,
+                             LLVMAppendBasicBlockInContext(context, function, "entry"));
+    int param_count = LLVMCountParams(function);
+    LLVMTypeRef args_type = LLVMArrayType(i64, param_count ? param_count : 1);
+    LLVMValueRef args = LLVMBuildAlloca(codegen->builder, args_type, "args");
+    LLVMValueRef first = LLVMBuildBitCast(codegen->builder, args, i64_ptr, "");
+    for (int i = 0; i < param_count; i++) {
+        LLVMValueRef offset = LLVMConstInt(i64, i, 0);
+        LLVMValueRef slot = LLVMBuildGEP2(codegen->builder, i64, first, &offset, 1, "");
+        LLVMBuildStore(codegen->builder, to_register(codegen, LLVMGetParam(function, i)), slot);
+    }
+    LLVMValueRef call_args[] = {
+        LLVMConstIntToPtr(LLVMConstInt(i64, (uintptr_t)tier->program, 0), i8_ptr),
+        LLVMConstInt(LLVMInt32TypeInContext(context), index, 0),
+        first,
+    };
+    LLVMValueRef result = LLVMBuildCall2(codegen->builder, call_type, call_address, call_args, 3, "");
+
+    LLVMTypeRef return_type = LLVMGetReturnType(LLVMGlobalGetValueType(function));
+    if (LLVMGetTypeKind(return_type) == LLVMVoidTypeKind) {
+        LLVMBuildRetVoid(codegen->builder);
+    } else {
+        LLVMBuildRet(codegen->builder, from_register(codegen, result, return_type));
+    }
+}
+
+// The entry point the interpreter calls: i64 name(i64 *args)
+static void build_native_entry(CodeGen *codegen, LLVMValueRef function, const char *name) {
+    LLVMContextRef context = codegen->context;
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(context);
+    LLVMTypeRef i64_ptr = LLVMPointerType(i64, 0);
+    LLVMValueRef entry = LLVMAddFunction(codegen->module, name, LLVMFunctionType(i64, &i64_ptr, 1, 0));
+    LLVMPositionBuilderAtEnd(codegen->builder,
+                             LLVMAppendBasicBlockInContext(context, entry, "entry"));
+
+    LLVMTypeRef type = LLVMGlobalGetValueType(function);
+    int param_count = LLVMCountParamTypes(type);
+    LLVMTypeRef *param_types = malloc((param_count ? param_count : 1) * sizeof(LLVMTypeRef));
+    LLVMValueRef *args = malloc((param_count ? param_count : 1) * sizeof(LLVMValueRef));
+    LLVMGetParamTypes(type, param_types);
+    for (int i = 0; i < param_count; i++) {
+        LLVMValueRef offset = LLVMConstInt(i64, i, 0);
+        LLVMValueRef slot = LLVMBuildGEP2(codegen->builder, i64, LLVMGetParam(entry, 0), &offset, 1, "");
+        args[i] = from_register(codegen, LLVMBuildLoad2(codegen->builder, i64, slot, ""), param_types[i]);
+    }
+    LLVMValueRef result = LLVMBuildCall2(codegen->builder, type, function, args, param_count, "");
+    if (LLVMGetTypeKind(LLVMGetReturnType(type)) == LLVMVoidTypeKind) {
+        LLVMBuildRet(codegen->builder, LLVMConstInt(i64, 0, 0));
+    } else {
+        LLVMBuildRet(codegen->builder, to_register(codegen, result));
+    }
+    free(param_types);
+    free(args);
+}
+
+// Point codegen's variables at the interpreter's globals of a module, so
+// generated code reads and writes the same memory the bytecode does
+static void declare_module_globals(TierCompiler *tier, CodeGen *codegen, int module) {
+    InterpProgram *program = tier->program;
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(codegen->context);
+    for (int i = 0; i < interp_global_count(program); i++) {
+        if (interp_global_module(program, i) != module) {
+            continue;
+        }
+        ASTNode *decl = interp_global_node(program, i);
+        LLVMTypeRef type = get_llvm_type(codegen, decl->data.variable_decl.type);
+        LLVMValueRef address = LLVMConstIntToPtr(
+            LLVMConstInt(i64, (uintptr_t)interp_global_address(program, i), 0),
+            LLVMPointerType(type, 0));
+        set_variable_with_type(codegen, decl->data.variable_decl.name, address, type,
+                               decl->data.variable_decl.is_mutable,
+                               decl->data.variable_decl.resolved_type);
+    }
+}
+
+static int append_continuation(ASTNode *block, ASTNode *node, ASTNode *loop, ASTNode *resume);
+
+// Statements of a list from the one holding the loop on
+static int append_continuation_list(ASTNode *block, ASTNode **statements, int count,
+                                    ASTNode *loop, ASTNode *resume) {
+    for (int i = 0; i < count; i++) {
+        if (append_continuation(block, statements[i], loop, resume)) {
+            for (int j = i + 1; j < count; j++) {
+                add_statement_to_block(block, statements[j]);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Add to block what runs of node from the loop's back edge on: resume in
+// place of the loop, then the statements after it in each enclosing
+// block. Returns 0 when the loop is not in node. Outermost loops are only
+// nested in blocks, conditionals and switches.
+static int append_continuation(ASTNode *block, ASTNode *node, ASTNode *loop, ASTNode *resume) {
+    if (!node) {
+        return 0;
+    }
+    if (node == loop) {
+        add_statement_to_block(block, resume);
+        return 1;
+    }
+    switch (node->type) {
+    case NODE_BLOCK:
+        return append_continuation_list(block, node->data.block.statements,
+                                        node->data.block.statement_count, loop, resume);
+    case NODE_IF:
+        return append_continuation(block, node->data.if_stmt.then_block, loop, resume) ||
+               append_continuation(block, node->data.if_stmt.else_block, loop, resume);
+    case NODE_UNLESS:
+        return append_continuation(block, node->data.unless_stmt.then_block, loop, resume) ||
+               append_continuation(block, node->data.unless_stmt.else_block, loop, resume);
+    case NODE_SWITCH: {
+        ASTNode *default_case = node->data.switch_stmt.default_case;
+        for (int i = 0; i < node->data.switch_stmt.case_count; i++) {
+            ASTNode *switch_case = node->data.switch_stmt.cases[i];
+            if (append_continuation_list(block, switch_case->data.switch_case.statements,
+                                         switch_case->data.switch_case.statement_count,
+                                         loop, resume)) {
+                return 1;
+            }
+        }
+        return default_case &&
+               append_continuation_list(block, default_case->data.switch_case.statements,
+                                        default_case->data.switch_case.statement_count,
+                                        loop, resume);
+    }
+    case NODE_MATCH:
+        for (int i = 0; i < node->data.match_stmt.case_count; i++) {
+            if (append_continuation(block, node->data.match_stmt.cases[i]->data.match_case.body,
+                                    loop, resume)) {
+                return 1;
+            }
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+// Generate name, the rest of a running call of the hot function from the
+// back edge of one of its loops, taking the loop's variables. Its body
+// shares the hot function's statements. Returns 0 when the loop's
+// variables are not all scalars.
+static int generate_loop_continuation(TierCompiler *tier, CodeGen *codegen, int index, int loop,
+                                      const char *name) {
+    InterpProgram *program = tier->program;
+    ASTNode *hot = interp_function_node(program, index);
+    ASTNode *loop_node = interp_loop_node(program, index, loop);
+    ASTNode *continuation = create_function_node(name, hot->data.function.return_type);
+    for (int i = 0; i < interp_loop_variable_count(program, index, loop); i++) {
+        TypeKind type;
+        const char *variable = interp_loop_variable(program, index, loop, i, &type);
+        add_parameter_to_function(continuation, create_parameter_node(variable, type_to_string(type)));
+    }
+
+    // From the back edge a for loop goes on to its test, not its initializer
+    ASTNode resume = *loop_node;
+    if (resume.type == NODE_FOR) {
+        resume.data.for_stmt.init = NULL;
+    }
+    ASTNode *body = create_block_node();
+    append_continuation(body, hot->data.function.body, loop_node, &resume);
+    continuation->data.function.body = body;
+
+    LLVMValueRef function = NULL;
+    int scalar = 1;
+    for (int i = 0; i < continuation->data.function.param_count && scalar; i++) {
+        scalar = is_scalar_type(get_llvm_type(codegen, continuation->data.function.params[i]->data.parameter.type));
+    }
+    if (scalar) {
+        VariableScope scope;
+        save_variables(codegen, &scope);
+        declare_module_globals(tier, codegen, interp_function_module(program, index));
+        function = codegen_function(codegen, continuation);
+        restore_variables(codegen, &scope);
+    }
+
+    // The statements belong to the hot function
+    body->data.block.statement_count = 0;
+    free_ast_node(continuation);
+    if (!function || codegen->has_error) {
+        return 0;
+    }
+    char entry_name[80];
+    snprintf(entry_name, sizeof(entry_name), "%s_entry", name);
+    build_native_entry(codegen, function, entry_name);
+    return 1;
+}
+
+// Generate a module holding the hot function and its native entry point,
+// with one more for each of its loops to continue a running call from.
+// Other functions with scalar signatures call back into the interpreter;
+// struct methods and the rest are generated in full, as codegen_struct and
+// codegen_function make them. Returns NULL when the function cannot be
+// compiled.
+static CodeGen *generate_tier_module(TierCompiler *tier, int index, const char *entry_name) {
+    InterpProgram *program = tier->program;
+    ASTNode *hot = interp_function_node(program, index);
+    CodeGen *codegen = create_codegen("gloin_tier");
+
+    // Declare every function first, so generated code can call any of them
+    int function_count = interp_function_count(program);
+    for (int i = 0; i < function_count; i++) {
+        ASTNode *node = interp_function_node(program, i);
+        if (node->type != NODE_FUNCTION || interp_find_function(program, node->data.function.name) != i) {
+            continue;
+        }
+        LLVMValueRef function = LLVMAddFunction(codegen->module, node->data.function.name,
+                                                function_type(codegen, node));
+        set_function(codegen, node->data.function.name, function);
+    }
+    if (!has_scalar_signature(LLVMGlobalGetValueType(get_function(codegen, hot->data.function.name)))) {
+        free_codegen(codegen);
+        return NULL;
+    }
+
+    for (int m = 0; m < interp_module_count(program) && !codegen->has_error; m++) {
+        ASTNode *module = interp_module(program, m);
+        for (int i = 0; i < module->data.program.function_count && !codegen->has_error; i++) {
+            if (module->data.program.functions[i]->type == NODE_STRUCT) {
+                VariableScope scope;
+                save_variables(codegen, &scope);
+                declare_module_globals(tier, codegen, m);
+                codegen_struct(codegen, module->data.program.functions[i]);
+                restore_variables(codegen, &scope);
+            }
+        }
+    }
+    for (int i = 0; i < function_count && !codegen->has_error; i++) {
+        ASTNode *node = interp_function_node(program, i);
+        if (node->type != NODE_FUNCTION || interp_find_function(program, node->data.function.name) != i) {
+            continue;
+        }
+        LLVMValueRef function = get_function(codegen, node->data.function.name);
+        if (i != index && has_scalar_signature(LLVMGlobalGetValueType(function))) {
+            build_interpreter_stub(tier, codegen, function, i);
+        } else {
+            VariableScope scope;
+            save_variables(codegen, &scope);
+            declare_module_globals(tier, codegen, interp_function_module(program, i));
+            codegen_function(codegen, node);
+            restore_variables(codegen, &scope);
+        }
+    }
+    if (codegen->has_error) {
+        free_codegen(codegen);
+        return NULL;
+    }
+    build_native_entry(codegen, get_function(codegen, hot->data.function.name), entry_name);
+    for (int loop = 0; loop < interp_loop_count(program, index) && !codegen->has_error; loop++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s_loop_%d", entry_name, loop);
+        generate_loop_continuation(tier, codegen, index, loop, name);
+    }
+    if (codegen->has_error) {
+        free_codegen(codegen);
+        return NULL;
+    }
+
+    // Only the entry points are looked up, so the rest may be inlined into them
+    size_t entry_length = strlen(entry_name);
+    for (LLVMValueRef function = LLVMGetFirstFunction(codegen->module); function;
+         function = LLVMGetNextFunction(function)) {
+        size_t length;
+        const char *name = LLVMGetValueName2(function, &length);
+        if (LLVMCountBasicBlocks(function) > 0 && strncmp(name, entry_name, entry_length) != 0) {
+            LLVMSetLinkage(function, LLVMInternalLinkage);
+        }
+    }
+    char *error = NULL;
+    if (LLVMVerifyModule(codegen->module, LLVMReturnStatusAction, &error)) {
+        LLVMDisposeMessage(error);
+        free_codegen(codegen);
+        return NULL;
+    }
+    LLVMDisposeMessage(error);
+    return codegen;
+}
+
+// Compile one hot function and install it. Failures leave the function
+// in the interpreter.
+static void compile_hot_function(TierCompiler *tier, int index) {
+    char entry_name[32];
+    snprintf(entry_name, sizeof(entry_name), "gloin_tier_%d", index);
+    CodeGen *codegen = generate_tier_module(tier, index, entry_name);
+    if (!codegen) {
+        return;
+    }
+
+    char *error = NULL;
+    LLVMTargetMachineRef target_machine = create_target_machine(codegen->module, 2, &error);
+    int failed = !target_machine ||
+                 optimize_module(codegen->module, target_machine, 2, LTO_NONE, NULL, &error) != 0;
+    if (target_machine) {
+        LLVMDisposeTargetMachine(target_machine);
+    }
+    LLVMDisposeMessage(error);
+    if (!failed && !tier->jit) {
+        tier->jit = create_jit();
+    }
+    failed = failed || !tier->jit || jit_add_module(tier->jit, codegen->module) != 0;
+    free_codegen(codegen);
+    if (failed) {
+        return;
+    }
+
+    InterpNative native = (InterpNative)jit_lookup(tier->jit, entry_name);
+    if (native) {
+        interp_set_native(tier->program, index, native);
+        tier->compiled_count++;
+    }
+    for (int loop = 0; loop < interp_loop_count(tier->program, index); loop++) {
+        char loop_entry[96];
+        snprintf(loop_entry, sizeof(loop_entry), "%s_loop_%d_entry", entry_name, loop);
+        native = (InterpNative)jit_lookup(tier->jit, loop_entry);
+        if (native) {
+            interp_set_loop_native(tier->program, index, loop, native);
+        }
+    }
+}
+
+static void *tier_thread(void *argument) {
+    TierCompiler *tier = argument;
+    // Messages from failed compiles would only confuse the program's output
+    DiagnosticBuffer messages = {0};
+    set_diagnostic_buffer(&messages);
+    set_type_registry(tier->registry);
+
+    pthread_mutex_lock(&tier->mutex);
+    while (1) {
+        while (tier->queue_count == 0 && !tier->stopping) {
+            pthread_cond_wait(&tier->queued, &tier->mutex);
+        }
+        if (tier->stopping) {
+            break;
+        }
+        int index = tier->queue[0];
+        tier->queue_count--;
+        memmove(tier->queue, tier->queue + 1, tier->queue_count * sizeof(int));
+        pthread_mutex_unlock(&tier->mutex);
+
+        compile_hot_function(tier, index);
+        clear_diagnostic_buffer(&messages);
+
+        pthread_mutex_lock(&tier->mutex);
+    }
+    pthread_mutex_unlock(&tier->mutex);
+
+    set_diagnostic_buffer(NULL);
+    clear_diagnostic_buffer(&messages);
+    return NULL;
+}
+
+static void queue_hot_function(void *context, int function) {
+    TierCompiler *tier = context;
+    if (interp_function_node(tier->program, function)->type != NODE_FUNCTION) {
+        return;
+    }
+    pthread_mutex_lock(&tier->mutex);
+    if (tier->queue_count == tier->queue_capacity) {
+        tier->queue_capacity = tier->queue_capacity ? tier->queue_capacity * 2 : 8;
+        tier->queue = realloc(tier->queue, tier->queue_capacity * sizeof(int));
+    }
+    tier->queue[tier->queue_count++] = function;
+    pthread_cond_signal(&tier->queued);
+    pthread_mutex_unlock(&tier->mutex);
+}
+
+TierCompiler *create_tier_compiler(InterpProgram *program, uint32_t threshold) {
+    TierCompiler *tier = calloc(1, sizeof(TierCompiler));
+    tier->program = program;
+    tier->registry = current_type_registry();
+    pthread_mutex_init(&tier->mutex, NULL);
+    pthread_cond_init(&tier->queued, NULL);
+    if (pthread_create(&tier->thread, NULL, tier_thread, tier) != 0) {
+        report_error("Error: Cannot start the tier compiler thread\n");
+        pthread_mutex_destroy(&tier->mutex);
+        pthread_cond_destroy(&tier->queued);
+        free(tier);
+        return NULL;
+    }
+    interp_set_tiering(program, threshold ? threshold : 1, queue_hot_function, tier);
+    return tier;
+}
+
+void free_tier_compiler(TierCompiler *tier) {
+    if (!tier) {
+        return;
+    }
+    interp_set_tiering(tier->program, 0, NULL, NULL);
+    pthread_mutex_lock(&tier->mutex);
+    tier->stopping = 1;
+    pthread_cond_signal(&tier->queued);
+    pthread_mutex_unlock(&tier->mutex);
+    pthread_join(tier->thread, NULL);
+
+    // Native code is gone with the JIT
+    for (int i = 0; i < interp_function_count(tier->program); i++) {
+        interp_set_native(tier->program, i, NULL);
+        for (int loop = 0; loop < interp_loop_count(tier->program, i); loop++) {
+            interp_set_loop_native(tier->program, i, loop, NULL);
+        }
+    }
+    free_jit(tier->jit);
+    pthread_mutex_destroy(&tier->mutex);
+    pthread_cond_destroy(&tier->queued);
+    free(tier->queue);
+    free(tier);
+}
+
+int tier_compiled_count(const TierCompiler *tier) {
+    return tier ? tier->compiled_count : 0;
+}
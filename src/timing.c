@@ -0,0 +1,233 @@
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Slowest details listed per phase in the text report
+#define REPORT_DETAILS 10
+
+static __thread TimeReport *active_report = NULL;
+
+static const char *phase_names[TIMING_PHASE_COUNT] = {
+    "read", "load-cache", "lex", "parse", "resolve-types",
+    "fold-constants", "codegen", "verify", "optimize", "emit", "link",
+};
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static TimePoint current_time(void) {
+    TimePoint now;
+    now.wall = clock_seconds(CLOCK_MONOTONIC);
+    now.cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+    return now;
+}
+
+TimeReport *create_time_report(void) {
+    TimeReport *report = calloc(1, sizeof(TimeReport));
+    report->started = current_time();
+    return report;
+}
+
+void free_time_report(TimeReport *report) {
+    if (!report) {
+        return;
+    }
+    for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        for (int i = 0; i < report->details[phase].count; i++) {
+            free(report->details[phase].entries[i].name);
+        }
+        free(report->details[phase].entries);
+    }
+    free(report);
+}
+
+TimeReport *set_time_report(TimeReport *report) {
+    TimeReport *previous = active_report;
+    active_report = report;
+    return previous;
+}
+
+TimeReport *current_time_report(void) {
+    return active_report;
+}
+
+int timing_enabled(void) {
+    return active_report != NULL;
+}
+
+TimePoint time_now(void) {
+    if (!active_report) {
+        TimePoint zero = {0, 0};
+        return zero;
+    }
+    return current_time();
+}
+
+TimePoint time_since(TimePoint start) {
+    TimePoint now = current_time();
+    now.wall -= start.wall;
+    now.cpu -= start.cpu;
+    return now;
+}
+
+static void add_entry(TimeReport *report, TimingPhase phase,
+                      const char *detail, TimePoint elapsed, long count) {
+    TimingEntry *total = &report->phases[phase];
+    total->time.wall += elapsed.wall;
+    total->time.cpu += elapsed.cpu;
+    total->count += count;
+    if (!detail) {
+        return;
+    }
+
+    // Search from the end: the same function or pass tends to repeat
+    TimingEntry *entry = NULL;
+    for (int i = report->details[phase].count - 1; i >= 0; i--) {
+        if (strcmp(report->details[phase].entries[i].name, detail) == 0) {
+            entry = &report->details[phase].entries[i];
+            break;
+        }
+    }
+    if (!entry) {
+        if (report->details[phase].count == report->details[phase].capacity) {
+            int capacity = report->details[phase].capacity ?
+                           report->details[phase].capacity * 2 : 16;
+            report->details[phase].entries =
+                realloc(report->details[phase].entries,
+                        capacity * sizeof(TimingEntry));
+            report->details[phase].capacity = capacity;
+        }
+        entry = &report->details[phase].entries[report->details[phase].count++];
+        memset(entry, 0, sizeof(TimingEntry));
+        entry->name = strdup(detail);
+    }
+    entry->time.wall += elapsed.wall;
+    entry->time.cpu += elapsed.cpu;
+    entry->count += count;
+}
+
+void record_time(TimingPhase phase, const char *detail, TimePoint start) {
+    if (active_report) {
+        add_entry(active_report, phase, detail, time_since(start), 1);
+    }
+}
+
+void add_time(TimingPhase phase, const char *detail, TimePoint elapsed) {
+    if (active_report) {
+        add_entry(active_report, phase, detail, elapsed, 1);
+    }
+}
+
+const char *timing_phase_name(TimingPhase phase) {
+    return phase_names[phase];
+}
+
+void merge_time_report(TimeReport *into, const TimeReport *from) {
+    for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        // Details carry their share of the phase total with them
+        TimePoint rest = from->phases[phase].time;
+        long rest_count = from->phases[phase].count;
+        for (int i = 0; i < from->details[phase].count; i++) {
+            const TimingEntry *entry = &from->details[phase].entries[i];
+            add_entry(into, phase, entry->name, entry->time, entry->count);
+            rest.wall -= entry->time.wall;
+            rest.cpu -= entry->time.cpu;
+            rest_count -= entry->count;
+        }
+        add_entry(into, phase, NULL, rest, rest_count);
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const TimingEntry *x = a;
+    const TimingEntry *y = b;
+    if (x->time.wall != y->time.wall) {
+        return x->time.wall < y->time.wall ? 1 : -1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+static void print_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void print_json_entry(FILE *out, const char *name,
+                             const TimingEntry *entry) {
+    fprintf(out, "{\"name\":");
+    print_json_string(out, name);
+    fprintf(out, ",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"count\":%ld",
+            entry->time.wall * 1000, entry->time.cpu * 1000, entry->count);
+}
+
+void print_time_report(const TimeReport *report, FILE *out, int json) {
+    TimePoint total = time_since(report->started);
+
+    if (json) {
+        fprintf(out, "{\"total_wall_ms\":%.3f,\"total_cpu_ms\":%.3f,"
+                "\"phases\":[", total.wall * 1000, total.cpu * 1000);
+        for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+            if (phase) {
+                fputc(',', out);
+            }
+            print_json_entry(out, phase_names[phase], &report->phases[phase]);
+            fprintf(out, ",\"details\":[");
+            for (int i = 0; i < report->details[phase].count; i++) {
+                const TimingEntry *entry = &report->details[phase].entries[i];
+                if (i) {
+                    fputc(',', out);
+                }
+                print_json_entry(out, entry->name, entry);
+                fprintf(out, "}");
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "]}\n");
+        return;
+    }
+
+    fprintf(out, "===---------------------------------------------------------------------===\n");
+    fprintf(out, "                            Gloin time report\n");
+    fprintf(out, "===---------------------------------------------------------------------===\n");
+    fprintf(out, "  Total: %.3f ms wall, %.3f ms CPU\n\n", total.wall * 1000,
+            total.cpu * 1000);
+    fprintf(out, "  %-36s %12s %12s %8s\n", "Phase", "Wall (ms)", "CPU (ms)",
+            "Count");
+    for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        const TimingEntry *entry = &report->phases[phase];
+        fprintf(out, "  %-36s %12.3f %12.3f %8ld\n", phase_names[phase],
+                entry->time.wall * 1000, entry->time.cpu * 1000, entry->count);
+    }
+
+    for (int phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        int count = report->details[phase].count;
+        if (count == 0) {
+            continue;
+        }
+        TimingEntry *sorted = malloc(count * sizeof(TimingEntry));
+        memcpy(sorted, report->details[phase].entries,
+               count * sizeof(TimingEntry));
+        qsort(sorted, count, sizeof(TimingEntry), compare_entries);
+
+        fprintf(out, "\n  Slowest in %s:\n", phase_names[phase]);
+        for (int i = 0; i < count && i < REPORT_DETAILS; i++) {
+            fprintf(out, "    %-34.34s %12.3f %12.3f %8ld\n", sorted[i].name,
+                    sorted[i].time.wall * 1000, sorted[i].time.cpu * 1000,
+                    sorted[i].count);
+        }
+        free(sorted);
+    }
+}
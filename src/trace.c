@@ -0,0 +1,199 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    char *category;
+    char *name;
+    char *file;      // May be NULL
+    char *function;  // May be NULL
+    double start;    // Microseconds since the trace started
+    double duration;
+    int thread;
+} TraceEvent;
+
+typedef struct {
+    int thread;
+    char *name;
+} TraceThread;
+
+// Workers are started after start_trace and joined before finish_trace, so
+// only the event lists need the lock
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_active = 0;
+static char *trace_path = NULL;
+static double trace_origin = 0;
+
+static TraceEvent *events = NULL;
+static int event_count = 0;
+static int event_capacity = 0;
+static TraceThread *threads = NULL;
+static int thread_count = 0;
+
+static unsigned next_thread = 0;
+static __thread int thread_id = 0;
+
+static double now_microseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int current_thread(void) {
+    if (!thread_id) {
+        thread_id = (int)__atomic_add_fetch(&next_thread, 1, __ATOMIC_RELAXED);
+    }
+    return thread_id;
+}
+
+static char *copy_string(const char *text) {
+    return text ? strdup(text) : NULL;
+}
+
+int start_trace(const char *path) {
+    // Fail before compiling rather than after
+    FILE *probe = fopen(path, "w");
+    if (!probe) {
+        return 1;
+    }
+    fclose(probe);
+
+    trace_path = strdup(path);
+    trace_origin = now_microseconds();
+    trace_active = 1;
+    trace_thread_name("main");
+    return 0;
+}
+
+int tracing_enabled(void) {
+    return trace_active;
+}
+
+void trace_thread_name(const char *name) {
+    if (!trace_active) {
+        return;
+    }
+    int thread = current_thread();
+    pthread_mutex_lock(&trace_lock);
+    threads = realloc(threads, (thread_count + 1) * sizeof(TraceThread));
+    threads[thread_count].thread = thread;
+    threads[thread_count].name = strdup(name);
+    thread_count++;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+double trace_begin(void) {
+    return trace_active ? now_microseconds() : 0;
+}
+
+void trace_end(double start, const char *category, const char *name,
+               const char *file, const char *function) {
+    if (!trace_active || start == 0) {
+        return;
+    }
+    double end = now_microseconds();
+
+    TraceEvent event;
+    event.category = strdup(category);
+    event.name = strdup(name);
+    event.file = copy_string(file);
+    event.function = copy_string(function);
+    event.start = start - trace_origin;
+    event.duration = end - start;
+    event.thread = current_thread();
+
+    pthread_mutex_lock(&trace_lock);
+    if (event_count == event_capacity) {
+        event_capacity = event_capacity ? event_capacity * 2 : 256;
+        events = realloc(events, event_capacity * sizeof(TraceEvent));
+    }
+    events[event_count++] = event;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static int write_trace(FILE *out) {
+    long pid = (long)getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"ph\":\"M\",\"pid\":%ld,\"tid\":1,\"name\":\"process_name\","
+            "\"args\":{\"name\":\"gloinc\"}}", pid);
+    for (int i = 0; i < thread_count; i++) {
+        fprintf(out, ",\n{\"ph\":\"M\",\"pid\":%ld,\"tid\":%d,"
+                "\"name\":\"thread_name\",\"args\":{\"name\":",
+                pid, threads[i].thread);
+        write_json_string(out, threads[i].name);
+        fprintf(out, "}}");
+    }
+
+    for (int i = 0; i < event_count; i++) {
+        TraceEvent *event = &events[i];
+        fprintf(out, ",\n{\"ph\":\"X\",\"pid\":%ld,\"tid\":%d,\"ts\":%.3f,"
+                "\"dur\":%.3f,\"cat\":", pid, event->thread, event->start,
+                event->duration);
+        write_json_string(out, event->category);
+        fprintf(out, ",\"name\":");
+        write_json_string(out, event->name);
+        fprintf(out, ",\"args\":{");
+        if (event->file) {
+            fprintf(out, "\"file\":");
+            write_json_string(out, event->file);
+        }
+        if (event->function) {
+            fprintf(out, event->file ? ",\"function\":" : "\"function\":");
+            write_json_string(out, event->function);
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) ? 1 : 0;
+}
+
+int finish_trace(void) {
+    if (!trace_active) {
+        return 0;
+    }
+    trace_active = 0;
+
+    int failed = 1;
+    FILE *out = fopen(trace_path, "w");
+    if (out) {
+        failed = write_trace(out);
+        failed |= fclose(out) != 0;
+    }
+
+    for (int i = 0; i < event_count; i++) {
+        free(events[i].category);
+        free(events[i].name);
+        free(events[i].file);
+        free(events[i].function);
+    }
+    free(events);
+    events = NULL;
+    event_count = event_capacity = 0;
+    for (int i = 0; i < thread_count; i++) {
+        free(threads[i].name);
+    }
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+    free(trace_path);
+    trace_path = NULL;
+    return failed;
+}
@@ -3,10 +3,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// Global struct registry
-StructType *registered_structs = NULL;
-int struct_count = 0;
-int next_struct_type_id = TYPE_STRUCT_START;
+// Registry used when the thread has not installed one
+static __thread TypeRegistry default_registry = {NULL, 0, TYPE_STRUCT_START};
+static __thread TypeRegistry *active_registry = NULL;
 
 // Type information table
 static const Type type_table[] = {
@@ -30,8 +29,30 @@ static const Type type_table[] = {
     {TYPE_STRING,   8,    0,      0,       1,          0,       0,         NULL}  // String comparisons only ==, !=
 };
 
-// Pointer types are handled dynamically
-static const int POINTER_SIZE = 8;  // 64-bit pointers
+// Pointer types: 64-bit, comparable with == and !=
+#define POINTER_ENTRY(kind, base) {kind, 8, 0, 0, 1, 0, 1, (Type *)&type_table[base]}
+static const Type pointer_table[] = {
+    POINTER_ENTRY(TYPE_PTR_VOID,   TYPE_VOID),
+    POINTER_ENTRY(TYPE_PTR_BOOL,   TYPE_BOOL),
+    POINTER_ENTRY(TYPE_PTR_I8,     TYPE_I8),
+    POINTER_ENTRY(TYPE_PTR_I16,    TYPE_I16),
+    POINTER_ENTRY(TYPE_PTR_I32,    TYPE_I32),
+    POINTER_ENTRY(TYPE_PTR_I64,    TYPE_I64),
+    POINTER_ENTRY(TYPE_PTR_I128,   TYPE_I128),
+    POINTER_ENTRY(TYPE_PTR_U8,     TYPE_U8),
+    POINTER_ENTRY(TYPE_PTR_U16,    TYPE_U16),
+    POINTER_ENTRY(TYPE_PTR_U32,    TYPE_U32),
+    POINTER_ENTRY(TYPE_PTR_U64,    TYPE_U64),
+    POINTER_ENTRY(TYPE_PTR_U128,   TYPE_U128),
+    POINTER_ENTRY(TYPE_PTR_F32,    TYPE_F32),
+    POINTER_ENTRY(TYPE_PTR_F64,    TYPE_F64),
+    POINTER_ENTRY(TYPE_PTR_F128,   TYPE_F128),
+    POINTER_ENTRY(TYPE_PTR_CHAR,   TYPE_CHAR),
+    POINTER_ENTRY(TYPE_PTR_STRING, TYPE_STRING)
+};
+#undef POINTER_ENTRY
+
+static const Type unknown_type = {TYPE_UNKNOWN, 0, 0, 0, 0, 0, 0, NULL};
 
 const Type* get_type_info(TypeKind kind) {
     // Handle basic types
@@ -39,15 +60,11 @@ const Type* get_type_info(TypeKind kind) {
         return &type_table[kind];
     }
     
-    // Handle pointer types dynamically
+    // Handle pointer types
     if (is_pointer_type(kind)) {
-        static Type pointer_type_info = {0, POINTER_SIZE, 0, 0, 1, 0, 1, NULL};
-        pointer_type_info.kind = kind;
-        return &pointer_type_info;
+        return &pointer_table[kind - TYPE_PTR_VOID];
     }
     
-    // Unknown type
-    static Type unknown_type = {TYPE_UNKNOWN, 0, 0, 0, 0, 0, 0, NULL};
     return &unknown_type;
 }
 
@@ -255,14 +272,57 @@ const char* pointer_type_to_string(TypeKind base_type) {
     return type_to_string(ptr_type);
 }
 
+// Struct registry
+TypeRegistry *create_type_registry(void) {
+    TypeRegistry *registry = malloc(sizeof(TypeRegistry));
+    registry->structs = NULL;
+    registry->struct_count = 0;
+    registry->next_struct_type_id = TYPE_STRUCT_START;
+    return registry;
+}
+
+void clear_type_registry(TypeRegistry *registry) {
+    for (int i = 0; i < registry->struct_count; i++) {
+        StructType *st = &registry->structs[i];
+        for (int j = 0; j < st->field_count; j++) {
+            free(st->fields[j].name);
+        }
+        free(st->fields);
+        free(st->name);
+    }
+    free(registry->structs);
+    registry->structs = NULL;
+    registry->struct_count = 0;
+    registry->next_struct_type_id = TYPE_STRUCT_START;
+}
+
+void free_type_registry(TypeRegistry *registry) {
+    if (!registry) return;
+    clear_type_registry(registry);
+    free(registry);
+}
+
+TypeRegistry *current_type_registry(void) {
+    return active_registry ? active_registry : &default_registry;
+}
+
+TypeRegistry *set_type_registry(TypeRegistry *registry) {
+    TypeRegistry *previous = active_registry;
+    active_registry = registry;
+    return previous;
+}
+
 // Struct type functions
 TypeKind register_struct_type(const char *name, StructField *fields, int field_count) {
+    TypeRegistry *registry = current_type_registry();
+    
     // Allocate new struct type
-    registered_structs = realloc(registered_structs, (struct_count + 1) * sizeof(StructType));
+    registry->structs = realloc(registry->structs,
+                                (registry->struct_count + 1) * sizeof(StructType));
     
-    StructType *new_struct = &registered_structs[struct_count];
+    StructType *new_struct = &registry->structs[registry->struct_count];
     new_struct->name = strdup(name);
-    new_struct->type_id = next_struct_type_id++;
+    new_struct->type_id = registry->next_struct_type_id++;
     new_struct->field_count = field_count;
     new_struct->fields = malloc(field_count * sizeof(StructField));
     
@@ -280,24 +340,26 @@ TypeKind register_struct_type(const char *name, StructField *fields, int field_c
     }
     
     new_struct->total_size = offset;
-    struct_count++;
+    registry->struct_count++;
     
     return new_struct->type_id;
 }
 
 StructType* get_struct_type(TypeKind type_id) {
-    for (int i = 0; i < struct_count; i++) {
-        if (registered_structs[i].type_id == type_id) {
-            return &registered_structs[i];
+    TypeRegistry *registry = current_type_registry();
+    for (int i = 0; i < registry->struct_count; i++) {
+        if (registry->structs[i].type_id == type_id) {
+            return &registry->structs[i];
         }
     }
     return NULL;
 }
 
 StructType* find_struct_by_name(const char *name) {
-    for (int i = 0; i < struct_count; i++) {
-        if (strcmp(registered_structs[i].name, name) == 0) {
-            return &registered_structs[i];
+    TypeRegistry *registry = current_type_registry();
+    for (int i = 0; i < registry->struct_count; i++) {
+        if (strcmp(registry->structs[i].name, name) == 0) {
+            return &registry->structs[i];
         }
     }
     return NULL;
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Parallel code generation: a program large enough to be split into
+# several partitions links to the same executable for every
+# --codegen-threads count, at -O0 and -O2.
+#
+# Usage: codegen_threads.sh <gloinc>
+
+set -e
+gloinc=$1
+dir=$(mktemp -d "${TMPDIR:-/tmp}/gloin-test-XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+fail() {
+    echo "codegen_threads: $*" >&2
+    exit 1
+}
+
+# 160 functions of straight-line arithmetic: about 40000 instructions,
+# which parallel.c splits into three partitions
+functions=160
+{
+    echo 'import "@std"'
+    i=0
+    while [ $i -lt $functions ]; do
+        echo "def work$i(n: i32) -> i32 {"
+        echo "    def mut total: i32 = n;"
+        j=0
+        while [ $j -lt 40 ]; do
+            echo "    total = total * 3 + $j - n;"
+            j=$((j + 1))
+        done
+        echo "    return total;"
+        echo "}"
+        i=$((i + 1))
+    done
+    echo 'def main() -> i32 {'
+    echo '    def mut sum: i32 = 0;'
+    i=0
+    while [ $i -lt $functions ]; do
+        echo "    def r$i: i32 = work$i($i);"
+        echo "    sum = sum + r$i;"
+        i=$((i + 1))
+    done
+    echo '    std.println(std.to_string(sum));'
+    echo '    return 0;'
+    echo '}'
+} > many.gloin
+
+for level in -O0 -O2; do
+    for threads in 1 2 4; do
+        "$gloinc" many.gloin $level --codegen-threads=$threads -o "many$threads" ||
+            fail "$level --codegen-threads=$threads did not compile"
+    done
+    expected=$(./many1)
+    for threads in 2 4; do
+        cmp -s many1 "many$threads" ||
+            fail "$level: --codegen-threads=$threads links a different executable than 1"
+        [ "$(./many$threads)" = "$expected" ] ||
+            fail "$level: --codegen-threads=$threads prints different output"
+    done
+done
@@ -0,0 +1,276 @@
+#!/bin/sh
+# Execution modes: a program prints the same output and exits with the
+# same status compiled, in the bytecode interpreter (run --interp) and
+# tiered (run --tiered=1, which compiles every function after its first
+# call or loop iteration). The programs given after gloinc are checked as
+# well as the ones written here.
+#
+# Usage: exec_modes.sh <gloinc> [<program.gloin>...]
+
+set -e
+gloinc=$1
+shift
+dir=$(mktemp -d "${TMPDIR:-/tmp}/gloin-test-XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "exec_modes: $*" >&2
+    exit 1
+}
+
+# Runs a program in every mode against the compiled executable's output
+check() {
+    program=$1
+    name=$(basename "$program" .gloin)
+    "$gloinc" "$program" -o "$dir/$name" > "$dir/build.txt" 2>&1 ||
+        fail "$name does not compile: $(cat "$dir/build.txt")"
+    status=0
+    "$dir/$name" < /dev/null > "$dir/native.txt" || status=$?
+    for mode in --interp --tiered=1; do
+        mode_status=0
+        "$gloinc" run $mode "$program" < /dev/null > "$dir/mode.txt" || mode_status=$?
+        cmp -s "$dir/native.txt" "$dir/mode.txt" ||
+            fail "$name prints differently with $mode"
+        [ "$status" = "$mode_status" ] ||
+            fail "$name exits with $mode_status with $mode, $status compiled"
+    done
+}
+
+# Every mode refuses a program with the same error
+check_rejected() {
+    program=$1
+    message=$2
+    name=$(basename "$program" .gloin)
+    if "$gloinc" "$program" -o "$dir/$name" > "$dir/build.txt" 2>&1; then
+        fail "$name compiles"
+    fi
+    grep -q "$message" "$dir/build.txt" || fail "$name fails without '$message'"
+    for mode in --interp --tiered=1; do
+        if "$gloinc" run $mode "$program" < /dev/null > "$dir/mode.txt" 2>&1; then
+            fail "$name runs with $mode"
+        fi
+        grep -q "$message" "$dir/mode.txt" || fail "$name fails with $mode without '$message'"
+    done
+}
+
+# Hot loops in running calls, which tiering continues natively from their
+# back edges: in main, inside an if, past continue and break, with
+# variables declared in the body, and returning from inside the loop
+cat > "$dir/hot_loops.gloin" <<'EOF'
+import "@std"
+
+def mut calls: i32 = 0;
+
+def step(x: i32) -> i32 {
+    calls = calls + 1;
+    return x + 1;
+}
+
+def work(n: i32, go: bool) -> i32 {
+    def mut total: i32 = 0;
+    if go {
+        def mut i: i32 = 0;
+        while i < n {
+            def doubled: i32 = i * 2;
+            i = i + 1;
+            if doubled > 100000 {
+                continue;
+            }
+            def mut j: i32 = 0;
+            while j < 3 {
+                total = total + j;
+                j = j + 1;
+            }
+            if i == 90000 {
+                break;
+            }
+            total = step(total);
+        }
+        total = total + 1000;
+    }
+    unless go {
+        total = 5;
+    }
+    return total;
+}
+
+def count(n: i32) -> void {
+    def mut i: i32 = 0;
+    while i < n {
+        i = i + 1;
+    }
+    std.println(i);
+}
+
+def main() -> i32 {
+    def mut sum: i32 = 0;
+    def mut i: i32 = 0;
+    while i < 200000 {
+        sum = sum + i * 3;
+        i = i + 1;
+    }
+    std.println(sum);
+    def first: i32 = work(200000, true);
+    std.println(first);
+    def second: i32 = work(10, false);
+    std.println(second);
+    count(50000);
+    std.println(calls);
+    while i < 400000 {
+        i = i + 1;
+        if i == 300000 {
+            return i - 299958;
+        }
+    }
+    return 1;
+}
+EOF
+check "$dir/hot_loops.gloin"
+
+# Folded constants: top-level and local def const values propagated into
+# arithmetic that wraps as it would at run time, signed division and
+# comparisons, constant conditions, and names that end a constant
+cat > "$dir/folded.gloin" <<'EOF'
+import "@std"
+
+def const WIDTH: i32 = 40;
+def const HEIGHT: i32 = WIDTH * 3 - 7;
+def const BIG: i32 = 2147483647;
+def const SMALL: i8 = 120;
+def const NEGATIVE: i32 = 0 - 7;
+def const DEBUG: bool = false;
+
+def area() -> i32 {
+    return WIDTH * HEIGHT;
+}
+
+def twice(WIDTH: i32) -> i32 {
+    return WIDTH * 2;
+}
+
+def main() -> i32 {
+    def size: i32 = area();
+    std.println(size);
+    def doubled: i32 = twice(5);
+    std.println(doubled);
+
+    def const wrapped: i32 = BIG + 1;
+    std.println(wrapped);
+    def const product: i32 = BIG * 3;
+    std.println(product);
+    def const tiny: i8 = SMALL + SMALL;
+    std.println(tiny);
+    def const half: i32 = NEGATIVE / 2;
+    std.println(half);
+    def const ordered: bool = NEGATIVE < WIDTH;
+    std.println(ordered);
+    def const same: bool = DEBUG == false;
+    std.println(same);
+
+    if DEBUG == true {
+        std.println("debug");
+    }
+    unless DEBUG == true {
+        std.println("release");
+    }
+    if WIDTH > 100 {
+        std.println("wide");
+    } else {
+        std.println("narrow");
+    }
+    while DEBUG == true {
+        std.println("never");
+    }
+
+    def mut total: i32 = 0;
+    def mut i: i32 = 0;
+    while WIDTH > i {
+        total = total + HEIGHT - i;
+        i = i + 1;
+    }
+    std.println(total);
+
+    def const WIDTH: i32 = 3;
+    std.println(WIDTH);
+    return HEIGHT - WIDTH;
+}
+EOF
+check "$dir/folded.gloin"
+
+# Top-level constants may be compiled into read-only memory, so they can
+# be neither assigned nor have their address taken
+cat > "$dir/assign_const.gloin" <<'EOF'
+import "@std"
+
+def const LIMIT: i32 = 5;
+
+def main() -> i32 {
+    LIMIT = 7;
+    std.print(LIMIT);
+    return 0;
+}
+EOF
+check_rejected "$dir/assign_const.gloin" "Cannot assign to constant 'LIMIT'"
+
+cat > "$dir/const_address.gloin" <<'EOF'
+def const READY: bool = true;
+
+def main() -> i32 {
+    def p: *bool = &READY;
+    *p = false;
+    return 0;
+}
+EOF
+check_rejected "$dir/const_address.gloin" "Cannot take the address of constant 'READY'"
+
+# A value std cannot show is an error, rather than a statement compiled
+# only up to its argument (here a call whose type is not known)
+cat > "$dir/unshown_value.gloin" <<'EOF'
+import "@std"
+
+def mut calls: i32 = 0;
+
+def work(n: i32) -> i32 {
+    calls = calls + n;
+    return calls;
+}
+
+def main() -> i32 {
+    std.println(std.to_string(work(5)));
+    std.println(calls);
+    return 0;
+}
+EOF
+check_rejected "$dir/unshown_value.gloin" "Unsupported type for std.to_string(): unknown"
+
+# Functions named like the C library functions that std calls, which keeps
+# them apart from the program's, also once optimized printf calls puts
+cat > "$dir/library_names.gloin" <<'EOF'
+import "@std"
+
+def sprintf(n: i32) -> i32 {
+    return n * 2;
+}
+
+def puts(n: i32) -> i32 {
+    return n + 1;
+}
+
+def main() -> i32 {
+    def doubled: i32 = sprintf(21);
+    std.println(std.to_string(doubled));
+    def next: i32 = puts(41);
+    std.println(next);
+    std.println("done");
+    return 0;
+}
+EOF
+check "$dir/library_names.gloin"
+"$gloinc" "$dir/library_names.gloin" -O2 -o "$dir/library_names" > "$dir/build.txt" 2>&1 ||
+    fail "library_names does not compile with -O2: $(cat "$dir/build.txt")"
+"$dir/library_names" > "$dir/mode.txt"
+cmp -s "$dir/native.txt" "$dir/mode.txt" || fail "library_names prints differently with -O2"
+
+for program in "$@"; do
+    check "$program"
+done
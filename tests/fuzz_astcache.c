@@ -0,0 +1,235 @@
+// Fuzz target for the AST cache loader (decode_ast_cache).
+//
+// Built with -DGLOIN_FUZZ_LIBFUZZER (cmake -DGLOIN_BUILD_FUZZERS=ON, with
+// clang) this is a libFuzzer target, which AFL++ can also drive through
+// its libFuzzer driver. Otherwise it is a replay driver that ctest runs:
+//
+//   fuzz_astcache_replay [--mutations=N] [--write-seeds=DIR] FILE...
+//
+// A FILE ending in .gloin is parsed and encoded into a cache image first;
+// any other file, such as a crash reproducer, is used as it is. Each input
+// is decoded, followed by N deterministic mutations of it. --write-seeds
+// saves the encoded images as a starting corpus for the fuzzer.
+//
+// The checksum and the expected source identity come from the input's own
+// header, and the compiler ID is the running one's, so mutations get past
+// the integrity checks into the decoder.
+
+#include "ast.h"
+#include "astcache.h"
+#include "diagnostics.h"
+#include "interface.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Field offsets of the cache header (CacheHeader in src/astcache.c)
+#define HEADER_SOURCE_SIZE 16
+#define HEADER_SOURCE_HASH 24
+#define HEADER_CHECKSUM 32
+#define HEADER_COMPILER_ID 72
+#define HEADER_SIZE 80
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Returns whether the input decoded to a tree
+static int decode_input(const uint8_t *data, size_t size) {
+    // A private, aligned copy the decoder may read in place
+    uint8_t *image = malloc(size ? size : 1);
+    memcpy(image, data, size);
+
+    uint64_t source_size = 0;
+    uint64_t source_hash = 0;
+    if (size >= HEADER_SIZE) {
+        uint64_t checksum = hash_bytes(image + HEADER_SIZE, size - HEADER_SIZE, 0);
+        memcpy(image + HEADER_CHECKSUM, &checksum, sizeof(checksum));
+        uint64_t compiler_id = compiler_build_id();
+        memcpy(image + HEADER_COMPILER_ID, &compiler_id, sizeof(compiler_id));
+        memcpy(&source_size, image + HEADER_SOURCE_SIZE, sizeof(source_size));
+        memcpy(&source_hash, image + HEADER_SOURCE_HASH, sizeof(source_hash));
+    }
+
+    ASTNode *program = decode_ast_cache(image, size, source_hash, source_size);
+    int decoded = program != NULL;
+    free_ast_node(program);
+    free(image);
+    return decoded;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    decode_input(data, size);
+    return 0;
+}
+
+#ifndef GLOIN_FUZZ_LIBFUZZER
+
+static uint8_t *read_input(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    *size = fread(data, 1, length > 0 ? length : 0, file);
+    fclose(file);
+    return data;
+}
+
+// Parse a source file and encode it as write_ast_cache would store it.
+// Returns NULL when the file does not parse.
+static uint8_t *encode_source(const char *path, size_t *size) {
+    char *source = read_file(path);
+    if (!source) {
+        return NULL;
+    }
+    // Parse errors are expected for some inputs; keep them out of the log
+    DiagnosticBuffer diagnostics = {0};
+    DiagnosticBuffer *previous = set_diagnostic_buffer(&diagnostics);
+    Lexer *lexer = create_lexer(source);
+    Parser *parser = create_parser(lexer);
+    ASTNode *program = parse_program(parser);
+    free_parser(parser);
+    free_lexer(lexer);
+    set_diagnostic_buffer(previous);
+    clear_diagnostic_buffer(&diagnostics);
+
+    uint8_t *image = NULL;
+    if (program) {
+        const char *tmp = getenv("TMPDIR");
+        char image_path[4096];
+        snprintf(image_path, sizeof(image_path), "%s/gloin-fuzz-XXXXXX",
+                 tmp ? tmp : "/tmp");
+        int fd = mkstemp(image_path);
+        if (fd >= 0) {
+            close(fd);
+            size_t length = strlen(source);
+            if (write_ast_cache(program, image_path, hash_bytes(source, length, 0),
+                                length) == 0) {
+                image = read_input(image_path, size);
+            }
+            remove(image_path);
+        }
+        free_ast_node(program);
+    }
+    free(source);
+    return image;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run replays the same mutations
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+// Flip bits, overwrite bytes or words with boundary values, or truncate,
+// biased towards the header and node table where the structure lives
+static size_t mutate(uint8_t *data, size_t size, uint64_t *state) {
+    static const uint32_t boundaries[] = {0, 1, 0x7f, 0x80, 0xff, 0xffff,
+                                          0x7fffffff, 0x80000000, 0xffffffff};
+    int edits = 1 + next_random(state) % 4;
+    for (int i = 0; i < edits && size > 0; i++) {
+        uint64_t r = next_random(state);
+        size_t span = (r & 1) && size > 512 ? 512 : size;
+        size_t at = (r >> 8) % span;
+        switch ((r >> 4) % 4) {
+        case 0:
+            data[at] ^= 1u << ((r >> 40) % 8);
+            break;
+        case 1:
+            data[at] = (uint8_t)(r >> 32);
+            break;
+        case 2:
+            if (at + 4 <= size) {
+                uint32_t value = boundaries[(r >> 32) % 9];
+                memcpy(data + at, &value, sizeof(value));
+            }
+            break;
+        default:
+            size = at;
+            break;
+        }
+    }
+    return size;
+}
+
+static int write_seed(const char *dir, const char *source_path,
+                      const uint8_t *data, size_t size) {
+    const char *slash = strrchr(source_path, '/');
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.gloinast", dir, slash ? slash + 1 : source_path);
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(data, 1, size, file) != size) {
+        fprintf(stderr, "cannot write %s\n", path);
+        if (file) {
+            fclose(file);
+        }
+        return 1;
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long mutations = 1000;
+    const char *seed_dir = NULL;
+    int inputs = 0;
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--mutations=", 12) == 0) {
+            mutations = atol(argv[i] + 12);
+            continue;
+        }
+        if (strncmp(argv[i], "--write-seeds=", 14) == 0) {
+            seed_dir = argv[i] + 14;
+            continue;
+        }
+
+        size_t length = strlen(argv[i]);
+        int is_source = length > 6 && strcmp(argv[i] + length - 6, ".gloin") == 0;
+        size_t size = 0;
+        uint8_t *data = is_source ? encode_source(argv[i], &size)
+                                  : read_input(argv[i], &size);
+        if (!data) {
+            // Sources in older syntax do not parse; only raw inputs must exist
+            if (!is_source) {
+                fprintf(stderr, "cannot read %s\n", argv[i]);
+                failed = 1;
+            }
+            continue;
+        }
+        if (seed_dir && is_source) {
+            failed |= write_seed(seed_dir, argv[i], data, size);
+        }
+
+        // An image just encoded must load, or the harness has gone stale
+        if (!decode_input(data, size) && is_source) {
+            fprintf(stderr, "%s: encoded image does not decode\n", argv[i]);
+            failed = 1;
+        }
+        uint8_t *mutant = malloc(size ? size : 1);
+        uint64_t state = 0x9e3779b97f4a7c15ull ^ size;
+        for (long m = 0; m < mutations; m++) {
+            memcpy(mutant, data, size);
+            LLVMFuzzerTestOneInput(mutant, mutate(mutant, size, &state));
+        }
+        free(mutant);
+        free(data);
+        inputs++;
+    }
+    if (inputs == 0) {
+        fprintf(stderr, "fuzz_astcache: no inputs\n");
+        return 1;
+    }
+    printf("fuzz_astcache: %d input(s), %ld mutation(s) each\n", inputs, mutations);
+    return failed;
+}
+
+#endif
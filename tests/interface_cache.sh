@@ -0,0 +1,82 @@
+#!/bin/sh
+# Separately compiled imports: an unchanged module is reused from the
+# cache, and a module whose function body or signature changes is rebuilt,
+# with importers compiled against its new interface.
+#
+# Usage: interface_cache.sh <gloinc>
+
+set -e
+gloinc=$1
+dir=$(mktemp -d "${TMPDIR:-/tmp}/gloin-test-XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+fail() {
+    echo "interface_cache: $*" >&2
+    exit 1
+}
+
+write_lib() {
+    cat > lib.gloin <<GLOIN
+def value() -> $1 {
+    def result: $1 = $2;
+    return result;
+}
+GLOIN
+}
+
+cat > main.gloin <<'GLOIN'
+import "@std"
+import "./lib"
+
+def main() -> i32 {
+    def v: i32 = value();
+    std.println(std.to_string(v));
+    return 0;
+}
+GLOIN
+
+write_lib i32 1
+"$gloinc" main.gloin -o main
+[ "$(./main)" = 1 ] || fail "first build printed '$(./main)'"
+[ -f .gloin-cache/lib.gloini ] && [ -f .gloin-cache/lib.o ] ||
+    fail "no cached interface and object for lib"
+
+# Unchanged: the cached object is linked as it is
+cp .gloin-cache/lib.o lib.o.before
+touch -d '@1' .gloin-cache/lib.o
+"$gloinc" main.gloin -o main
+[ "$(./main)" = 1 ] || fail "rebuild printed '$(./main)'"
+[ "$(stat -c %Y .gloin-cache/lib.o)" = 1 ] || fail "unchanged lib was recompiled"
+
+# A new body of the same size, within the same second
+write_lib i32 2
+"$gloinc" main.gloin -o main
+[ "$(./main)" = 2 ] || fail "changed body: printed '$(./main)'"
+
+# Another build of the compiler, here one without a build ID, uses none
+# of what this one cached
+if command -v objcopy > /dev/null; then
+    objcopy --remove-section .note.gnu.build-id "$gloinc" other-gloinc
+    touch -d '@1' .gloin-cache/lib.o .gloin-cache/main.gloinast
+    ./other-gloinc main.gloin -o main
+    [ "$(./main)" = 2 ] || fail "other build printed '$(./main)'"
+    [ "$(stat -c %Y .gloin-cache/lib.o)" != 1 ] || fail "other build reused lib's object"
+    [ "$(stat -c %Y .gloin-cache/main.gloinast)" != 1 ] ||
+        fail "other build reused main's syntax tree"
+fi
+
+# A new signature reaches the importer through the interface
+cat > caller.gloin <<'GLOIN'
+import "./lib"
+
+def main() -> i32 {
+    value();
+    return 0;
+}
+GLOIN
+write_lib i64 3
+"$gloinc" caller.gloin --emit=llvm-ir -o main.ll
+grep -q 'declare i64 @value()' main.ll || fail "importer still sees the old signature"
+
+echo "interface_cache: ok"
@@ -0,0 +1,137 @@
+// The import graph: a module reached along two paths, under two spellings,
+// is processed once, and an import cycle is reported with its chain.
+
+#include "codegen.h"
+#include "diagnostics.h"
+#include "parser.h"
+#include "test_util.h"
+#include <sys/stat.h>
+
+static CodeGen *compile_file(const char *path, DiagnosticBuffer *diagnostics) {
+    DiagnosticBuffer *previous = set_diagnostic_buffer(diagnostics);
+    CodeGen *codegen = create_codegen(path);
+    codegen->source_path = strdup(path);
+    ASTNode *program = parse_file(path);
+    if (program) {
+        codegen_program(codegen, program);
+    } else {
+        codegen->has_error = 1;
+    }
+    set_diagnostic_buffer(previous);
+    return codegen;
+}
+
+static ImportModule *find_module(ImportGraph *graph, const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    ImportModule *module = import_graph_find(graph, path);
+    free(path);
+    return module;
+}
+
+static void test_diamond(void) {
+    char *dir = make_scratch_dir();
+    char *sub = malloc(strlen(dir) + 8);
+    sprintf(sub, "%s/sub", dir);
+    mkdir(sub, 0755);
+    free(sub);
+
+    free(write_source(dir, "base.gloin",
+                      "def base_value() -> i32 {\n"
+                      "    return 7;\n"
+                      "}\n"));
+    free(write_source(dir, "left.gloin",
+                      "import \"./base\"\n"
+                      "\n"
+                      "def left_value() -> i32 {\n"
+                      "    return base_value();\n"
+                      "}\n"));
+    // The same file, spelled differently
+    free(write_source(dir, "right.gloin",
+                      "import \"./sub/../base\"\n"
+                      "\n"
+                      "def right_value() -> i32 {\n"
+                      "    return base_value();\n"
+                      "}\n"));
+    char *main_path = write_source(dir, "main.gloin",
+                                   "import \"./left\"\n"
+                                   "import \"./right\"\n"
+                                   "\n"
+                                   "def main() -> i32 {\n"
+                                   "    return left_value();\n"
+                                   "}\n");
+
+    DiagnosticBuffer diagnostics = {0};
+    CodeGen *codegen = compile_file(main_path, &diagnostics);
+    CHECK(!codegen->has_error);
+    if (diagnostics.data) {
+        fprintf(stderr, "%s", diagnostics.data);
+    }
+
+    ImportGraph *graph = codegen->imports;
+    CHECK(graph->module_count == 4);
+    ImportModule *base = find_module(graph, dir, "base.gloin");
+    ImportModule *left = find_module(graph, dir, "left.gloin");
+    ImportModule *right = find_module(graph, dir, "right.gloin");
+    CHECK(base && left && right);
+    if (base && left && right) {
+        CHECK(left->dep_count == 1 && left->deps[0] == base);
+        CHECK(right->dep_count == 1 && right->deps[0] == base);
+        CHECK(base->object_path != NULL);
+        CHECK(base->state == MODULE_DONE);
+    }
+
+    free_codegen(codegen);
+    clear_diagnostic_buffer(&diagnostics);
+    free(main_path);
+    remove_scratch_dir(dir);
+}
+
+static void test_cycle(void) {
+    char *dir = make_scratch_dir();
+    char *a_path = write_source(dir, "a.gloin",
+                                "import \"./b\"\n"
+                                "\n"
+                                "def main() -> i32 {\n"
+                                "    return 0;\n"
+                                "}\n");
+    free(write_source(dir, "b.gloin",
+                      "import \"./c\"\n"
+                      "\n"
+                      "def b_value() -> i32 {\n"
+                      "    return 1;\n"
+                      "}\n"));
+    free(write_source(dir, "c.gloin",
+                      "import \"./b\"\n"
+                      "\n"
+                      "def c_value() -> i32 {\n"
+                      "    return 2;\n"
+                      "}\n"));
+
+    DiagnosticBuffer diagnostics = {0};
+    CodeGen *codegen = compile_file(a_path, &diagnostics);
+    CHECK(codegen->has_error);
+
+    // The chain starts at the module imported again: b, c, then b
+    const char *text = diagnostics.data ? diagnostics.data : "";
+    const char *header = strstr(text, "import cycle detected");
+    const char *b_line = header ? strstr(header, "/b.gloin imports") : NULL;
+    const char *c_line = b_line ? strstr(b_line, "/c.gloin imports") : NULL;
+    const char *end = c_line ? strstr(c_line, "/b.gloin\n") : NULL;
+    CHECK(header && b_line && c_line && end);
+    CHECK(!strstr(text, "/a.gloin imports"));
+    if (!end) {
+        fprintf(stderr, "diagnostics:\n%s", text);
+    }
+
+    free_codegen(codegen);
+    clear_diagnostic_buffer(&diagnostics);
+    free(a_path);
+    remove_scratch_dir(dir);
+}
+
+int main(void) {
+    test_diamond();
+    test_cycle();
+    return finish_test("test_imports");
+}
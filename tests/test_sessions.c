@@ -0,0 +1,102 @@
+// Library sessions: compiling on several threads at once, each with its
+// own session, produces the same IR as compiling on one thread.
+
+#include "gloin.h"
+#include "test_util.h"
+#include <pthread.h>
+
+#define THREADS 8
+#define ROUNDS 4
+
+// Structs, methods, loops and the standard library, so the type registry
+// and diagnostics of each session are exercised
+static const char *source =
+    "import \"@std\"\n"
+    "\n"
+    "def struct Counter {\n"
+    "    value: i32;\n"
+    "    step: i32;\n"
+    "\n"
+    "    pub ahead() -> bool {\n"
+    "        return value > step;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "def sum_to(n: i64) -> i64 {\n"
+    "    def const one: i64 = 1;\n"
+    "    def mut total: i64 = 0;\n"
+    "    def mut i: i64 = one;\n"
+    "    while i <= n {\n"
+    "        total = total + i;\n"
+    "        i = i + one;\n"
+    "    }\n"
+    "    return total;\n"
+    "}\n"
+    "\n"
+    "def main() -> i32 {\n"
+    "    def c: Counter = Counter { value: 40, step: 2 };\n"
+    "    def limit: i64 = 100;\n"
+    "    def ahead: bool = c.ahead();\n"
+    "    if ahead {\n"
+    "        std.println(\"ahead\");\n"
+    "    }\n"
+    "    def total: i64 = sum_to(limit);\n"
+    "    std.println(std.to_string(total));\n"
+    "    return 0;\n"
+    "}\n";
+
+static char *compile_ir(GloinSession *session) {
+    GloinBuffer output;
+    if (gloin_compile_buffer(session, source, strlen(source), NULL,
+                             GLOIN_OUTPUT_LLVM_IR, &output) != 0) {
+        fprintf(stderr, "compile failed:\n%s", gloin_session_diagnostics(session));
+        return NULL;
+    }
+    char *ir = strdup(output.data);
+    gloin_buffer_free(&output);
+    return ir;
+}
+
+typedef struct {
+    const char *expected;
+    int mismatches;
+} Worker;
+
+static void *compile_rounds(void *arg) {
+    Worker *worker = arg;
+    GloinSession *session = gloin_session_create();
+    for (int i = 0; i < ROUNDS; i++) {
+        char *ir = compile_ir(session);
+        if (!ir || strcmp(ir, worker->expected) != 0) {
+            worker->mismatches++;
+        }
+        free(ir);
+    }
+    gloin_session_destroy(session);
+    return NULL;
+}
+
+int main(void) {
+    GloinSession *session = gloin_session_create();
+    char *expected = compile_ir(session);
+    gloin_session_destroy(session);
+    CHECK(expected != NULL);
+    if (!expected) {
+        return finish_test("test_sessions");
+    }
+
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i].expected = expected;
+        workers[i].mismatches = 0;
+        pthread_create(&threads[i], NULL, compile_rounds, &workers[i]);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(workers[i].mismatches == 0);
+    }
+
+    free(expected);
+    return finish_test("test_sessions");
+}
@@ -0,0 +1,67 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+// Helpers shared by the C tests: checks that count failures instead of
+// stopping, and scratch directories holding generated source files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #condition);                                           \
+            test_failures++;                                               \
+        }                                                                  \
+    } while (0)
+
+// A fresh directory under TMPDIR, removed again by remove_scratch_dir()
+static inline char *make_scratch_dir(void) {
+    const char *tmp = getenv("TMPDIR");
+    char *dir = malloc(strlen(tmp ? tmp : "/tmp") + 32);
+    sprintf(dir, "%s/gloin-test-XXXXXX", tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    return dir;
+}
+
+static inline void remove_scratch_dir(char *dir) {
+    char *command = malloc(strlen(dir) + 16);
+    sprintf(command, "rm -rf '%s'", dir);
+    if (system(command) != 0) {
+        fprintf(stderr, "cannot remove %s\n", dir);
+    }
+    free(command);
+    free(dir);
+}
+
+// Write text to dir/name and return the malloc'd path
+static inline char *write_source(const char *dir, const char *name, const char *text) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+    return path;
+}
+
+static inline int finish_test(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#!/bin/sh
+# --time-report: on a large file, lexing and parsing are both timed, and
+# neither is left at zero by the other's share.
+#
+# Usage: time_report.sh <gloinc>
+
+set -e
+gloinc=$1
+dir=$(mktemp -d "${TMPDIR:-/tmp}/gloin-test-XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "time_report: $*" >&2
+    exit 1
+}
+
+# About 1500 lines
+{
+    echo 'import "@std"'
+    i=0
+    while [ $i -lt 250 ]; do
+        cat <<EOF
+
+def step_$i(a: i32, b: i32) -> i32 {
+    def mut total: i32 = a * $i + b;
+    if total > 100 {
+        total = total - 100;
+    }
+    return total;
+}
+EOF
+        i=$((i + 1))
+    done
+    cat <<'EOF'
+
+def main() -> i32 {
+    def result: i32 = step_1(2, 3);
+    std.println(result);
+    return 0;
+}
+EOF
+} > "$dir/large.gloin"
+
+GLOIN_NO_CACHE=1 "$gloinc" "$dir/large.gloin" -o "$dir/large" --time-report=json \
+    > "$dir/report.json" 2>&1 || fail "large.gloin does not compile: $(cat "$dir/report.json")"
+
+for phase in lex parse; do
+    wall=$(sed -n "s/.*{\"name\":\"$phase\",\"wall_ms\":\([0-9.]*\).*/\1/p" "$dir/report.json")
+    [ -n "$wall" ] || fail "no $phase phase in the report"
+    [ "$wall" != "0.000" ] || fail "$phase time is zero"
+done